@@ -0,0 +1,226 @@
+// generated by uweb_assetgen from test_data, do not edit
+
+#include "uweb.h"
+
+#if UWEB_CFG_ASSETS
+
+static const uint8_t asset_0[] = {
+  0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x10, 0x10, 0x10, 0x00, 0x01, 0x00, 0x04, 0x00, 0x28, 0x01,
+  0x00, 0x00, 0x16, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x20, 0x00,
+  0x00, 0x00, 0x01, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x5e, 0xff, 0x00, 0x00, 0xbb, 0xff, 0x00, 0x00, 0x95, 0xff, 0x00, 0x00, 0x2a,
+  0xb5, 0x00, 0xff, 0x84, 0x00, 0x00, 0x00, 0xea, 0xff, 0x00, 0x00, 0xf2, 0xff, 0x00, 0x00, 0x3c,
+  0xff, 0x00, 0x00, 0xff, 0xdd, 0x00, 0x00, 0x73, 0xff, 0x00, 0x00, 0x4d, 0xff, 0x00, 0x00, 0xff,
+  0xb7, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x05, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x55, 0x55, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x55, 0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x55, 0x55, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x54, 0x45, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x58, 0x85, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x5b, 0xb5, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x11, 0x11, 0x50, 0x00, 0x00, 0x00, 0x00,
+  0x5a, 0xaa, 0xaa, 0xa5, 0x00, 0x00, 0x00, 0x05, 0xaa, 0x33, 0x33, 0xaa, 0x50, 0x00, 0x00, 0x05,
+  0xa3, 0x26, 0x62, 0x3a, 0x50, 0x00, 0x00, 0x05, 0xc3, 0x67, 0x76, 0x3c, 0x50, 0x00, 0x00, 0x05,
+  0xc9, 0x26, 0x62, 0x9c, 0x50, 0x00, 0x00, 0x00, 0x5c, 0x99, 0x99, 0xc5, 0x00, 0x00, 0x00, 0x00,
+  0x05, 0xcc, 0xcc, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x55, 0x55, 0x00, 0x00, 0x00, 0xfe, 0x7f,
+  0x00, 0x00, 0xfc, 0x3f, 0x00, 0x00, 0xfc, 0x3f, 0x00, 0x00, 0xfc, 0x3f, 0x00, 0x00, 0xfc, 0x3f,
+  0x00, 0x00, 0xfc, 0x3f, 0x00, 0x00, 0xfc, 0x3f, 0x00, 0x00, 0xf8, 0x1f, 0x00, 0x00, 0xf0, 0x0f,
+  0x00, 0x00, 0xe0, 0x07, 0x00, 0x00, 0xe0, 0x07, 0x00, 0x00, 0xe0, 0x07, 0x00, 0x00, 0xe0, 0x07,
+  0x00, 0x00, 0xf0, 0x0f, 0x00, 0x00, 0xf8, 0x1f, 0x00, 0x00, 0xfc, 0x3f, 0x00, 0x00,
+};
+static const uint8_t asset_0_gz[] = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x63, 0x60, 0x60, 0x04, 0x42, 0x01,
+  0x01, 0x01, 0x20, 0xc9, 0xc2, 0xa0, 0xc1, 0xc8, 0xc0, 0x20, 0xc6, 0xc0, 0xc0, 0xa0, 0x01, 0xc4,
+  0x02, 0x40, 0xac, 0x00, 0xc4, 0x20, 0x71, 0x10, 0x68, 0x60, 0x40, 0x00, 0x01, 0x24, 0x36, 0x43,
+  0xdc, 0x7f, 0x06, 0x86, 0xdd, 0x40, 0x3c, 0x15, 0x88, 0xb5, 0xb6, 0x32, 0xfc, 0x6f, 0x01, 0x8a,
+  0xbd, 0x02, 0xb2, 0x3f, 0x01, 0xb1, 0x0d, 0x10, 0xff, 0xbf, 0xcb, 0xc0, 0x50, 0x0c, 0xa4, 0x7d,
+  0x41, 0xec, 0xed, 0x0c, 0x68, 0x80, 0x35, 0x00, 0x42, 0x87, 0x86, 0x62, 0xa7, 0x43, 0x5c, 0x21,
+  0x74, 0x44, 0x2b, 0x84, 0x8e, 0xde, 0x0a, 0xd1, 0x26, 0x28, 0x08, 0xd6, 0x18, 0xb5, 0x6a, 0xd5,
+  0x52, 0x10, 0x77, 0x95, 0xb1, 0xf1, 0x2a, 0xa0, 0x00, 0xeb, 0x62, 0xb5, 0x24, 0x2b, 0x10, 0x7d,
+  0x38, 0xbd, 0xcc, 0x06, 0x44, 0x9f, 0x54, 0x4b, 0x9a, 0x03, 0x52, 0x18, 0x33, 0x73, 0xe6, 0x51,
+  0xb0, 0xbe, 0x33, 0x67, 0x02, 0x10, 0xe6, 0xff, 0xab, 0x67, 0x60, 0xf8, 0x63, 0x8f, 0x1d, 0xff,
+  0x90, 0x67, 0x60, 0xf8, 0xc0, 0xcf, 0xc0, 0xf0, 0x80, 0x1d, 0x15, 0x83, 0xc4, 0x40, 0x72, 0x20,
+  0x35, 0x00, 0x50, 0xca, 0x41, 0x82, 0x3e, 0x01, 0x00, 0x00,
+};
+
+static const uint8_t asset_1[] = {
+  0x3c, 0x21, 0x44, 0x4f, 0x43, 0x54, 0x59, 0x50, 0x45, 0x20, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0x0a,
+  0x3c, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0x0a, 0x3c, 0x62, 0x6f, 0x64, 0x79, 0x3e, 0x0a, 0x0a, 0x3c,
+  0x66, 0x6f, 0x72, 0x6d, 0x20, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x3d, 0x22, 0x66, 0x69, 0x6c,
+  0x65, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 0x22, 0x20, 0x6d, 0x65, 0x74, 0x68, 0x6f, 0x64, 0x3d, 0x22,
+  0x70, 0x6f, 0x73, 0x74, 0x22, 0x20, 0x65, 0x6e, 0x63, 0x74, 0x79, 0x70, 0x65, 0x3d, 0x22, 0x6d,
+  0x75, 0x6c, 0x74, 0x69, 0x70, 0x61, 0x72, 0x74, 0x2f, 0x66, 0x6f, 0x72, 0x6d, 0x2d, 0x64, 0x61,
+  0x74, 0x61, 0x22, 0x3e, 0x0a, 0x20, 0x20, 0x3c, 0x66, 0x69, 0x65, 0x6c, 0x64, 0x73, 0x65, 0x74,
+  0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x6c, 0x65, 0x67, 0x65, 0x6e, 0x64, 0x3e, 0x55, 0x70,
+  0x6c, 0x6f, 0x61, 0x64, 0x20, 0x66, 0x69, 0x6c, 0x65, 0x3c, 0x2f, 0x6c, 0x65, 0x67, 0x65, 0x6e,
+  0x64, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 0x79,
+  0x70, 0x65, 0x3d, 0x22, 0x66, 0x69, 0x6c, 0x65, 0x22, 0x20, 0x6e, 0x61, 0x6d, 0x65, 0x3d, 0x22,
+  0x66, 0x69, 0x6c, 0x65, 0x54, 0x6f, 0x55, 0x70, 0x6c, 0x6f, 0x61, 0x64, 0x22, 0x20, 0x69, 0x64,
+  0x3d, 0x22, 0x66, 0x69, 0x6c, 0x65, 0x54, 0x6f, 0x55, 0x70, 0x6c, 0x6f, 0x61, 0x64, 0x22, 0x3e,
+  0x0a, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 0x79, 0x70, 0x65,
+  0x3d, 0x22, 0x73, 0x75, 0x62, 0x6d, 0x69, 0x74, 0x22, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x3d,
+  0x22, 0x53, 0x65, 0x6e, 0x64, 0x22, 0x20, 0x6e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x73, 0x75, 0x62,
+  0x6d, 0x69, 0x74, 0x22, 0x3e, 0x0a, 0x20, 0x20, 0x20, 0x3c, 0x2f, 0x66, 0x69, 0x65, 0x6c, 0x64,
+  0x73, 0x65, 0x74, 0x3e, 0x0a, 0x3c, 0x2f, 0x66, 0x6f, 0x72, 0x6d, 0x3e, 0x0a, 0x0a, 0x3c, 0x2f,
+  0x62, 0x6f, 0x64, 0x79, 0x3e, 0x0a, 0x3c, 0x2f, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0x0a, 0x0a,
+};
+static const uint8_t asset_1_gz[] = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x6d, 0x50, 0xbb, 0x0e, 0xc2, 0x30,
+  0x0c, 0xdc, 0xf3, 0x15, 0x26, 0x3b, 0xe4, 0x07, 0xd2, 0x2c, 0xc0, 0x0c, 0x12, 0x65, 0x60, 0x4c,
+  0x9b, 0x94, 0x46, 0xca, 0x4b, 0xad, 0x83, 0xd4, 0xbf, 0x27, 0x69, 0x8a, 0x90, 0x10, 0x93, 0x7d,
+  0xb6, 0xef, 0x7c, 0x36, 0xdf, 0x9d, 0x2e, 0xc7, 0xf6, 0x71, 0x3d, 0xc3, 0x88, 0xce, 0x0a, 0xc2,
+  0xb7, 0xd0, 0x05, 0xb5, 0x08, 0x42, 0xf8, 0x10, 0x26, 0x07, 0xb2, 0x47, 0x13, 0x7c, 0x43, 0x07,
+  0x63, 0xf5, 0xa1, 0x0c, 0x50, 0x70, 0x1a, 0xc7, 0xa0, 0x1a, 0x1a, 0xc3, 0x8c, 0x14, 0xb4, 0xef,
+  0x71, 0x89, 0xba, 0xa1, 0x2e, 0x59, 0x34, 0x51, 0x4e, 0xc8, 0x0a, 0x71, 0xaf, 0x24, 0x4a, 0x2a,
+  0x08, 0x00, 0x1f, 0x8c, 0xb6, 0x6a, 0xd6, 0x58, 0x40, 0x86, 0x56, 0x3f, 0xb5, 0x57, 0xe2, 0x1e,
+  0x6d, 0x90, 0x0a, 0x8a, 0x2e, 0x67, 0x5b, 0xad, 0x0e, 0x18, 0x1f, 0x13, 0x42, 0x15, 0x2d, 0x6d,
+  0x0a, 0x5e, 0xba, 0x2d, 0x6f, 0x43, 0xe5, 0x51, 0x30, 0xea, 0xa7, 0xf2, 0x87, 0x3d, 0xa7, 0xce,
+  0x99, 0xec, 0xf1, 0x25, 0x6d, 0xca, 0xf0, 0x96, 0x77, 0x7c, 0xc4, 0xb6, 0xd6, 0x4a, 0xe2, 0xec,
+  0x6b, 0x91, 0xaf, 0xee, 0xcb, 0xf9, 0xac, 0xfe, 0x81, 0xb3, 0xfa, 0x16, 0xf2, 0x06, 0xae, 0xe1,
+  0x00, 0x28, 0x2f, 0x01, 0x00, 0x00,
+};
+
+static const uint8_t asset_2[] = {
+  0x3c, 0x21, 0x44, 0x4f, 0x43, 0x54, 0x59, 0x50, 0x45, 0x20, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0x0a,
+  0x3c, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0x3c, 0x62, 0x6f, 0x64, 0x79, 0x3e, 0x0a, 0x3c, 0x68, 0x31,
+  0x3e, 0x75, 0x57, 0x65, 0x62, 0x20, 0x73, 0x6f, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x73, 0x65, 0x72,
+  0x76, 0x65, 0x72, 0x20, 0x69, 0x6d, 0x70, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 0x61, 0x74, 0x69,
+  0x6f, 0x6e, 0x3c, 0x2f, 0x68, 0x31, 0x3e, 0x0a, 0x3c, 0x70, 0x3e, 0x3c, 0x61, 0x20, 0x68, 0x72,
+  0x65, 0x66, 0x3d, 0x22, 0x70, 0x6f, 0x73, 0x74, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 0x22, 0x3e, 0x50,
+  0x6f, 0x73, 0x74, 0x20, 0x73, 0x6f, 0x6d, 0x65, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x3c, 0x2f, 0x61,
+  0x3e, 0x3c, 0x2f, 0x70, 0x3e, 0x0a, 0x3c, 0x70, 0x3e, 0x3c, 0x61, 0x20, 0x68, 0x72, 0x65, 0x66,
+  0x3d, 0x22, 0x66, 0x69, 0x6c, 0x65, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 0x22, 0x3e, 0x55, 0x70, 0x6c,
+  0x6f, 0x61, 0x64, 0x20, 0x61, 0x20, 0x66, 0x69, 0x6c, 0x65, 0x3c, 0x2f, 0x61, 0x3e, 0x3c, 0x2f,
+  0x70, 0x3e, 0x0a, 0x3c, 0x70, 0x3e, 0x3c, 0x61, 0x20, 0x68, 0x72, 0x65, 0x66, 0x3d, 0x22, 0x71,
+  0x75, 0x69, 0x74, 0x22, 0x3e, 0x4b, 0x69, 0x6c, 0x6c, 0x20, 0x6f, 0x66, 0x66, 0x20, 0x73, 0x65,
+  0x72, 0x76, 0x65, 0x72, 0x3c, 0x2f, 0x61, 0x3e, 0x3c, 0x2f, 0x70, 0x3e, 0x0a, 0x3c, 0x2f, 0x62,
+  0x6f, 0x64, 0x79, 0x3e, 0x3c, 0x2f, 0x68, 0x74, 0x6d, 0x6c, 0x3e,
+};
+static const uint8_t asset_2_gz[] = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x6d, 0x8f, 0x31, 0x0e, 0xc2, 0x30,
+  0x0c, 0x45, 0xf7, 0x9e, 0xc2, 0xe4, 0x00, 0x44, 0xec, 0x26, 0x0b, 0x30, 0x31, 0xd0, 0xa1, 0x08,
+  0x31, 0xa6, 0xd4, 0x21, 0x11, 0x49, 0x13, 0x5a, 0x17, 0x89, 0xdb, 0x93, 0x54, 0x95, 0x10, 0x12,
+  0x93, 0xed, 0xaf, 0x67, 0xeb, 0x19, 0x57, 0xfb, 0xd3, 0xae, 0xb9, 0xd6, 0x07, 0xb0, 0x1c, 0xbc,
+  0xaa, 0x70, 0x2e, 0xd8, 0xc6, 0xee, 0x5d, 0x86, 0x8d, 0x9a, 0x2e, 0xd4, 0xc2, 0x18, 0x6f, 0x0f,
+  0x62, 0x18, 0x69, 0x78, 0xd1, 0x00, 0x2e, 0x24, 0x4f, 0x81, 0x7a, 0xd6, 0xec, 0x62, 0x8f, 0x32,
+  0x53, 0x15, 0x26, 0x85, 0x1a, 0xec, 0x40, 0x66, 0x2b, 0x52, 0x1c, 0x79, 0x5d, 0xee, 0x08, 0x55,
+  0xe7, 0x36, 0x6f, 0x07, 0x62, 0xeb, 0xfa, 0x3b, 0x4a, 0xad, 0x50, 0xa6, 0x5f, 0xda, 0x38, 0x4f,
+  0x0b, 0x7d, 0x4e, 0x3e, 0xea, 0x0e, 0x34, 0x94, 0xec, 0x2f, 0xfc, 0x9c, 0x1c, 0x0b, 0x75, 0x74,
+  0xde, 0x43, 0x34, 0x66, 0x11, 0xfa, 0x92, 0x72, 0xf6, 0xce, 0x46, 0xe5, 0x89, 0x0f, 0x2c, 0x93,
+  0x9b, 0x60, 0xdb, 0x00, 0x00, 0x00,
+};
+
+static const uint8_t asset_3[] = {
+  0x3c, 0x21, 0x44, 0x4f, 0x43, 0x54, 0x59, 0x50, 0x45, 0x20, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0x0a,
+  0x3c, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0x3c, 0x62, 0x6f, 0x64, 0x79, 0x3e, 0x0a, 0x3c, 0x66, 0x6f,
+  0x72, 0x6d, 0x20, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x3d, 0x22, 0x70, 0x6f, 0x73, 0x74, 0x2e,
+  0x68, 0x74, 0x6d, 0x6c, 0x22, 0x20, 0x6d, 0x65, 0x74, 0x68, 0x6f, 0x64, 0x3d, 0x22, 0x70, 0x6f,
+  0x73, 0x74, 0x22, 0x3e, 0x0a, 0x20, 0x20, 0x3c, 0x66, 0x69, 0x65, 0x6c, 0x64, 0x73, 0x65, 0x74,
+  0x3e, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x6c, 0x65, 0x67, 0x65, 0x6e, 0x64, 0x3e, 0x50, 0x65,
+  0x72, 0x73, 0x6f, 0x6e, 0x61, 0x6c, 0x20, 0x69, 0x6e, 0x66, 0x6f, 0x72, 0x6d, 0x61, 0x74, 0x69,
+  0x6f, 0x6e, 0x3a, 0x3c, 0x2f, 0x6c, 0x65, 0x67, 0x65, 0x6e, 0x64, 0x3e, 0x0a, 0x20, 0x20, 0x20,
+  0x20, 0x46, 0x69, 0x72, 0x73, 0x74, 0x20, 0x6e, 0x61, 0x6d, 0x65, 0x3a, 0x3c, 0x62, 0x72, 0x3e,
+  0x0a, 0x20, 0x20, 0x20, 0x20, 0x3c, 0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 0x79, 0x70, 0x65,
+  0x3d, 0x22, 0x74, 0x65, 0x78, 0x74, 0x22, 0x20, 0x6e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x66, 0x69,
+  0x72, 0x73, 0x74, 0x6e, 0x61, 0x6d, 0x65, 0x22, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x3d, 0x22,
+  0x4d, 0x69, 0x63, 0x6b, 0x65, 0x79, 0x22, 0x3e, 0x3c, 0x62, 0x72, 0x3e, 0x0a, 0x20, 0x20, 0x20,
+  0x20, 0x4c, 0x61, 0x73, 0x74, 0x20, 0x6e, 0x61, 0x6d, 0x65, 0x3a, 0x3c, 0x62, 0x72, 0x3e, 0x0a,
+  0x20, 0x20, 0x20, 0x20, 0x3c, 0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 0x79, 0x70, 0x65, 0x3d,
+  0x22, 0x74, 0x65, 0x78, 0x74, 0x22, 0x20, 0x6e, 0x61, 0x6d, 0x65, 0x3d, 0x22, 0x6c, 0x61, 0x73,
+  0x74, 0x6e, 0x61, 0x6d, 0x65, 0x22, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x3d, 0x22, 0x4d, 0x6f,
+  0x75, 0x73, 0x65, 0x22, 0x3e, 0x3c, 0x62, 0x72, 0x3e, 0x3c, 0x62, 0x72, 0x3e, 0x0a, 0x20, 0x20,
+  0x20, 0x20, 0x3c, 0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 0x74, 0x79, 0x70, 0x65, 0x3d, 0x22, 0x73,
+  0x75, 0x62, 0x6d, 0x69, 0x74, 0x22, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x3d, 0x22, 0x53, 0x75,
+  0x62, 0x6d, 0x69, 0x74, 0x22, 0x3e, 0x0a, 0x20, 0x20, 0x3c, 0x2f, 0x66, 0x69, 0x65, 0x6c, 0x64,
+  0x73, 0x65, 0x74, 0x3e, 0x0a, 0x3c, 0x2f, 0x66, 0x6f, 0x72, 0x6d, 0x3e, 0x0a, 0x3c, 0x2f, 0x62,
+  0x6f, 0x64, 0x79, 0x3e, 0x3c, 0x2f, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0x0a, 0x0a,
+};
+static const uint8_t asset_3_gz[] = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x8d, 0x50, 0xcb, 0x0e, 0x82, 0x30,
+  0x10, 0xbc, 0xf3, 0x15, 0x6b, 0x3f, 0x40, 0xee, 0xa6, 0x70, 0xf1, 0x71, 0xd2, 0x48, 0xa2, 0x17,
+  0x8f, 0x05, 0x16, 0x69, 0xec, 0x83, 0xd0, 0xc5, 0xc8, 0xdf, 0xdb, 0x16, 0x82, 0x89, 0xf1, 0xe0,
+  0x69, 0x77, 0x66, 0x67, 0x26, 0xd9, 0xe1, 0xab, 0xdd, 0x79, 0x7b, 0xbd, 0x15, 0x7b, 0x68, 0x49,
+  0xab, 0x3c, 0xe1, 0x71, 0xf0, 0xd2, 0xd6, 0xa3, 0x07, 0x8d, 0xed, 0x35, 0x88, 0x8a, 0xa4, 0x35,
+  0x19, 0xeb, 0xac, 0xa3, 0x75, 0x38, 0x33, 0xd0, 0x48, 0xad, 0xad, 0x27, 0x8a, 0xe5, 0x09, 0x00,
+  0x6f, 0x24, 0xaa, 0xda, 0x21, 0x05, 0xe0, 0xa1, 0xc2, 0x3b, 0x9a, 0x3a, 0x2f, 0xb0, 0x77, 0xd6,
+  0x08, 0x05, 0xd2, 0x84, 0x28, 0x11, 0x82, 0x36, 0x3c, 0x9d, 0xaf, 0x51, 0x7a, 0x90, 0xbd, 0x23,
+  0x30, 0x42, 0xe3, 0x86, 0x97, 0xfd, 0x6c, 0x97, 0xa6, 0x1b, 0x08, 0x68, 0xec, 0x30, 0x63, 0x84,
+  0x2f, 0x62, 0x51, 0x90, 0xb1, 0x26, 0x88, 0xc3, 0xca, 0xe0, 0x29, 0xd4, 0xe0, 0x99, 0x93, 0xac,
+  0x1e, 0x38, 0xb2, 0x7c, 0xf1, 0x1e, 0xc5, 0xff, 0x71, 0x4a, 0x7c, 0xa7, 0xd9, 0xc1, 0xe1, 0x14,
+  0xf6, 0xdb, 0xed, 0x86, 0x52, 0x4b, 0x5a, 0xf4, 0x97, 0x09, 0xc6, 0x06, 0xd2, 0x4f, 0x05, 0x7e,
+  0xf7, 0xdf, 0x86, 0x19, 0x7b, 0xe4, 0xe9, 0xd4, 0x6d, 0xf2, 0x06, 0x5c, 0x23, 0xc2, 0xf3, 0x6d,
+  0x01, 0x00, 0x00,
+};
+
+static const uweb_asset assets[] = {
+  {
+    "/favicon.ico", "image/x-icon", "\"86f021a9-13e\"",
+    "HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: image/x-icon\r\nContent-Length: 318\r\n"
+      "ETag: \"86f021a9-13e\"\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n",
+    sizeof("HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: image/x-icon\r\nContent-Length: 318\r\n") - 1,
+    asset_0, 318,
+    "HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: image/x-icon\r\nContent-Length: 186\r\n"
+      "ETag: \"86f021a9-13e\"\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\nContent-Encoding: gzip\r\n",
+    sizeof("HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: image/x-icon\r\nContent-Length: 186\r\n") - 1,
+    asset_0_gz, 186,
+    "HTTP/1.1 304 Not Modified\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "ETag: \"86f021a9-13e\"\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n",
+  },
+  {
+    "/file.html", "text/html; charset=utf-8", "\"0926e988-12f\"",
+    "HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: text/html; charset=utf-8\r\nContent-Length: 303\r\n"
+      "ETag: \"0926e988-12f\"\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n",
+    sizeof("HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: text/html; charset=utf-8\r\nContent-Length: 303\r\n") - 1,
+    asset_1, 303,
+    "HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: text/html; charset=utf-8\r\nContent-Length: 198\r\n"
+      "ETag: \"0926e988-12f\"\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\nContent-Encoding: gzip\r\n",
+    sizeof("HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: text/html; charset=utf-8\r\nContent-Length: 198\r\n") - 1,
+    asset_1_gz, 198,
+    "HTTP/1.1 304 Not Modified\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "ETag: \"0926e988-12f\"\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n",
+  },
+  {
+    "/index.html", "text/html; charset=utf-8", "\"58d025da-db\"",
+    "HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: text/html; charset=utf-8\r\nContent-Length: 219\r\n"
+      "ETag: \"58d025da-db\"\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n",
+    sizeof("HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: text/html; charset=utf-8\r\nContent-Length: 219\r\n") - 1,
+    asset_2, 219,
+    "HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: text/html; charset=utf-8\r\nContent-Length: 166\r\n"
+      "ETag: \"58d025da-db\"\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\nContent-Encoding: gzip\r\n",
+    sizeof("HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: text/html; charset=utf-8\r\nContent-Length: 166\r\n") - 1,
+    asset_2_gz, 166,
+    "HTTP/1.1 304 Not Modified\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "ETag: \"58d025da-db\"\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n",
+  },
+  {
+    "/post.html", "text/html; charset=utf-8", "\"f85c0b24-16d\"",
+    "HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: text/html; charset=utf-8\r\nContent-Length: 365\r\n"
+      "ETag: \"f85c0b24-16d\"\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n",
+    sizeof("HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: text/html; charset=utf-8\r\nContent-Length: 365\r\n") - 1,
+    asset_3, 365,
+    "HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: text/html; charset=utf-8\r\nContent-Length: 211\r\n"
+      "ETag: \"f85c0b24-16d\"\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\nContent-Encoding: gzip\r\n",
+    sizeof("HTTP/1.1 200 OK\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "Content-Type: text/html; charset=utf-8\r\nContent-Length: 211\r\n") - 1,
+    asset_3_gz, 211,
+    "HTTP/1.1 304 Not Modified\r\n" "Server: " UWEB_SERVER_NAME "\r\n"
+      "ETag: \"f85c0b24-16d\"\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n",
+  },
+};
+
+const uweb_assets uweb_web_assets = { assets, 4 };
+
+#endif
@@ -31,6 +31,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <time.h>
 
 #define UWEB_SERVER_NAME              "uWeb"
 #define UWEB_TX_MAX_LEN               2048
@@ -40,8 +41,60 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define UWEB_MAX_CONNECTION_LEN       64
 #define UWEB_MAX_CONTENT_DISP_LEN     256
 #define UWEB_REQ_BUF_MAX_LEN          512
+#define UWEB_RX_BUF_LEN               512
+#define UWEB_CHUNK_COALESCE           1
+#ifndef UWEB_CFG_COALESCE
+#define UWEB_CFG_COALESCE             1
+#endif
+#define UWEB_COALESCE_LEN             16384
 #define UWEB_ASSERT(x)
-#define UWEB_DBG(...)                 printf( "[UWEB] "__VA_ARGS__ )
+// feature switches may be overridden per build profile, see makefile; a
+// module whose switch is 0 compiles to nothing
+#ifndef UWEB_CFG_METRICS
+#define UWEB_CFG_METRICS              1
+#endif
+#ifndef UWEB_CFG_WEBSOCKET
+#define UWEB_CFG_WEBSOCKET            1
+#endif
+#ifndef UWEB_CFG_HTTP2
+#define UWEB_CFG_HTTP2                1
+#endif
+#ifndef UWEB_CFG_CACHE
+#define UWEB_CFG_CACHE                1
+#endif
+#define UWEB_CACHE_ENTRY_LEN          8192
+#ifndef UWEB_CFG_ARENA
+#define UWEB_CFG_ARENA                1
+#endif
+#define UWEB_ARENA_BLOCK_ALLOC(len)   malloc(len)
+#define UWEB_ARENA_BLOCK_FREE(p)      free(p)
+#ifndef UWEB_CFG_SLAB
+#define UWEB_CFG_SLAB                 1
+#endif
+#define UWEB_SLAB_ALLOC(len)          malloc(len)
+#define UWEB_CFG_STREAMS_POSIX        1
+#define UWEB_STREAM_REALLOC(p, len)   realloc(p, len)
+#define UWEB_STREAM_FREE(p)           free(p)
+#define UWEB_FILE_CACHE_ENTRIES       16
+#ifndef UWEB_CFG_ASSETS
+#define UWEB_CFG_ASSETS               1
+#endif
+#ifndef UWEB_CFG_VHOST
+#define UWEB_CFG_VHOST                1
+#endif
+#define UWEB_METRICS_PATH             "/metrics"
+#define UWEB_METRICS_MAX_THREADS      8
+#define UWEB_THREAD_LOCAL             __thread
+#define UWEB_TIME_NS()                _uweb_cfg_time_ns()
+#ifndef UWEB_TRACE_LEVEL
+#define UWEB_TRACE_LEVEL              3
+#endif
+#define UWEB_TRACE_LEN                256
 
+static inline uint64_t _uweb_cfg_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
 #endif /* UWEB_CFG_H_ */
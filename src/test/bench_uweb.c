@@ -0,0 +1,374 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Parser throughput benchmark.
+ * Runs UWEB_parse over a corpus of in-memory requests, fed in fragments of
+ * different sizes, and reports ns/request, MB/s and instructions per byte.
+ *
+ *   -o <file>   save results
+ *   -b <file>   compare against earlier saved results
+ *   -f <filter> only run cases whose name contains filter
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "../uweb.h"
+#include "bench_uweb.h"
+
+#define BENCH_MIN_NS          200000000ULL
+#define BENCH_MAX_CASES       64
+#define BENCH_BOUNDARY        "---------------------------812961605669629873499955133"
+
+typedef struct {
+  const char *name;
+  char *data;
+  uint32_t len;
+} bench_req;
+
+typedef struct {
+  char name[64];
+  double ns_per_req;
+  double mb_s;
+  double insn_per_byte;
+} bench_res;
+
+static const uint32_t FRAGMENTS[] = { 1, 64, 4096, 0 };
+
+static bench_req corpus[8];
+static uint32_t corpus_len;
+static bench_res results[BENCH_MAX_CASES];
+static uint32_t results_len;
+static volatile uint32_t data_sink;
+
+static uint8_t *in_data;
+static uint32_t in_len;
+static uint32_t in_ix;
+
+static int32_t benchstr_read(UW_STREAM str, uint8_t *dst, uint32_t len) {
+  if (len > (uint32_t)str->avail_sz) len = str->avail_sz;
+  memcpy(dst, &in_data[in_ix], len);
+  in_ix += len;
+  str->avail_sz -= len;
+  return len;
+}
+
+static int32_t benchstr_write(UW_STREAM str, uint8_t *src, uint32_t len) {
+  (void)str;
+  data_sink += src[0] + len;
+  return len;
+}
+
+static uweb_data_stream in_stream, out_stream, res_stream;
+
+static int32_t resstr_read(UW_STREAM str, uint8_t *dst, uint32_t len) {
+  memcpy(dst, "Hello world!", len);
+  str->avail_sz -= len;
+  return len;
+}
+
+static uweb_response bench_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+  (void)req; (void)http_status; (void)content_type; (void)extra_headers;
+  res_stream.total_sz = 12;
+  res_stream.avail_sz = 12;
+  res_stream.read = resstr_read;
+  *res = &res_stream;
+  return UWEB_OK;
+}
+
+static void bench_data_fn(uweb_request_header *req, uweb_data_type type, uint32_t offset, uint8_t *data, uint32_t length) {
+  (void)req; (void)type; (void)offset;
+  data_sink += length;
+  if (length) data_sink += data[0];
+}
+
+// --- corpus
+
+static void add_req(const char *name, const char *hdr, const char *body, uint32_t body_len) {
+  uint32_t hdr_len = strlen(hdr);
+  bench_req *r = &corpus[corpus_len++];
+  r->name = name;
+  r->len = hdr_len + body_len;
+  r->data = malloc(r->len);
+  memcpy(r->data, hdr, hdr_len);
+  if (body_len) memcpy(&r->data[hdr_len], body, body_len);
+}
+
+static void build_corpus(void) {
+  char hdr[1024];
+  char *body;
+  uint32_t i, len;
+
+  add_req("get_minimal",
+      "GET / HTTP/1.1\r\n"
+      "\r\n", 0, 0);
+
+  add_req("get_browser",
+      "GET /index.html HTTP/1.1\r\n"
+      "Host: localhost:8080\r\n"
+      "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:44.0) Gecko/20100101 Firefox/44.0\r\n"
+      "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+      "Accept-Language: en-US,en;q=0.5\r\n"
+      "Accept-Encoding: gzip, deflate\r\n"
+      "Referer: http://localhost:8080/\r\n"
+      "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark\r\n"
+      "Connection: keep-alive\r\n"
+      "Cache-Control: max-age=0\r\n"
+      "\r\n", 0, 0);
+
+  len = 1024*1024;
+  body = malloc(len);
+  memset(body, 'x', len);
+  sprintf(hdr,
+      "POST /upload HTTP/1.1\r\n"
+      "Host: localhost\r\n"
+      "Content-Type: application/octet-stream\r\n"
+      "Content-Length: %u\r\n"
+      "\r\n", len);
+  add_req("post_content_1M", hdr, body, len);
+  free(body);
+
+  // 4096 chunks of 16 bytes
+  len = 4096 * (4 + 16 + 2) + 5;
+  body = malloc(len + 1);
+  char *p = body;
+  for (i = 0; i < 4096; i++) {
+    p += sprintf(p, "10\r\n0123456789abcdef\r\n");
+  }
+  p += sprintf(p, "0\r\n\r\n");
+  add_req("post_chunked_4096x16",
+      "POST /sensor HTTP/1.1\r\n"
+      "Host: localhost\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "\r\n", body, p - body);
+  free(body);
+
+  // 64 small parts
+  body = malloc(64 * 256);
+  p = body;
+  for (i = 0; i < 64; i++) {
+    p += sprintf(p, "--"BENCH_BOUNDARY"\r\n"
+        "Content-Disposition: form-data; name=\"field%u\"\r\n"
+        "\r\n"
+        "value of field number %u\r\n", i, i);
+  }
+  p += sprintf(p, "--"BENCH_BOUNDARY"--\r\n");
+  sprintf(hdr,
+      "POST / HTTP/1.1\r\n"
+      "Host: localhost\r\n"
+      "Content-Type: multipart/form-data; boundary="BENCH_BOUNDARY"\r\n"
+      "Content-Length: %u\r\n"
+      "\r\n", (uint32_t)(p - body));
+  add_req("post_multipart_64x24", hdr, body, p - body);
+  free(body);
+
+  // one huge part
+  len = 1024*1024;
+  body = malloc(len + 512);
+  p = body;
+  p += sprintf(p, "--"BENCH_BOUNDARY"\r\n"
+      "Content-Disposition: form-data; name=\"file1\"; filename=\"big.bin\"\r\n"
+      "Content-Type: application/octet-stream\r\n"
+      "\r\n");
+  for (i = 0; i < len; i++) {
+    *p++ = (i & 0x3f) == 0 ? '\r' : 'a' + (i % 26);
+  }
+  p += sprintf(p, "\r\n--"BENCH_BOUNDARY"--\r\n");
+  sprintf(hdr,
+      "POST / HTTP/1.1\r\n"
+      "Host: localhost\r\n"
+      "Content-Type: multipart/form-data; boundary="BENCH_BOUNDARY"\r\n"
+      "Content-Length: %u\r\n"
+      "\r\n", (uint32_t)(p - body));
+  add_req("post_multipart_1x1M", hdr, body, p - body);
+  free(body);
+}
+
+// --- measurement
+
+static int perf_fd = -1;
+
+static void perf_open(void) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// feeds one request to the parser in fragments of frag bytes, 0 meaning whole
+static void feed(bench_req *r, uint32_t frag) {
+  in_data = (uint8_t *)r->data;
+  in_len = r->len;
+  in_ix = 0;
+  if (frag == 0) frag = in_len;
+  while (in_ix < in_len) {
+    uint32_t len = in_len - in_ix < frag ? in_len - in_ix : frag;
+    in_stream.avail_sz = len;
+    in_stream.total_sz = len;
+    UWEB_parse(&in_stream, &out_stream);
+  }
+}
+
+static void run_case(bench_req *r, uint32_t frag) {
+  uint64_t iters = 0;
+  uint64_t insn = 0;
+  uint64_t t0, t;
+
+  UWEB_init(bench_response_fn, bench_data_fn);
+  feed(r, frag); // warm up
+
+  if (perf_fd >= 0) {
+    ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  t0 = now_ns();
+  do {
+    feed(r, frag);
+    iters++;
+    t = now_ns();
+  } while (t - t0 < BENCH_MIN_NS);
+  if (perf_fd >= 0) {
+    ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(perf_fd, &insn, sizeof(insn)) != sizeof(insn)) insn = 0;
+  }
+
+  bench_res *res = &results[results_len++];
+  if (frag) {
+    snprintf(res->name, sizeof(res->name), "%s/%u", r->name, frag);
+  } else {
+    snprintf(res->name, sizeof(res->name), "%s/whole", r->name);
+  }
+  res->ns_per_req = (double)(t - t0) / iters;
+  res->mb_s = ((double)r->len * iters) / ((double)(t - t0) / 1e9) / (1024.0 * 1024.0);
+  res->insn_per_byte = insn ? (double)insn / ((double)r->len * iters) : 0;
+}
+
+static bench_res *find_res(bench_res *list, uint32_t len, const char *name) {
+  uint32_t i;
+  for (i = 0; i < len; i++) {
+    if (strcmp(list[i].name, name) == 0) return &list[i];
+  }
+  return 0;
+}
+
+static uint32_t load_results(const char *path, bench_res *list) {
+  FILE *f = fopen(path, "r");
+  uint32_t len = 0;
+  if (f == 0) return 0;
+  while (len < BENCH_MAX_CASES &&
+      fscanf(f, "%63s %lf %lf %lf", list[len].name, &list[len].ns_per_req,
+             &list[len].mb_s, &list[len].insn_per_byte) == 4) {
+    len++;
+  }
+  fclose(f);
+  return len;
+}
+
+static void save_results(const char *path) {
+  FILE *f = fopen(path, "w");
+  uint32_t i;
+  if (f == 0) {
+    printf("could not save results to %s\n", path);
+    return;
+  }
+  for (i = 0; i < results_len; i++) {
+    fprintf(f, "%s %.1f %.2f %.2f\n", results[i].name, results[i].ns_per_req,
+            results[i].mb_s, results[i].insn_per_byte);
+  }
+  fclose(f);
+  printf("results saved to %s\n", path);
+}
+
+int run_bench(int argc, char **args) {
+  const char *out_path = 0;
+  const char *base_path = 0;
+  const char *filter = 0;
+  static bench_res baseline[BENCH_MAX_CASES];
+  uint32_t baseline_len = 0;
+  uint32_t c, f;
+  int arg;
+
+  for (arg = 1; arg < argc - 1; arg++) {
+    if (strcmp("-o", args[arg]) == 0) out_path = args[++arg];
+    else if (strcmp("-b", args[arg]) == 0) base_path = args[++arg];
+    else if (strcmp("-f", args[arg]) == 0) filter = args[++arg];
+  }
+  if (base_path) {
+    baseline_len = load_results(base_path, baseline);
+    if (baseline_len == 0) printf("no baseline in %s\n", base_path);
+  }
+
+  in_stream.read = benchstr_read;
+  out_stream.write = benchstr_write;
+  build_corpus();
+  perf_open();
+  if (perf_fd < 0) printf("instruction counter not available\n");
+#if UWEB_CFG_SLAB
+  printf("connection context %u bytes, pooled buffers %u bytes while busy\n", (uint32_t)sizeof(uweb_ctx),
+         (uint32_t)(UWEB_RX_BUF_LEN + UWEB_REQ_BUF_MAX_LEN + 1 + UWEB_TX_MAX_LEN + sizeof(uweb_request_header)));
+#if UWEB_CFG_HTTP2
+  printf("HTTP/2 state %u bytes while the connection speaks it\n", (uint32_t)sizeof(uweb_h2));
+#endif
+#else
+  printf("connection context %u bytes\n", (uint32_t)sizeof(uweb_ctx));
+#endif
+
+  printf("%-32s %12s %10s %10s %10s\n", "case/fragment", "ns/req", "MB/s", "insn/B", "vs base");
+  for (c = 0; c < corpus_len; c++) {
+    if (filter && strstr(corpus[c].name, filter) == 0) continue;
+    for (f = 0; f < sizeof(FRAGMENTS)/sizeof(FRAGMENTS[0]); f++) {
+      run_case(&corpus[c], FRAGMENTS[f]);
+      bench_res *res = &results[results_len-1];
+      bench_res *base = find_res(baseline, baseline_len, res->name);
+      char delta[16] = "-";
+      if (base && base->ns_per_req > 0) {
+        snprintf(delta, sizeof(delta), "%+.1f%%",
+                 100.0 * (res->ns_per_req - base->ns_per_req) / base->ns_per_req);
+      }
+      printf("%-32s %12.1f %10.2f %10.2f %10s\n", res->name, res->ns_per_req,
+             res->mb_s, res->insn_per_byte, delta);
+    }
+  }
+
+  if (out_path) save_results(out_path);
+  for (c = 0; c < corpus_len; c++) free(corpus[c].data);
+  if (perf_fd >= 0) close(perf_fd);
+  return 0;
+}
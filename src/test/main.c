@@ -23,15 +23,23 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <stdlib.h>
 
-#ifdef RUN_SERVER
+#if defined(RUN_SERVER)
 #include "uweb_sockserv.h"
+#elif defined(RUN_BENCH)
+#include "bench_uweb.h"
+#elif defined(RUN_LOADGEN)
+#include "uweb_loadgen.h"
 #else
 #include "testrunner.h"
 #endif
 
 int main(int argc, char **args) {
-#ifdef RUN_SERVER
-  start_socket_server(8080);
+#if defined(RUN_SERVER)
+  run_socket_server(argc, args);
+#elif defined(RUN_BENCH)
+  run_bench(argc, args);
+#elif defined(RUN_LOADGEN)
+  run_loadgen(argc, args);
 #else
   run_tests(argc, args);
 #endif
@@ -23,13 +23,28 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "../uweb.h"
 #include "testrunner.h"
+#include "uweb_timer.h"
+#if UWEB_CFG_STREAMS_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if UWEB_CFG_ASSETS
+// test_data, see ASSET_DIR in makefile
+extern const uweb_assets uweb_web_assets;
+#endif
 
 static UW_STREAM _response_stream = 0;
 static uint32_t _response_chunk_bytes = 0;
 static uint32_t _response_buffer_ix = 0;
+static uint32_t _response_closed;
 static uint8_t _response_buffer[65536];
 static uint32_t _data_buffer_ix = 0;
 static uint8_t _data_buffer[65536];
+static uint32_t _data_calls = 0;
+static uint32_t _data_trailer_ix = 0;
+static uint8_t _data_trailer[1024];
+static uint32_t _data_frag_len = 0;
 
 static int32_t chstr_read(UW_STREAM str, uint8_t *dst, uint32_t len) {
   if (str->avail_sz > str->total_sz)
@@ -59,10 +74,29 @@ UW_STREAM make_char_stream(UW_STREAM str, const char *data)
   return str;
 }
 
+static int32_t fragstr_read(UW_STREAM str, uint8_t *dst, uint32_t len) {
+  if (len > _data_frag_len)
+    len = _data_frag_len;
+  return chstr_read(str, dst, len);
+}
+
+// char stream only giving fragments of _data_frag_len bytes per read
+UW_STREAM make_frag_stream(UW_STREAM str, const char *data, uint32_t frag_len)
+{
+  make_char_stream(str, data);
+  _data_frag_len = frag_len;
+  str->read = fragstr_read;
+  return str;
+}
+
 static int32_t prstr_read(UW_STREAM str, uint8_t *dst, uint32_t len) {
   return 0;
 }
 
+static void prstr_close(UW_STREAM str) {
+  _response_closed++;
+}
+
 static int32_t prstr_write(UW_STREAM str, uint8_t *src, uint32_t len) {
   while (len--) {
     _response_buffer[_response_buffer_ix++] = *src;
@@ -74,11 +108,13 @@ static int32_t prstr_write(UW_STREAM str, uint8_t *src, uint32_t len) {
 UW_STREAM make_printf_stream(UW_STREAM str)
 {
   _response_buffer_ix = 0;
+  _response_closed = 0;
   str->total_sz = -1;
   str->avail_sz = str->total_sz;
   str->user = 0;
   str->read = prstr_read;
   str->write = prstr_write;
+  str->close = prstr_close;
   return str;
 }
 
@@ -95,7 +131,7 @@ static uweb_response uweb_response_fn(uweb_request_header *req, UW_STREAM *res,
 }
 
 static void uweb_data_fn(uweb_request_header *req, uweb_data_type type, uint32_t offset, uint8_t *data, uint32_t length) {
-#if 1
+#if UWEB_CFG_MULTIPART
   printf("#####      DATA TYPE:%i OFFS:%i LENGTH:%i\n"
          "#####           CHUNK:%i CONN:%s CONTENT_TYPE:%s\n"
          "#####           MLTPART #:%i DISP:%s TYPE:%s\n",
@@ -103,9 +139,16 @@ static void uweb_data_fn(uweb_request_header *req, uweb_data_type type, uint32_t
          req->chunk_nbr, req->connection, req->content_type,
          req->cur_multipart.multipart_nbr, req->cur_multipart.content_disp, req->cur_multipart.content_type);
 #endif
+  if (type == DATA_CHUNK_TRAILER) {
+    _data_trailer_ix += sprintf(&_data_trailer[_data_trailer_ix], "[%s]", data);
+    return;
+  }
+  if (length) _data_calls++;
+#if UWEB_CFG_MULTIPART
   if (strstr(req->content_type, "multipart/form-data") && offset == 0) {
     _data_buffer_ix += sprintf(&_data_buffer[_data_buffer_ix], "[%s]", req->cur_multipart.content_disp);
   }
+#endif
   while (length--) {
     _data_buffer[_data_buffer_ix++] = *data++;
   }
@@ -129,6 +172,9 @@ SUITE(uweb_tests)
     memset(_response_buffer, 0, sizeof(_response_buffer));
     _data_buffer_ix = 0;
     memset(_data_buffer, 0, sizeof(_data_buffer));
+    _data_calls = 0;
+    _data_trailer_ix = 0;
+    memset(_data_trailer, 0, sizeof(_data_trailer));
   }
 
   static void teardown()
@@ -149,12 +195,22 @@ SUITE(uweb_tests)
      "Server: uWeb\r\n"
      "Content-Type: text/html; charset=utf-8\r\n"
      "Content-Length: 12\r\n"
-     "Connection: close\r\n"
      "\r\n"
      "Hello world!"), 0);
+    // kept open for the next request unless the client closes
+    TEST_CHECK_EQ(_response_closed, 0);
+    req_str = make_char_stream(&stream[0],
+      "GET / HTTP/1.1\r\n"
+      "Connection: keep-alive, Close\r\n"
+      "\r\n");
+    res_str = make_char_stream(&stream[2], "Hello world!");
+    UWEB_parse(req_str, make_printf_stream(pri_str));
+    TEST_CHECK(strstr(_response_buffer, "\r\nConnection: close\r\n\r\nHello world!") != 0);
+    TEST_CHECK_EQ(_response_closed, 1);
     return TEST_RES_OK;
   } TEST_END
 
+#if UWEB_CFG_CHUNKED_RESP
   TEST(simple_chunk_request)
   {
     UW_STREAM req_str = make_char_stream(&stream[0], REQ_TXT);
@@ -179,6 +235,7 @@ SUITE(uweb_tests)
      "0\r\n\r\n"), 0);
     return TEST_RES_OK;
   } TEST_END
+#endif
 
 
   TEST(simple_request_bad)
@@ -228,7 +285,6 @@ SUITE(uweb_tests)
      "Server: uWeb\r\n"
      "Content-Type: text/html; charset=utf-8\r\n"
      "Content-Length: 13\r\n"
-     "Connection: close\r\n"
      "\r\n"
      "Hello world!\n"), 0);
 
@@ -238,6 +294,7 @@ SUITE(uweb_tests)
   } TEST_END
 
 
+#if UWEB_CFG_MULTIPART
   TEST(post_multipart_request) {
 
     UW_STREAM req_str = make_char_stream(&stream[0],
@@ -293,7 +350,1871 @@ SUITE(uweb_tests)
 
     return TEST_RES_OK;
   } TEST_END
+#endif
+
+  static const char *CHUNKED_REQ_TXT =
+      "POST /sensor HTTP/1.1\r\n"
+      "Host: localhost\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "Trailer: X-Checksum\r\n"
+      "\r\n"
+      "5\r\n"
+      "Hello\r\n"
+      "1;ext=val\r\n"
+      " \r\n"
+      "6 \t;x\r\n"
+      "world!\r\n"
+      "A\r\n"
+      "0123456789\r\n"
+      "0\r\n"
+      "X-Checksum: 1234\r\n"
+      "X-Other: foo\r\n"
+      "\r\n";
+
+#if UWEB_CFG_CHUNKED_REQ
+  TEST(chunked_post_request)
+  {
+    UW_STREAM req_str = make_char_stream(&stream[0], CHUNKED_REQ_TXT);
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    UW_STREAM res_str = make_char_stream(&stream[2], "Hello world!");
+    _response_stream = res_str;
+    UWEB_init(uweb_response_fn, uweb_data_fn);
+    UWEB_parse(req_str, pri_str);
+
+    TEST_CHECK_EQ(strcmp(_data_buffer, "Hello world!0123456789"), 0);
+    TEST_CHECK_EQ(strcmp(_data_trailer, "[X-Checksum: 1234][X-Other: foo]"), 0);
+#if UWEB_CHUNK_COALESCE
+    TEST_CHECK_EQ(_data_calls, 1);
+#else
+    TEST_CHECK_EQ(_data_calls, 4);
+#endif
+    return TEST_RES_OK;
+  } TEST_END
+
+  TEST(chunked_post_request_fragmented)
+  {
+    uint32_t frag;
+    for (frag = 1; frag < 16; frag++) {
+      setup();
+      UW_STREAM req_str = make_frag_stream(&stream[0], CHUNKED_REQ_TXT, frag);
+      UW_STREAM pri_str = make_printf_stream(&stream[1]);
+      UW_STREAM res_str = make_char_stream(&stream[2], "Hello world!");
+      _response_stream = res_str;
+      UWEB_init(uweb_response_fn, uweb_data_fn);
+      UWEB_parse(req_str, pri_str);
+
+      TEST_CHECK_EQ(strcmp(_data_buffer, "Hello world!0123456789"), 0);
+      TEST_CHECK_EQ(strcmp(_data_trailer, "[X-Checksum: 1234][X-Other: foo]"), 0);
+    }
+    return TEST_RES_OK;
+  } TEST_END
+
+  TEST(chunked_post_request_pipelined)
+  {
+    char req[1024];
+    sprintf(req, "%s%s", CHUNKED_REQ_TXT, REQ_TXT);
+    UW_STREAM req_str = make_char_stream(&stream[0], req);
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    UW_STREAM res_str = make_char_stream(&stream[2], "Hello world!");
+    _response_stream = res_str;
+    UWEB_init(uweb_response_fn, uweb_data_fn);
+    UWEB_parse(req_str, pri_str);
+
+    TEST_CHECK_EQ(strcmp(_data_buffer, "Hello world!0123456789"), 0);
+    // second request must be served after the chunked one
+    char *second = strstr(_response_buffer, "Hello world!");
+    TEST_CHECK(second != 0);
+    TEST_CHECK(strstr(second, "HTTP/1.1 200 OK") != 0);
+    return TEST_RES_OK;
+  } TEST_END
+
+  TEST(chunked_post_request_bad_size)
+  {
+    UW_STREAM req_str = make_char_stream(&stream[0],
+      "POST /sensor HTTP/1.1\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "\r\n"
+      "5x\r\n"
+      "Hello\r\n"
+      "0\r\n"
+      "\r\n");
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    UW_STREAM res_str = make_char_stream(&stream[2], "Hello world!");
+    _response_stream = res_str;
+    UWEB_init(uweb_response_fn, uweb_data_fn);
+    memset(_response_buffer, 0, sizeof(_response_buffer));
+    UWEB_parse(req_str, pri_str);
+
+    // answered at the header, so the bad body closes the connection
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 200 OK") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 400") == 0);
+    TEST_CHECK_EQ(_response_closed, 1);
+    TEST_CHECK_EQ(_data_calls, 0);
+
+    // whitespace may only follow the size, "1 0" is not 0x10
+    req_str = make_char_stream(&stream[0],
+      "POST /sensor HTTP/1.1\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "\r\n"
+      "1 0\r\n"
+      "0123456789abcdef\r\n"
+      "0\r\n"
+      "\r\n");
+    UWEB_parse(req_str, make_printf_stream(pri_str));
+    TEST_CHECK_EQ(_response_closed, 1);
+    TEST_CHECK_EQ(_data_calls, 0);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+#if UWEB_CFG_METRICS && UWEB_CFG_CHUNKED_REQ
+  TEST(metrics_request)
+  {
+    UWEB_metrics_reset();
+    UW_STREAM req_str = make_char_stream(&stream[0], REQ_TXT);
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    UW_STREAM res_str = make_char_stream(&stream[2], "Hello world!");
+    _response_stream = res_str;
+    UWEB_init(uweb_response_fn, uweb_data_fn);
+    UWEB_parse(req_str, pri_str);
+    req_str = make_char_stream(&stream[0], CHUNKED_REQ_TXT);
+    UWEB_parse(req_str, pri_str);
+    req_str = make_char_stream(&stream[0],
+      "BAD / HTTP/1.1\r\n"
+      "\r\n");
+    UWEB_parse(req_str, pri_str);
+
+    uweb_metrics_block m;
+    UWEB_metrics_get(&m);
+    TEST_CHECK_EQ((int)m.req_method[GET], 1);
+    TEST_CHECK_EQ((int)m.req_method[POST], 1);
+    TEST_CHECK_EQ((int)m.req_method[_BAD_REQ], 1);
+    TEST_CHECK_EQ((int)m.resp_status[S200_OK], 2);
+    TEST_CHECK_EQ((int)m.resp_status[S400_BAD_REQ], 1);
+    TEST_CHECK_EQ((int)m.counter[UWEB_CNT_CHUNKS_IN], 4);
+    TEST_CHECK_EQ((int)m.counter[UWEB_CNT_BYTES_IN],
+        (int)(strlen(REQ_TXT) + strlen(CHUNKED_REQ_TXT) + strlen("BAD / HTTP/1.1\r\n\r\n")));
+
+    _response_buffer_ix = 0;
+    memset(_response_buffer, 0, sizeof(_response_buffer));
+    req_str = make_char_stream(&stream[0],
+      "GET /metrics HTTP/1.1\r\n"
+      "\r\n");
+    UWEB_parse(req_str, pri_str);
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 200 OK") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, "uweb_requests_total{method=\"GET\"} 2\n") != 0);
+    TEST_CHECK(strstr(_response_buffer, "uweb_requests_total{method=\"POST\"} 1\n") != 0);
+    TEST_CHECK(strstr(_response_buffer, "uweb_errors_total{class=\"4xx\"} 1\n") != 0);
+    TEST_CHECK(strstr(_response_buffer, "uweb_handler_seconds_count 2\n") != 0);
+    TEST_CHECK(strstr(_response_buffer, "uweb_header_parse_seconds_count 4\n") != 0);
+    TEST_CHECK(strstr(_response_buffer, "\r\n0\r\n\r\n") != 0);
+
+    // values on a bucket bound count in that bucket
+    UWEB_metrics_reset();
+    _uweb_metrics_hist(UWEB_HIST_HANDLER, 1024);
+    _uweb_metrics_hist(UWEB_HIST_HANDLER, 1025);
+    _uweb_metrics_hist(UWEB_HIST_HANDLER, 2048);
+    _uweb_metrics_hist(UWEB_HIST_HANDLER, 2049);
+    _uweb_metrics_hist(UWEB_HIST_HANDLER, ~0ULL);
+    UWEB_metrics_get(&m);
+    TEST_CHECK_EQ((int)m.hist[UWEB_HIST_HANDLER][0], 1);
+    TEST_CHECK_EQ((int)m.hist[UWEB_HIST_HANDLER][1], 2);
+    TEST_CHECK_EQ((int)m.hist[UWEB_HIST_HANDLER][2], 1);
+    TEST_CHECK_EQ((int)m.hist[UWEB_HIST_HANDLER][UWEB_METRICS_BUCKETS], 1);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+#if UWEB_TRACE_LEVEL >= UWEB_TRACE_DBG && UWEB_CFG_CHUNKED_REQ
+  static uint8_t _trace_dump[sizeof(uweb_trace_hdr) + UWEB_TRACE_LEN * sizeof(uweb_trace_rec)];
+  static uint32_t _trace_dump_len;
+  static void trace_emit(void *arg, const uint8_t *data, uint32_t len) {
+    (void)arg;
+    memcpy(&_trace_dump[_trace_dump_len], data, len);
+    _trace_dump_len += len;
+  }
+
+  TEST(trace_request)
+  {
+    UW_STREAM req_str = make_char_stream(&stream[0], CHUNKED_REQ_TXT);
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    UW_STREAM res_str = make_char_stream(&stream[2], "Hello world!");
+    _response_stream = res_str;
+    UWEB_init(uweb_response_fn, uweb_data_fn);
+    UWEB_parse(req_str, pri_str);
+    req_str = make_char_stream(&stream[0],
+      "POST /sensor HTTP/1.1\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "\r\n"
+      "5x\r\n");
+    UWEB_parse(req_str, pri_str);
+
+    _trace_dump_len = 0;
+    UWEB_trace_dump(trace_emit, 0);
+    uweb_trace_hdr *hdr = (uweb_trace_hdr *)_trace_dump;
+    uweb_trace_rec *rec = (uweb_trace_rec *)&_trace_dump[sizeof(uweb_trace_hdr)];
+    TEST_CHECK_EQ(memcmp(hdr->magic, UWEB_TRACE_MAGIC, 4), 0);
+    TEST_CHECK_EQ(hdr->lost, 0);
+    TEST_CHECK_EQ(_trace_dump_len, sizeof(uweb_trace_hdr) + hdr->count * sizeof(uweb_trace_rec));
+
+    uint32_t i, chunks = 0, trailers = 0, requests = 0, done = 0, errors = 0;
+    for (i = 0; i < hdr->count; i++) {
+      switch (rec[i].event) {
+      case TRC_REQUEST:
+        TEST_CHECK_EQ(rec[i].a, POST);
+        requests++;
+        break;
+      case TRC_CHUNK: chunks++; break;
+      case TRC_CHUNK_TRAILER: trailers++; break;
+      case TRC_CHUNKS_DONE:
+        TEST_CHECK_EQ(rec[i].a, 4);
+        TEST_CHECK_EQ(rec[i].b, 22);
+        done++;
+        break;
+      case TRC_BAD_CHUNK_SIZE:
+        TEST_CHECK_EQ(rec[i].level, UWEB_TRACE_ERR);
+        TEST_CHECK_EQ(rec[i].b, 'x');
+        errors++;
+        break;
+      case TRC_ERROR_RESPONSE:
+        errors++;
+        break;
+      }
+    }
+    TEST_CHECK_EQ(requests, 2);
+    TEST_CHECK_EQ(chunks, 4);
+    TEST_CHECK_EQ(trailers, 2);
+    TEST_CHECK_EQ(done, 1);
+    // already answered, the bad chunk closes without an error response
+    TEST_CHECK_EQ(errors, 1);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+  TEST(timeout_partial_request_line)
+  {
+    UW_STREAM req_str = make_char_stream(&stream[0], "GET / HT");
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    UWEB_init(uweb_response_fn, uweb_data_fn);
+    UWEB_timeout(pri_str);
+    TEST_CHECK_EQ(_response_buffer_ix, 0);
+    UWEB_parse(req_str, pri_str);
+    UWEB_timeout(pri_str);
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 408") == (char *)_response_buffer);
+    return TEST_RES_OK;
+  } TEST_END
+
+#if UWEB_CFG_CHUNKED_REQ
+  TEST(ctx_interleaved)
+  {
+    static uweb_ctx ctx[2];
+    const char *req = CHUNKED_REQ_TXT;
+    uint32_t i, len = strlen(req);
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    UW_STREAM res_str = make_char_stream(&stream[2], "Hello world!");
+    _response_stream = res_str;
+    _data_buffer_ix = 0;
+    UWEB_ctx_init(&ctx[0], uweb_response_fn, uweb_data_fn);
+    UWEB_ctx_init(&ctx[1], uweb_response_fn, uweb_data_fn);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx[0]), UWEB_PHASE_IDLE);
+    // feed both contexts the same request, three bytes at a time, interleaved
+    for (i = 0; i < len; i += 3) {
+      char frag[4] = {0};
+      strncpy(frag, &req[i], 3);
+      make_char_stream(&stream[0], frag);
+      UWEB_ctx_parse(&ctx[0], &stream[0], pri_str);
+      make_char_stream(&stream[0], frag);
+      UWEB_ctx_parse(&ctx[1], &stream[0], pri_str);
+      if (i == 3) TEST_CHECK_EQ(UWEB_ctx_phase(&ctx[1]), UWEB_PHASE_HEADER);
+    }
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx[0]), UWEB_PHASE_IDLE);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx[1]), UWEB_PHASE_IDLE);
+    // data of both requests, interleaved in three byte fragments
+    TEST_CHECK_EQ(_data_buffer_ix, 2 * strlen("Hello world!0123456789"));
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+  static void limits_fn(uweb_request_header *req, uweb_limits *limits) {
+    if (strcmp(req->resource, "/small") == 0) {
+      limits->body_size = 4;
+    }
+  }
+
+  static const char *limits_check(const char *req) {
+    UW_STREAM req_str = make_char_stream(&stream[0], req);
+    make_printf_stream(&stream[1]);
+    memset(_response_buffer, 0, sizeof(_response_buffer));
+    _data_calls = 0;
+    UWEB_parse(req_str, &stream[1]);
+    return (const char *)_response_buffer;
+  }
+
+  TEST(request_limits)
+  {
+    static char long_line[2048];
+    uint32_t i;
+    uweb_limits limits = { .uri_len = 16, .header_bytes = 1024, .header_count = 3, .body_size = 0 };
+    UW_STREAM res_str = make_char_stream(&stream[2], "Hello world!");
+    _response_stream = res_str;
+    UWEB_init(uweb_response_fn, uweb_data_fn);
+    UWEB_set_limits(&limits, limits_fn);
+
+    TEST_CHECK(strstr(limits_check(
+        "GET /0123456789abcdef HTTP/1.1\r\n"
+        "\r\n"), "HTTP/1.1 414 ") == (char *)_response_buffer);
+    // request line longer than parse buffer is rejected, not cut
+    memset(long_line, 0, sizeof(long_line));
+    strcpy(long_line, "GET /");
+    memset(&long_line[5], 'a', UWEB_REQ_BUF_MAX_LEN + 32);
+    TEST_CHECK(strstr(limits_check(long_line), "HTTP/1.1 414 ") == (char *)_response_buffer);
+    TEST_CHECK(strstr(limits_check(
+        "GET / HTTP/1.1\r\n"
+        "A: 1\r\nB: 2\r\nC: 3\r\nD: 4\r\n"
+        "\r\n"), "HTTP/1.1 431 ") == (char *)_response_buffer);
+    memset(long_line, 0, sizeof(long_line));
+    strcpy(long_line, "GET / HTTP/1.1\r\n");
+    for (i = 0; i < 3; i++) {
+      strcat(long_line, "X: ");
+      memset(&long_line[strlen(long_line)], 'x', 150);
+      strcat(long_line, "\r\n");
+    }
+    strcat(long_line, "\r\n");
+    TEST_CHECK(strstr(limits_check(long_line), "HTTP/1.1 200 OK") == (char *)_response_buffer);
+    long_line[strlen(long_line) - 2] = 0;
+    for (i = 0; i < 3; i++) {
+      strcat(long_line, "Y: ");
+      memset(&long_line[strlen(long_line)], 'y', 150);
+      strcat(long_line, "\r\n");
+    }
+    strcat(long_line, "\r\n");
+    TEST_CHECK(strstr(limits_check(long_line), "HTTP/1.1 431 ") == (char *)_response_buffer);
+    // rejected at the header, the body is dropped and the handler never runs
+    TEST_CHECK(strstr(limits_check(
+        "POST /big HTTP/1.1\r\n"
+        "Content-Length: 10000000000\r\n"
+        "\r\n"
+        "GET / HTTP/1.1\r\n\r\n"), "HTTP/1.1 413 ") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, "200 OK") == 0);
+    TEST_CHECK(strstr(limits_check(
+        "POST /small HTTP/1.1\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "abcde"), "HTTP/1.1 413 ") == (char *)_response_buffer);
+    TEST_CHECK_EQ(_data_calls, 0);
+#if UWEB_CFG_CHUNKED_REQ
+    TEST_CHECK(strstr(limits_check(
+        "POST /small HTTP/1.1\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "3\r\nabc\r\n"
+        "3\r\ndef\r\n"
+        "0\r\n\r\n"), "HTTP/1.1 200 OK") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 413 ") == 0);
+    TEST_CHECK_EQ(_response_closed, 1);
+    // so do trailers over the header limits
+    TEST_CHECK(strstr(limits_check(
+        "POST /large HTTP/1.1\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "0\r\n"
+        "T: 1\r\nU: 2\r\nV: 3\r\n"
+        "\r\n"), "HTTP/1.1 200 OK") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 431 ") == 0);
+    TEST_CHECK_EQ(_response_closed, 1);
+#endif
+    // within limits, after rejections the next call starts over
+    TEST_CHECK(strstr(limits_check(
+        "POST /large HTTP/1.1\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "abcde"), "HTTP/1.1 200 OK") == (char *)_response_buffer);
+    TEST_CHECK_EQ(_data_calls, 1);
+    return TEST_RES_OK;
+  } TEST_END
+
+  static uweb_http_status header_fn(uweb_request_header *req) {
+    if (strcmp(req->resource, "/private") == 0) {
+      return S401_UNAUTH;
+    }
+    return S100_CONTINUE;
+  }
+
+  TEST(expect_continue)
+  {
+    UW_STREAM res_str = make_char_stream(&stream[2], "Hello world!");
+    _response_stream = res_str;
+    UWEB_init(uweb_response_fn, uweb_data_fn);
+    UWEB_set_header_f(header_fn);
+
+    // accepted, interim response before the final one
+    TEST_CHECK(strstr(limits_check(
+        "POST /upload HTTP/1.1\r\n"
+        "Content-Length: 5\r\n"
+        "Expect: 100-continue\r\n"
+        "\r\n"
+        "abcde"), "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK") == (char *)_response_buffer);
+    TEST_CHECK_EQ(_data_calls, 1);
+    TEST_CHECK(strstr(limits_check(
+        "POST /upload HTTP/1.1\r\n"
+        "Content-Length: 5\r\n"
+        "Expect: 100-Continue\r\n"
+        "\r\n"
+        "abcde"), "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK") == (char *)_response_buffer);
+    // rejected, no interim response, body never read
+    TEST_CHECK(strstr(limits_check(
+        "POST /private HTTP/1.1\r\n"
+        "Content-Length: 5\r\n"
+        "Expect: 100-continue\r\n"
+        "\r\n"
+        "abcde"), "HTTP/1.1 401 ") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, "100 Continue") == 0);
+    TEST_CHECK(strstr(_response_buffer, "200 OK") == 0);
+    TEST_CHECK_EQ(_data_calls, 0);
+    // no body, nothing to continue
+    TEST_CHECK(strstr(limits_check(
+        "GET / HTTP/1.1\r\n"
+        "Expect: 100-continue\r\n"
+        "\r\n"), "HTTP/1.1 200 OK") == (char *)_response_buffer);
+    TEST_CHECK(strstr(limits_check(
+        "POST /upload HTTP/1.1\r\n"
+        "Content-Length: 5\r\n"
+        "Expect: something\r\n"
+        "\r\n"
+        "abcde"), "HTTP/1.1 417 ") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, UWEB_HTTP_MSG_EXPECTATION_FAILED) != 0);
+    TEST_CHECK_EQ(_data_calls, 0);
+    return TEST_RES_OK;
+  } TEST_END
+
+  static uweb_response sse_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+    if (strncmp(req->resource, "/events/", 8) == 0) {
+      return UWEB_return_event_stream(req, &req->resource[8]);
+    }
+    return uweb_response_fn(req, res, http_status, content_type, extra_headers);
+  }
+
+  TEST(event_stream)
+  {
+    static uweb_ctx ctx;
+    char ev[64];
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    UWEB_ctx_init(&ctx, sse_response_fn, uweb_data_fn);
+    make_char_stream(&stream[0],
+        "GET /events/tele HTTP/1.1\r\n"
+        "\r\n"
+        "GET / HTTP/1.1\r\n"
+        "\r\n");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 200 OK\r\n") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, "\r\nContent-Type: text/event-stream\r\n") != 0);
+    // header only, anything further from the client is dropped
+    TEST_CHECK(strstr(_response_buffer, "\r\n\r\n") + 4 == (char *)&_response_buffer[_response_buffer_ix]);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_EVENT_STREAM);
+    TEST_CHECK_EQ(strcmp(ctx.req->event_channel, "tele"), 0);
+
+    TEST_CHECK_EQ(uweb_sse_format(ev, sizeof(ev), "temp", 7, (const uint8_t *)"21.5\n22.0", 9), 41);
+    TEST_CHECK_EQ(memcmp(ev, "id: 7\nevent: temp\ndata: 21.5\ndata: 22.0\n\n", 41), 0);
+    // counts what would not fit
+    TEST_CHECK_EQ(uweb_sse_format(ev, 4, 0, 0, (const uint8_t *)"abc", 3), 11);
+    TEST_CHECK_EQ(memcmp(ev, "data", 4), 0);
+    TEST_CHECK_EQ(uweb_sse_format(ev, sizeof(ev), 0, 0, (const uint8_t *)"a\rb\r\nc", 6), 25);
+    TEST_CHECK_EQ(memcmp(ev, "data: a\ndata: b\ndata: c\n\n", 25), 0);
+    TEST_CHECK_EQ(uweb_sse_format(ev, sizeof(ev), "x\ndata: y", 0, (const uint8_t *)"a", 1), 0);
+    return TEST_RES_OK;
+  } TEST_END
+
+  static uweb_response deferred_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+    if (strncmp(req->resource, "/backend/", 9) == 0) return UWEB_DEFERRED;
+    return uweb_response_fn(req, res, http_status, content_type, extra_headers);
+  }
+
+  static void field_fn(uweb_request_header *req, const char *line, uint32_t len) {
+    _data_trailer_ix += sprintf((char *)&_data_trailer[_data_trailer_ix], "[%.*s]", (int)len, line);
+  }
+
+  TEST(deferred_response)
+  {
+    static uweb_ctx ctx;
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    _response_stream = make_char_stream(&stream[2], "Hello world!");
+    UWEB_ctx_init(&ctx, deferred_response_fn, uweb_data_fn);
+    UWEB_ctx_set_field_f(&ctx, field_fn);
+    make_char_stream(&stream[0],
+        "POST /backend/upload HTTP/1.1\r\n"
+        "Content-Type: multipart/form-data; boundary=xyz\r\n"
+        "Content-Length: 27\r\n"
+        "\r\n"
+        "--xyz\r\n"
+        "\r\n"
+        "abc\r\n"
+        "--xyz--\r\n"
+        "\r\n"
+        "\r\n"
+        "GET / HTTP/1.1\r\n"
+        "\r\n");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    // nothing sent, all fields and the raw body reported
+    TEST_CHECK_EQ(_response_buffer_ix, 0);
+    TEST_CHECK_EQ(strcmp((char *)_data_trailer,
+        "[Content-Type: multipart/form-data; boundary=xyz][Content-Length: 27]"), 0);
+    TEST_CHECK(strstr((char *)_data_buffer, "--xyz\r\n\r\nabc\r\n--xyz--\r\n\r\n\r\n") != 0);
+    // pipelined request waits for the deferred response
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_DEFERRED);
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    TEST_CHECK_EQ(_response_buffer_ix, 0);
+    UWEB_ctx_deferred_done(&ctx, &stream[0], pri_str);
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 200 OK\r\n") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, "Hello world!") != 0);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_IDLE);
+    TEST_CHECK_EQ(_response_closed, 0);
+
+    // done before the body is received, the request ends with the body
+    make_printf_stream(pri_str);
+    make_char_stream(&stream[0],
+        "POST /backend/x HTTP/1.1\r\n"
+        "Connection: close\r\n"
+        "Content-Length: 4\r\n"
+        "\r\n"
+        "ab");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_BODY);
+    UWEB_ctx_deferred_done(&ctx, &stream[0], pri_str);
+    make_char_stream(&stream[0], "cd");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_CLOSING);
+    TEST_CHECK_EQ(_response_closed, 1);
+    TEST_CHECK_EQ(_response_buffer_ix, 0);
+
+    // the server owns the response, a timeout sends no 408
+    make_printf_stream(pri_str);
+    make_char_stream(&stream[0],
+        "POST /backend/x HTTP/1.1\r\n"
+        "Content-Length: 4\r\n"
+        "\r\n"
+        "ab");
+    UWEB_ctx_init(&ctx, deferred_response_fn, uweb_data_fn);
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    UWEB_ctx_timeout(&ctx, pri_str);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_CLOSING);
+    TEST_CHECK_EQ(_response_closed, 1);
+    TEST_CHECK_EQ(_response_buffer_ix, 0);
+    return TEST_RES_OK;
+  } TEST_END
 
+#if UWEB_CFG_CHUNKED_RESP
+  static uint32_t _gen_blocked;
+
+  static int count_gen(uweb_gen *gen, uweb_request_header *req) {
+    static const char *words[] = { "one ", "two ", "three" };
+    UWEB_GEN_BEGIN(gen);
+    for (gen->ix = 0; gen->ix < 3; gen->ix++) {
+      UWEB_GEN_YIELD(gen, words[gen->ix], strlen(words[gen->ix]));
+    }
+    // empty yields are not sent
+    UWEB_GEN_YIELD(gen, "", 0);
+    UWEB_GEN_END(gen);
+  }
+
+  static int gen_blocked_fn(uweb_request_header *req) {
+    // blocked after every chunk
+    return req->chunk_nbr >= _gen_blocked;
+  }
+
+  static uweb_response gen_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+    if (strcmp(req->resource, "/count") == 0) return UWEB_return_generator(req, count_gen, 0);
+    return uweb_response_fn(req, res, http_status, content_type, extra_headers);
+  }
+
+  TEST(generator_response)
+  {
+    static uweb_ctx ctx;
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    _response_stream = make_char_stream(&stream[2], "Hello world!");
+    UWEB_ctx_init(&ctx, gen_response_fn, uweb_data_fn);
+    // runs to its end at once without a blocked function
+    make_char_stream(&stream[0], "GET /count HTTP/1.1\r\n\r\n");
+    memset(_response_buffer, 0, sizeof(_response_buffer));
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    TEST_CHECK_EQ(strcmp(_response_buffer,
+     "HTTP/1.1 200 OK\r\n"
+     "Server: uWeb\r\n"
+     "Content-Type: text/html; charset=utf-8\r\n"
+     "Transfer-Encoding: chunked\r\n"
+     "\r\n"
+     "4; chunk 0\r\n"
+     "one \r\n"
+     "4; chunk 1\r\n"
+     "two \r\n"
+     "5; chunk 2\r\n"
+     "three\r\n"
+     "0\r\n\r\n"), 0);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_IDLE);
+
+    // suspended while output is blocked, pipelined request waits
+    UWEB_ctx_set_blocked_f(&ctx, gen_blocked_fn);
+    _gen_blocked = 1;
+    make_printf_stream(pri_str);
+    memset(_response_buffer, 0, sizeof(_response_buffer));
+    make_char_stream(&stream[0],
+        "GET /count HTTP/1.1\r\n\r\n"
+        "GET / HTTP/1.1\r\n\r\n");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    TEST_CHECK(strstr(_response_buffer, "one \r\n") != 0);
+    TEST_CHECK(strstr(_response_buffer, "two") == 0);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_DEFERRED);
+    UWEB_ctx_resume(&ctx, &stream[0], pri_str);
+    TEST_CHECK(strstr(_response_buffer, "two") == 0);
+    _gen_blocked = 2;
+    UWEB_ctx_resume(&ctx, &stream[0], pri_str);
+    TEST_CHECK(strstr(_response_buffer, "two \r\n") != 0);
+    TEST_CHECK(strstr(_response_buffer, "three") == 0);
+    _gen_blocked = 10;
+    UWEB_ctx_resume(&ctx, &stream[0], pri_str);
+    TEST_CHECK(strstr(_response_buffer, "three\r\n0\r\n\r\nHTTP/1.1 200 OK\r\n") != 0);
+    TEST_CHECK(strstr(_response_buffer, "Hello world!") != 0);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_IDLE);
+    TEST_CHECK(ctx.gen_f == 0);
+
+    // a HEAD request gets the header only
+    make_printf_stream(pri_str);
+    memset(_response_buffer, 0, sizeof(_response_buffer));
+    make_char_stream(&stream[0], "HEAD /count HTTP/1.1\r\n\r\n");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    TEST_CHECK(strstr(_response_buffer, "\r\n\r\n") == (char *)_response_buffer + strlen((char *)_response_buffer) - 4);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_IDLE);
+
+    // the response is under way, a timeout closes
+    _gen_blocked = 0;
+    make_printf_stream(pri_str);
+    make_char_stream(&stream[0], "GET /count HTTP/1.1\r\n\r\n");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_DEFERRED);
+    UWEB_ctx_timeout(&ctx, pri_str);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_CLOSING);
+    TEST_CHECK_EQ(_response_closed, 1);
+    TEST_CHECK(ctx.gen_f == 0);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+#if UWEB_CFG_CACHE
+  static uint32_t _cache_calls;
+  static uint32_t _cache_hits;
+  static uweb_ctx *_cache_resumed;
+
+  static uint32_t cache_fn(uweb_request_header *req) {
+    if (strncmp(req->resource, "/short", 6) == 0) return 1;
+    if (strncmp(req->resource, "/api/", 5) == 0 || strncmp(req->resource, "/backend/", 9) == 0) return 60000;
+    return 0;
+  }
+
+  static uweb_response cache_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+    if (req->chunk_nbr == 0) _cache_calls++;
+    return deferred_response_fn(req, res, http_status, content_type, extra_headers);
+  }
+
+  static void cached_fn(uweb_request_header *req, int waited) {
+    if (waited) _cache_resumed = req->ctx;
+    else _cache_hits++;
+  }
+
+  static void cache_get(uweb_ctx *ctx, UW_STREAM in, UW_STREAM out, const char *req) {
+    make_printf_stream(out);
+    _response_stream = make_char_stream(&stream[2], "Hello world!");
+    make_char_stream(in, req);
+    UWEB_ctx_parse(ctx, in, out);
+    _response_buffer[_response_buffer_ix] = 0;
+  }
+
+  TEST(cache_response)
+  {
+    static const char * const vary[] = { "Accept-Language", 0 };
+    static uweb_ctx ctx;
+    static uweb_ctx ctx2;
+    static uint8_t first[1024];
+    uint32_t first_len;
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    _cache_calls = 0;
+    _cache_hits = 0;
+    _cache_resumed = 0;
+    _response_chunk_bytes = 0;
+    UWEB_cache_clear();
+    UWEB_set_cache_f(cache_fn, vary);
+    UWEB_ctx_init(&ctx, cache_response_fn, uweb_data_fn);
+    UWEB_ctx_set_cached_f(&ctx, cached_fn);
+
+    cache_get(&ctx, &stream[0], pri_str, "GET /api/status HTTP/1.1\r\n\r\n");
+    TEST_CHECK_EQ(_cache_calls, 1);
+    first_len = _response_buffer_ix;
+    memcpy(first, _response_buffer, first_len);
+    // answered from the cache, with its age
+    cache_get(&ctx, &stream[0], pri_str, "GET /api/status HTTP/1.1\r\n\r\n");
+    TEST_CHECK_EQ(_cache_calls, 1);
+    TEST_CHECK_EQ(_cache_hits, 1);
+    TEST_CHECK(strstr((char *)_response_buffer, "\r\nAge: 0\r\n\r\nHello world!") != 0);
+    TEST_CHECK_EQ(_response_buffer_ix, first_len + 8);
+    TEST_CHECK_EQ(memcmp(_response_buffer, first, first_len - 14), 0);
+    // selected field values and method are part of the key
+    cache_get(&ctx, &stream[0], pri_str, "GET /api/status HTTP/1.1\r\nAccept-Language: sv\r\n\r\n");
+    TEST_CHECK_EQ(_cache_calls, 2);
+    cache_get(&ctx, &stream[0], pri_str, "GET /api/status HTTP/1.1\r\naccept-language:sv\r\n\r\n");
+    TEST_CHECK_EQ(_cache_calls, 2);
+    cache_get(&ctx, &stream[0], pri_str, "HEAD /api/status HTTP/1.1\r\n\r\n");
+    TEST_CHECK_EQ(_cache_calls, 3);
+    TEST_CHECK(strstr((char *)_response_buffer, "Hello") == 0);
+    // not picked by the cache function
+    cache_get(&ctx, &stream[0], pri_str, "GET /other HTTP/1.1\r\n\r\nGET /other HTTP/1.1\r\n\r\n");
+    TEST_CHECK_EQ(_cache_calls, 5);
+    // the client's close is added to a hit
+    cache_get(&ctx, &stream[0], pri_str, "GET /api/status HTTP/1.1\r\nConnection: close\r\n\r\n");
+    TEST_CHECK_EQ(_cache_calls, 5);
+    TEST_CHECK(strstr((char *)_response_buffer, "\r\nAge: 0\r\nConnection: close\r\n\r\nHello world!") != 0);
+    TEST_CHECK_EQ(_response_closed, 1);
+    UWEB_ctx_init(&ctx, cache_response_fn, uweb_data_fn);
+    UWEB_ctx_set_cached_f(&ctx, cached_fn);
+
+    // chunked response, captured chunk by chunk
+    _response_chunk_bytes = 5;
+    cache_get(&ctx, &stream[0], pri_str, "GET /api/chunked HTTP/1.1\r\n\r\n");
+    TEST_CHECK_EQ(_cache_calls, 6);
+    first_len = _response_buffer_ix;
+    cache_get(&ctx, &stream[0], pri_str, "GET /api/chunked HTTP/1.1\r\n\r\n");
+    TEST_CHECK_EQ(_cache_calls, 6);
+    TEST_CHECK(strstr((char *)_response_buffer,
+        "Transfer-Encoding: chunked\r\nAge: 0\r\n\r\n5; chunk 0\r\nHello\r\n5; chunk 1\r\n worl\r\n"
+        "2; chunk 2\r\nd!\r\n0\r\n\r\n") != 0);
+    TEST_CHECK_EQ(_response_buffer_ix, first_len + 8);
+    _response_chunk_bytes = 0;
+
+    // expired
+    cache_get(&ctx, &stream[0], pri_str, "GET /short HTTP/1.1\r\n\r\n");
+    uint64_t t = UWEB_TIME_NS();
+    while (UWEB_TIME_NS() - t < 2000000);
+    cache_get(&ctx, &stream[0], pri_str, "GET /short HTTP/1.1\r\n\r\n");
+    TEST_CHECK_EQ(_cache_calls, 8);
+
+    // concurrent misses of a deferred response wait for the first one
+    UWEB_ctx_init(&ctx2, cache_response_fn, uweb_data_fn);
+    UWEB_ctx_set_cached_f(&ctx2, cached_fn);
+    cache_get(&ctx, &stream[0], pri_str, "GET /backend/x HTTP/1.1\r\n\r\n");
+    cache_get(&ctx2, &stream[3], pri_str, "GET /backend/x HTTP/1.1\r\n\r\nGET /api/status HTTP/1.1\r\n\r\n");
+    TEST_CHECK_EQ(_cache_calls, 9);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx2), UWEB_PHASE_DEFERRED);
+    TEST_CHECK_EQ(_response_buffer_ix, 0);
+    UW_STREAM out = UWEB_ctx_out(&ctx, pri_str);
+    TEST_CHECK(out != pri_str);
+    out->write(out, (uint8_t *)"HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok", 40);
+    UWEB_ctx_deferred_done(&ctx, &stream[0], pri_str);
+    TEST_CHECK(_cache_resumed == &ctx2);
+    _response_buffer[_response_buffer_ix] = 0;
+    TEST_CHECK(strstr((char *)_response_buffer,
+        "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok"
+        "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nAge: 0\r\n\r\nok") == (char *)_response_buffer);
+    // the waiting one parses on when done
+    TEST_CHECK_EQ(_cache_hits, 4);
+    UWEB_ctx_deferred_done(&ctx2, &stream[3], pri_str);
+    TEST_CHECK_EQ(_cache_hits, 5);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx2), UWEB_PHASE_IDLE);
+    TEST_CHECK_EQ(_cache_calls, 9);
+
+    // a waiting request that is closed is not resumed
+    _cache_resumed = 0;
+    cache_get(&ctx, &stream[0], pri_str, "GET /backend/y HTTP/1.1\r\n\r\n");
+    cache_get(&ctx2, &stream[3], pri_str, "GET /backend/y HTTP/1.1\r\n\r\n");
+    UWEB_ctx_close(&ctx2);
+    UWEB_ctx_deferred_done(&ctx, &stream[0], pri_str);
+    TEST_CHECK(_cache_resumed == 0);
+    TEST_CHECK_EQ(_cache_calls, 10);
+
+    // not kept when not 200, the waiting request calls the response function
+    // itself rather than wait again
+    UWEB_ctx_init(&ctx2, cache_response_fn, uweb_data_fn);
+    UWEB_ctx_set_cached_f(&ctx2, cached_fn);
+    cache_get(&ctx, &stream[0], pri_str, "GET /backend/z HTTP/1.1\r\n\r\n");
+    cache_get(&ctx2, &stream[3], pri_str, "GET /backend/z HTTP/1.1\r\n\r\n");
+    out = UWEB_ctx_out(&ctx, pri_str);
+    out->write(out, (uint8_t *)"HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n", 47);
+    UWEB_ctx_deferred_done(&ctx, &stream[0], pri_str);
+    TEST_CHECK_EQ(_cache_calls, 12);
+    TEST_CHECK(_cache_resumed == 0);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx2), UWEB_PHASE_DEFERRED);
+    TEST_CHECK(UWEB_ctx_out(&ctx2, pri_str) == pri_str);
+    UWEB_ctx_deferred_done(&ctx2, &stream[3], pri_str);
+    // a given up response lets the next one try
+    cache_get(&ctx, &stream[0], pri_str, "GET /backend/z HTTP/1.1\r\n\r\n");
+    cache_get(&ctx2, &stream[3], pri_str, "GET /backend/z HTTP/1.1\r\n\r\n");
+    TEST_CHECK_EQ(_cache_calls, 13);
+    UWEB_ctx_timeout(&ctx, pri_str);
+    TEST_CHECK_EQ(_cache_calls, 14);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx2), UWEB_PHASE_DEFERRED);
+    TEST_CHECK(UWEB_ctx_out(&ctx2, pri_str) != pri_str);
+    UWEB_ctx_close(&ctx);
+    UWEB_ctx_close(&ctx2);
+
+    UWEB_set_cache_f(0, 0);
+    UWEB_cache_clear();
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+#if UWEB_CFG_ARENA
+  static uint32_t _arena_aligned;
+  static uint32_t _arena_own;
+  static uint32_t _arena_used;
+  static void *_arena_big;
+  static uint8_t *_arena_buf;
+
+  static uweb_response arena_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+    (void)http_status;
+    (void)content_type;
+    (void)extra_headers;
+    if (req->chunk_nbr) return UWEB_OK;
+    uint8_t *a = (uint8_t *)UWEB_req_alloc(req, 3);
+    uint8_t *b = (uint8_t *)UWEB_req_alloc(req, 1);
+    _arena_aligned = ((uintptr_t)a % UWEB_ARENA_ALIGN) == 0 && b - a == UWEB_ARENA_ALIGN;
+    _arena_big = strcmp(req->resource, "/big") == 0 ? UWEB_req_alloc(req, UWEB_ARENA_LEN) : 0;
+    _arena_own = req->arena == &req->ctx->arena;
+    _arena_used = req->arena->used;
+    _arena_buf = req->arena->buf;
+    *res = make_char_stream(&stream[2], UWEB_req_printf(req, "<p>%s</p>", req->resource));
+    return UWEB_OK;
+  }
+
+  TEST(request_arena)
+  {
+    static uweb_ctx ctx;
+    uweb_request_header req;
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    UWEB_ctx_init(&ctx, arena_response_fn, uweb_data_fn);
+    make_char_stream(&stream[0],
+        "GET /index HTTP/1.1\r\n"
+        "\r\n");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    _response_buffer[_response_buffer_ix] = 0;
+    TEST_CHECK(strstr(_response_buffer, "<p>/index</p>") != 0);
+    TEST_CHECK_EQ(_arena_own, 1);
+    TEST_CHECK_EQ(_arena_aligned, 1);
+    TEST_CHECK_EQ(_arena_used, 2 * UWEB_ARENA_ALIGN);
+    // reset when the request is done
+    TEST_CHECK_EQ(ctx.arena.used, 0);
+
+    // too large for what is left, a fallback block
+    make_printf_stream(pri_str);
+    make_char_stream(&stream[0],
+        "GET /big HTTP/1.1\r\n"
+        "\r\n");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    _response_buffer[_response_buffer_ix] = 0;
+    TEST_CHECK(strstr(_response_buffer, "<p>/big</p>") != 0);
+    TEST_CHECK(_arena_big != 0);
+    TEST_CHECK((uint8_t *)_arena_big < _arena_buf || (uint8_t *)_arena_big >= _arena_buf + UWEB_ARENA_LEN);
+    TEST_CHECK_EQ(ctx.arena.used, 0);
+    TEST_CHECK(ctx.arena.blocks == 0);
+
+    // more than can be had
+    memset(&req, 0, sizeof(req));
+    req.ctx = &ctx;
+    req.arena = &ctx.arena;
+    TEST_CHECK(UWEB_req_alloc(&req, 0x80000000UL) == 0);
+    TEST_CHECK(UWEB_req_alloc(&req, 0xffffffffUL) == 0);
+    TEST_CHECK_EQ(ctx.arena.used, 0);
+    UWEB_ctx_close(&ctx);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+#if UWEB_CFG_SLAB
+  TEST(buffer_pool)
+  {
+    static uweb_ctx ctx;
+    uweb_slab_stats base[_UWEB_SLAB_COUNT];
+    uweb_slab_stats st[_UWEB_SLAB_COUNT];
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    UWEB_slab_stats(base);
+    UWEB_ctx_init(&ctx, uweb_response_fn, uweb_data_fn);
+
+    // a keep-alive connection between requests holds no buffers
+    _response_stream = make_char_stream(&stream[2], "Hello world!");
+    make_char_stream(&stream[0],
+        "GET / HTTP/1.1\r\n"
+        "\r\n");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    _response_buffer[_response_buffer_ix] = 0;
+    TEST_CHECK(strstr(_response_buffer, "Hello world!") != 0);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_IDLE);
+    TEST_CHECK(ctx.rx_buf == 0 && ctx.req_buf == 0 && ctx.tx_buf == 0);
+    UWEB_slab_stats(st);
+    TEST_CHECK_EQ(st[UWEB_SLAB_TX].in_use, base[UWEB_SLAB_TX].in_use);
+    TEST_CHECK_EQ(st[UWEB_SLAB_REQ].in_use, base[UWEB_SLAB_REQ].in_use);
+    TEST_CHECK(st[UWEB_SLAB_TX].high > base[UWEB_SLAB_TX].in_use);
+    TEST_CHECK_EQ(st[UWEB_SLAB_TX].size, UWEB_TX_MAX_LEN);
+    TEST_CHECK_EQ(st[UWEB_SLAB_TX].total % UWEB_SLAB_GROW, 0);
+
+    // half a request line is kept until the rest arrives
+    make_printf_stream(pri_str);
+    make_char_stream(&stream[0], "GET /ind");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    TEST_CHECK(ctx.req_buf != 0);
+    TEST_CHECK(ctx.tx_buf == 0);
+    UWEB_slab_stats(st);
+    TEST_CHECK_EQ(st[UWEB_SLAB_REQ].in_use, base[UWEB_SLAB_REQ].in_use + 1);
+    _response_stream = make_char_stream(&stream[2], "Hello world!");
+    make_char_stream(&stream[0],
+        "ex HTTP/1.1\r\n"
+        "\r\n");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    _response_buffer[_response_buffer_ix] = 0;
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 200 OK\r\n") == (char *)_response_buffer);
+    TEST_CHECK(ctx.req_buf == 0);
+
+    // given back when the connection closes mid request
+    make_char_stream(&stream[0], "GET /ind");
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    TEST_CHECK(ctx.req_buf != 0);
+    UWEB_ctx_close(&ctx);
+    TEST_CHECK(ctx.req_buf == 0);
+    UWEB_slab_stats(st);
+    TEST_CHECK_EQ(st[UWEB_SLAB_REQ].in_use, base[UWEB_SLAB_REQ].in_use);
+    TEST_CHECK_EQ(st[UWEB_SLAB_RX].in_use, base[UWEB_SLAB_RX].in_use);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+#if UWEB_CFG_WEBSOCKET
+  static uint32_t _ws_msgs;
+  static uint32_t _ws_close_code;
+
+  static uweb_response ws_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+    if (req->websocket) return UWEB_WEBSOCKET;
+    return uweb_response_fn(req, res, http_status, content_type, extra_headers);
+  }
+
+  static void ws_data_fn(uweb_request_header *req, uweb_data_type type, uint32_t offset, uint8_t *data, uint32_t length) {
+    if (type == DATA_WS_CLOSE) {
+      _ws_close_code = offset;
+      return;
+    }
+    if ((type == DATA_WS_TEXT || type == DATA_WS_BINARY) && length == 0) _ws_msgs++;
+    uweb_data_fn(req, type, offset, data, length);
+  }
+
+  // client frame, masked
+  static uint32_t ws_frame(uint8_t *dst, uint8_t b0, const uint8_t *payload, uint32_t len) {
+    static const uint8_t mask[4] = { 0x37, 0xfa, 0x21, 0x3d };
+    uint32_t i, hlen = 2;
+    dst[0] = b0;
+    if (len < 126) {
+      dst[1] = 0x80 | len;
+    } else {
+      dst[1] = 0x80 | 126;
+      dst[2] = len >> 8;
+      dst[3] = len;
+      hlen = 4;
+    }
+    memcpy(&dst[hlen], mask, 4);
+    hlen += 4;
+    for (i = 0; i < len; i++) dst[hlen + i] = payload[i] ^ mask[i & 3];
+    return hlen + len;
+  }
+
+  static const char *WS_REQ_TXT =
+      "GET /chat HTTP/1.1\r\n"
+      "Host: server.example.com\r\n"
+      "Upgrade: websocket\r\n"
+      "Connection: Upgrade\r\n"
+      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+      "Sec-WebSocket-Version: 13\r\n"
+      "\r\n";
+
+  TEST(websocket)
+  {
+    static const uint8_t RFC_HELLO[] = { 0x81, 0x85, 0x37, 0xfa, 0x21, 0x3d, 0x7f, 0x9f, 0x4d, 0x51, 0x58 };
+    static const uint8_t PONG[] = { 0x8a, 0x04, 'p', 'i', 'n', 'g' };
+    static const uint8_t CLOSE_NORMAL[] = { 0x88, 0x02, 0x03, 0xe8 };
+    static const uint8_t CLOSE_PROTOCOL[] = { 0x88, 0x02, 0x03, 0xea };
+    static uint8_t req[2048];
+    static uint8_t big[300];
+    uint32_t i, len, hdr_len;
+    _ws_msgs = 0;
+    _ws_close_code = 0;
+    for (i = 0; i < sizeof(big); i++) big[i] = i;
+    UWEB_init(ws_response_fn, ws_data_fn);
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+
+    len = strlen(WS_REQ_TXT);
+    memcpy(req, WS_REQ_TXT, len);
+    len += ws_frame(&req[len], 0x81, (const uint8_t *)"Hello", 5);
+    TEST_CHECK(memcmp(&req[len - sizeof(RFC_HELLO)], RFC_HELLO, sizeof(RFC_HELLO)) == 0);
+    // fragmented, with a ping in between
+    len += ws_frame(&req[len], 0x01, (const uint8_t *)"Hel", 3);
+    len += ws_frame(&req[len], 0x89, (const uint8_t *)"ping", 4);
+    len += ws_frame(&req[len], 0x80, (const uint8_t *)"lo", 2);
+    len += ws_frame(&req[len], 0x82, big, sizeof(big));
+    // in odd fragments, unmasking restarts at all mask offsets
+    make_frag_stream(&stream[0], "", 7);
+    stream[0].user = req;
+    stream[0].total_sz = stream[0].avail_sz = len;
+    UWEB_parse(&stream[0], pri_str);
+
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 101 Switching Protocols\r\n") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, "\r\nSec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != 0);
+    hdr_len = (uint8_t *)strstr(_response_buffer, "\r\n\r\n") + 4 - _response_buffer;
+    TEST_CHECK_EQ(_response_buffer_ix, hdr_len + sizeof(PONG));
+    TEST_CHECK(memcmp(&_response_buffer[hdr_len], PONG, sizeof(PONG)) == 0);
+    TEST_CHECK_EQ(_ws_msgs, 3);
+    TEST_CHECK_EQ(_data_buffer_ix, 10 + sizeof(big));
+    TEST_CHECK(memcmp(_data_buffer, "HelloHello", 10) == 0);
+    TEST_CHECK(memcmp(&_data_buffer[10], big, sizeof(big)) == 0);
+
+    // close is answered
+    len = ws_frame(req, 0x88, &CLOSE_NORMAL[2], 2);
+    make_frag_stream(&stream[0], "", len);
+    stream[0].user = req;
+    stream[0].total_sz = stream[0].avail_sz = len;
+    make_printf_stream(&stream[1]);
+    UWEB_parse(&stream[0], pri_str);
+    TEST_CHECK_EQ(_ws_close_code, 1000);
+    TEST_CHECK_EQ(_response_buffer_ix, sizeof(CLOSE_NORMAL));
+    TEST_CHECK(memcmp(_response_buffer, CLOSE_NORMAL, sizeof(CLOSE_NORMAL)) == 0);
+
+    // unmasked client frame is a protocol error
+    len = strlen(WS_REQ_TXT);
+    memcpy(req, WS_REQ_TXT, len);
+    memcpy(&req[len], "\x81\x02hi", 4);
+    len += 4;
+    make_frag_stream(&stream[0], "", len);
+    stream[0].user = req;
+    stream[0].total_sz = stream[0].avail_sz = len;
+    make_printf_stream(&stream[1]);
+    UWEB_parse(&stream[0], pri_str);
+    hdr_len = (uint8_t *)strstr(_response_buffer, "\r\n\r\n") + 4 - _response_buffer;
+    TEST_CHECK(memcmp(&_response_buffer[hdr_len], CLOSE_PROTOCOL, sizeof(CLOSE_PROTOCOL)) == 0);
+    TEST_CHECK_EQ(_ws_msgs, 3);
+
+    // close with a one byte status is a protocol error
+    len = strlen(WS_REQ_TXT);
+    memcpy(req, WS_REQ_TXT, len);
+    len += ws_frame(&req[len], 0x88, (const uint8_t *)"x", 1);
+    make_frag_stream(&stream[0], "", len);
+    stream[0].user = req;
+    stream[0].total_sz = stream[0].avail_sz = len;
+    make_printf_stream(&stream[1]);
+    UWEB_parse(&stream[0], pri_str);
+    hdr_len = (uint8_t *)strstr(_response_buffer, "\r\n\r\n") + 4 - _response_buffer;
+    TEST_CHECK(memcmp(&_response_buffer[hdr_len], CLOSE_PROTOCOL, sizeof(CLOSE_PROTOCOL)) == 0);
+    TEST_CHECK_EQ(_ws_close_code, UWEB_WS_CLOSE_PROTOCOL_ERROR);
+
+    // other versions are told to use 13
+    len = strstr(WS_REQ_TXT, "13\r\n") - WS_REQ_TXT;
+    memcpy(req, WS_REQ_TXT, len);
+    strcpy((char *)&req[len], "8\r\n\r\n");
+    UWEB_parse(make_char_stream(&stream[0], (const char *)req), make_printf_stream(&stream[1]));
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 426 Upgrade Required\r\n") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, "\r\nSec-WebSocket-Version: 13\r\n") != 0);
+    // and an upgrade needs Connection: Upgrade
+    len = strstr(WS_REQ_TXT, "Connection: ") - WS_REQ_TXT;
+    memcpy(req, WS_REQ_TXT, len);
+    strcpy((char *)&req[len], strstr(WS_REQ_TXT, "Sec-WebSocket-Key"));
+    UWEB_parse(make_char_stream(&stream[0], (const char *)req), make_printf_stream(&stream[1]));
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 400 ") == (char *)_response_buffer);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+#if UWEB_CFG_HTTP2
+  static char _h2_host[UWEB_MAX_HOST_LEN];
+  static uint32_t _h2_streams;
+
+  static uweb_response h2_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+    strcpy(_h2_host, req->host);
+    _h2_streams += req->stream_id;
+    _response_stream = make_char_stream(&stream[2], "Hello world!");
+    return uweb_response_fn(req, res, http_status, content_type, extra_headers);
+  }
+
+  static uint32_t h2_frame(uint8_t *dst, uint8_t type, uint8_t flags, uint32_t id, const uint8_t *payload, uint32_t len) {
+    dst[0] = len >> 16;
+    dst[1] = len >> 8;
+    dst[2] = len;
+    dst[3] = type;
+    dst[4] = flags;
+    dst[5] = id >> 24;
+    dst[6] = id >> 16;
+    dst[7] = id >> 8;
+    dst[8] = id;
+    memcpy(&dst[9], payload, len);
+    return 9 + len;
+  }
+
+  // checks next response frame and returns its payload
+  static uint8_t *h2_next(uint32_t *ix, uint8_t type, uint8_t flags, uint32_t id, uint32_t *len) {
+    uint8_t *f = &_response_buffer[*ix];
+    *len = (f[0] << 16) | (f[1] << 8) | f[2];
+    if (*ix + 9 + *len > _response_buffer_ix || f[3] != type || f[4] != flags ||
+        (uint32_t)((f[5] << 24) | (f[6] << 16) | (f[7] << 8) | f[8]) != id) {
+      return 0;
+    }
+    *ix += 9 + *len;
+    return &f[9];
+  }
+
+  TEST(http2)
+  {
+    // RFC 7541 C.4.1 and C.4.2, huffman coded, second one refers to the
+    // dynamic table entry added by the first
+    static const uint8_t REQ1[] = {
+      0x82, 0x86, 0x84, 0x41, 0x8c, 0xf1, 0xe3, 0xc2, 0xe5, 0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff
+    };
+    static const uint8_t REQ2[] = { 0x82, 0x86, 0x84, 0xbe, 0x58, 0x86, 0xa8, 0xeb, 0x10, 0x64, 0x9c, 0xbf };
+    // POST /, content-length 3, authority now second in the dynamic table
+    static const uint8_t REQ3[] = { 0x83, 0x86, 0x84, 0xbf, 0x0f, 0x0d, 0x01, '3' };
+    static const uint8_t PING[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    static uweb_ctx ctx;
+    static uint8_t req[512];
+    uint8_t *p;
+    uint32_t len, ix;
+    _h2_streams = 0;
+    UWEB_ctx_init(&ctx, h2_response_fn, uweb_data_fn);
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+
+    len = strlen(UWEB_H2_PREFACE);
+    memcpy(req, UWEB_H2_PREFACE, len);
+    len += h2_frame(&req[len], H2_SETTINGS, 0, 0, 0, 0);
+    len += h2_frame(&req[len], H2_HEADERS, 0x05, 1, REQ1, sizeof(REQ1));
+    len += h2_frame(&req[len], H2_HEADERS, 0x05, 3, REQ2, sizeof(REQ2));
+    len += h2_frame(&req[len], H2_HEADERS, 0x04, 5, REQ3, sizeof(REQ3));
+    len += h2_frame(&req[len], H2_PING, 0, 0, PING, sizeof(PING));
+    len += h2_frame(&req[len], H2_DATA, 0x01, 5, (const uint8_t *)"abc", 3);
+    make_frag_stream(&stream[0], "", 7);
+    stream[0].user = req;
+    stream[0].total_sz = stream[0].avail_sz = len;
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+
+    TEST_CHECK_EQ(_h2_streams, 1 + 3 + 5);
+    TEST_CHECK(strcmp(_h2_host, "www.example.com") == 0);
+    TEST_CHECK_EQ(_data_buffer_ix, 3);
+    TEST_CHECK(memcmp(_data_buffer, "abc", 3) == 0);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_IDLE);
+
+    ix = 0;
+    TEST_CHECK(h2_next(&ix, H2_SETTINGS, 0, 0, &len) != 0);
+    TEST_CHECK(h2_next(&ix, H2_SETTINGS, 0x01, 0, &len) != 0);
+    for (uint32_t id = 1; id <= 5; id += 2) {
+      // :status 200 from the static table
+      p = h2_next(&ix, H2_HEADERS, 0x04, id, &len);
+      TEST_CHECK(p != 0 && p[0] == 0x88);
+      p = h2_next(&ix, H2_DATA, 0x01, id, &len);
+      TEST_CHECK(p != 0 && len == 12 && memcmp(p, "Hello world!", 12) == 0);
+    }
+    p = h2_next(&ix, H2_PING, 0x01, 0, &len);
+    TEST_CHECK(p != 0 && memcmp(p, PING, 8) == 0);
+    TEST_CHECK_EQ(ix, _response_buffer_ix);
+
+    // ping on a stream is a connection error
+    len = h2_frame(req, H2_PING, 0, 1, PING, sizeof(PING));
+    make_frag_stream(&stream[0], "", len);
+    stream[0].user = req;
+    stream[0].total_sz = stream[0].avail_sz = len;
+    make_printf_stream(&stream[1]);
+    UWEB_ctx_parse(&ctx, &stream[0], pri_str);
+    ix = 0;
+    p = h2_next(&ix, H2_GOAWAY, 0, 0, &len);
+    TEST_CHECK(p != 0 && len == 8 && p[3] == 5 && p[7] == H2_PROTOCOL_ERROR);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_CLOSING);
+    return TEST_RES_OK;
+  } TEST_END
+
+  static void h2_feed(uweb_ctx *ctx, uint8_t *req, uint32_t len) {
+    make_frag_stream(&stream[0], "", 5);
+    stream[0].user = req;
+    stream[0].total_sz = stream[0].avail_sz = len;
+    UWEB_ctx_parse(ctx, &stream[0], make_printf_stream(&stream[1]));
+  }
+
+  TEST(http2_streams)
+  {
+    static const uint8_t WINDOW_5[] = { 0, 4, 0, 0, 0, 5 };
+    static const uint8_t WINDOW_64K[] = { 0, 4, 0, 0, 0xff, 0xff };
+    static const uint8_t INC_7[] = { 0, 0, 0, 7 };
+    static const uint8_t CANCEL[] = { 0, 0, 0, H2_CANCEL };
+    // GET /, authority x added to the dynamic table
+    static const uint8_t GET[] = { 0x82, 0x86, 0x84, 0x41, 0x01, 'x' };
+    // padded, continued by GET_END referring to authority x
+    static const uint8_t GET_PADDED[] = { 2, 0x82, 0x86, 0, 0 };
+    static const uint8_t GET_END[] = { 0x84, 0xbe };
+    static const uint8_t POST[] = { 0x83, 0x86, 0x84, 0xbe };
+    // resizes the table to 100, adding x-a: 1 and x-b: 2 evicts the rest
+    static const uint8_t EVICT[] = {
+      0x3f, 0x45, 0x40, 0x03, 'x', '-', 'a', 0x01, '1', 0x40, 0x03, 'x', '-', 'b', 0x01, '2', 0x82, 0x86, 0x84
+    };
+    static uweb_ctx ctx;
+    static uint8_t req[2048];
+    uint8_t *p;
+    uint32_t len, ix, id;
+    _h2_streams = 0;
+    UWEB_ctx_init(&ctx, h2_response_fn, uweb_data_fn);
+
+    // stream window of 5 holds the body back until WINDOW_UPDATE
+    len = strlen(UWEB_H2_PREFACE);
+    memcpy(req, UWEB_H2_PREFACE, len);
+    len += h2_frame(&req[len], H2_SETTINGS, 0, 0, WINDOW_5, sizeof(WINDOW_5));
+    len += h2_frame(&req[len], H2_HEADERS, 0x05, 1, GET, sizeof(GET));
+    h2_feed(&ctx, req, len);
+    ix = 0;
+    TEST_CHECK(h2_next(&ix, H2_SETTINGS, 0, 0, &len) != 0);
+    TEST_CHECK(h2_next(&ix, H2_SETTINGS, 0x01, 0, &len) != 0);
+    TEST_CHECK(h2_next(&ix, H2_HEADERS, 0x04, 1, &len) != 0);
+    p = h2_next(&ix, H2_DATA, 0, 1, &len);
+    TEST_CHECK(p != 0 && len == 5 && memcmp(p, "Hello", 5) == 0);
+    TEST_CHECK_EQ(ix, _response_buffer_ix);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_BODY);
+    len = h2_frame(req, H2_WINDOW_UPDATE, 0, 1, INC_7, sizeof(INC_7));
+    h2_feed(&ctx, req, len);
+    ix = 0;
+    p = h2_next(&ix, H2_DATA, 0x01, 1, &len);
+    TEST_CHECK(p != 0 && len == 7 && memcmp(p, " world!", 7) == 0);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_IDLE);
+
+    // padded HEADERS continued by CONTINUATION
+    len = h2_frame(req, H2_SETTINGS, 0, 0, WINDOW_64K, sizeof(WINDOW_64K));
+    len += h2_frame(&req[len], H2_HEADERS, 0x09, 3, GET_PADDED, sizeof(GET_PADDED));
+    len += h2_frame(&req[len], H2_CONTINUATION, 0x04, 3, GET_END, sizeof(GET_END));
+    _h2_host[0] = 0;
+    h2_feed(&ctx, req, len);
+    TEST_CHECK_EQ(_h2_streams, 1 + 3);
+    TEST_CHECK(strcmp(_h2_host, "x") == 0);
+    ix = 0;
+    TEST_CHECK(h2_next(&ix, H2_SETTINGS, 0x01, 0, &len) != 0);
+    TEST_CHECK(h2_next(&ix, H2_HEADERS, 0x04, 3, &len) != 0);
+    p = h2_next(&ix, H2_DATA, 0x01, 3, &len);
+    TEST_CHECK(p != 0 && len == 12);
+
+    // answered streams stay open until the client ends them, one more
+    // than UWEB_H2_MAX_STREAMS is refused
+    len = 0;
+    for (id = 5; id < 5 + 2 * (UWEB_H2_MAX_STREAMS + 1); id += 2) {
+      len += h2_frame(&req[len], H2_HEADERS, 0x04, id, POST, sizeof(POST));
+    }
+    h2_feed(&ctx, req, len);
+    ix = 0;
+    for (id = 5; id < 5 + 2 * UWEB_H2_MAX_STREAMS; id += 2) {
+      TEST_CHECK(h2_next(&ix, H2_HEADERS, 0x04, id, &len) != 0);
+      TEST_CHECK(h2_next(&ix, H2_DATA, 0x01, id, &len) != 0);
+    }
+    p = h2_next(&ix, H2_RST_STREAM, 0, id, &len);
+    TEST_CHECK(p != 0 && p[3] == H2_REFUSED_STREAM);
+    TEST_CHECK_EQ(_uweb_h2_open_streams(&ctx), UWEB_H2_MAX_STREAMS);
+    len = 0;
+    for (id = 5; id < 5 + 2 * UWEB_H2_MAX_STREAMS; id += 2) {
+      len += h2_frame(&req[len], H2_RST_STREAM, 0, id, CANCEL, sizeof(CANCEL));
+    }
+    h2_feed(&ctx, req, len);
+    TEST_CHECK_EQ(_response_buffer_ix, 0);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_IDLE);
+
+    // a value too long to keep is answered 431, the table keeps its size
+    id += 2;
+    len = 9 + 2 + UWEB_H2_FIELD_LEN + 1;
+    memcpy(&req[9], "\x82\x86\x84\x40\x03x-c\x7f", 9);
+    req[9 + 9] = ((UWEB_H2_FIELD_LEN + 1 - 127) & 0x7f) | 0x80;
+    req[9 + 10] = (UWEB_H2_FIELD_LEN + 1 - 127) >> 7;
+    memset(&req[9 + 11], 'v', UWEB_H2_FIELD_LEN + 1);
+    h2_frame(req, H2_HEADERS, 0x05, id, &req[9], len);
+    h2_feed(&ctx, req, 9 + len);
+    ix = 0;
+    p = h2_next(&ix, H2_HEADERS, 0x04, id, &len);
+    TEST_CHECK(p != 0 && memcmp(p, "\x08\x03" "431", 5) == 0);
+    TEST_CHECK_EQ(ctx.h2->hpack.count, 2);
+    TEST_CHECK_EQ(ctx.h2->hpack.size, 43 + 32 + 3 + UWEB_H2_FIELD_LEN + 1);
+
+    // shrinking the table and adding evicts the oldest entries
+    id += 2;
+    len = h2_frame(req, H2_HEADERS, 0x05, id, EVICT, sizeof(EVICT));
+    h2_feed(&ctx, req, len);
+    TEST_CHECK_EQ(ctx.h2->hpack.count, 2);
+    TEST_CHECK_EQ(ctx.h2->hpack.size, 36 + 36);
+    ix = 0;
+    p = h2_next(&ix, H2_HEADERS, 0x04, id, &len);
+    TEST_CHECK(p != 0 && p[0] == 0x88);
+    return TEST_RES_OK;
+  } TEST_END
+
+  static uint32_t _h2_res_closed;
+
+  static void h2_res_close(UW_STREAM str) {
+    _h2_res_closed++;
+  }
+
+  // answers with a stream counting its close
+  static uweb_response h2_close_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+    _response_stream = make_char_stream(&stream[2], "Hello world!");
+    stream[2].close = h2_res_close;
+    return uweb_response_fn(req, res, http_status, content_type, extra_headers);
+  }
+
+  TEST(http2_close)
+  {
+    static const uint8_t WINDOW_5[] = { 0, 4, 0, 0, 0, 5 };
+    static const uint8_t GET[] = { 0x82, 0x86, 0x84, 0x41, 0x01, 'x' };
+    static const uint8_t NO_ERROR[8] = { 0 };
+    static const uint8_t PING[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    static uweb_ctx ctx;
+    static uint8_t req[512];
+    uint32_t len, pre, round;
+
+    // a response held back by the stream window is closed however the
+    // connection ends: closed by the server, GOAWAY, connection error
+    for (round = 0; round < 3; round++) {
+      UWEB_ctx_init(&ctx, h2_close_response_fn, uweb_data_fn);
+      len = strlen(UWEB_H2_PREFACE);
+      memcpy(req, UWEB_H2_PREFACE, len);
+      len += h2_frame(&req[len], H2_SETTINGS, 0, 0, WINDOW_5, sizeof(WINDOW_5));
+      len += h2_frame(&req[len], H2_HEADERS, 0x05, 1, GET, sizeof(GET));
+      _h2_res_closed = 0;
+      h2_feed(&ctx, req, len);
+      TEST_CHECK_EQ(_uweb_h2_open_streams(&ctx), 1);
+      TEST_CHECK_EQ(_h2_res_closed, 0);
+      pre = _response_closed;
+      if (round == 0) {
+        UWEB_ctx_close(&ctx);
+      } else if (round == 1) {
+        len = h2_frame(req, H2_GOAWAY, 0, 0, NO_ERROR, sizeof(NO_ERROR));
+        h2_feed(&ctx, req, len);
+        TEST_CHECK_EQ(_response_closed, pre + 1);
+      } else {
+        len = h2_frame(req, H2_PING, 0, 1, PING, sizeof(PING));
+        h2_feed(&ctx, req, len);
+        TEST_CHECK_EQ(_response_closed, pre + 1);
+      }
+      TEST_CHECK_EQ(_h2_res_closed, 1);
+      TEST_CHECK_EQ(_uweb_h2_open_streams(&ctx), 0);
+      UWEB_ctx_close(&ctx);
+      TEST_CHECK_EQ(_h2_res_closed, 1);
+    }
+    return TEST_RES_OK;
+  } TEST_END
+
+  TEST(http2_upgrade)
+  {
+    // HTTP2-Settings holds initial window 5
+    static const char UPGRADE[] =
+      "GET / HTTP/1.1\r\n"
+      "Host: x\r\n"
+      "Connection: Upgrade, HTTP2-Settings\r\n"
+      "Upgrade: H2C\r\n"
+      "HTTP2-Settings: AAQAAAAF\r\n"
+      "\r\n";
+    static uweb_ctx ctx;
+    static uint8_t req[512];
+    uint8_t *p;
+    uint32_t len, ix;
+    _h2_streams = 0;
+    UWEB_ctx_init(&ctx, h2_response_fn, uweb_data_fn);
+
+    len = strlen(UPGRADE);
+    memcpy(req, UPGRADE, len);
+    memcpy(&req[len], UWEB_H2_PREFACE, strlen(UWEB_H2_PREFACE));
+    len += strlen(UWEB_H2_PREFACE);
+    len += h2_frame(&req[len], H2_SETTINGS, 0, 0, 0, 0);
+    h2_feed(&ctx, req, len);
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 101 Switching Protocols\r\n") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, "\r\nUpgrade: h2c\r\n") != 0);
+    ix = (uint8_t *)strstr(_response_buffer, "\r\n\r\n") + 4 - _response_buffer;
+    // the upgrading request is answered on stream 1, within its window
+    TEST_CHECK(h2_next(&ix, H2_SETTINGS, 0, 0, &len) != 0);
+    TEST_CHECK(h2_next(&ix, H2_HEADERS, 0x04, 1, &len) != 0);
+    p = h2_next(&ix, H2_DATA, 0, 1, &len);
+    TEST_CHECK(p != 0 && len == 5);
+    TEST_CHECK(h2_next(&ix, H2_SETTINGS, 0x01, 0, &len) != 0);
+    TEST_CHECK_EQ(ix, _response_buffer_ix);
+    TEST_CHECK_EQ(_h2_streams, 1);
+    UWEB_ctx_close(&ctx);
+
+    // without HTTP2-Settings it stays HTTP/1.1
+    UWEB_ctx_init(&ctx, h2_response_fn, uweb_data_fn);
+    len = strstr(UPGRADE, "HTTP2-Settings: ") - UPGRADE;
+    memcpy(req, UPGRADE, len);
+    memcpy(&req[len], "\r\n", 2);
+    h2_feed(&ctx, req, len + 2);
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 200 OK\r\n") == (char *)_response_buffer);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+#if !UWEB_CFG_CHUNKED_REQ
+  TEST(disabled_feature)
+  {
+    UW_STREAM req_str = make_char_stream(&stream[0],
+      "POST /sensor HTTP/1.1\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "\r\n"
+      "5\r\n"
+      "Hello\r\n"
+      "0\r\n"
+      "\r\n");
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    UW_STREAM res_str = make_char_stream(&stream[2], "Hello world!");
+    _response_stream = res_str;
+    _data_calls = 0;
+    UWEB_init(uweb_response_fn, uweb_data_fn);
+    memset(_response_buffer, 0, sizeof(_response_buffer));
+    UWEB_parse(req_str, pri_str);
+    // compiled out features are refused, not misparsed
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 501 ") == (char *)_response_buffer);
+    TEST_CHECK_EQ(_response_closed, 1);
+    TEST_CHECK_EQ(_data_calls, 0);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+  TEST(shed_request)
+  {
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+#if UWEB_CFG_METRICS
+    UWEB_metrics_reset();
+#endif
+    UWEB_shed(pri_str, UWEB_SHED_REQUESTS);
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 503 Service Unavailable\r\n") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, "\r\nRetry-After: 1\r\n") != 0);
+#if UWEB_CFG_METRICS
+    uweb_metrics_block m;
+    UWEB_metrics_get(&m);
+    TEST_CHECK_EQ((int)m.counter[UWEB_CNT_SHED_REQUESTS], 1);
+    TEST_CHECK_EQ((int)m.counter[UWEB_CNT_SHED_CONNECTIONS], 0);
+    TEST_CHECK_EQ((int)m.resp_status[S503_SERVICE_UNAVAILABLE], 1);
+#endif
+    return TEST_RES_OK;
+  } TEST_END
+
+  static uint32_t _timer_fired;
+  static uint32_t _timer_late;
+  static void timer_fn(uweb_timer *t, void *arg) {
+    uweb_timer_wheel *w = (uweb_timer_wheel *)arg;
+    if (w->now != t->expires) _timer_late++;
+    _timer_fired++;
+  }
+
+  TEST(timer_wheel)
+  {
+    static uweb_timer_wheel w;
+    static uweb_timer t[1000];
+    uint32_t i, cancelled = 0;
+    uint64_t now = 12345;
+    _timer_fired = 0;
+    _timer_late = 0;
+    timer_wheel_init(&w, now);
+    srand(1);
+    for (i = 0; i < 1000; i++) {
+      timer_init(&t[i]);
+      // spread over all levels
+      timer_arm(&w, &t[i], now + 1 + (rand() % (1 << (2 + (i % 4) * 6))));
+    }
+    for (i = 0; i < 1000; i += 3) {
+      timer_cancel(&t[i]);
+      cancelled++;
+    }
+    // rearming moves timer
+    timer_arm(&w, &t[1], now + 5);
+    while (w.now < now + (1 << 20)) {
+      timer_wheel_advance(&w, w.now + 1 + rand() % 50, timer_fn, &w);
+    }
+    TEST_CHECK_EQ(_timer_fired, 1000 - cancelled);
+    TEST_CHECK_EQ(_timer_late, 0);
+    for (i = 0; i < 1000; i++) {
+      TEST_CHECK(!timer_armed(&t[i]));
+    }
+    return TEST_RES_OK;
+  } TEST_END
+
+#if UWEB_CFG_COALESCE
+  static uint32_t _out_writes;
+  static uint32_t _out_writes_at_resp;
+
+  static int32_t countstr_write(UW_STREAM str, uint8_t *src, uint32_t len) {
+    _out_writes++;
+    return prstr_write(str, src, len);
+  }
+
+  static uweb_response coalesce_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+    _out_writes_at_resp = _out_writes;
+    return uweb_response_fn(req, res, http_status, content_type, extra_headers);
+  }
+
+  TEST(output_coalescing)
+  {
+    static uweb_ctx ctx;
+    static uweb_data_stream big;
+    static char big_data[UWEB_COALESCE_LEN + 100];
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    pri_str->write = countstr_write;
+    UWEB_ctx_init(&ctx, coalesce_response_fn, uweb_data_fn);
+
+    // header, chunk size lines, data and last chunk in one write, chunks
+    // as they were
+    _out_writes = 0;
+    _response_chunk_bytes = 5;
+    _response_stream = make_char_stream(&stream[2], "Hello world!");
+    UWEB_ctx_parse(&ctx, make_char_stream(&stream[0], "GET / HTTP/1.1\r\n\r\n"), pri_str);
+    TEST_CHECK_EQ(strcmp(_response_buffer,
+     "HTTP/1.1 200 OK\r\n"
+     "Server: uWeb\r\n"
+     "Content-Type: text/html; charset=utf-8\r\n"
+     "Transfer-Encoding: chunked\r\n"
+     "\r\n"
+     "5; chunk 0\r\n"
+     "Hello\r\n"
+     "5; chunk 1\r\n"
+     " worl\r\n"
+     "2; chunk 2\r\n"
+     "d!\r\n"
+     "0\r\n\r\n"), 0);
+    TEST_CHECK_EQ(_out_writes, 1);
+    _response_chunk_bytes = 0;
+
+    // pipelined, each response written when done
+    make_printf_stream(pri_str);
+    pri_str->write = countstr_write;
+    memset(_response_buffer, 0, sizeof(_response_buffer));
+    _out_writes = 0;
+    _response_stream = make_char_stream(&stream[2], "Hello world!");
+    UWEB_ctx_parse(&ctx, make_char_stream(&stream[0],
+        "GET / HTTP/1.1\r\n\r\n"
+        "GET / HTTP/1.1\r\n\r\n"), pri_str);
+    TEST_CHECK_EQ(_out_writes, 2);
+    TEST_CHECK_EQ(_out_writes_at_resp, 1);
+
+    // a payload as big as the buffer goes straight after what is collected
+    make_printf_stream(pri_str);
+    pri_str->write = countstr_write;
+    memset(_response_buffer, 0, sizeof(_response_buffer));
+    memset(big_data, 'x', sizeof(big_data));
+    _out_writes = 0;
+    _response_stream = UWEB_stream_mem(&big, big_data, sizeof(big_data));
+    UWEB_ctx_parse(&ctx, make_char_stream(&stream[0], "GET / HTTP/1.1\r\n\r\n"), pri_str);
+    TEST_CHECK_EQ(_out_writes, 2);
+    TEST_CHECK_EQ(_response_buffer_ix - (strstr(_response_buffer, "\r\n\r\n") + 4 - (char *)_response_buffer), sizeof(big_data));
+#if UWEB_CFG_SLAB
+    TEST_CHECK(ctx.out_buf == 0);
+#endif
+    UWEB_ctx_close(&ctx);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+#if UWEB_CFG_ASSETS
+  static uweb_data_stream _asset_str;
+
+  static uweb_response asset_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+    const uweb_asset *a = UWEB_asset_find(&uweb_web_assets, req->resource);
+    if (a) return UWEB_asset_serve(req, a, &_asset_str, res, http_status, content_type, extra_headers);
+    return uweb_response_fn(req, res, http_status, content_type, extra_headers);
+  }
+
+  static void asset_get(uweb_ctx *ctx, UW_STREAM pri_str, const char *request) {
+    make_printf_stream(pri_str);
+    memset(_response_buffer, 0, sizeof(_response_buffer));
+    UWEB_ctx_parse(ctx, make_char_stream(&stream[0], request), pri_str);
+  }
+
+  TEST(assets)
+  {
+    static uweb_ctx ctx;
+    static uint8_t file[4096];
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+    const uweb_asset *a;
+    char *body;
+    FILE *f = fopen("test_data/index.html", "rb");
+    TEST_CHECK(f != 0);
+    uint32_t flen = fread(file, 1, sizeof(file), f);
+    fclose(f);
+
+    // sorted index, queries and directories
+    a = UWEB_asset_find(&uweb_web_assets, "/index.html");
+    TEST_CHECK(a != 0);
+    TEST_CHECK_EQ(a->len, flen);
+    TEST_CHECK_EQ(memcmp(a->data, file, flen), 0);
+    TEST_CHECK(strcmp(a->mime, "text/html; charset=utf-8") == 0);
+    TEST_CHECK(UWEB_asset_find(&uweb_web_assets, "/") == a);
+    TEST_CHECK(UWEB_asset_find(&uweb_web_assets, "/?lang=en") == a);
+    TEST_CHECK(UWEB_asset_find(&uweb_web_assets, "/index.html?x") == a);
+    TEST_CHECK(UWEB_asset_find(&uweb_web_assets, "/favicon.ico") != 0);
+    TEST_CHECK(UWEB_asset_find(&uweb_web_assets, "/post.html") != 0);
+    TEST_CHECK(UWEB_asset_find(&uweb_web_assets, "/index.htm") == 0);
+    TEST_CHECK(UWEB_asset_find(&uweb_web_assets, "/zzz") == 0);
+    TEST_CHECK(UWEB_asset_find(&uweb_web_assets, "index.html") == 0);
+
+    // the prebuilt header and the file
+    UWEB_ctx_init(&ctx, asset_response_fn, uweb_data_fn);
+    asset_get(&ctx, pri_str, "GET / HTTP/1.1\r\n\r\n");
+    body = strstr(_response_buffer, "\r\n\r\n") + 4;
+    TEST_CHECK_EQ(body - (char *)_response_buffer, strlen(a->hdr) + 2);
+    TEST_CHECK_EQ(memcmp(_response_buffer, a->hdr, strlen(a->hdr)), 0);
+    TEST_CHECK(strstr(_response_buffer, "Content-Length: ") != 0);
+    TEST_CHECK(strstr(_response_buffer, a->etag) != 0);
+    TEST_CHECK_EQ(_response_buffer_ix, body - (char *)_response_buffer + flen);
+    TEST_CHECK_EQ(memcmp(body, file, flen), 0);
+
+    // gzip when taken and smaller
+    TEST_CHECK(a->gz_len > 0 && a->gz_len < a->len);
+    asset_get(&ctx, pri_str, "GET /index.html HTTP/1.1\r\nAccept-Encoding: gzip, deflate\r\n\r\n");
+    TEST_CHECK(strstr(_response_buffer, "Content-Encoding: gzip\r\n") != 0);
+    body = strstr(_response_buffer, "\r\n\r\n") + 4;
+    TEST_CHECK_EQ(_response_buffer_ix, body - (char *)_response_buffer + a->gz_len);
+    TEST_CHECK_EQ(memcmp(body, a->gz_data, a->gz_len), 0);
+
+    // not modified
+    char req[256];
+    sprintf(req, "GET /index.html HTTP/1.1\r\nIf-None-Match: %s\r\n\r\n", a->etag);
+    asset_get(&ctx, pri_str, req);
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 304 Not Modified\r\n") == (char *)_response_buffer);
+    TEST_CHECK(strstr(_response_buffer, a->etag) != 0);
+    TEST_CHECK_EQ(_response_buffer_ix, strlen(a->hdr_304) + 2);
+    asset_get(&ctx, pri_str, "GET /index.html HTTP/1.1\r\nIf-None-Match: \"other\"\r\n\r\n");
+    TEST_CHECK(strstr(_response_buffer, "HTTP/1.1 200 OK\r\n") == (char *)_response_buffer);
+
+    // head, and closing
+    asset_get(&ctx, pri_str, "HEAD / HTTP/1.1\r\n\r\n");
+    TEST_CHECK_EQ(_response_buffer_ix, strlen(a->hdr) + 2);
+    asset_get(&ctx, pri_str, "GET / HTTP/1.1\r\nConnection: close\r\n\r\n");
+    TEST_CHECK(strstr(_response_buffer, "Connection: close\r\n\r\n") != 0);
+    TEST_CHECK_EQ(UWEB_ctx_phase(&ctx), UWEB_PHASE_CLOSING);
+    UWEB_ctx_close(&ctx);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+#if UWEB_CFG_VHOST
+  static uweb_data_stream _vhost_str;
+  static uint32_t _vhost_data_len;
+
+  // answers with the site's name, kept in user
+  static uweb_response vhost_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+    const char *name = (const char *)req->site->user;
+    *res = UWEB_stream_mem(&_vhost_str, name, strlen(name));
+    return UWEB_OK;
+  }
+
+  static void vhost_data_fn(uweb_request_header *req, uweb_data_type type, uint32_t offset, uint8_t *data, uint32_t length) {
+    _vhost_data_len += length;
+  }
+
+  static void vhost_get(uweb_ctx *ctx, UW_STREAM pri_str, const char *request) {
+    make_printf_stream(pri_str);
+    memset(_response_buffer, 0, sizeof(_response_buffer));
+    UWEB_ctx_parse(ctx, make_char_stream(&stream[0], request), pri_str);
+  }
+
+  TEST(vhost)
+  {
+    static uweb_ctx ctx;
+    static const uweb_site sites[] = {
+      {.host = "device-a.local", .resp_f = vhost_response_fn, .root = "a", .user = "A"},
+      {.host = "device-b.local", .resp_f = vhost_response_fn, .root = "b", .user = "B"},
+      {.host = "api.example.com", .resp_f = vhost_response_fn, .data_f = vhost_data_fn, .user = "API"},
+      {.host = "[::1]", .resp_f = vhost_response_fn, .user = "LOOPBACK"},
+    };
+    static const uweb_site dflt = {.host = "", .resp_f = vhost_response_fn, .user = "DEFAULT"};
+    static const uweb_site dup[] = {{.host = "a"}, {.host = "A"}};
+    static const uweb_site *slots[16];
+    static uweb_vhosts vh;
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+
+    // laid out without collisions, port, case and trailing dot ignored
+    TEST_CHECK_EQ(UWEB_vhosts_init(&vh, dup, 2, slots, 16, &dflt), -1);
+    TEST_CHECK_EQ(UWEB_vhosts_init(&vh, sites, 4, slots, 2, &dflt), -1);
+    TEST_CHECK(UWEB_vhost_find(&vh, "device-a.local") == &dflt);
+    TEST_CHECK_EQ(UWEB_vhosts_init(&vh, sites, 4, slots, 16, &dflt), 0);
+    TEST_CHECK(vh.mask + 1 >= 4 && vh.mask + 1 <= 16);
+    TEST_CHECK(UWEB_vhost_find(&vh, "device-a.local") == &sites[0]);
+    TEST_CHECK(UWEB_vhost_find(&vh, "Device-A.Local:8080") == &sites[0]);
+    TEST_CHECK(UWEB_vhost_find(&vh, "device-b.local.") == &sites[1]);
+    TEST_CHECK(UWEB_vhost_find(&vh, "API.example.com:443") == &sites[2]);
+    TEST_CHECK(UWEB_vhost_find(&vh, "[::1]:8080") == &sites[3]);
+    TEST_CHECK(UWEB_vhost_find(&vh, "device-a.loca") == &dflt);
+    TEST_CHECK(UWEB_vhost_find(&vh, "device-a.locals") == &dflt);
+    TEST_CHECK(UWEB_vhost_find(&vh, "") == &dflt);
+
+    // each host to its site's functions
+    UWEB_ctx_init(&ctx, uweb_response_fn, uweb_data_fn);
+    UWEB_ctx_set_vhosts(&ctx, &vh);
+    vhost_get(&ctx, pri_str, "GET / HTTP/1.1\r\nHost: Device-B.local:80\r\n\r\n");
+    TEST_CHECK(strstr(_response_buffer, "\r\n\r\nB") != 0);
+    vhost_get(&ctx, pri_str, "GET / HTTP/1.1\r\nHost: device-a.local\r\n\r\n");
+    TEST_CHECK(strstr(_response_buffer, "\r\n\r\nA") != 0);
+    vhost_get(&ctx, pri_str, "GET / HTTP/1.1\r\nHost: elsewhere.org\r\n\r\n");
+    TEST_CHECK(strstr(_response_buffer, "\r\n\r\nDEFAULT") != 0);
+    vhost_get(&ctx, pri_str, "GET / HTTP/1.0\r\n\r\n");
+    TEST_CHECK(strstr(_response_buffer, "\r\n\r\nDEFAULT") != 0);
+    _vhost_data_len = 0;
+    vhost_get(&ctx, pri_str, "POST /api HTTP/1.1\r\nHost: api.example.com\r\nContent-Length: 5\r\n\r\nhello");
+    TEST_CHECK(strstr(_response_buffer, "\r\n\r\nAPI") != 0);
+    TEST_CHECK_EQ(_vhost_data_len, 5);
+    UWEB_ctx_close(&ctx);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
+
+  TEST(streams)
+  {
+    static uweb_data_stream str;
+    uint8_t buf[512];
+    UW_STREAM pri_str = make_printf_stream(&stream[1]);
+
+    // constant memory, seekable, served straight from its bytes
+    UWEB_stream_mem(&str, "Hello stream!", 13);
+    TEST_CHECK_EQ(str.total_sz, 13);
+    TEST_CHECK(str.flags & UWEB_STREAM_SEEKABLE);
+    TEST_CHECK_EQ(UWEB_stream_seek(&str, 6), 0);
+    TEST_CHECK_EQ(str.avail_sz, 7);
+    TEST_CHECK_EQ(str.read(&str, buf, sizeof(buf)), 7);
+    TEST_CHECK_EQ(memcmp(buf, "stream!", 7), 0);
+    TEST_CHECK_EQ(UWEB_stream_seek(&str, 14), -1);
+    str.flags &= ~UWEB_STREAM_SEEKABLE;
+    TEST_CHECK_EQ(UWEB_stream_seek(&str, 0), -1);
+    _response_stream = UWEB_stream_mem(&str, "Hello stream!", 13);
+    UWEB_parse(make_char_stream(&stream[0], "GET / HTTP/1.1\r\n\r\n"), pri_str);
+    TEST_CHECK(strstr(_response_buffer, "Content-Length: 13\r\n") != 0);
+    TEST_CHECK(strstr(_response_buffer, "\r\n\r\nHello stream!") != 0);
+    TEST_CHECK_EQ(str.rd_offs, 13);
+
+#if defined(UWEB_STREAM_REALLOC) && defined(UWEB_STREAM_FREE)
+    // growable buffer, freed by uweb when sent
+    {
+      int i;
+      TEST_CHECK(UWEB_stream_buf(&str, 0) != 0);
+      for (i = 0; i < 300; i++) buf[i] = 'a' + i % 26;
+      TEST_CHECK_EQ(str.write(&str, buf, 100), 100);
+      TEST_CHECK_EQ(str.write(&str, &buf[100], 200), 200);
+      TEST_CHECK_EQ(str.total_sz, 300);
+      TEST_CHECK_EQ(str.avail_sz, 300);
+      TEST_CHECK_EQ(memcmp(str.mem, buf, 300), 0);
+      _response_stream = &str;
+      make_printf_stream(pri_str);
+      memset(_response_buffer, 0, sizeof(_response_buffer));
+      UWEB_parse(make_char_stream(&stream[0], "GET / HTTP/1.1\r\n\r\n"), pri_str);
+      TEST_CHECK(strstr(_response_buffer, "Content-Length: 300\r\n") != 0);
+      TEST_CHECK_EQ(memcmp(strstr(_response_buffer, "\r\n\r\n") + 4, buf, 300), 0);
+      TEST_CHECK(str.mem == 0);
+    }
+#endif
+
+#if UWEB_CFG_STREAMS_POSIX
+    // memory mapped file
+    {
+      char path[] = "/tmp/uweb_streamXXXXXX";
+      int fd = mkstemp(path);
+      TEST_CHECK(fd >= 0);
+      TEST_CHECK_EQ(write(fd, "file contents", 13), 13);
+      close(fd);
+      TEST_CHECK(UWEB_stream_file(&str, path) != 0);
+      unlink(path);
+      TEST_CHECK_EQ(str.total_sz, 13);
+      TEST_CHECK_EQ(memcmp(str.mem, "file contents", 13), 0);
+      str.close(&str);
+      TEST_CHECK(str.mem == 0);
+#if UWEB_FILE_CACHE_ENTRIES
+      UWEB_file_cache_clear();
+#endif
+      TEST_CHECK(UWEB_stream_file(&str, path) == 0);
+    }
+
+    // pipe, read and spliced
+    {
+      int in[2], out[2];
+      TEST_CHECK_EQ(pipe(in), 0);
+      TEST_CHECK_EQ(pipe(out), 0);
+      TEST_CHECK_EQ(write(in[1], "piped", 5), 5);
+      UWEB_stream_pipe(&str, in[0]);
+      TEST_CHECK_EQ(str.total_sz, UWEB_UNKNONW_SZ);
+      TEST_CHECK_EQ(str.avail_sz, 5);
+      TEST_CHECK(str.flags & UWEB_STREAM_FD);
+      TEST_CHECK_EQ(UWEB_stream_splice(&str, out[1], sizeof(buf)), 5);
+      TEST_CHECK_EQ(str.avail_sz, 0);
+      TEST_CHECK_EQ(read(out[0], buf, sizeof(buf)), 5);
+      TEST_CHECK_EQ(memcmp(buf, "piped", 5), 0);
+      TEST_CHECK_EQ(write(in[1], "again", 5), 5);
+      TEST_CHECK_EQ(str.avail_sz, 0);
+      TEST_CHECK_EQ(str.read(&str, buf, 3), 3);
+      TEST_CHECK_EQ(str.avail_sz, 2);
+      close(in[0]);
+      close(in[1]);
+      close(out[0]);
+      close(out[1]);
+    }
+#endif
+    return TEST_RES_OK;
+  } TEST_END
+
+#if UWEB_CFG_STREAMS_POSIX && UWEB_FILE_CACHE_ENTRIES
+  TEST(file_cache)
+  {
+    char path[] = "/tmp/uweb_fcacheXXXXXX";
+    char next[] = "/tmp/uweb_fcacheXXXXXX";
+    uweb_data_stream a, b, c;
+    uint8_t buf[16];
+    int fds[2];
+    int fd = mkstemp(path);
+    TEST_CHECK(fd >= 0);
+    TEST_CHECK_EQ(write(fd, "first", 5), 5);
+    close(fd);
+
+    // opened once, shared
+    TEST_CHECK(UWEB_stream_file(&a, path) != 0);
+    TEST_CHECK(UWEB_stream_file(&b, path) != 0);
+    TEST_CHECK(a.mem == b.mem);
+    TEST_CHECK(a.user == b.user);
+    b.close(&b);
+
+    // replaced, the open stream keeps the old file
+    fd = mkstemp(next);
+    TEST_CHECK(fd >= 0);
+    TEST_CHECK_EQ(write(fd, "second!", 7), 7);
+    close(fd);
+    TEST_CHECK_EQ(rename(next, path), 0);
+    UWEB_file_cache_clear();
+    TEST_CHECK(UWEB_stream_file(&b, path) != 0);
+    TEST_CHECK_EQ(b.total_sz, 7);
+    TEST_CHECK_EQ(memcmp(b.mem, "second!", 7), 0);
+    TEST_CHECK(a.mem != b.mem);
+    TEST_CHECK_EQ(memcmp(a.mem, "first", 5), 0);
+    a.close(&a);
+    b.close(&b);
+
+    // too large to map, read and sent by offset
+    fd = open(path, O_WRONLY | O_TRUNC);
+    TEST_CHECK(fd >= 0);
+    TEST_CHECK_EQ(ftruncate(fd, UWEB_STREAM_MAP_MAX_LEN + 100), 0);
+    TEST_CHECK_EQ(pwrite(fd, "tail", 4, UWEB_STREAM_MAP_MAX_LEN), 4);
+    close(fd);
+    UWEB_file_cache_clear();
+    TEST_CHECK(UWEB_stream_file(&a, path) != 0);
+    TEST_CHECK(UWEB_stream_file(&c, path) != 0);
+    TEST_CHECK(a.mem == 0);
+    TEST_CHECK_EQ(a.flags, UWEB_STREAM_FD | UWEB_STREAM_SEEKABLE);
+    TEST_CHECK_EQ(a.total_sz, UWEB_STREAM_MAP_MAX_LEN + 100);
+    TEST_CHECK(a.user == c.user);
+    TEST_CHECK_EQ(UWEB_stream_seek(&a, UWEB_STREAM_MAP_MAX_LEN), 0);
+    TEST_CHECK_EQ(a.read(&a, buf, sizeof(buf)), 16);
+    TEST_CHECK_EQ(memcmp(buf, "tail", 4), 0);
+    TEST_CHECK_EQ(a.avail_sz, 100 - 16);
+    TEST_CHECK_EQ(pipe(fds), 0);
+    TEST_CHECK_EQ(UWEB_stream_seek(&c, UWEB_STREAM_MAP_MAX_LEN + 1), 0);
+    TEST_CHECK_EQ(UWEB_stream_splice(&c, fds[1], 3), 3);
+    TEST_CHECK_EQ(c.avail_sz, 100 - 1 - 3);
+    TEST_CHECK_EQ(read(fds[0], buf, sizeof(buf)), 3);
+    TEST_CHECK_EQ(memcmp(buf, "ail", 3), 0);
+    close(fds[0]);
+    close(fds[1]);
+    a.close(&a);
+    c.close(&c);
+
+    unlink(path);
+    UWEB_file_cache_clear();
+    TEST_CHECK(UWEB_stream_file(&a, path) == 0);
+    return TEST_RES_OK;
+  } TEST_END
+#endif
 
   TEST(urlnencdec)
   {
@@ -312,9 +2233,72 @@ SUITE(uweb_tests)
 
 SUITE_TESTS(uweb_tests)
   ADD_TEST(simple_request)
+#if UWEB_CFG_CHUNKED_RESP
   ADD_TEST(simple_chunk_request)
+#endif
   ADD_TEST(simple_request_bad)
   ADD_TEST(simple_post_request)
+#if UWEB_CFG_MULTIPART
   ADD_TEST(post_multipart_request)
+#endif
+#if UWEB_CFG_CHUNKED_REQ
+  ADD_TEST(chunked_post_request)
+  ADD_TEST(chunked_post_request_fragmented)
+  ADD_TEST(chunked_post_request_pipelined)
+  ADD_TEST(chunked_post_request_bad_size)
+#endif
+#if UWEB_CFG_METRICS && UWEB_CFG_CHUNKED_REQ
+  ADD_TEST(metrics_request)
+#endif
+#if UWEB_TRACE_LEVEL >= UWEB_TRACE_DBG && UWEB_CFG_CHUNKED_REQ
+  ADD_TEST(trace_request)
+#endif
+  ADD_TEST(timeout_partial_request_line)
+#if UWEB_CFG_CHUNKED_REQ
+  ADD_TEST(ctx_interleaved)
+#endif
+  ADD_TEST(request_limits)
+  ADD_TEST(expect_continue)
+  ADD_TEST(event_stream)
+  ADD_TEST(deferred_response)
+#if UWEB_CFG_CHUNKED_RESP
+  ADD_TEST(generator_response)
+#endif
+#if UWEB_CFG_CACHE
+  ADD_TEST(cache_response)
+#endif
+#if UWEB_CFG_ARENA
+  ADD_TEST(request_arena)
+#endif
+#if UWEB_CFG_SLAB
+  ADD_TEST(buffer_pool)
+#endif
+#if UWEB_CFG_WEBSOCKET
+  ADD_TEST(websocket)
+#endif
+#if UWEB_CFG_HTTP2
+  ADD_TEST(http2)
+  ADD_TEST(http2_streams)
+  ADD_TEST(http2_close)
+  ADD_TEST(http2_upgrade)
+#endif
+#if !UWEB_CFG_CHUNKED_REQ
+  ADD_TEST(disabled_feature)
+#endif
+#if UWEB_CFG_COALESCE
+  ADD_TEST(output_coalescing)
+#endif
+#if UWEB_CFG_ASSETS
+  ADD_TEST(assets)
+#endif
+#if UWEB_CFG_VHOST
+  ADD_TEST(vhost)
+#endif
+  ADD_TEST(streams)
+#if UWEB_CFG_STREAMS_POSIX && UWEB_FILE_CACHE_ENTRIES
+  ADD_TEST(file_cache)
+#endif
+  ADD_TEST(shed_request)
+  ADD_TEST(timer_wheel)
   ADD_TEST(urlnencdec)
 SUITE_END(uweb_tests)
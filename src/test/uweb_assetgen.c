@@ -0,0 +1,244 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Compiles a directory of static files into C source for UWEB_asset_find
+ * and UWEB_asset_serve, see uweb_assets.h.
+ * usage: uweb_assetgen [-n name] <dir> <out.c>
+ * Defines const uweb_assets name, uweb_assets_bundle if not given, holding
+ * every file below dir but hidden ones, as /path relative to dir.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#define PATH_LEN 1024
+
+typedef struct {
+  char path[PATH_LEN];
+  const char *mime;
+  char etag[32];
+  uint8_t *data;
+  uint32_t len;
+  uint8_t *gz_data;
+  uint32_t gz_len;
+} asset;
+
+static asset *assets;
+static uint32_t asset_count;
+
+static const char * const MIME[] = {
+  "html", "text/html; charset=utf-8",
+  "htm", "text/html; charset=utf-8",
+  "css", "text/css; charset=utf-8",
+  "js", "text/javascript; charset=utf-8",
+  "json", "application/json",
+  "txt", "text/plain; charset=utf-8",
+  "xml", "application/xml",
+  "svg", "image/svg+xml",
+  "png", "image/png",
+  "jpg", "image/jpeg",
+  "jpeg", "image/jpeg",
+  "gif", "image/gif",
+  "ico", "image/x-icon",
+  "webp", "image/webp",
+  "woff", "font/woff",
+  "woff2", "font/woff2",
+  "wasm", "application/wasm",
+  "pdf", "application/pdf",
+  0
+};
+
+static const char *mime_of(const char *path) {
+  const char *ext = strrchr(path, '.');
+  uint32_t i;
+  if (ext && strchr(ext, '/') == 0) {
+    for (i = 0; MIME[i]; i += 2) {
+      if (strcasecmp(ext + 1, MIME[i]) == 0) return MIME[i + 1];
+    }
+  }
+  return "application/octet-stream";
+}
+
+// FNV-1a
+static uint32_t hash(const uint8_t *data, uint32_t len) {
+  uint32_t h = 2166136261u;
+  while (len--) {
+    h ^= *data++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// gzip variant, kept if it saves a sixteenth or more
+static void compress_asset(asset *a) {
+  z_stream z;
+  uLong bound;
+  memset(&z, 0, sizeof(z));
+  if (a->len == 0 || deflateInit2(&z, 9, Z_DEFLATED, MAX_WBITS + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return;
+  }
+  bound = deflateBound(&z, a->len);
+  a->gz_data = malloc(bound);
+  z.next_in = a->data;
+  z.avail_in = a->len;
+  z.next_out = a->gz_data;
+  z.avail_out = bound;
+  if (a->gz_data && deflate(&z, Z_FINISH) == Z_STREAM_END && z.total_out < a->len - a->len / 16) {
+    a->gz_len = z.total_out;
+  }
+  deflateEnd(&z);
+}
+
+static int add_file(const char *file, const char *path) {
+  FILE *f = fopen(file, "rb");
+  struct stat st;
+  asset *a;
+  if (f == NULL || fstat(fileno(f), &st) < 0) {
+    perror(file);
+    if (f) fclose(f);
+    return -1;
+  }
+  assets = realloc(assets, (asset_count + 1) * sizeof(asset));
+  a = &assets[asset_count++];
+  memset(a, 0, sizeof(asset));
+  snprintf(a->path, PATH_LEN, "%s", path);
+  a->mime = mime_of(path);
+  a->len = st.st_size;
+  a->data = malloc(a->len + 1);
+  if (fread(a->data, 1, a->len, f) != a->len) {
+    perror(file);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  sprintf(a->etag, "\\\"%08x-%x\\\"", hash(a->data, a->len), a->len);
+  compress_asset(a);
+  return 0;
+}
+
+static int add_dir(const char *dir, const char *path) {
+  DIR *d = opendir(dir);
+  struct dirent *e;
+  if (d == NULL) {
+    perror(dir);
+    return -1;
+  }
+  while ((e = readdir(d)) != NULL) {
+    char file[PATH_LEN], sub[PATH_LEN];
+    struct stat st;
+    if (e->d_name[0] == '.') continue;
+    snprintf(file, PATH_LEN, "%s/%s", dir, e->d_name);
+    snprintf(sub, PATH_LEN, "%s/%s", path, e->d_name);
+    if (stat(file, &st) < 0) continue;
+    if ((S_ISDIR(st.st_mode) ? add_dir(file, sub) : S_ISREG(st.st_mode) ? add_file(file, sub) : 0) < 0) {
+      closedir(d);
+      return -1;
+    }
+  }
+  closedir(d);
+  return 0;
+}
+
+static int cmp_asset(const void *a, const void *b) {
+  return strcmp(((const asset *)a)->path, ((const asset *)b)->path);
+}
+
+static void put_bytes(FILE *out, const char *name, const uint8_t *data, uint32_t len) {
+  uint32_t i;
+  fprintf(out, "static const uint8_t %s[] = {", name);
+  for (i = 0; i < len; i++) {
+    fprintf(out, "%s0x%02x,", i % 16 ? " " : "\n  ", data[i]);
+  }
+  fprintf(out, "%s};\n", len ? "\n" : " 0 ");
+}
+
+// status line and fields up to ETag, and those from ETag on, of a response
+static void put_hdr(FILE *out, const asset *a, int gz) {
+  char head[256], fields[256];
+  sprintf(head,
+      "\"HTTP/1.1 200 OK\\r\\n\" \"Server: \" UWEB_SERVER_NAME \"\\r\\n\"\n"
+      "      \"Content-Type: %s\\r\\nContent-Length: %u\\r\\n\"",
+      a->mime, gz ? a->gz_len : a->len);
+  sprintf(fields, "\"ETag: %s\\r\\nCache-Control: no-cache\\r\\n%s%s\"",
+      a->etag, a->gz_len ? "Vary: Accept-Encoding\\r\\n" : "", gz ? "Content-Encoding: gzip\\r\\n" : "");
+  fprintf(out, "    %s\n      %s,\n    sizeof(%s) - 1,\n", head, fields, head);
+}
+
+int main(int argc, char **args) {
+  const char *name = "uweb_assets_bundle";
+  FILE *out;
+  uint32_t i;
+  if (argc == 5 && strcmp(args[1], "-n") == 0) {
+    name = args[2];
+    args += 2;
+    argc -= 2;
+  }
+  if (argc != 3) {
+    fprintf(stderr, "usage: uweb_assetgen [-n name] <dir> <out.c>\n");
+    return 1;
+  }
+  if (add_dir(args[1], "") < 0) return 1;
+  qsort(assets, asset_count, sizeof(asset), cmp_asset);
+  if ((out = fopen(args[2], "w")) == NULL) {
+    perror(args[2]);
+    return 1;
+  }
+
+  fprintf(out, "// generated by uweb_assetgen from %s, do not edit\n\n", args[1]);
+  fprintf(out, "#include \"uweb.h\"\n\n#if UWEB_CFG_ASSETS\n\n");
+  for (i = 0; i < asset_count; i++) {
+    char data_name[32];
+    sprintf(data_name, "asset_%u", i);
+    put_bytes(out, data_name, assets[i].data, assets[i].len);
+    if (assets[i].gz_len) {
+      sprintf(data_name, "asset_%u_gz", i);
+      put_bytes(out, data_name, assets[i].gz_data, assets[i].gz_len);
+    }
+    fprintf(out, "\n");
+  }
+  fprintf(out, "static const uweb_asset assets[] = {\n");
+  for (i = 0; i < asset_count; i++) {
+    const asset *a = &assets[i];
+    fprintf(out, "  {\n    \"%s\", \"%s\", \"%s\",\n", a->path, a->mime, a->etag);
+    put_hdr(out, a, 0);
+    fprintf(out, "    asset_%u, %u,\n", i, a->len);
+    if (a->gz_len) {
+      put_hdr(out, a, 1);
+      fprintf(out, "    asset_%u_gz, %u,\n", i, a->gz_len);
+    } else {
+      fprintf(out, "    0, 0, 0, 0,\n");
+    }
+    fprintf(out, "    \"HTTP/1.1 304 Not Modified\\r\\n\" \"Server: \" UWEB_SERVER_NAME \"\\r\\n\"\n"
+        "      \"ETag: %s\\r\\nCache-Control: no-cache\\r\\n%s\",\n  },\n",
+        a->etag, a->gz_len ? "Vary: Accept-Encoding\\r\\n" : "");
+  }
+  fprintf(out, "};\n\nconst uweb_assets %s = { assets, %u };\n\n#endif\n", name, asset_count);
+  fclose(out);
+  return 0;
+}
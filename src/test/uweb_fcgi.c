@@ -0,0 +1,781 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include "uweb_upstream.h"
+#include "uweb_fcgi.h"
+
+#define FCGI_VERSION_1              1
+#define FCGI_BEGIN_REQUEST          1
+#define FCGI_ABORT_REQUEST          2
+#define FCGI_END_REQUEST            3
+#define FCGI_PARAMS                 4
+#define FCGI_STDIN                  5
+#define FCGI_STDOUT                 6
+#define FCGI_STDERR                 7
+#define FCGI_GET_VALUES             9
+#define FCGI_GET_VALUES_RESULT      10
+#define FCGI_RESPONDER              1
+#define FCGI_KEEP_CONN              1
+#define FCGI_HDR_LEN                8
+#define FCGI_MAX_CONTENT            65535
+// management record content kept
+#define FCGI_MGMT_LEN               256
+
+// request header fields not passed on, Proxy as it would end up in the
+// worker's environment as HTTP_PROXY
+static const char * const hop_fields[] = {
+  "Connection",
+  "Keep-Alive",
+  "Proxy-Connection",
+  "TE",
+  "Transfer-Encoding",
+  "Upgrade",
+  "Expect",
+  "HTTP2-Settings",
+  "Proxy",
+};
+
+typedef struct {
+  uint8_t *data;
+  uint32_t len;
+  uint32_t size;
+} fcgi_buf;
+
+struct fcgi_conn_s;
+
+typedef struct {
+  int upstream;
+  struct fcgi_conn_s *conns;
+  uint32_t conn_count;
+  // requests waiting for a free slot, oldest first
+  fcgi_req *wait_head;
+  fcgi_req *wait_tail;
+} fcgi_backend;
+
+typedef struct fcgi_conn_s {
+  upstream_conn *u;
+  fcgi_backend *b;
+  // requests at a time, 1 until the worker says it multiplexes
+  uint32_t max;
+  uint32_t active;
+  // by request id - 1. An id stays taken until its END_REQUEST, also when
+  // the request was aborted and is gone
+  fcgi_req *reqs[FCGI_MAX_MPX];
+  uint8_t used[FCGI_MAX_MPX];
+  // record being received
+  uint8_t hdr[FCGI_HDR_LEN];
+  uint8_t hdr_len;
+  uint8_t type;
+  uint8_t pad;
+  uint16_t id;
+  uint32_t left;
+  uint8_t mgmt[FCGI_MGMT_LEN];
+  uint32_t mgmt_len;
+  // request with output not yet written to its client
+  fcgi_req *pending;
+  struct fcgi_conn_s *next;
+} fcgi_conn;
+
+typedef struct {
+  char prefix[PROXY_PREFIX_LEN];
+  fcgi_backend *b;
+} fcgi_route_t;
+
+// response relay states
+typedef enum {
+  R_HEADERS = 0,
+  R_BODY
+} fcgi_state;
+
+struct fcgi_req_s {
+  proxy_client cl;
+  fcgi_backend *b;
+  fcgi_conn *fc;
+  uint16_t id;
+  fcgi_req *wait_next;
+  // CGI parameters, then records not yet written while waiting for a
+  // slot, their request ids filled in when it gets one
+  fcgi_buf params;
+  fcgi_buf tx;
+  uint8_t oom;
+  uint8_t head;
+  // request fully sent
+  uint8_t req_done;
+  uint8_t waiting;
+  // client held, too many records queued
+  uint8_t held;
+  // client connection closes after the response
+  uint8_t close;
+  // client write failed
+  uint8_t broken;
+  uint8_t started;
+  uint8_t state;
+  uint8_t has_len;
+  uint8_t chunked;
+  uint8_t no_body;
+  uint8_t location;
+  char status[64];
+  // response header fields
+  fcgi_buf hdr;
+  char line[FCGI_LINE_LEN];
+  uint32_t line_len;
+  // client output coalesced
+  uint8_t obuf[FCGI_BUF_LEN];
+  uint32_t olen;
+};
+
+static fcgi_backend backends[FCGI_MAX_BACKENDS];
+static int backend_count;
+static fcgi_route_t routes[FCGI_MAX_ROUTES];
+static int route_count;
+static uint8_t rbuf[2 * FCGI_BUF_LEN];
+static uint8_t sbuf[FCGI_HDR_LEN + FCGI_BUF_LEN];
+
+static void _fcgi_event(upstream_conn *u, uint32_t events);
+
+int fcgi_route(const char *prefix, const char *backend) {
+  int i, u = upstream_backend(backend);
+  fcgi_backend *b = NULL;
+  if (u < 0 || route_count >= FCGI_MAX_ROUTES || strlen(prefix) >= PROXY_PREFIX_LEN) return -1;
+  for (i = 0; i < backend_count; i++) {
+    if (backends[i].upstream == u) b = &backends[i];
+  }
+  if (b == NULL) {
+    if (backend_count >= FCGI_MAX_BACKENDS) return -1;
+    b = &backends[backend_count++];
+    memset(b, 0, sizeof(fcgi_backend));
+    b->upstream = u;
+  }
+  strcpy(routes[route_count].prefix, prefix);
+  routes[route_count].b = b;
+  return route_count++;
+}
+
+int fcgi_match(const char *resource) {
+  int i;
+  for (i = 0; i < route_count; i++) {
+    if (strncmp(resource, routes[i].prefix, strlen(routes[i].prefix)) == 0) return i;
+  }
+  return -1;
+}
+
+static void _fcgi_add(fcgi_req *r, fcgi_buf *b, const void *data, uint32_t len) {
+  if (len == 0) return;
+  if (b->len + len > b->size) {
+    uint32_t size = b->size ? b->size * 2 : 512;
+    while (size < b->len + len) size *= 2;
+    uint8_t *d = realloc(b->data, size);
+    if (d == NULL) {
+      r->oom = 1;
+      return;
+    }
+    b->data = d;
+    b->size = size;
+  }
+  memcpy(&b->data[b->len], data, len);
+  b->len += len;
+}
+
+static void _fcgi_buf_free(fcgi_buf *b) {
+  free(b->data);
+  memset(b, 0, sizeof(fcgi_buf));
+}
+
+static void _fcgi_hdr(uint8_t *h, uint8_t type, uint16_t id, uint16_t len) {
+  h[0] = FCGI_VERSION_1;
+  h[1] = type;
+  h[2] = id >> 8;
+  h[3] = id;
+  h[4] = len >> 8;
+  h[5] = len;
+  h[6] = 0;
+  h[7] = 0;
+}
+
+// name or value length of a parameter
+static uint32_t _fcgi_len(uint8_t *d, uint32_t len) {
+  if (len < 128) {
+    d[0] = len;
+    return 1;
+  }
+  d[0] = 0x80 | len >> 24;
+  d[1] = len >> 16;
+  d[2] = len >> 8;
+  d[3] = len;
+  return 4;
+}
+
+static void _fcgi_param(fcgi_req *r, const char *name, uint32_t name_len, const char *value, uint32_t value_len) {
+  uint8_t lens[8];
+  uint32_t n = _fcgi_len(lens, name_len);
+  n += _fcgi_len(&lens[n], value_len);
+  _fcgi_add(r, &r->params, lens, n);
+  _fcgi_add(r, &r->params, name, name_len);
+  _fcgi_add(r, &r->params, value, value_len);
+}
+
+static void _fcgi_param_str(fcgi_req *r, const char *name, const char *value) {
+  _fcgi_param(r, name, strlen(name), value, strlen(value));
+}
+
+// appends records of type holding data, an empty one if there is none
+static void _fcgi_rec(fcgi_req *r, fcgi_buf *dst, uint8_t type, const uint8_t *data, uint32_t len) {
+  do {
+    uint8_t h[FCGI_HDR_LEN];
+    uint32_t n = len > FCGI_MAX_CONTENT ? FCGI_MAX_CONTENT : len;
+    _fcgi_hdr(h, type, r->id, n);
+    _fcgi_add(r, dst, h, FCGI_HDR_LEN);
+    _fcgi_add(r, dst, data, n);
+    data += n;
+    len -= n;
+  } while (len);
+}
+
+// writes records of type to the worker, or keeps them while waiting
+static int _fcgi_send(fcgi_req *r, uint8_t type, const uint8_t *data, uint32_t len) {
+  if (r->fc == NULL) {
+    _fcgi_rec(r, &r->tx, type, data, len);
+    return r->oom ? -1 : 0;
+  }
+  upstream_conn *u = r->fc->u;
+  do {
+    uint32_t n = len > FCGI_MAX_CONTENT ? FCGI_MAX_CONTENT : len;
+    _fcgi_hdr(sbuf, type, r->id, n);
+    if (n <= FCGI_BUF_LEN) {
+      // small pieces go with their header
+      if (n) memcpy(&sbuf[FCGI_HDR_LEN], data, n);
+      if (upstream_write(u, sbuf, FCGI_HDR_LEN + n) < 0) return -1;
+    } else if (upstream_write(u, sbuf, FCGI_HDR_LEN) < 0 || upstream_write(u, data, n) < 0) {
+      return -1;
+    }
+    data += n;
+    len -= n;
+  } while (len);
+  return 0;
+}
+
+fcgi_req *fcgi_new(int route, uweb_request_header *req, const proxy_client *cl) {
+  fcgi_req *r = calloc(1, sizeof(fcgi_req));
+  if (r == NULL) return NULL;
+  r->cl = *cl;
+  r->b = routes[route].b;
+  r->head = req->method == HEAD;
+  // the route prefix is the script, the rest of the path its path info
+  const char *prefix = routes[route].prefix;
+  uint32_t script_len = strlen(prefix);
+  if (script_len && prefix[script_len - 1] == '/') script_len--;
+  const char *path = &req->resource[script_len];
+  const char *query = strchr(path, '?');
+  uint32_t path_len = query ? (uint32_t)(query - path) : strlen(path);
+  _fcgi_param_str(r, "GATEWAY_INTERFACE", "CGI/1.1");
+  _fcgi_param_str(r, "SERVER_SOFTWARE", UWEB_SERVER_NAME);
+  _fcgi_param_str(r, "SERVER_PROTOCOL", "HTTP/1.1");
+  _fcgi_param_str(r, "REQUEST_METHOD", UWEB_HTTP_REQ_METHODS[req->method]);
+  _fcgi_param_str(r, "REQUEST_URI", req->resource);
+  _fcgi_param(r, "SCRIPT_NAME", 11, prefix, script_len);
+  _fcgi_param(r, "PATH_INFO", 9, path, path_len);
+  _fcgi_param_str(r, "QUERY_STRING", query ? query + 1 : "");
+  return r;
+}
+
+void fcgi_field(fcgi_req *r, const char *line, uint32_t len) {
+  char name[128];
+  uint32_t i, name_len;
+  const char *colon = memchr(line, ':', len);
+  if (colon == NULL) return;
+  name_len = colon - line;
+  const char *value = colon + 1;
+  while (value < &line[len] && (*value == ' ' || *value == '\t')) value++;
+  uint32_t value_len = &line[len] - value;
+  for (i = 0; i < sizeof(hop_fields) / sizeof(hop_fields[0]); i++) {
+    if (name_len == strlen(hop_fields[i]) && strncasecmp(line, hop_fields[i], name_len) == 0) return;
+  }
+  if (name_len == 12 && strncasecmp(line, "Content-Type", 12) == 0) {
+    _fcgi_param(r, "CONTENT_TYPE", 12, value, value_len);
+    return;
+  }
+  if (name_len == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+    _fcgi_param(r, "CONTENT_LENGTH", 14, value, value_len);
+    return;
+  }
+  if (name_len + 5 > sizeof(name)) return;
+  memcpy(name, "HTTP_", 5);
+  for (i = 0; i < name_len; i++) {
+    char c = line[i];
+    name[5 + i] = c == '-' ? '_' : (c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c);
+  }
+  _fcgi_param(r, name, name_len + 5, value, value_len);
+}
+
+static void _fcgi_flush(fcgi_req *r) {
+  if (r->olen == 0) return;
+  r->started = 1;
+  if (r->cl.out->write(r->cl.out, r->obuf, r->olen) < 0) r->broken = 1;
+  r->olen = 0;
+}
+
+static void _fcgi_out(fcgi_req *r, const void *data, uint32_t len) {
+  const uint8_t *d = (const uint8_t *)data;
+  while (len) {
+    uint32_t n = sizeof(r->obuf) - r->olen;
+    if (n == 0) {
+      _fcgi_flush(r);
+      continue;
+    }
+    if (n > len) n = len;
+    memcpy(&r->obuf[r->olen], d, n);
+    r->olen += n;
+    d += n;
+    len -= n;
+  }
+}
+
+// answers 502 unless the response is under way, and closes the client
+static void _fcgi_fail(fcgi_req *r) {
+  if (!r->started) {
+    r->olen = 0;
+    proxy_respond(r->cl.out, S502_BAD_GATEWAY, PROXY_MSG_BAD_GATEWAY);
+  }
+  // frees r
+  r->cl.done(r->cl.arg, 1);
+}
+
+// takes a request id on connection and sends what was kept meanwhile
+static int _fcgi_attach(fcgi_conn *fc, fcgi_req *r) {
+  uint32_t i = 0, offs = 0;
+  while (fc->used[i]) i++;
+  fc->used[i] = 1;
+  fc->reqs[i] = r;
+  fc->active++;
+  r->fc = fc;
+  r->id = i + 1;
+  while (offs + FCGI_HDR_LEN <= r->tx.len) {
+    uint8_t *h = &r->tx.data[offs];
+    h[2] = r->id >> 8;
+    h[3] = r->id;
+    offs += FCGI_HDR_LEN + (h[4] << 8 | h[5]) + h[6];
+  }
+  int res = upstream_write(fc->u, r->tx.data, r->tx.len);
+  _fcgi_buf_free(&r->tx);
+  if (r->held && fc->u->q.bytes <= FCGI_MAX_QUEUED) {
+    r->held = 0;
+    r->cl.hold(r->cl.arg, 0);
+  }
+  return res;
+}
+
+static fcgi_conn *_fcgi_connect(fcgi_backend *b) {
+  uint8_t q[64];
+  uint32_t len = FCGI_HDR_LEN;
+  fcgi_conn *fc = calloc(1, sizeof(fcgi_conn));
+  if (fc == NULL) return NULL;
+  fc->u = upstream_get(b->upstream, _fcgi_event, fc);
+  if (fc->u == NULL) {
+    free(fc);
+    return NULL;
+  }
+  fc->b = b;
+  fc->max = 1;
+  // ask whether the worker multiplexes
+  len += _fcgi_len(&q[len], 15);
+  len += _fcgi_len(&q[len], 0);
+  memcpy(&q[len], "FCGI_MPXS_CONNS", 15);
+  len += 15;
+  len += _fcgi_len(&q[len], 13);
+  len += _fcgi_len(&q[len], 0);
+  memcpy(&q[len], "FCGI_MAX_REQS", 13);
+  len += 13;
+  _fcgi_hdr(q, FCGI_GET_VALUES, 0, len - FCGI_HDR_LEN);
+  if (upstream_write(fc->u, q, len) < 0) {
+    upstream_close(fc->u);
+    free(fc);
+    return NULL;
+  }
+  fc->next = b->conns;
+  b->conns = fc;
+  b->conn_count++;
+  return fc;
+}
+
+// connection with the most free slots, or a new one
+static fcgi_conn *_fcgi_slot(fcgi_backend *b) {
+  fcgi_conn *fc, *best = NULL;
+  for (fc = b->conns; fc; fc = fc->next) {
+    if (fc->active < fc->max && (best == NULL || fc->max - fc->active > best->max - best->active)) {
+      best = fc;
+    }
+  }
+  if (best || b->conn_count >= FCGI_MAX_CONNS) return best;
+  return _fcgi_connect(b);
+}
+
+// starts waiting requests as far as there are slots
+static void _fcgi_run_waiting(fcgi_backend *b) {
+  while (b->wait_head) {
+    fcgi_conn *fc = _fcgi_slot(b);
+    if (fc == NULL && b->conn_count) return;
+    fcgi_req *r = b->wait_head;
+    b->wait_head = r->wait_next;
+    if (b->wait_head == NULL) b->wait_tail = NULL;
+    r->waiting = 0;
+    // no connection to the backend at all fails them all
+    if (fc == NULL || _fcgi_attach(fc, r) < 0) _fcgi_fail(r);
+  }
+}
+
+// connection broke, its requests fail
+static void _fcgi_conn_fail(fcgi_conn *fc) {
+  fcgi_backend *b = fc->b;
+  fcgi_conn **pp = &b->conns;
+  uint32_t i;
+  while (*pp != fc) pp = &(*pp)->next;
+  *pp = fc->next;
+  b->conn_count--;
+  upstream_close(fc->u);
+  for (i = 0; i < FCGI_MAX_MPX; i++) {
+    fcgi_req *r = fc->reqs[i];
+    if (r == NULL) continue;
+    fc->reqs[i] = NULL;
+    r->fc = NULL;
+    _fcgi_fail(r);
+  }
+  free(fc);
+  _fcgi_run_waiting(b);
+}
+
+// response header from the worker is complete, the client gets its own
+static void _fcgi_header_done(fcgi_req *r) {
+  char start[128];
+  int status = r->status[0] ? atoi(r->status) : (r->location ? 302 : 200);
+  r->no_body = r->head || status == 204 || status == 304 || status < 200;
+  r->chunked = !r->has_len && !r->no_body;
+  int len = snprintf(start, sizeof(start), "HTTP/1.1 %s\r\nServer: " UWEB_SERVER_NAME "\r\n",
+      r->status[0] ? r->status : (r->location ? "302 Found" : "200 OK"));
+  _fcgi_out(r, start, len);
+  _fcgi_out(r, r->hdr.data, r->hdr.len);
+  if (r->chunked) _fcgi_out(r, "Transfer-Encoding: chunked\r\n", 28);
+  if (r->close) _fcgi_out(r, "Connection: close\r\n", 19);
+  _fcgi_out(r, "\r\n", 2);
+  _fcgi_buf_free(&r->hdr);
+  r->state = R_BODY;
+}
+
+// handles a CGI response header line, returns -1 if it is bad
+static int _fcgi_header(fcgi_req *r) {
+  char *line = r->line;
+  if (r->line_len == 0) {
+    _fcgi_header_done(r);
+    return 0;
+  }
+  char *colon = strchr(line, ':');
+  if (colon == NULL) return -1;
+  char *value = colon + 1;
+  while (*value == ' ' || *value == '\t') value++;
+  if (strncasecmp(line, "Status:", 7) == 0) {
+    snprintf(r->status, sizeof(r->status), "%s", value);
+    return 0;
+  }
+  if (strncasecmp(line, "Connection:", 11) == 0 ||
+      strncasecmp(line, "Keep-Alive:", 11) == 0 ||
+      strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+    return 0;
+  }
+  if (strncasecmp(line, "Location:", 9) == 0) r->location = 1;
+  if (strncasecmp(line, "Content-Length:", 15) == 0) r->has_len = 1;
+  _fcgi_add(r, &r->hdr, line, r->line_len);
+  _fcgi_add(r, &r->hdr, "\r\n", 2);
+  return r->oom ? -1 : 0;
+}
+
+// relays STDOUT, returns -1 if the response is bad
+static int _fcgi_response(fcgi_req *r, const uint8_t *data, uint32_t len) {
+  while (len) {
+    if (r->state == R_BODY) {
+      if (r->no_body) return 0;
+      if (r->chunked) {
+        char size[16];
+        _fcgi_out(r, size, sprintf(size, "%x\r\n", len));
+        _fcgi_out(r, data, len);
+        _fcgi_out(r, "\r\n", 2);
+      } else {
+        _fcgi_out(r, data, len);
+      }
+      return 0;
+    }
+    const uint8_t *nl = memchr(data, '\n', len);
+    uint32_t n = nl ? (uint32_t)(nl - data) : len;
+    if (r->line_len + n >= FCGI_LINE_LEN) return -1;
+    memcpy(&r->line[r->line_len], data, n);
+    r->line_len += n;
+    if (nl == NULL) return 0;
+    data += n + 1;
+    len -= n + 1;
+    if (r->line_len && r->line[r->line_len - 1] == '\r') r->line_len--;
+    r->line[r->line_len] = 0;
+    if (_fcgi_header(r) < 0) return -1;
+    r->line_len = 0;
+  }
+  return 0;
+}
+
+// worker ended a request
+static void _fcgi_end(fcgi_conn *fc) {
+  uint16_t id = fc->id;
+  if (id == 0 || !fc->used[id - 1]) return;
+  fcgi_req *r = fc->reqs[id - 1];
+  fc->used[id - 1] = 0;
+  fc->reqs[id - 1] = NULL;
+  fc->active--;
+  if (r) {
+    r->fc = NULL;
+    if (fc->pending == r) fc->pending = NULL;
+    if (r->state != R_BODY) {
+      _fcgi_fail(r);
+    } else {
+      if (r->chunked) _fcgi_out(r, "0\r\n\r\n", 5);
+      _fcgi_flush(r);
+      // frees r
+      r->cl.done(r->cl.arg, r->close || r->broken);
+    }
+  }
+  _fcgi_run_waiting(fc->b);
+}
+
+// worker says whether it multiplexes
+static void _fcgi_values(fcgi_conn *fc) {
+  uint32_t offs = 0, mpxs = 0, max = FCGI_MAX_MPX;
+  while (offs < fc->mgmt_len) {
+    uint32_t l[2], i;
+    for (i = 0; i < 2; i++) {
+      if (offs >= fc->mgmt_len) return;
+      if (fc->mgmt[offs] & 0x80) {
+        if (offs + 4 > fc->mgmt_len) return;
+        l[i] = (fc->mgmt[offs] & 0x7f) << 24 | fc->mgmt[offs + 1] << 16 | fc->mgmt[offs + 2] << 8 | fc->mgmt[offs + 3];
+        offs += 4;
+      } else {
+        l[i] = fc->mgmt[offs++];
+      }
+    }
+    if (l[0] > FCGI_MGMT_LEN || l[1] > FCGI_MGMT_LEN || offs + l[0] + l[1] > fc->mgmt_len) return;
+    const char *name = (const char *)&fc->mgmt[offs];
+    char value[16];
+    snprintf(value, sizeof(value), "%.*s", (int)l[1], (const char *)&fc->mgmt[offs + l[0]]);
+    if (l[0] == 15 && memcmp(name, "FCGI_MPXS_CONNS", 15) == 0) mpxs = atoi(value);
+    if (l[0] == 13 && memcmp(name, "FCGI_MAX_REQS", 13) == 0 && atoi(value) > 0 &&
+        (uint32_t)atoi(value) < max) {
+      max = atoi(value);
+    }
+    offs += l[0] + l[1];
+  }
+  if (mpxs) {
+    fc->max = max;
+    _fcgi_run_waiting(fc->b);
+  }
+}
+
+// handles record content as received, returns -1 if the connection is
+// out of step
+static int _fcgi_record(fcgi_conn *fc, const uint8_t *data, uint32_t len, int end) {
+  fcgi_req *r = fc->id ? fc->reqs[fc->id - 1] : NULL;
+  switch (fc->type) {
+  case FCGI_STDOUT:
+    if (r == NULL || len == 0) break;
+    if (fc->pending != r) {
+      if (fc->pending) _fcgi_flush(fc->pending);
+      fc->pending = r;
+    }
+    r->cl.activity(r->cl.arg);
+    if (_fcgi_response(r, data, len) < 0 || r->broken) {
+      // frees r, the worker is told to abort
+      fc->pending = NULL;
+      _fcgi_fail(r);
+    }
+    break;
+  case FCGI_STDERR:
+    if (len) fwrite(data, 1, len, stderr);
+    break;
+  case FCGI_END_REQUEST:
+    if (end) _fcgi_end(fc);
+    break;
+  case FCGI_GET_VALUES_RESULT:
+    if (fc->mgmt_len + len > FCGI_MGMT_LEN) return -1;
+    memcpy(&fc->mgmt[fc->mgmt_len], data, len);
+    fc->mgmt_len += len;
+    if (end) _fcgi_values(fc);
+    break;
+  default:
+    break;
+  }
+  return 0;
+}
+
+static int _fcgi_input(fcgi_conn *fc, const uint8_t *data, uint32_t len) {
+  while (len) {
+    uint32_t n;
+    if (fc->hdr_len < FCGI_HDR_LEN) {
+      n = FCGI_HDR_LEN - fc->hdr_len;
+      if (n > len) n = len;
+      memcpy(&fc->hdr[fc->hdr_len], data, n);
+      fc->hdr_len += n;
+      data += n;
+      len -= n;
+      if (fc->hdr_len < FCGI_HDR_LEN) break;
+      fc->type = fc->hdr[1];
+      fc->id = fc->hdr[2] << 8 | fc->hdr[3];
+      fc->left = fc->hdr[4] << 8 | fc->hdr[5];
+      fc->pad = fc->hdr[6];
+      fc->mgmt_len = 0;
+      if (fc->hdr[0] != FCGI_VERSION_1 || fc->id > FCGI_MAX_MPX) return -1;
+      if (fc->left == 0 && _fcgi_record(fc, NULL, 0, 1) < 0) return -1;
+    } else if (fc->left) {
+      n = fc->left < len ? fc->left : len;
+      fc->left -= n;
+      if (_fcgi_record(fc, data, n, fc->left == 0) < 0) return -1;
+      data += n;
+      len -= n;
+    } else {
+      n = fc->pad < len ? fc->pad : len;
+      fc->pad -= n;
+      data += n;
+      len -= n;
+    }
+    if (fc->hdr_len == FCGI_HDR_LEN && fc->left == 0 && fc->pad == 0) fc->hdr_len = 0;
+  }
+  return 0;
+}
+
+static void _fcgi_event(upstream_conn *u, uint32_t events) {
+  fcgi_conn *fc = (fcgi_conn *)u->user;
+  uint32_t i;
+  if (events & UPSTREAM_ERROR) {
+    _fcgi_conn_fail(fc);
+    return;
+  }
+  if (events & UPSTREAM_DRAINED) {
+    for (i = 0; i < FCGI_MAX_MPX; i++) {
+      fcgi_req *r = fc->reqs[i];
+      if (r && r->held) {
+        r->held = 0;
+        r->cl.hold(r->cl.arg, 0);
+      }
+    }
+  }
+  if (!(events & UPSTREAM_READABLE)) return;
+  // a few rounds, then other connections get their turn
+  for (i = 0; i < 8; i++) {
+    ssize_t n = read(u->fd, rbuf, sizeof(rbuf));
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    // an idle connection closed by the worker fails no request
+    if (n <= 0 || _fcgi_input(fc, rbuf, n) < 0) {
+      _fcgi_conn_fail(fc);
+      return;
+    }
+  }
+  if (fc->pending) _fcgi_flush(fc->pending);
+  fc->pending = NULL;
+}
+
+int fcgi_begin(fcgi_req *r, uweb_request_header *req) {
+  // responder, connection kept after the request
+  uint8_t begin[8] = { 0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0 };
+  r->close = strcasestr(req->connection, "close") != NULL;
+  r->req_done = !req->chunked && req->content_length == 0;
+  // captured on its way out when the response is being cached
+  r->cl.out = UWEB_ctx_out(req->ctx, r->cl.out);
+  _fcgi_rec(r, &r->tx, FCGI_BEGIN_REQUEST, begin, sizeof(begin));
+  _fcgi_rec(r, &r->tx, FCGI_PARAMS, r->params.data, r->params.len);
+  _fcgi_rec(r, &r->tx, FCGI_PARAMS, NULL, 0);
+  if (r->req_done) _fcgi_rec(r, &r->tx, FCGI_STDIN, NULL, 0);
+  _fcgi_buf_free(&r->params);
+  if (r->oom) return -1;
+  fcgi_conn *fc = _fcgi_slot(r->b);
+  if (fc) return _fcgi_attach(fc, r);
+  if (r->b->conn_count == 0) return -1;
+  // all slots taken
+  r->waiting = 1;
+  if (r->b->wait_tail) r->b->wait_tail->wait_next = r;
+  else r->b->wait_head = r;
+  r->b->wait_tail = r;
+  return 0;
+}
+
+void fcgi_body(fcgi_req *r, uweb_data_type type, uint8_t *data, uint32_t len) {
+  int res;
+  // trailers have no place in CGI
+  if (r->req_done || type == DATA_CHUNK_TRAILER) return;
+  if (len == 0) {
+    res = _fcgi_send(r, FCGI_STDIN, NULL, 0);
+    r->req_done = 1;
+  } else {
+    res = _fcgi_send(r, FCGI_STDIN, data, len);
+  }
+  if (res < 0) {
+    _fcgi_fail(r);
+    return;
+  }
+  uint32_t queued = r->fc ? r->fc->u->q.bytes : r->tx.len;
+  if (!r->held && queued > FCGI_MAX_QUEUED) {
+    // worker is behind, stop receiving the body
+    r->held = 1;
+    r->cl.hold(r->cl.arg, 1);
+  }
+}
+
+void fcgi_expired(fcgi_req *r) {
+  if (r->started) return;
+  if (r->req_done) proxy_respond(r->cl.out, S504_GATEWAY_TIMEOUT, PROXY_MSG_GATEWAY_TIMEOUT);
+  else proxy_respond(r->cl.out, S408_REQUEST_TIMEOUT, UWEB_HTTP_MSG_TIMEOUT);
+  r->started = 1;
+}
+
+void fcgi_free(fcgi_req *r) {
+  fcgi_conn *fc = r->fc;
+  if (fc) {
+    uint8_t h[FCGI_HDR_LEN];
+    _fcgi_hdr(h, FCGI_ABORT_REQUEST, r->id, 0);
+    upstream_write(fc->u, h, FCGI_HDR_LEN);
+    // the id stays taken until the worker ends the request
+    fc->reqs[r->id - 1] = NULL;
+    if (fc->pending == r) fc->pending = NULL;
+  }
+  if (r->waiting) {
+    fcgi_req **pp = &r->b->wait_head, *prev = NULL;
+    while (*pp != r) {
+      prev = *pp;
+      pp = &(*pp)->wait_next;
+    }
+    *pp = r->wait_next;
+    if (r->b->wait_tail == r) r->b->wait_tail = prev;
+  }
+  _fcgi_buf_free(&r->params);
+  _fcgi_buf_free(&r->tx);
+  _fcgi_buf_free(&r->hdr);
+  free(r);
+}
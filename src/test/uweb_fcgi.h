@@ -0,0 +1,77 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * FastCGI client.
+ * Requests for a routed resource prefix are passed to FastCGI application
+ * workers as a BEGIN_REQUEST record, the request as CGI parameters and the
+ * body as STDIN records. Each backend has a few persistent connections,
+ * and a worker announcing FCGI_MPXS_CONNS gets several requests at a time
+ * over each, told apart by request id. Requests beyond that wait for a
+ * free slot. STDOUT is relayed as a response with the worker's
+ * Content-Length, else chunked.
+ */
+
+#ifndef _UWEB_FCGI_H_
+#define _UWEB_FCGI_H_
+
+#include <stdint.h>
+#include "../uweb.h"
+#include "uweb_proxy.h"
+
+#define FCGI_MAX_ROUTES             8
+#define FCGI_MAX_BACKENDS           4
+// persistent connections per backend
+#define FCGI_MAX_CONNS              4
+// requests at a time over one connection, if the worker multiplexes
+#define FCGI_MAX_MPX                16
+#define FCGI_BUF_LEN                8192
+// longest response header line from a worker
+#define FCGI_LINE_LEN               8192
+// request records queued before the client is held back
+#define FCGI_MAX_QUEUED             (256 * 1024)
+
+typedef struct fcgi_req_s fcgi_req;
+
+/* Passes requests for resources starting with prefix to the FastCGI
+   workers at backend, unix:<path> or <host>:<port>. Returns -1 on a bad
+   backend or too many */
+int fcgi_route(const char *prefix, const char *backend);
+/* Returns the route of resource, -1 if not routed */
+int fcgi_match(const char *resource);
+/* Starts a request on route, method and resource are known. Returns 0 if
+   out of memory */
+fcgi_req *fcgi_new(int route, uweb_request_header *req, const proxy_client *cl);
+/* Passes a request header field line on as a parameter */
+void fcgi_field(fcgi_req *r, const char *line, uint32_t len);
+/* Sends the request to a worker when the header is complete, or queues it
+   until one is free. Returns -1 if there is no worker connection */
+int fcgi_begin(fcgi_req *r, uweb_request_header *req);
+/* Passes request body data on, as reported to the data function */
+void fcgi_body(fcgi_req *r, uweb_data_type type, uint8_t *data, uint32_t len);
+/* Call when the client connection times out, answers as proxy_expired */
+void fcgi_expired(fcgi_req *r);
+/* Frees request, aborting it at the worker if still running */
+void fcgi_free(fcgi_req *r);
+
+#endif /* _UWEB_FCGI_H_ */
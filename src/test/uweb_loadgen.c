@@ -0,0 +1,567 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Closed-loop HTTP load generator.
+ * Forks a uweb socket server on loopback (unless -x) and runs a number of
+ * connections against it, each sending a new request as soon as the
+ * previous response is complete. Reports throughput and a log-linear
+ * latency histogram.
+ *
+ *   -c <n>      number of connections, default 8
+ *   -d <s>      duration in seconds, default 5
+ *   -p <port>   server port, default 8081
+ *   -u <path>   connect to a Unix domain socket at path instead
+ *   -s          short-lived connections, one request per connection
+ *   -x          use an already running server instead of forking one
+ *   -m <mix>    request mix as name=weight,..., names being
+ *               get, post, multipart and chunked; default get=1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "uweb_sockserv.h"
+#include "uweb_loadgen.h"
+
+#define LG_MAX_CONNS          1024
+#define LG_LINE_LEN           256
+#define LG_RX_LEN             16384
+#define LG_BOUNDARY           "----uwebloadgen7d0a1e"
+
+// histogram, values below 32 are exact, above that 16 linear sub-buckets
+// per power of two
+#define LG_HIST_SUB_BITS      5
+#define LG_HIST_SUB           (1 << LG_HIST_SUB_BITS)
+#define LG_HIST_HALF          (LG_HIST_SUB / 2)
+#define LG_HIST_LEN           (LG_HIST_SUB + (64 - LG_HIST_SUB_BITS) * LG_HIST_HALF)
+
+typedef enum {
+  MIX_GET = 0,
+  MIX_POST,
+  MIX_MULTIPART,
+  MIX_CHUNKED,
+  _MIX_COUNT
+} lg_mix;
+
+static const char * const LG_MIX_NAMES[] = {
+  "get", "post", "multipart", "chunked"
+};
+
+typedef enum {
+  R_STATUS = 0,
+  R_HEADERS,
+  R_BODY,
+  R_CHUNK_SIZE,
+  R_CHUNK_DATA,
+  R_CHUNK_END,
+  R_TRAILER,
+} lg_rstate;
+
+typedef struct {
+  int fd;
+  uint8_t sending;
+  const char *tx;
+  uint32_t tx_len;
+  uint32_t tx_ix;
+  uint64_t t_start;
+  lg_rstate rstate;
+  char line[LG_LINE_LEN];
+  uint32_t line_len;
+  int32_t content_length;
+  uint8_t chunked;
+  uint32_t left;
+  uint16_t status;
+} lg_conn;
+
+static struct {
+  uint16_t port;
+  // unix domain socket, empty for TCP
+  char path[108];
+  int conns;
+  int duration;
+  uint8_t short_lived;
+  uint32_t weights[_MIX_COUNT];
+  uint32_t weight_sum;
+  char *req[_MIX_COUNT];
+  uint32_t req_len[_MIX_COUNT];
+  lg_conn conn[LG_MAX_CONNS];
+  struct pollfd pfd[LG_MAX_CONNS];
+  uint64_t hist[LG_HIST_LEN];
+  uint64_t requests;
+  uint64_t errors;
+  uint64_t connects;
+  uint64_t status_bad;
+  uint64_t rx_bytes;
+  uint32_t rnd;
+} lg;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// --- histogram
+
+// above the exact range, v >> shift keeps the top five bits of v, where the
+// msb is always set, so only the lower four select a sub-bucket
+static uint32_t hist_ix(uint64_t v) {
+  if (v < LG_HIST_SUB) return v;
+  uint32_t msb = 63 - __builtin_clzll(v);
+  uint32_t shift = msb - LG_HIST_SUB_BITS + 1;
+  return LG_HIST_SUB + (shift - 1) * LG_HIST_HALF + (v >> shift) - LG_HIST_HALF;
+}
+
+// lower bound of the values in bucket ix
+static uint64_t hist_val(uint32_t ix) {
+  if (ix < LG_HIST_SUB) return ix;
+  uint32_t shift = (ix - LG_HIST_SUB) / LG_HIST_HALF + 1;
+  return ((uint64_t)((ix - LG_HIST_SUB) % LG_HIST_HALF + LG_HIST_HALF)) << shift;
+}
+
+static void hist_record(uint64_t v) {
+  uint32_t ix = hist_ix(v);
+  if (ix >= LG_HIST_LEN) ix = LG_HIST_LEN - 1;
+  lg.hist[ix]++;
+}
+
+static uint64_t hist_percentile(double p) {
+  uint64_t total = 0, cum = 0;
+  uint32_t i;
+  for (i = 0; i < LG_HIST_LEN; i++) total += lg.hist[i];
+  if (total == 0) return 0;
+  uint64_t target = (uint64_t)(p / 100.0 * total + 0.5);
+  if (target == 0) target = 1;
+  for (i = 0; i < LG_HIST_LEN; i++) {
+    cum += lg.hist[i];
+    if (cum >= target) return hist_val(i);
+  }
+  return hist_val(LG_HIST_LEN - 1);
+}
+
+// --- requests
+
+static void build_requests(void) {
+  char *body;
+  uint32_t i;
+
+  lg.req[MIX_GET] = strdup(
+      "GET /index.html HTTP/1.1\r\n"
+      "Host: localhost\r\n"
+      "User-Agent: uweb-loadgen\r\n"
+      "\r\n");
+
+  body = malloc(4096 + 1);
+  for (i = 0; i < 4096; i++) body[i] = 'a' + (i % 26);
+  body[4096] = 0;
+  memcpy(body, "field=", 6);
+  lg.req[MIX_POST] = malloc(4096 + 256);
+  sprintf(lg.req[MIX_POST],
+      "POST /post.html HTTP/1.1\r\n"
+      "Host: localhost\r\n"
+      "Content-Type: application/x-www-form-urlencoded\r\n"
+      "Content-Length: %u\r\n"
+      "\r\n%s", 4096, body);
+  free(body);
+
+  body = malloc(16384 + 512);
+  char *p = body;
+  p += sprintf(p, "--"LG_BOUNDARY"\r\n"
+      "Content-Disposition: form-data; name=\"file1\"; filename=\"load.bin\"\r\n"
+      "Content-Type: application/octet-stream\r\n"
+      "\r\n");
+  for (i = 0; i < 16384; i++) *p++ = 'A' + (i % 26);
+  p += sprintf(p, "\r\n--"LG_BOUNDARY"--\r\n");
+  *p = 0;
+  lg.req[MIX_MULTIPART] = malloc(16384 + 1024);
+  sprintf(lg.req[MIX_MULTIPART],
+      "POST / HTTP/1.1\r\n"
+      "Host: localhost\r\n"
+      "Content-Type: multipart/form-data; boundary="LG_BOUNDARY"\r\n"
+      "Content-Length: %u\r\n"
+      "\r\n%s", (uint32_t)(p - body), body);
+  free(body);
+
+  lg.req[MIX_CHUNKED] = strdup(
+      "GET /stream HTTP/1.1\r\n"
+      "Host: localhost\r\n"
+      "\r\n");
+
+  for (i = 0; i < _MIX_COUNT; i++) lg.req_len[i] = strlen(lg.req[i]);
+}
+
+static int parse_mix(char *mix) {
+  char *tok;
+  memset(lg.weights, 0, sizeof(lg.weights));
+  for (tok = strtok(mix, ","); tok; tok = strtok(0, ",")) {
+    char *eq = strchr(tok, '=');
+    uint32_t w = 1;
+    uint32_t i;
+    if (eq) {
+      *eq = 0;
+      w = atoi(eq + 1);
+    }
+    for (i = 0; i < _MIX_COUNT; i++) {
+      if (strcmp(tok, LG_MIX_NAMES[i]) == 0) break;
+    }
+    if (i == _MIX_COUNT) {
+      printf("unknown request type %s\n", tok);
+      return -1;
+    }
+    lg.weights[i] = w;
+  }
+  return 0;
+}
+
+static lg_mix pick_mix(void) {
+  uint32_t i, r;
+  lg.rnd = lg.rnd * 1103515245 + 12345;
+  r = (lg.rnd >> 8) % lg.weight_sum;
+  for (i = 0; i < _MIX_COUNT; i++) {
+    if (r < lg.weights[i]) return i;
+    r -= lg.weights[i];
+  }
+  return MIX_GET;
+}
+
+// --- connections
+
+// server address, loopback port or unix socket path, returns its length
+static socklen_t server_addr(struct sockaddr_storage *sa) {
+  memset(sa, 0, sizeof(*sa));
+  if (lg.path[0]) {
+    struct sockaddr_un *sun = (struct sockaddr_un *)sa;
+    sun->sun_family = AF_UNIX;
+    strcpy(sun->sun_path, lg.path);
+    return sizeof(struct sockaddr_un);
+  }
+  struct sockaddr_in *sin = (struct sockaddr_in *)sa;
+  sin->sin_family = AF_INET;
+  sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sin->sin_port = htons(lg.port);
+  return sizeof(struct sockaddr_in);
+}
+
+static int conn_open(lg_conn *c) {
+  struct sockaddr_storage addr;
+  socklen_t addr_len = server_addr(&addr);
+  int one = 1;
+  c->fd = socket(addr.ss_family, SOCK_STREAM, 0);
+  if (c->fd < 0) return -1;
+  if (addr.ss_family != AF_UNIX) setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fcntl(c->fd, F_SETFL, O_NONBLOCK);
+  if (connect(c->fd, (struct sockaddr *)&addr, addr_len) < 0 && errno != EINPROGRESS) {
+    close(c->fd);
+    c->fd = -1;
+    return -1;
+  }
+  lg.connects++;
+  return 0;
+}
+
+static void conn_close(lg_conn *c) {
+  if (c->fd >= 0) close(c->fd);
+  c->fd = -1;
+}
+
+static void conn_request(lg_conn *c) {
+  lg_mix m = pick_mix();
+  c->tx = lg.req[m];
+  c->tx_len = lg.req_len[m];
+  c->tx_ix = 0;
+  c->sending = 1;
+  c->rstate = R_STATUS;
+  c->line_len = 0;
+  c->content_length = -1;
+  c->chunked = 0;
+  c->status = 0;
+  c->t_start = now_ns();
+}
+
+static void conn_line(lg_conn *c) {
+  c->line[c->line_len] = 0;
+  switch (c->rstate) {
+  case R_STATUS:
+    if (strncmp(c->line, "HTTP/1.", 7) == 0) {
+      c->status = atoi(&c->line[9]);
+      c->rstate = R_HEADERS;
+    }
+    break;
+  case R_HEADERS:
+    if (c->line_len == 0) {
+      if (c->chunked) {
+        c->rstate = R_CHUNK_SIZE;
+      } else {
+        c->left = c->content_length > 0 ? c->content_length : 0;
+        c->rstate = R_BODY;
+      }
+    } else if (strncasecmp(c->line, "Content-Length:", 15) == 0) {
+      c->content_length = atoi(&c->line[15]);
+    } else if (strncasecmp(c->line, "Transfer-Encoding:", 18) == 0) {
+      c->chunked = strstr(&c->line[18], "chunked") != 0;
+    }
+    break;
+  case R_CHUNK_SIZE:
+    c->left = strtol(c->line, 0, 16);
+    c->rstate = c->left ? R_CHUNK_DATA : R_TRAILER;
+    break;
+  case R_CHUNK_END:
+    c->rstate = R_CHUNK_SIZE;
+    break;
+  case R_TRAILER:
+    if (c->line_len == 0) c->rstate = R_BODY, c->left = 0;
+    break;
+  default:
+    break;
+  }
+  c->line_len = 0;
+}
+
+// consume response bytes, returns 1 when the response is complete
+static int conn_rx(lg_conn *c, uint8_t *buf, uint32_t len) {
+  uint32_t i = 0;
+  while (i < len) {
+    if (c->rstate == R_BODY) {
+      uint32_t n = len - i < c->left ? len - i : c->left;
+      c->left -= n;
+      i += n;
+      if (c->left == 0) return 1;
+    } else if (c->rstate == R_CHUNK_DATA) {
+      uint32_t n = len - i < c->left ? len - i : c->left;
+      c->left -= n;
+      i += n;
+      if (c->left == 0) c->rstate = R_CHUNK_END;
+    } else {
+      uint8_t ch = buf[i++];
+      if (ch == '\r') continue;
+      if (ch == '\n') {
+        conn_line(c);
+        if (c->rstate == R_BODY && c->left == 0) return 1;
+      } else if (c->line_len < LG_LINE_LEN - 1) {
+        c->line[c->line_len++] = ch;
+      }
+    }
+  }
+  return c->rstate == R_BODY && c->left == 0;
+}
+
+// open a connection and send its first request, a failed open counts as an
+// error and is retried on the next poll round
+static void conn_start(lg_conn *c) {
+  if (conn_open(c) < 0) {
+    lg.errors++;
+    return;
+  }
+  conn_request(c);
+}
+
+static void conn_done(lg_conn *c) {
+  hist_record(now_ns() - c->t_start);
+  lg.requests++;
+  if (c->status < 200 || c->status >= 300) lg.status_bad++;
+  if (lg.short_lived) {
+    conn_close(c);
+    conn_start(c);
+  } else {
+    conn_request(c);
+  }
+}
+
+static void conn_fail(lg_conn *c) {
+  lg.errors++;
+  conn_close(c);
+  conn_start(c);
+}
+
+static void run_load(void) {
+  static uint8_t rx[LG_RX_LEN];
+  uint64_t t_end;
+  int i;
+
+  for (i = 0; i < lg.conns; i++) conn_start(&lg.conn[i]);
+
+  t_end = now_ns() + (uint64_t)lg.duration * 1000000000ULL;
+  while (now_ns() < t_end) {
+    for (i = 0; i < lg.conns; i++) {
+      if (lg.conn[i].fd < 0) conn_start(&lg.conn[i]);
+      lg.pfd[i].fd = lg.conn[i].fd;
+      lg.pfd[i].events = lg.conn[i].sending ? POLLOUT : POLLIN;
+      lg.pfd[i].revents = 0;
+    }
+    int res = poll(lg.pfd, lg.conns, 100);
+    if (res < 0 && errno != EINTR) {
+      perror("poll");
+      break;
+    }
+    if (res <= 0) continue;
+    for (i = 0; i < lg.conns; i++) {
+      lg_conn *c = &lg.conn[i];
+      if (c->fd < 0 || lg.pfd[i].revents == 0) continue;
+      if (c->sending) {
+        ssize_t n = send(c->fd, &c->tx[c->tx_ix], c->tx_len - c->tx_ix, MSG_NOSIGNAL);
+        if (n < 0) {
+          if (errno != EAGAIN) conn_fail(c);
+          continue;
+        }
+        c->tx_ix += n;
+        if (c->tx_ix == c->tx_len) c->sending = 0;
+      } else {
+        ssize_t n = recv(c->fd, rx, sizeof(rx), 0);
+        if (n <= 0) {
+          if (n < 0 && errno == EAGAIN) continue;
+          conn_fail(c);
+          continue;
+        }
+        lg.rx_bytes += n;
+        if (conn_rx(c, rx, n)) conn_done(c);
+      }
+    }
+  }
+
+  for (i = 0; i < lg.conns; i++) conn_close(&lg.conn[i]);
+}
+
+static int wait_for_server(void) {
+  int tries;
+  for (tries = 0; tries < 100; tries++) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = server_addr(&addr);
+    int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+    int res = connect(fd, (struct sockaddr *)&addr, addr_len);
+    close(fd);
+    if (res == 0) return 0;
+    usleep(20000);
+  }
+  return -1;
+}
+
+static void report(uint64_t elapsed_ns) {
+  double secs = elapsed_ns / 1e9;
+  uint32_t i;
+  printf("connections:  %i (%s)\n", lg.conns, lg.short_lived ? "short-lived" : "keep-alive");
+  printf("mix:         ");
+  for (i = 0; i < _MIX_COUNT; i++) {
+    if (lg.weights[i]) printf(" %s=%u", LG_MIX_NAMES[i], lg.weights[i]);
+  }
+  printf("\n");
+  printf("duration:     %.2f s\n", secs);
+  printf("requests:     %llu (%.1f req/s)\n", (unsigned long long)lg.requests, lg.requests / secs);
+  printf("received:     %.2f MB/s\n", lg.rx_bytes / secs / (1024.0 * 1024.0));
+  printf("connects:     %llu\n", (unsigned long long)lg.connects);
+  printf("errors:       %llu\n", (unsigned long long)lg.errors);
+  printf("non-2xx:      %llu\n", (unsigned long long)lg.status_bad);
+  printf("latency:      p50 %.1f us  p90 %.1f us  p99 %.1f us  p99.9 %.1f us  max %.1f us\n",
+         hist_percentile(50) / 1e3, hist_percentile(90) / 1e3, hist_percentile(99) / 1e3,
+         hist_percentile(99.9) / 1e3, hist_percentile(100) / 1e3);
+  printf("histogram:\n");
+  uint64_t total = 0, cum = 0;
+  for (i = 0; i < LG_HIST_LEN; i++) total += lg.hist[i];
+  // print in power of two rows, the first row being the exact range
+  uint32_t shift = 0;
+  for (i = 0; i < LG_HIST_LEN; i = i == 0 ? LG_HIST_SUB : i + LG_HIST_HALF, shift++) {
+    uint32_t end = i == 0 ? LG_HIST_SUB : i + LG_HIST_HALF;
+    uint64_t n = 0;
+    uint32_t j;
+    for (j = i; j < end; j++) n += lg.hist[j];
+    if (n == 0) continue;
+    cum += n;
+    printf("  < %10.1f us %10llu %7.3f%%\n", 2.0 * (1ULL << (LG_HIST_SUB_BITS - 1 + shift)) / 1e3,
+           (unsigned long long)n, 100.0 * cum / total);
+  }
+}
+
+int run_loadgen(int argc, char **args) {
+  int arg;
+  int external = 0;
+  pid_t server = 0;
+  char mix[128] = "get=1";
+
+  memset(&lg, 0, sizeof(lg));
+  lg.port = 8081;
+  lg.conns = 8;
+  lg.duration = 5;
+  lg.rnd = 1;
+  for (arg = 1; arg < argc; arg++) {
+    if (strcmp("-c", args[arg]) == 0 && arg + 1 < argc) lg.conns = atoi(args[++arg]);
+    else if (strcmp("-d", args[arg]) == 0 && arg + 1 < argc) lg.duration = atoi(args[++arg]);
+    else if (strcmp("-p", args[arg]) == 0 && arg + 1 < argc) lg.port = atoi(args[++arg]);
+    else if (strcmp("-u", args[arg]) == 0 && arg + 1 < argc) strncpy(lg.path, args[++arg], sizeof(lg.path) - 1);
+    else if (strcmp("-m", args[arg]) == 0 && arg + 1 < argc) strncpy(mix, args[++arg], sizeof(mix) - 1);
+    else if (strcmp("-s", args[arg]) == 0) lg.short_lived = 1;
+    else if (strcmp("-x", args[arg]) == 0) external = 1;
+  }
+  if (lg.conns < 1) lg.conns = 1;
+  if (lg.conns > LG_MAX_CONNS) lg.conns = LG_MAX_CONNS;
+  if (parse_mix(mix) < 0) return -1;
+  for (arg = 0; arg < _MIX_COUNT; arg++) lg.weight_sum += lg.weights[arg];
+  if (lg.weight_sum == 0) {
+    printf("empty request mix\n");
+    return -1;
+  }
+  build_requests();
+
+  if (!external) {
+    server = fork();
+    if (server == 0) {
+      socket_server_verbose(0);
+      if (lg.path[0]) {
+        char addr[sizeof(lg.path) + 5];
+        sprintf(addr, "unix:%s", lg.path);
+        socket_server_listen(addr);
+      }
+      start_socket_server(lg.port);
+      exit(EXIT_SUCCESS);
+    }
+  }
+  if (wait_for_server() < 0) {
+    if (lg.path[0]) printf("no server at %s\n", lg.path);
+    else printf("no server on port %i\n", lg.port);
+    if (server > 0) kill(server, SIGKILL);
+    return -1;
+  }
+
+  uint64_t t0 = now_ns();
+  run_load();
+  report(now_ns() - t0);
+
+  if (server > 0) {
+    kill(server, SIGTERM);
+    waitpid(server, 0, 0);
+  }
+  for (arg = 0; arg < _MIX_COUNT; arg++) free(lg.req[arg]);
+  return 0;
+}
@@ -0,0 +1,104 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "uweb_outq.h"
+
+uint64_t outq_total_bytes;
+
+outq_buf *outq_buf_new(const uint8_t *data, uint32_t len) {
+  outq_buf *b = malloc(sizeof(outq_buf) + len);
+  if (b == NULL) return NULL;
+  b->refs = 1;
+  b->len = len;
+  if (data) memcpy(b->data, data, len);
+  return b;
+}
+
+void outq_buf_ref(outq_buf *b) {
+  b->refs++;
+}
+
+void outq_buf_unref(outq_buf *b) {
+  if (--b->refs == 0) free(b);
+}
+
+int outq_push(outq *q, outq_buf *b) {
+  outq_item *it = malloc(sizeof(outq_item));
+  if (it == NULL) return -1;
+  outq_buf_ref(b);
+  it->next = NULL;
+  it->buf = b;
+  it->offs = 0;
+  if (q->tail) q->tail->next = it;
+  else q->head = it;
+  q->tail = it;
+  q->bytes += b->len;
+  outq_total_bytes += b->len;
+  return 0;
+}
+
+int outq_push_copy(outq *q, const uint8_t *data, uint32_t len) {
+  outq_buf *b = outq_buf_new(data, len);
+  if (b == NULL) return -1;
+  int res = outq_push(q, b);
+  outq_buf_unref(b);
+  return res;
+}
+
+static void _outq_pop(outq *q) {
+  outq_item *it = q->head;
+  uint32_t left = it->buf->len - it->offs;
+  q->bytes -= left;
+  outq_total_bytes -= left;
+  q->head = it->next;
+  if (q->head == NULL) q->tail = NULL;
+  outq_buf_unref(it->buf);
+  free(it);
+}
+
+int outq_flush(outq *q, int fd) {
+  while (q->head) {
+    outq_item *it = q->head;
+    uint32_t left = it->buf->len - it->offs;
+    ssize_t l = send(fd, &it->buf->data[it->offs], left, MSG_NOSIGNAL);
+    if (l < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 1 : -1;
+    }
+    if ((uint32_t)l < left) {
+      it->offs += l;
+      q->bytes -= l;
+      outq_total_bytes -= l;
+      return 1;
+    }
+    _outq_pop(q);
+  }
+  return 0;
+}
+
+void outq_clear(outq *q) {
+  while (q->head) _outq_pop(q);
+}
@@ -0,0 +1,73 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Connection output queue.
+ * Output the socket cannot take right away is queued as references to
+ * refcounted buffers, so one buffer can be queued on many connections.
+ * The bytes queued over all connections are tracked for admission control.
+ */
+
+#ifndef _UWEB_OUTQ_H_
+#define _UWEB_OUTQ_H_
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t refs;
+  uint32_t len;
+  uint8_t data[];
+} outq_buf;
+
+typedef struct outq_item_s {
+  struct outq_item_s *next;
+  outq_buf *buf;
+  uint32_t offs;
+} outq_item;
+
+typedef struct {
+  outq_item *head;
+  outq_item *tail;
+  uint32_t bytes;
+} outq;
+
+/* Bytes queued in all queues */
+extern uint64_t outq_total_bytes;
+
+/* Returns a new buffer with one reference holding a copy of data, or 0.
+   With data 0 the buffer is left for the caller to fill in */
+outq_buf *outq_buf_new(const uint8_t *data, uint32_t len);
+void outq_buf_ref(outq_buf *b);
+void outq_buf_unref(outq_buf *b);
+
+/* Queues buffer, taking a reference. Returns -1 if out of memory */
+int outq_push(outq *q, outq_buf *b);
+/* Queues a copy of data. Returns -1 if out of memory */
+int outq_push_copy(outq *q, const uint8_t *data, uint32_t len);
+/* Writes as much as possible to nonblocking fd. Returns 0 when
+   queue is empty, 1 if data remains, -1 on error */
+int outq_flush(outq *q, int fd);
+/* Drops all queued data */
+void outq_clear(outq *q);
+
+#endif /* _UWEB_OUTQ_H_ */
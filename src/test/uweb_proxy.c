@@ -0,0 +1,552 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "uweb_upstream.h"
+#include "uweb_proxy.h"
+
+// request header fields that concern one connection only
+static const char * const hop_fields[] = {
+  "Connection:",
+  "Keep-Alive:",
+  "Proxy-Connection:",
+  "TE:",
+  "Transfer-Encoding:",
+  "Upgrade:",
+  "Expect:",
+  "HTTP2-Settings:",
+};
+
+// response relay states
+typedef enum {
+  P_STATUS = 0,
+  P_HEADERS,
+  P_BODY,
+  P_BODY_CLOSE,
+  P_CHUNK_SIZE,
+  P_CHUNK_DATA,
+  P_CHUNK_END,
+  P_TRAILER,
+  P_DONE
+} proxy_state;
+
+typedef struct {
+  char prefix[PROXY_PREFIX_LEN];
+  int backend;
+} proxy_route_t;
+
+struct proxy_req_s {
+  proxy_client cl;
+  int backend;
+  upstream_conn *u;
+  // request header, kept until the response begins to resend it on a
+  // pooled connection the backend closed meanwhile
+  uint8_t *hdr;
+  uint32_t hdr_len;
+  uint32_t hdr_size;
+  uint8_t oom;
+  uint8_t head;
+  uint8_t req_body;
+  // request fully sent upstream
+  uint8_t req_done;
+  // request trailer begun
+  uint8_t trailer;
+  // client held, the upstream queue is full
+  uint8_t held;
+  // client connection closes after the response
+  uint8_t close;
+  // client write failed
+  uint8_t broken;
+  uint8_t state;
+  // something was received from, or passed to the client
+  uint8_t got;
+  uint8_t started;
+  uint8_t chunked;
+  uint8_t has_len;
+  // backend connection can not be reused
+  uint8_t up_close;
+  uint16_t status;
+  // body or chunk bytes left
+  uint64_t left;
+  char line[PROXY_LINE_LEN];
+  uint32_t line_len;
+  // client output coalesced
+  uint8_t obuf[PROXY_BUF_LEN];
+  uint32_t olen;
+};
+
+static proxy_route_t routes[PROXY_MAX_ROUTES];
+static int route_count;
+static uint8_t rbuf[PROXY_BUF_LEN];
+// backend to client splicing pipe, emptied after each use
+static int spipe[2] = { -1, -1 };
+static int spipe_failed;
+
+int proxy_route(const char *prefix, const char *backend) {
+  int b = upstream_backend(backend);
+  if (b < 0 || route_count >= PROXY_MAX_ROUTES || strlen(prefix) >= PROXY_PREFIX_LEN) return -1;
+  strcpy(routes[route_count].prefix, prefix);
+  routes[route_count].backend = b;
+  return route_count++;
+}
+
+int proxy_match(const char *resource) {
+  int i;
+  for (i = 0; i < route_count; i++) {
+    if (strncmp(resource, routes[i].prefix, strlen(routes[i].prefix)) == 0) return i;
+  }
+  return -1;
+}
+
+static void _proxy_hdr_add(proxy_req *p, const void *data, uint32_t len) {
+  if (p->hdr_len + len > p->hdr_size) {
+    uint32_t size = p->hdr_size ? p->hdr_size * 2 : 512;
+    while (size < p->hdr_len + len) size *= 2;
+    uint8_t *hdr = realloc(p->hdr, size);
+    if (hdr == NULL) {
+      p->oom = 1;
+      return;
+    }
+    p->hdr = hdr;
+    p->hdr_size = size;
+  }
+  memcpy(&p->hdr[p->hdr_len], data, len);
+  p->hdr_len += len;
+}
+
+proxy_req *proxy_new(int route, uweb_request_header *req, const proxy_client *cl) {
+  proxy_req *p = calloc(1, sizeof(proxy_req));
+  if (p == NULL) return NULL;
+  p->cl = *cl;
+  p->backend = routes[route].backend;
+  p->head = req->method == HEAD;
+  const char *method = UWEB_HTTP_REQ_METHODS[req->method];
+  _proxy_hdr_add(p, method, strlen(method));
+  _proxy_hdr_add(p, " ", 1);
+  _proxy_hdr_add(p, req->resource, strlen(req->resource));
+  _proxy_hdr_add(p, " HTTP/1.1\r\n", 11);
+  return p;
+}
+
+void proxy_field(proxy_req *p, const char *line, uint32_t len) {
+  uint32_t i;
+  for (i = 0; i < sizeof(hop_fields) / sizeof(hop_fields[0]); i++) {
+    if (strncasecmp(line, hop_fields[i], strlen(hop_fields[i])) == 0) return;
+  }
+  _proxy_hdr_add(p, line, len);
+  _proxy_hdr_add(p, "\r\n", 2);
+}
+
+void proxy_respond(UW_STREAM out, uweb_http_status status, const char *msg) {
+  char buf[256];
+  int len = snprintf(buf, sizeof(buf),
+      "HTTP/1.1 %i %s\r\n"
+      "Content-Type: text/plain\r\n"
+      "Content-Length: %i\r\n"
+      "Connection: close\r\n"
+      "\r\n%s",
+      UWEB_HTTP_STATUS_NUM[status], UWEB_HTTP_STATUS_STRING[status], (int)strlen(msg), msg);
+  out->write(out, (uint8_t *)buf, len);
+}
+
+// done with the backend connection, and with the request
+static void _proxy_finish(proxy_req *p, int reuse, int close) {
+  upstream_conn *u = p->u;
+  p->u = NULL;
+  if (u) {
+    if (reuse) upstream_put(u);
+    else upstream_close(u);
+  }
+  // frees p
+  p->cl.done(p->cl.arg, close);
+}
+
+static void _proxy_event(upstream_conn *u, uint32_t events);
+
+static void _proxy_fail(proxy_req *p) {
+  if (!p->started) {
+    p->olen = 0;
+    proxy_respond(p->cl.out, S502_BAD_GATEWAY, PROXY_MSG_BAD_GATEWAY);
+  }
+  _proxy_finish(p, 0, 1);
+}
+
+static void _proxy_flush(proxy_req *p) {
+  if (p->olen) {
+    p->started = 1;
+    if (p->cl.out->write(p->cl.out, p->obuf, p->olen) < 0) p->broken = 1;
+    p->olen = 0;
+  }
+  if (p->u && p->cl.q->bytes > PROXY_MAX_QUEUED) {
+    // client is behind, leave the rest with the backend
+    upstream_rx(p->u, 0);
+  }
+}
+
+static void _proxy_out(proxy_req *p, const void *data, uint32_t len) {
+  const uint8_t *d = (const uint8_t *)data;
+  while (len) {
+    uint32_t n = sizeof(p->obuf) - p->olen;
+    if (n == 0) {
+      _proxy_flush(p);
+      continue;
+    }
+    if (n > len) n = len;
+    memcpy(&p->obuf[p->olen], d, n);
+    p->olen += n;
+    d += n;
+    len -= n;
+  }
+}
+
+static void _proxy_out_line(proxy_req *p, const char *line, uint32_t len) {
+  _proxy_out(p, line, len);
+  _proxy_out(p, "\r\n", 2);
+}
+
+// response header complete, pick the body framing
+static void _proxy_header_done(proxy_req *p) {
+  if (p->head || p->status == 204 || p->status == 304) {
+    p->state = P_DONE;
+  } else if (p->chunked) {
+    p->state = P_CHUNK_SIZE;
+  } else if (p->has_len) {
+    p->state = p->left ? P_BODY : P_DONE;
+  } else {
+    // body ends when the backend closes
+    p->state = P_BODY_CLOSE;
+    p->close = 1;
+    p->up_close = 1;
+  }
+  if (p->close) _proxy_out_line(p, "Connection: close", 17);
+  _proxy_out(p, "\r\n", 2);
+  // no resending from here on
+  free(p->hdr);
+  p->hdr = NULL;
+}
+
+// handles a received response line, returns -1 if it is bad
+static int _proxy_line(proxy_req *p) {
+  char *line = p->line;
+  uint32_t len = p->line_len;
+  switch (p->state) {
+  case P_STATUS:
+    if (len < 12 || strncmp(line, "HTTP/1.", 7) != 0 || line[8] != ' ') return -1;
+    p->status = atoi(&line[9]);
+    if (p->status < 100) return -1;
+    // a HTTP/1.0 backend closes unless asked not to
+    if (line[7] == '0') p->up_close = 1;
+    if (p->status >= 200) {
+      _proxy_out(p, "HTTP/1.1", 8);
+      _proxy_out_line(p, &line[8], len - 8);
+    }
+    p->state = P_HEADERS;
+    break;
+  case P_HEADERS:
+    if (len == 0) {
+      // interim responses are not relayed
+      if (p->status < 200) p->state = P_STATUS;
+      else _proxy_header_done(p);
+      break;
+    }
+    if (p->status < 200) break;
+    if (strncasecmp(line, "Connection:", 11) == 0 ||
+        strncasecmp(line, "Keep-Alive:", 11) == 0 ||
+        strncasecmp(line, "Proxy-Connection:", 17) == 0) {
+      if (strcasestr(line, "close")) p->up_close = 1;
+      break;
+    }
+    if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strcasestr(line, "chunked")) {
+      p->chunked = 1;
+    } else if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      char *end;
+      p->left = strtoull(&line[15], &end, 10);
+      if (end == &line[15]) return -1;
+      p->has_len = 1;
+    }
+    _proxy_out_line(p, line, len);
+    break;
+  case P_CHUNK_SIZE: {
+    char *end;
+    p->left = strtoull(line, &end, 16);
+    if (end == line) return -1;
+    _proxy_out_line(p, line, len);
+    p->state = p->left ? P_CHUNK_DATA : P_TRAILER;
+    break;
+  }
+  case P_CHUNK_END:
+    if (len) return -1;
+    _proxy_out(p, "\r\n", 2);
+    p->state = P_CHUNK_SIZE;
+    break;
+  case P_TRAILER:
+    _proxy_out_line(p, line, len);
+    if (len == 0) p->state = P_DONE;
+    break;
+  }
+  return 0;
+}
+
+// relays received response bytes, returns -1 if the response is bad
+static int _proxy_input(proxy_req *p, const uint8_t *data, uint32_t len) {
+  while (len) {
+    switch (p->state) {
+    case P_BODY:
+    case P_CHUNK_DATA: {
+      uint32_t n = p->left < len ? (uint32_t)p->left : len;
+      _proxy_out(p, data, n);
+      data += n;
+      len -= n;
+      p->left -= n;
+      if (p->left == 0) p->state = p->state == P_BODY ? P_DONE : P_CHUNK_END;
+      break;
+    }
+    case P_BODY_CLOSE:
+      _proxy_out(p, data, len);
+      len = 0;
+      break;
+    case P_DONE:
+      // more than the response, the connection is out of step
+      p->up_close = 1;
+      len = 0;
+      break;
+    default: {
+      const uint8_t *nl = memchr(data, '\n', len);
+      uint32_t n = nl ? (uint32_t)(nl - data) : len;
+      if (p->line_len + n >= PROXY_LINE_LEN) return -1;
+      memcpy(&p->line[p->line_len], data, n);
+      p->line_len += n;
+      if (nl == NULL) return 0;
+      data += n + 1;
+      len -= n + 1;
+      if (p->line_len && p->line[p->line_len - 1] == '\r') p->line_len--;
+      p->line[p->line_len] = 0;
+      if (_proxy_line(p) < 0) return -1;
+      p->line_len = 0;
+      break;
+    }
+    }
+  }
+  return 0;
+}
+
+static int _proxy_can_splice(proxy_req *p) {
+  if ((p->state != P_BODY && p->state != P_BODY_CLOSE && p->state != P_CHUNK_DATA) ||
+      p->olen || p->cl.q->head || p->cl.fd < 0 || spipe_failed) {
+    return 0;
+  }
+  if (spipe[0] < 0 && pipe2(spipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+    spipe_failed = 1;
+    return 0;
+  }
+  return 1;
+}
+
+// moves body bytes from backend to client socket without copying them,
+// what the client socket does not take is queued as usual
+static ssize_t _proxy_splice(proxy_req *p) {
+  size_t want = PROXY_SPLICE_LEN;
+  if (p->state != P_BODY_CLOSE && p->left < want) want = p->left;
+  ssize_t n = splice(p->u->fd, NULL, spipe[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (n <= 0) return n;
+  ssize_t sent = splice(spipe[0], NULL, p->cl.fd, NULL, n, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (sent < 0) sent = 0;
+  p->started = 1;
+  while (sent < n) {
+    ssize_t r = read(spipe[0], rbuf, n - sent < (ssize_t)sizeof(rbuf) ? (size_t)(n - sent) : sizeof(rbuf));
+    if (r <= 0) break;
+    if (p->cl.out->write(p->cl.out, rbuf, r) < 0) p->broken = 1;
+    sent += r;
+  }
+  if (p->state != P_BODY_CLOSE) {
+    p->left -= n;
+    if (p->left == 0) p->state = p->state == P_BODY ? P_DONE : P_CHUNK_END;
+  }
+  return n;
+}
+
+// sends the request header again on a new connection
+static int _proxy_retry(proxy_req *p) {
+  upstream_close(p->u);
+  p->u = upstream_get(p->backend, _proxy_event, p);
+  if (p->u == NULL) return -1;
+  return upstream_write(p->u, p->hdr, p->hdr_len);
+}
+
+static void _proxy_eof(proxy_req *p) {
+  if (p->state == P_BODY_CLOSE) {
+    _proxy_flush(p);
+    _proxy_finish(p, 0, 1);
+    return;
+  }
+  // a pooled connection closed by the backend before it got the request
+  if (!p->got && p->u->reused && !p->req_body && _proxy_retry(p) == 0) return;
+  _proxy_fail(p);
+}
+
+static void _proxy_read(proxy_req *p) {
+  int i;
+  // a few rounds, then other connections get their turn
+  for (i = 0; i < 8 && p->u->rx_on; i++) {
+    ssize_t n;
+    if (_proxy_can_splice(p)) {
+      n = _proxy_splice(p);
+    } else {
+      n = read(p->u->fd, rbuf, sizeof(rbuf));
+      if (n > 0) {
+        p->got = 1;
+        if (_proxy_input(p, rbuf, n) < 0) {
+          _proxy_fail(p);
+          return;
+        }
+      }
+    }
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+      _proxy_fail(p);
+      return;
+    }
+    if (n == 0) {
+      _proxy_eof(p);
+      return;
+    }
+    p->got = 1;
+    // the response header goes out whole
+    if (p->state >= P_BODY) _proxy_flush(p);
+    if (p->broken) {
+      _proxy_finish(p, 0, 1);
+      return;
+    }
+    if (p->state == P_DONE) {
+      _proxy_finish(p, !p->up_close && p->req_done, p->close);
+      return;
+    }
+  }
+}
+
+static void _proxy_event(upstream_conn *u, uint32_t events) {
+  proxy_req *p = (proxy_req *)u->user;
+  p->cl.activity(p->cl.arg);
+  if (events & UPSTREAM_ERROR) {
+    if (!p->got && u->reused && !p->req_body && _proxy_retry(p) == 0) return;
+    _proxy_fail(p);
+    return;
+  }
+  if ((events & UPSTREAM_DRAINED) && p->held) {
+    p->held = 0;
+    p->cl.hold(p->cl.arg, 0);
+  }
+  if (events & UPSTREAM_READABLE) _proxy_read(p);
+}
+
+int proxy_begin(proxy_req *p, uweb_request_header *req) {
+  if (req->chunked) _proxy_hdr_add(p, "Transfer-Encoding: chunked\r\n", 28);
+  _proxy_hdr_add(p, "\r\n", 2);
+  if (p->oom) return -1;
+  p->close = strcasestr(req->connection, "close") != NULL;
+  p->req_body = req->chunked || req->content_length > 0;
+  p->req_done = !p->req_body;
+  // a response being cached is captured on its way out, not spliced past it
+  UW_STREAM out = UWEB_ctx_out(req->ctx, p->cl.out);
+  if (out != p->cl.out) {
+    p->cl.out = out;
+    p->cl.fd = -1;
+  }
+  p->u = upstream_get(p->backend, _proxy_event, p);
+  if (p->u == NULL) return -1;
+  if (upstream_write(p->u, p->hdr, p->hdr_len) < 0) {
+    upstream_close(p->u);
+    p->u = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+// writes to backend, small pieces coalesced with their chunk framing
+static int _proxy_up(proxy_req *p, const char *pre, const uint8_t *data, uint32_t len, const char *post) {
+  uint32_t pre_len = strlen(pre), post_len = strlen(post);
+  if (pre_len + len + post_len <= sizeof(rbuf)) {
+    memcpy(rbuf, pre, pre_len);
+    memcpy(&rbuf[pre_len], data, len);
+    memcpy(&rbuf[pre_len + len], post, post_len);
+    return upstream_write(p->u, rbuf, pre_len + len + post_len);
+  }
+  if (upstream_write(p->u, (const uint8_t *)pre, pre_len) < 0 ||
+      upstream_write(p->u, data, len) < 0) {
+    return -1;
+  }
+  return upstream_write(p->u, (const uint8_t *)post, post_len);
+}
+
+void proxy_body(proxy_req *p, uweb_data_type type, uint8_t *data, uint32_t len) {
+  int res = 0;
+  if (p->u == NULL || p->req_done) return;
+  if (type == DATA_CHUNK && data == 0 && len == 0) {
+    res = _proxy_up(p, p->trailer ? "" : "0\r\n", 0, 0, "\r\n");
+    p->req_done = 1;
+  } else if (type == DATA_CHUNK) {
+    char size[16];
+    sprintf(size, "%x\r\n", len);
+    res = _proxy_up(p, size, data, len, "\r\n");
+  } else if (type == DATA_CHUNK_TRAILER) {
+    res = _proxy_up(p, p->trailer ? "" : "0\r\n", data, len, "\r\n");
+    p->trailer = 1;
+  } else if (len == 0) {
+    p->req_done = 1;
+  } else {
+    res = upstream_write(p->u, data, len);
+  }
+  if (res < 0) {
+    _proxy_fail(p);
+    return;
+  }
+  if (!p->held && p->u->q.bytes > PROXY_MAX_QUEUED) {
+    // backend is behind, stop receiving the body
+    p->held = 1;
+    p->cl.hold(p->cl.arg, 1);
+  }
+}
+
+void proxy_drained(proxy_req *p) {
+  if (p->u && !p->u->rx_on && p->cl.q->bytes < PROXY_MAX_QUEUED / 2) upstream_rx(p->u, 1);
+}
+
+void proxy_expired(proxy_req *p) {
+  if (p->started) return;
+  if (p->req_done) proxy_respond(p->cl.out, S504_GATEWAY_TIMEOUT, PROXY_MSG_GATEWAY_TIMEOUT);
+  else proxy_respond(p->cl.out, S408_REQUEST_TIMEOUT, UWEB_HTTP_MSG_TIMEOUT);
+  p->started = 1;
+}
+
+void proxy_free(proxy_req *p) {
+  if (p->u) upstream_close(p->u);
+  free(p->hdr);
+  free(p);
+}
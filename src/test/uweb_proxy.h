@@ -0,0 +1,100 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Reverse proxy.
+ * Requests for a routed resource prefix are relayed to a backend over
+ * pooled keep-alive connections, see uweb_upstream.h. The request header
+ * goes upstream as received less hop-by-hop fields, and the body follows as
+ * it arrives, a chunked body chunked again. The response keeps its framing,
+ * Content-Length, chunked or until close. Its body is spliced from backend
+ * socket to client socket while the client keeps up, else copied and
+ * queued, and the backend is not read while the client is too far behind.
+ */
+
+#ifndef _UWEB_PROXY_H_
+#define _UWEB_PROXY_H_
+
+#include <stdint.h>
+#include "../uweb.h"
+#include "uweb_outq.h"
+
+#define PROXY_MAX_ROUTES            8
+#define PROXY_PREFIX_LEN            64
+#define PROXY_BUF_LEN               16384
+// longest response header line from a backend
+#define PROXY_LINE_LEN              8192
+// bytes moved per splice
+#define PROXY_SPLICE_LEN            65536
+// output queued to either side before the other side is held back
+#define PROXY_MAX_QUEUED            (256 * 1024)
+
+#define PROXY_MSG_BAD_GATEWAY       "Bad gateway\n"
+#define PROXY_MSG_GATEWAY_TIMEOUT   "Gateway timed out\n"
+
+// the client side of a relayed request
+typedef struct {
+  // client output, queuing what the socket can not take
+  UW_STREAM out;
+  // client socket and its queue, spliced to when nothing is queued
+  int fd;
+  outq *q;
+  // the backend made progress
+  void (*activity)(void *arg);
+  // stop or resume receiving the request body
+  void (*hold)(void *arg, int on);
+  // response relayed or failed, close if the connection must be closed.
+  // The proxy request is done with and may be freed
+  void (*done)(void *arg, int close);
+  void *arg;
+} proxy_client;
+
+typedef struct proxy_req_s proxy_req;
+
+/* Relays requests for resources starting with prefix to backend, given as
+   unix:<path> or <host>:<port>. Returns -1 on a bad backend or too many */
+int proxy_route(const char *prefix, const char *backend);
+/* Returns the route of resource, -1 if not routed */
+int proxy_match(const char *resource);
+/* Starts a request on route, method and resource are known. Returns 0 if
+   out of memory */
+proxy_req *proxy_new(int route, uweb_request_header *req, const proxy_client *cl);
+/* Passes a request header field line on */
+void proxy_field(proxy_req *p, const char *line, uint32_t len);
+/* Sends the request header to the backend when the header is complete.
+   Returns -1 if no backend connection could be had */
+int proxy_begin(proxy_req *p, uweb_request_header *req);
+/* Passes request body data on, as reported to the data function */
+void proxy_body(proxy_req *p, uweb_data_type type, uint8_t *data, uint32_t len);
+/* Call when the client output queue shrank */
+void proxy_drained(proxy_req *p);
+/* Call when the client connection times out. Answers 504, or 408 if the
+   request body is not received, unless the response is under way */
+void proxy_expired(proxy_req *p);
+/* Answers with status and a text message when no response has begun, the
+   connection is to be closed after it */
+void proxy_respond(UW_STREAM out, uweb_http_status status, const char *msg);
+/* Frees request, closing its backend connection if still held */
+void proxy_free(proxy_req *p);
+
+#endif /* _UWEB_PROXY_H_ */
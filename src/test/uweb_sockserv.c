@@ -21,122 +21,465 @@ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#define _GNU_SOURCE
 #include "testrunner.h"
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include "../uweb.h"
+#include "uweb_timer.h"
+#include "uweb_outq.h"
+#include "uweb_upstream.h"
+#include "uweb_proxy.h"
+#include "uweb_fcgi.h"
+#include "uweb_sockserv.h"
 
 #define CONTENT_PATH "test_data"
+#define STREAM_CHUNK_LEN 64
+#define STREAM_CHUNKS    64
+
+#define SOCKSERV_RX_LEN             4096
+#define SOCKSERV_TICK_MS            10
+#define SOCKSERV_CHANNELS           16
+#define SOCKSERV_CHANNEL_LEN        32
+#define SOCKSERV_CACHE_ROUTES       8
+#define SOCKSERV_LISTENERS          8
+#define SOCKSERV_ADDR_LEN           128
+
+#if UWEB_CFG_ASSETS
+// test_data, see ASSET_DIR in makefile
+extern const uweb_assets uweb_web_assets;
+#endif
+
+struct conn_s;
+
+// event channel and its subscribers
+typedef struct {
+  char name[SOCKSERV_CHANNEL_LEN];
+  struct conn_s *subs;
+  uint32_t last_id;
+} channel;
+
+// a connection; parser context, timer and streams
+typedef struct conn_s {
+  int fd;
+  uweb_ctx ctx;
+  uweb_timer timer;
+  uweb_data_stream in;
+  uweb_data_stream out;
+  uweb_data_stream res;
+  uint8_t rx[SOCKSERV_RX_LEN];
+  // tick when current request started, 0 if idle
+  uint64_t t_request;
+  // tick of last received data
+  uint64_t t_activity;
+  uint32_t requests;
+  // output the socket could not take yet
+  outq q;
+  // request in flight, from first byte until response is sent
+  uint8_t busy;
+  uint8_t closing;
+  // output limit hit mid response, the rest of it is dropped
+  uint8_t shed;
+  // closed, freed after the current event batch
+  uint8_t dead;
+  struct conn_s *reap_next;
+  // request relayed to a backend, HTTP or FastCGI
+  proxy_req *proxy;
+  fcgi_req *fcgi;
+  uint8_t proxied;
+  // not reading, the backend is behind
+  uint8_t hold;
+  // within UWEB_ctx_parse
+  uint8_t parsing;
+  // message being received; websocket echo or event to publish
+  uint8_t *msg;
+  uint32_t msg_len;
+  // event channel subscription
+  channel *chan;
+  struct conn_s *sub_prev;
+  struct conn_s *sub_next;
+  uint32_t dropped;
+} conn;
+
+// a listening socket, its epoll tag
+typedef struct {
+  int fd;
+  int family;
+  // as given, e.g. unix:/run/uweb.sock
+  char addr[SOCKSERV_ADDR_LEN];
+} listener;
 
-static uweb_data_stream in_stream, out_stream, res_stream;
 static volatile int running;
+static listener listeners[SOCKSERV_LISTENERS];
+static int listener_count;
+static int verbose = 1;
+static int ep;
+static uweb_timer_wheel wheel;
+static uint32_t conn_count;
+// closed connections, freed when no event of the batch can refer to them
+static conn *reap;
+static uint32_t inflight;
+// epoll tag of the backend connection set
+static uint8_t upstream_tag;
+
+// admission limits: connections, requests in flight, queued output bytes
+static uint32_t max_conns = 1024;
+static uint32_t max_inflight = 256;
+static uint64_t max_queued = 64 * 1024 * 1024;
+
+// timeouts in ms: whole header, body idle, keep-alive idle, whole request
+static uint32_t to_header = 10000;
+static uint32_t to_body_idle = 10000;
+static uint32_t to_keepalive = 5000;
+static uint32_t to_request = 60000;
+// websocket idle
+static uint32_t to_websocket = 300000;
+
+// event channels; output bytes a subscriber may have queued, and whether
+// to drop the subscriber or the events when it is exceeded
+static channel channels[SOCKSERV_CHANNELS];
+static uint32_t max_sub_queued = 256 * 1024;
+static int drop_subscriber = 0;
+
+#if UWEB_CFG_CACHE
+// cached resource prefixes, and ms their responses are kept
+typedef struct {
+  char prefix[PROXY_PREFIX_LEN];
+  uint32_t ttl_ms;
+} cache_route;
+
+static cache_route cache_routes[SOCKSERV_CACHE_ROUTES];
+static uint32_t cache_route_count;
+// responses differ by content negotiation
+static const char * const cache_vary[] = { "Accept", "Accept-Encoding", 0 };
+#endif
 
+static uint64_t now_tick(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000) / SOCKSERV_TICK_MS;
+}
+
+static uint64_t ms_ticks(uint32_t ms) {
+  return (ms + SOCKSERV_TICK_MS - 1) / SOCKSERV_TICK_MS;
+}
+
+// sets the epoll events of a connection; not reading while closing, held
+// or while a deferred response holds back the next pipelined request
+static void conn_watch(conn *c, int out) {
+  struct epoll_event ev = { .events = out ? EPOLLOUT : 0, .data.ptr = c };
+  if (!c->closing && !c->hold && UWEB_ctx_phase(&c->ctx) != UWEB_PHASE_DEFERRED) {
+    ev.events |= EPOLLIN;
+  }
+  epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+}
 
-static int32_t sockstr_read(UW_STREAM str, uint8_t *dst, uint32_t len) {
-  int32_t r = recv((intptr_t)str->user, dst, len, 0);
-  return r;
+// reads what was received into the connection buffer
+static int32_t rxstr_read(UW_STREAM str, uint8_t *dst, uint32_t len) {
+  if (len > (uint32_t)str->avail_sz) len = str->avail_sz;
+  memcpy(dst, (uint8_t *)str->user + str->rd_offs, len);
+  str->rd_offs += len;
+  str->avail_sz -= len;
+  return len;
 }
 
+// writes to socket directly, queues what it cannot take
 static int32_t sockstr_write(UW_STREAM str, uint8_t *src, uint32_t len) {
-  int l;
-  while (len) {
-    l = write((intptr_t)str->user, src, len);
-    if (l < 0) break;
-    len -= l;
+  conn *c = (conn *)str->user;
+  uint32_t sent = 0;
+  if (c->shed) return -1;
+  if (c->q.head == NULL) {
+    int l = send(c->fd, src, len, MSG_NOSIGNAL);
+    if (l < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      c->closing = 1;
+      return -1;
+    }
+    if (l > 0) sent = l;
+    if (sent < len) conn_watch(c, 1);
+  }
+  if (sent < len && outq_total_bytes + (len - sent) > max_queued) {
+    // a response outgrowing the output limit sheds its connection
+    if (verbose) printf("--- %i over output limit\n", c->fd);
+    outq_clear(&c->q);
+    c->shed = 1;
+    c->closing = 1;
+    return -1;
+  }
+  if (sent < len && outq_push_copy(&c->q, src + sent, len - sent) < 0) {
+    c->closing = 1;
+    return -1;
   }
-  return l;
+  return len;
+}
+
+// writes directly to a socket without connection, for shedding
+static int32_t fdstr_write(UW_STREAM str, uint8_t *src, uint32_t len) {
+  return send((int)(intptr_t)str->user, src, len, MSG_NOSIGNAL | MSG_DONTWAIT);
 }
 
-UW_STREAM make_socket_stream(UW_STREAM str, int sockfd)
-{
-  str->total_sz = -1;
-  str->avail_sz = 256;
-  str->user = (void *)((intptr_t)sockfd);
-  str->read = sockstr_read;
-  str->write = sockstr_write;
-  return str;
+static void sockstr_close(UW_STREAM str) {
+  ((conn *)str->user)->closing = 1;
 }
 
+// splices from a pipe or file to the socket while nothing is queued before it
+static int32_t sockstr_splice(UW_STREAM str, UW_STREAM src, uint32_t len) {
+  conn *c = (conn *)str->user;
+  if (c->shed || c->q.head) return 0;
+  int32_t n = UWEB_stream_splice(src, c->fd, len);
+  if (n < 0) {
+    c->closing = 1;
+    return -1;
+  }
+  return n;
+}
 
-static int32_t filestr_read(UW_STREAM str, uint8_t *dst, uint32_t len) {
-  int32_t r = read((intptr_t)str->user, dst, len);
-  if (r > 0) {
-    str->total_sz -= r;
-    str->avail_sz -= r;
+// generated response, STREAM_CHUNKS chunks of the alphabet, suspended
+// while the client is behind
+static int stream_gen(uweb_gen *gen, uweb_request_header *req) {
+  static uint8_t chunk[STREAM_CHUNK_LEN];
+  uint32_t i;
+  (void)req;
+  UWEB_GEN_BEGIN(gen);
+  for (i = 0; i < STREAM_CHUNK_LEN; i++) {
+    chunk[i] = 'a' + (i % 26);
   }
-  if (r <= 0 || str->total_sz == 0) {
-    close((intptr_t)str->user);
-    str->avail_sz = 0;
+  for (gen->ix = 0; gen->ix < STREAM_CHUNKS; gen->ix++) {
+    UWEB_GEN_YIELD(gen, chunk, STREAM_CHUNK_LEN);
   }
-  return r;
+  UWEB_GEN_END(gen);
+}
+
+#if UWEB_TRACE_LEVEL > UWEB_TRACE_OFF && UWEB_CFG_ARENA
+#define TRACE_DUMP_LEN  (sizeof(uweb_trace_hdr) + UWEB_TRACE_LEN * sizeof(uweb_trace_rec))
+#define TRACE_MSG_NO_MEMORY "Out of memory\n"
+
+typedef struct {
+  uint8_t *buf;
+  uint32_t len;
+} trace_dump;
+
+static void trace_emit(void *arg, const uint8_t *data, uint32_t len) {
+  trace_dump *d = (trace_dump *)arg;
+  memcpy(&d->buf[d->len], data, len);
+  d->len += len;
 }
+#endif
 
-static int32_t filestr_write(UW_STREAM str, uint8_t *src, uint32_t len) {
-  int l;
-  while (len) {
-    l = write((intptr_t)str->user, src, len);
-    if (l < 0) break;
-    len -= l;
+// a generated response waits while output is queued
+static int uweb_blocked_fn(uweb_request_header *req) {
+  conn *c = (conn *)req->ctx->user;
+  return c->q.head != NULL;
+}
+
+static void conn_relay_activity(void *arg);
+static void conn_relay_hold(void *arg, int on);
+static void conn_relay_done(void *arg, int close);
+
+// starts relaying a routed request
+static void conn_relay_new(conn *c, uweb_request_header *req) {
+  proxy_client cl = {
+    .out = &c->out, .fd = c->fd, .q = &c->q,
+    .activity = conn_relay_activity, .hold = conn_relay_hold, .done = conn_relay_done,
+    .arg = c
+  };
+  int route = proxy_match(req->resource);
+  if (route >= 0) {
+    c->proxy = proxy_new(route, req, &cl);
+  } else if ((route = fcgi_match(req->resource)) >= 0) {
+    c->fcgi = fcgi_new(route, req, &cl);
   }
-  return l;
 }
 
-UW_STREAM make_file_stream(UW_STREAM str, int fd)
-{
-  uint32_t sz = lseek(fd, 0L, SEEK_END);
-  lseek(fd, 0L, SEEK_SET);
-  str->total_sz = sz;
-  str->avail_sz = sz;
-  str->user = (void *)((intptr_t)fd);
-  str->read = filestr_read;
-  str->write = filestr_write;
-  return str;
+static void conn_relay_free(conn *c) {
+  if (c->proxy) proxy_free(c->proxy);
+  if (c->fcgi) fcgi_free(c->fcgi);
+  c->proxy = NULL;
+  c->fcgi = NULL;
+}
+
+// header field of a request; a routed one is relayed as it comes. A
+// request failing before it is answered closes the connection, so there
+// is no relay left over from an earlier one
+static void uweb_field_fn(uweb_request_header *req, const char *line, uint32_t len) {
+  conn *c = (conn *)req->ctx->user;
+  if (c->proxy == NULL && c->fcgi == NULL) conn_relay_new(c, req);
+  if (c->proxy) proxy_field(c->proxy, line, len);
+  if (c->fcgi) fcgi_field(c->fcgi, line, len);
 }
 
-UW_STREAM make_null_stream(UW_STREAM str)
-{
-  str->total_sz = 0;
-  str->avail_sz = 0;
-  str->read = 0;
-  str->write = 0;
-  return str;
+#if UWEB_CFG_CACHE
+static uint32_t uweb_cache_fn(uweb_request_header *req) {
+  uint32_t i;
+  for (i = 0; i < cache_route_count; i++) {
+    if (strncmp(req->resource, cache_routes[i].prefix, strlen(cache_routes[i].prefix)) == 0) {
+      return cache_routes[i].ttl_ms;
+    }
+  }
+  return 0;
+}
+
+// answered from the cache, the relay set up for it is not needed; one
+// that waited for another request's response is done
+static void uweb_cached_fn(uweb_request_header *req, int waited) {
+  conn *c = (conn *)req->ctx->user;
+  if (waited) conn_relay_done(c, 0);
+  else conn_relay_free(c);
 }
+#endif
 
 static uweb_response uweb_response_fn(uweb_request_header *req, UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+  conn *c = (conn *)req->ctx->user;
+  // per request storage when offered, e.g. per HTTP/2 stream
+  uweb_data_stream *res_stream = *res ? *res : &c->res;
+  if (req->chunk_nbr == 0) c->requests++;
+#if UWEB_TRACE_LEVEL > UWEB_TRACE_OFF && UWEB_CFG_ARENA
+  if (strcmp("/trace", req->resource) == 0) {
+    // binary trace dump of this connection, decode with uweb_tracedec.
+    // Kept in the request arena until the response is sent
+    trace_dump d = { (uint8_t *)UWEB_req_alloc(req, TRACE_DUMP_LEN), 0 };
+    if (d.buf == 0) {
+      UWEB_stream_mem(res_stream, TRACE_MSG_NO_MEMORY, strlen(TRACE_MSG_NO_MEMORY));
+      *http_status = S503_SERVICE_UNAVAILABLE;
+      *res = res_stream;
+      return UWEB_OK;
+    }
+    UWEB_ctx_trace_dump(req->ctx, trace_emit, &d);
+    UWEB_stream_mem(res_stream, d.buf, d.len);
+    strcpy(content_type, "application/octet-stream");
+    *res = res_stream;
+    return UWEB_OK;
+  }
+#endif
+  c->proxied = 0;
+  if (proxy_match(req->resource) >= 0 || fcgi_match(req->resource) >= 0) {
+    if (req->stream_id) {
+      // HTTP/2 streams are not relayed, uweb answers them 501
+      conn_relay_free(c);
+      return UWEB_DEFERRED;
+    }
+    // a request without header fields
+    if (c->proxy == NULL && c->fcgi == NULL) conn_relay_new(c, req);
+    if ((c->proxy && proxy_begin(c->proxy, req) == 0) ||
+        (c->fcgi && fcgi_begin(c->fcgi, req) == 0)) {
+      c->proxied = 1;
+      return UWEB_DEFERRED;
+    }
+    conn_relay_free(c);
+    UWEB_stream_mem(res_stream, PROXY_MSG_BAD_GATEWAY, strlen(PROXY_MSG_BAD_GATEWAY));
+    *http_status = S502_BAD_GATEWAY;
+    *res = res_stream;
+    return UWEB_OK;
+  }
+  if (strncmp("/events/", req->resource, 8) == 0) {
+    // subscribed once the header is sent
+    return UWEB_return_event_stream(req, &req->resource[8]);
+  }
+  if (strncmp("/publish/", req->resource, 9) == 0) {
+    // body is published when received
+    UWEB_stream_mem(res_stream, "", 0);
+    *res = res_stream;
+    return UWEB_OK;
+  }
+#if UWEB_CFG_WEBSOCKET
+  if (req->websocket && strcmp("/ws", req->resource) == 0) {
+    // echo websocket
+    return UWEB_WEBSOCKET;
+  }
+#endif
+  if (strcmp("/stream", req->resource) == 0) {
+    strcpy(content_type, "text/plain");
+    return UWEB_return_generator(req, stream_gen, 0);
+  }
   if (req->chunk_nbr == 0) {
-    printf("opening %s\n", &req->resource[1]);
-    char path[512];
+    if (verbose) printf("opening %s\n", &req->resource[1]);
+    char path[512] = "";
     if (strcmp("/exit", req->resource) == 0 ||
         strcmp("/quit", req->resource) == 0 ||
         strcmp("/stop", req->resource) == 0 ||
         strcmp("/halt", req->resource) == 0) {
       printf("req stop server\n");
       running = 0;
-      in_stream.avail_sz = 0;
+      c->in.avail_sz = 0;
     } else if (strlen(req->resource) == 1) { // "/"
       sprintf(path, "./%s/index.html", CONTENT_PATH);
     } else {
       sprintf(path, "./%s%s", CONTENT_PATH, req->resource);
     }
 
-    int fd = open(path, O_RDONLY, S_IRUSR | S_IWUSR);
-    if (fd > 0) {
-      make_file_stream(&res_stream, fd);
-    } else {
-      make_null_stream(&res_stream);
+#if UWEB_CFG_ASSETS
+    // bundled at build time, the file system serves the rest
+    const uweb_asset *a = UWEB_asset_find(&uweb_web_assets, req->resource);
+    if (a && (req->method == GET || req->method == HEAD)) {
+      return UWEB_asset_serve(req, a, res_stream, res, http_status, content_type, extra_headers);
+    }
+#endif
+    // mapped or sent by offset, from the open file cache
+    if (UWEB_stream_file(res_stream, path) == 0) {
+      UWEB_stream_mem(res_stream, "", 0);
       *http_status = S404_NOT_FOUND;
     }
   }
-  *res = &res_stream;
+  *res = res_stream;
 
   return UWEB_CHUNKED;
 }
 
+// collect message data, returns 1 when the message is complete
+static int msg_collect(conn *c, uint32_t offset, uint8_t *data, uint32_t length) {
+  if (length == 0) return 1;
+  uint8_t *msg = realloc(c->msg, offset + length);
+  if (msg == NULL) return 0;
+  memcpy(&msg[offset], data, length);
+  c->msg = msg;
+  c->msg_len = offset + length;
+  return 0;
+}
+
+static void msg_free(conn *c) {
+  free(c->msg);
+  c->msg = NULL;
+  c->msg_len = 0;
+}
+
 static void uweb_data_fn(uweb_request_header *req, uweb_data_type type, uint32_t offset, uint8_t *data, uint32_t length) {
+  conn *c = (conn *)req->ctx->user;
+  if (c->proxied) {
+    // gone once the response is relayed
+    if (c->proxy) proxy_body(c->proxy, type, data, length);
+    else if (c->fcgi) fcgi_body(c->fcgi, type, data, length);
+    return;
+  }
+#if UWEB_CFG_WEBSOCKET
+  if (type == DATA_WS_TEXT || type == DATA_WS_BINARY) {
+    // echo
+    if (msg_collect(c, offset, data, length)) {
+      UWEB_ws_send(&c->out, type == DATA_WS_TEXT ? WS_TEXT : WS_BINARY, c->msg, c->msg_len);
+      msg_free(c);
+    }
+    return;
+  }
+#endif
+  if (type == DATA_CONTENT && strncmp("/publish/", req->resource, 9) == 0) {
+    if (msg_collect(c, offset, data, length)) {
+      socket_server_publish(&req->resource[9], NULL, c->msg, c->msg_len);
+      msg_free(c);
+    }
+    return;
+  }
+  if (!verbose) return;
   printf("DATA ");
   printf("type:%s  ", type == DATA_CONTENT ? "CONTENT" : (type == DATA_CHUNK ? "CHUNK" : (type == DATA_MULTIPART ? "MULTIPART" : "?")));
   printf("offset:%6i  length:%6i\n", offset, length);
@@ -171,63 +514,613 @@ static void uweb_data_fn(uweb_request_header *req, uweb_data_type type, uint32_t
   }
 }
 
-void start_socket_server(int port) {
-  running = 1;
-  int sockfd, client_sock, clilen, read_size;
-  struct sockaddr_in server, client;
+void socket_server_verbose(int on) {
+  verbose = on;
+}
 
-  // create socket
-  sockfd = socket(AF_INET, SOCK_STREAM, 0);
-  if (sockfd == -1) {
-    printf("could not create socket\n");
-    return;
+void socket_server_timeouts(uint32_t header_ms, uint32_t body_idle_ms,
+    uint32_t keepalive_ms, uint32_t request_ms) {
+  to_header = header_ms;
+  to_body_idle = body_idle_ms;
+  to_keepalive = keepalive_ms;
+  to_request = request_ms;
+}
+
+void socket_server_limits(uint32_t conns, uint32_t requests, uint64_t queued_bytes) {
+  max_conns = conns;
+  max_inflight = requests;
+  max_queued = queued_bytes;
+}
+
+static channel *channel_find(const char *name, int create) {
+  uint32_t i;
+  channel *free_ch = NULL;
+  for (i = 0; i < SOCKSERV_CHANNELS; i++) {
+    if (channels[i].name[0] == 0) {
+      if (free_ch == NULL) free_ch = &channels[i];
+    } else if (strcmp(channels[i].name, name) == 0) {
+      return &channels[i];
+    }
+  }
+  if (!create || free_ch == NULL || name[0] == 0 || strlen(name) >= SOCKSERV_CHANNEL_LEN) return NULL;
+  strcpy(free_ch->name, name);
+  return free_ch;
+}
+
+static int conn_subscribe(conn *c, const char *name) {
+  channel *ch = channel_find(name, 1);
+  if (ch == NULL) return -1;
+  c->chan = ch;
+  c->sub_prev = NULL;
+  c->sub_next = ch->subs;
+  if (ch->subs) ch->subs->sub_prev = c;
+  ch->subs = c;
+  if (verbose) printf("--- %i subscribed to %s\n", c->fd, ch->name);
+  return 0;
+}
+
+static void conn_unsubscribe(conn *c) {
+  channel *ch = c->chan;
+  if (ch == NULL) return;
+  if (c->sub_prev) c->sub_prev->sub_next = c->sub_next;
+  else ch->subs = c->sub_next;
+  if (c->sub_next) c->sub_next->sub_prev = c->sub_prev;
+  c->chan = NULL;
+  if (ch->subs == NULL) {
+    // last one out frees the channel
+    ch->name[0] = 0;
+    ch->last_id = 0;
+  }
+}
+
+static void conn_close(conn *c) {
+  if (c->dead) return;
+  if (verbose) printf("<<< closed %i\n", c->fd);
+  if (c->busy) inflight--;
+  c->busy = 0;
+  outq_clear(&c->q);
+  free(c->msg);
+  c->msg = NULL;
+  conn_relay_free(c);
+  conn_unsubscribe(c);
+  UWEB_ctx_close(&c->ctx);
+  timer_cancel(&c->timer);
+  epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  conn_count--;
+  // e.g. a publisher closing subscribers, later events may still point here
+  c->dead = 1;
+  c->reap_next = reap;
+  reap = c;
+}
+
+static void conn_reap(void) {
+  while (reap) {
+    conn *c = reap;
+    reap = c->reap_next;
+    free(c);
+  }
+}
+
+// arm connection timer to the nearest deadline of current phase
+static void conn_rearm(conn *c, uint64_t now) {
+  uint64_t deadline;
+  uweb_phase phase = UWEB_ctx_phase(&c->ctx);
+  if ((phase == UWEB_PHASE_IDLE || phase == UWEB_PHASE_WEBSOCKET || phase == UWEB_PHASE_EVENT_STREAM) &&
+      c->busy && c->q.head == NULL) {
+    // response sent, or upgraded; open streams are not requests in flight
+    c->busy = 0;
+    inflight--;
+  }
+  if (c->q.head && phase != UWEB_PHASE_WEBSOCKET && phase != UWEB_PHASE_EVENT_STREAM) {
+    // client must keep reading the response
+    phase = UWEB_PHASE_BODY;
+  }
+  switch (phase) {
+  case UWEB_PHASE_IDLE:
+    c->t_request = 0;
+    deadline = c->t_activity + ms_ticks(c->requests ? to_keepalive : to_header);
+    break;
+  case UWEB_PHASE_WEBSOCKET:
+    c->t_request = 0;
+    deadline = c->t_activity + ms_ticks(to_websocket);
+    break;
+  case UWEB_PHASE_EVENT_STREAM:
+    c->t_request = 0;
+    if (c->q.head == NULL) {
+      // waits for events as long as the client stays
+      timer_cancel(&c->timer);
+      return;
+    }
+    // subscriber must keep reading
+    deadline = c->t_activity + ms_ticks(to_body_idle);
+    break;
+  case UWEB_PHASE_HEADER:
+    // counted from request start, trickling bytes does not extend it
+    if (c->t_request == 0) c->t_request = now;
+    deadline = c->t_request + ms_ticks(to_header);
+    break;
+  default:
+    if (c->t_request == 0) c->t_request = now;
+    deadline = c->t_activity + ms_ticks(to_body_idle);
+    break;
+  }
+  if (c->t_request && c->t_request + ms_ticks(to_request) < deadline) {
+    deadline = c->t_request + ms_ticks(to_request);
   }
+  timer_arm(&wheel, &c->timer, deadline);
+}
 
-  // prepare the sockaddr_in structure
-  server.sin_family = AF_INET;
-  server.sin_addr.s_addr = INADDR_ANY;
-  server.sin_port = htons(port);
+static void conn_expired(uweb_timer *t, void *arg) {
+  (void)arg;
+  conn *c = (conn *)((uint8_t *)t - offsetof(conn, timer));
+  if (verbose) printf("--- timeout %i\n", c->fd);
+  // sends 408 unless idle, closes websockets; a relayed request 504
+  if (c->q.head == NULL && c->proxy) proxy_expired(c->proxy);
+  if (c->q.head == NULL && c->fcgi) fcgi_expired(c->fcgi);
+  if (c->q.head == NULL) UWEB_ctx_timeout(&c->ctx, &c->out);
+  conn_close(c);
+}
 
-  // bind
-  if (bind(sockfd, (struct sockaddr *) &server, sizeof(server)) < 0) {
-    perror("bind failed.");
+// close now, or when queued output is sent
+static void conn_closing(conn *c, uint64_t now) {
+  if (c->q.head == NULL) {
+    conn_close(c);
     return;
   }
+  conn_watch(c, 1);
+  conn_rearm(c, now);
+}
 
-  int istrue = 1;
-  setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &istrue, sizeof(int));
+static void conn_accept(listener *l, uint64_t now) {
+  while (1) {
+    int fd = accept4(l->fd, NULL, NULL, SOCK_NONBLOCK);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept failed");
+      return;
+    }
+    if (conn_count >= max_conns) {
+      // reject before allocating anything
+      uweb_data_stream shed = { .user = (void *)(intptr_t)fd, .write = fdstr_write };
+      UWEB_shed(&shed, UWEB_SHED_CONNECTIONS);
+      close(fd);
+      continue;
+    }
+    conn *c = malloc(sizeof(conn));
+    if (c == NULL) {
+      close(fd);
+      continue;
+    }
+    if (l->family != AF_UNIX) {
+      int istrue = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &istrue, sizeof(int));
+    }
+    c->fd = fd;
+    c->t_request = 0;
+    c->t_activity = now;
+    c->requests = 0;
+    c->busy = 0;
+    c->closing = 0;
+    c->shed = 0;
+    c->dead = 0;
+    c->msg = NULL;
+    c->msg_len = 0;
+    c->chan = NULL;
+    c->dropped = 0;
+    c->proxy = NULL;
+    c->fcgi = NULL;
+    c->proxied = 0;
+    c->hold = 0;
+    c->parsing = 0;
+    memset(&c->q, 0, sizeof(outq));
+    UWEB_ctx_init(&c->ctx, uweb_response_fn, uweb_data_fn);
+    c->ctx.user = c;
+    UWEB_ctx_set_field_f(&c->ctx, uweb_field_fn);
+    UWEB_ctx_set_blocked_f(&c->ctx, uweb_blocked_fn);
+#if UWEB_CFG_CACHE
+    UWEB_ctx_set_cached_f(&c->ctx, uweb_cached_fn);
+#endif
+    memset(&c->in, 0, sizeof(uweb_data_stream));
+    c->in.user = c->rx;
+    c->in.read = rxstr_read;
+    memset(&c->out, 0, sizeof(uweb_data_stream));
+    c->out.total_sz = -1;
+    c->out.user = c;
+    c->out.write = sockstr_write;
+    c->out.close = sockstr_close;
+    c->out.splice = sockstr_splice;
+    UWEB_stream_mem(&c->res, "", 0);
+    timer_init(&c->timer);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    conn_count++;
+    conn_rearm(c, now);
+    if (verbose) printf(">>> accepted %i\n", fd);
+  }
+}
 
-  // listen
-  listen(sockfd, 8);
+static void conn_parsed(conn *c, uint32_t requests, uint64_t now);
 
-  // accept and incoming connection
-  printf("uweb server started @ port %i\n", port);
-  clilen = sizeof(struct sockaddr_in);
+// output drained, a suspended generator goes on, and pipelined requests
+// are parsed when it is done
+static void conn_resume(conn *c, uint64_t now) {
+  uint32_t requests = c->requests;
+  c->parsing = 1;
+  UWEB_ctx_resume(&c->ctx, &c->in, &c->out);
+  c->parsing = 0;
+  conn_watch(c, c->q.head != NULL);
+  conn_parsed(c, requests, now);
+}
 
-  UWEB_init(uweb_response_fn, uweb_data_fn);
+static void conn_write(conn *c, uint64_t now) {
+  uint32_t queued = c->q.bytes;
+  int res = outq_flush(&c->q, c->fd);
+  if (res < 0) {
+    conn_close(c);
+    return;
+  }
+  if (c->q.bytes != queued) c->t_activity = now;
+  if (c->proxy) {
+    // the backend may go on
+    proxy_drained(c->proxy);
+    if (c->dead) return;
+  }
+  if (res == 0) {
+    if (c->closing) {
+      conn_close(c);
+      return;
+    }
+    if (c->ctx.gen_f) {
+      conn_resume(c, now);
+      return;
+    }
+    conn_watch(c, 0);
+  }
+  conn_rearm(c, now);
+}
 
-  while (running) {
-    // accept connection from an incoming client
-    client_sock = accept(sockfd, (struct sockaddr *)&client,
-                         (socklen_t *)&clilen);
-    if (client_sock < 0) {
-      perror("accept failed");
-      close(sockfd);
+// after parsing; closes, subscribes or rearms the connection
+static void conn_parsed(conn *c, uint32_t requests, uint64_t now) {
+  if (c->closing) {
+    conn_closing(c, now);
+    return;
+  }
+  if (c->requests != requests) c->t_request = 0;
+  if (c->chan == NULL && UWEB_ctx_phase(&c->ctx) == UWEB_PHASE_EVENT_STREAM &&
+      conn_subscribe(c, c->ctx.req->event_channel) < 0) {
+    conn_close(c);
+    return;
+  }
+  conn_rearm(c, now);
+}
+
+static void conn_read(conn *c, uint32_t events, uint64_t now) {
+  if (c->hold || UWEB_ctx_phase(&c->ctx) == UWEB_PHASE_DEFERRED) {
+    // not reading, only a hangup is of interest
+    if (events & (EPOLLHUP | EPOLLERR)) conn_close(c);
+    return;
+  }
+  int32_t len = recv(c->fd, c->rx, SOCKSERV_RX_LEN, 0);
+  if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+  if (len <= 0) {
+    conn_close(c);
+    return;
+  }
+  uweb_phase phase = UWEB_ctx_phase(&c->ctx);
+  if (!c->busy && phase != UWEB_PHASE_WEBSOCKET && phase != UWEB_PHASE_EVENT_STREAM) {
+    // a new request, admit it before parsing
+    if (inflight >= max_inflight) {
+      UWEB_shed(&c->out, UWEB_SHED_REQUESTS);
+    } else if (outq_total_bytes >= max_queued) {
+      UWEB_shed(&c->out, UWEB_SHED_OUTPUT);
+    } else {
+      c->busy = 1;
+      inflight++;
+    }
+    if (c->closing) {
+      conn_closing(c, now);
       return;
     }
+  }
+  uint32_t requests = c->requests;
+  c->t_activity = now;
+  c->in.rd_offs = 0;
+  c->in.avail_sz = len;
+  c->parsing = 1;
+  UWEB_ctx_parse(&c->ctx, &c->in, &c->out);
+  c->parsing = 0;
+  conn_parsed(c, requests, now);
+}
 
-    //fcntl(sockfd, F_SETFL, O_NONBLOCK);
-    printf(">>> accepted\n");
+static void conn_relay_activity(void *arg) {
+  conn *c = (conn *)arg;
+  c->t_activity = now_tick();
+  conn_rearm(c, c->t_activity);
+}
 
-    UW_STREAM req_str = make_socket_stream(&in_stream, client_sock);
-    UW_STREAM out_str = make_socket_stream(&out_stream, client_sock);
+static void conn_relay_hold(void *arg, int on) {
+  conn *c = (conn *)arg;
+  c->hold = on;
+  conn_watch(c, c->q.head != NULL);
+}
 
-    UWEB_parse(req_str, out_str);
+// relayed response is out, parse on with what was received meanwhile
+static void conn_relay_done(void *arg, int close) {
+  conn *c = (conn *)arg;
+  uint32_t requests = c->requests;
+  conn_relay_free(c);
+  c->hold = 0;
+  if (close) c->closing = 1;
+  if (c->parsing) {
+    // from the data function, the rest of the body is parsed and dropped
+    if (!c->closing) UWEB_ctx_deferred_done(&c->ctx, &c->in, &c->out);
+    return;
+  }
+  if (!c->closing) {
+    c->parsing = 1;
+    UWEB_ctx_deferred_done(&c->ctx, &c->in, &c->out);
+    c->parsing = 0;
+    conn_watch(c, c->q.head != NULL);
+  }
+  conn_parsed(c, requests, now_tick());
+}
 
-    close(client_sock);
-    printf("<<< served\n");
+void socket_server_events(uint32_t max_queued_bytes, int drop_subscribers) {
+  max_sub_queued = max_queued_bytes;
+  drop_subscriber = drop_subscribers;
+}
+
+int socket_server_publish(const char *name, const char *event, const uint8_t *data, uint32_t len) {
+  channel *ch = channel_find(name, 0);
+  int queued = 0;
+  if (ch == NULL || ch->subs == NULL) return 0;
+  // format once, all subscribers queue a reference to the same buffer
+  uint32_t id = ch->last_id + 1;
+  uint32_t flen = uweb_sse_format(NULL, 0, event, id, data, len);
+  if (flen == 0) return -1;
+  ch->last_id = id;
+  outq_buf *b = outq_buf_new(NULL, flen);
+  if (b == NULL) return -1;
+  uweb_sse_format((char *)b->data, flen, event, id, data, len);
+  uint64_t now = now_tick();
+  conn *c = ch->subs;
+  while (c) {
+    conn *next = c->sub_next;
+    if (c->q.bytes + flen > max_sub_queued) {
+      // slow subscriber, it sees a gap in event ids
+      c->dropped++;
+      if (drop_subscriber) {
+        if (verbose) printf("--- %i dropped from %s\n", c->fd, ch->name);
+        conn_close(c);
+      }
+    } else if (outq_push(&c->q, b) < 0 || outq_flush(&c->q, c->fd) < 0) {
+      conn_close(c);
+    } else {
+      if (c->q.head) {
+        conn_watch(c, 1);
+        conn_rearm(c, now);
+      }
+      queued++;
+    }
+    c = next;
+  }
+  outq_buf_unref(b);
+  return queued;
+}
+
+int socket_server_proxy(const char *prefix, const char *backend) {
+  return proxy_route(prefix, backend);
+}
+
+int socket_server_fastcgi(const char *prefix, const char *backend) {
+  return fcgi_route(prefix, backend);
+}
+
+#if UWEB_CFG_CACHE
+int socket_server_cache(const char *prefix, uint32_t ttl_ms) {
+  if (cache_route_count >= SOCKSERV_CACHE_ROUTES || strlen(prefix) >= PROXY_PREFIX_LEN) return -1;
+  strcpy(cache_routes[cache_route_count].prefix, prefix);
+  cache_routes[cache_route_count].ttl_ms = ttl_ms;
+  cache_route_count++;
+  UWEB_set_cache_f(uweb_cache_fn, cache_vary);
+  return 0;
+}
+#endif
+
+void run_socket_server(int argc, char **args) {
+  int arg, port = 8080;
+  for (arg = 1; arg < argc; arg++) {
+    if (strcmp("-p", args[arg]) == 0 && arg + 1 < argc) {
+      port = atoi(args[++arg]);
+    } else if (strcmp("-l", args[arg]) == 0 && arg + 1 < argc) {
+      // -l unix:<path>|fd:<n>|[<host>:]<port>, repeatable
+      if (socket_server_listen(args[++arg]) < 0) {
+        printf("cannot listen on %s\n", args[arg]);
+        return;
+      }
+    } else if ((strcmp("-P", args[arg]) == 0 || strcmp("-F", args[arg]) == 0) && arg + 1 < argc) {
+      // -P|-F <prefix>=<backend>, HTTP or FastCGI
+      int fastcgi = args[arg][1] == 'F';
+      char route[PROXY_PREFIX_LEN + UPSTREAM_ADDR_LEN];
+      strncpy(route, args[++arg], sizeof(route) - 1);
+      route[sizeof(route) - 1] = 0;
+      char *eq = strchr(route, '=');
+      if (eq) *eq = 0;
+      if (eq == NULL || (fastcgi ? socket_server_fastcgi(route, eq + 1) : socket_server_proxy(route, eq + 1)) < 0) {
+        printf("bad route %s\n", args[arg]);
+        return;
+      }
+#if UWEB_CFG_CACHE
+    } else if (strcmp("-C", args[arg]) == 0 && arg + 1 < argc) {
+      // -C <prefix>=<ms>
+      char *eq = strchr(args[++arg], '=');
+      if (eq) *eq = 0;
+      if (eq == NULL || socket_server_cache(args[arg], atoi(eq + 1)) < 0) {
+        printf("bad cache route %s\n", args[arg]);
+        return;
+      }
+#endif
+    }
   }
+  socket_server_listen_systemd();
+  start_socket_server(port);
+}
 
-  close(sockfd);
+// binds and listens on a unix domain socket, replacing a stale one
+static int listen_unix(const char *path) {
+  struct sockaddr_un sun;
+  struct stat st;
+  if (path[0] == 0 || strlen(path) >= sizeof(sun.sun_path)) return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  memset(&sun, 0, sizeof(sun));
+  sun.sun_family = AF_UNIX;
+  strcpy(sun.sun_path, path);
+  // left by a server that did not stop cleanly
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+  if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0 || listen(fd, 128) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
 
+// binds and listens on [<host>:]<port>, any address if no host
+static int listen_tcp(const char *addr) {
+  char host[SOCKSERV_ADDR_LEN];
+  struct addrinfo hints, *res;
+  const char *colon = strrchr(addr, ':');
+  const char *port = colon ? colon + 1 : addr;
+  if (port[0] == 0) return -1;
+  host[0] = 0;
+  if (colon) {
+    memcpy(host, addr, colon - addr);
+    host[colon - addr] = 0;
+  }
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = host[0] ? AF_UNSPEC : AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  if (getaddrinfo(host[0] ? host : NULL, port, &hints, &res) != 0) return -1;
+  int fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd >= 0) {
+    int istrue = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &istrue, sizeof(int));
+    if (bind(fd, res->ai_addr, res->ai_addrlen) < 0 || listen(fd, 128) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(res);
+  return fd;
+}
+
+// takes a descriptor already listening, e.g. inherited
+static int listen_inherited(int fd) {
+  int type, accepting;
+  socklen_t len = sizeof(int);
+  if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0 || type != SOCK_STREAM) return -1;
+  len = sizeof(int);
+  if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &len) < 0 || !accepting) return -1;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+int socket_server_listen(const char *addr) {
+  struct sockaddr_storage sa;
+  socklen_t sa_len = sizeof(sa);
+  int fd;
+  if (listener_count >= SOCKSERV_LISTENERS || strlen(addr) >= SOCKSERV_ADDR_LEN) return -1;
+  if (strncmp(addr, "unix:", 5) == 0) {
+    fd = listen_unix(&addr[5]);
+  } else if (strncmp(addr, "fd:", 3) == 0) {
+    fd = addr[3] ? listen_inherited(atoi(&addr[3])) : -1;
+  } else {
+    fd = listen_tcp(addr);
+  }
+  if (fd < 0) return -1;
+  listener *l = &listeners[listener_count++];
+  l->fd = fd;
+  l->family = getsockname(fd, (struct sockaddr *)&sa, &sa_len) == 0 ? sa.ss_family : AF_INET;
+  strcpy(l->addr, addr);
+  return 0;
+}
+
+int socket_server_listen_systemd(void) {
+  const char *pid = getenv("LISTEN_PID");
+  const char *fds = getenv("LISTEN_FDS");
+  int i, n, added = 0;
+  if (pid == NULL || fds == NULL || atoi(pid) != getpid()) return 0;
+  n = atoi(fds);
+  // passed from descriptor 3 on
+  for (i = 0; i < n; i++) {
+    char addr[16];
+    sprintf(addr, "fd:%i", 3 + i);
+    if (socket_server_listen(addr) == 0) added++;
+  }
+  unsetenv("LISTEN_PID");
+  unsetenv("LISTEN_FDS");
+  unsetenv("LISTEN_FDNAMES");
+  return added;
+}
+
+void start_socket_server(int port) {
+  running = 1;
+  struct epoll_event evs[64];
+  int i;
+
+  if (listener_count == 0) {
+    char addr[16];
+    sprintf(addr, "%i", port);
+    if (socket_server_listen(addr) < 0) {
+      perror("bind failed.");
+      return;
+    }
+  }
+
+  ep = epoll_create1(0);
+  // all listeners alike, whatever their kind
+  for (i = 0; i < listener_count; i++) {
+    struct epoll_event lev = { .events = EPOLLIN, .data.ptr = &listeners[i] };
+    epoll_ctl(ep, EPOLL_CTL_ADD, listeners[i].fd, &lev);
+  }
+  // backend connections are watched in a set of their own
+  struct epoll_event uev = { .events = EPOLLIN, .data.ptr = &upstream_tag };
+  epoll_ctl(ep, EPOLL_CTL_ADD, upstream_epoll_fd(), &uev);
+  timer_wheel_init(&wheel, now_tick());
+
+  for (i = 0; i < listener_count; i++) {
+    printf("uweb server started @ %s\n", listeners[i].addr);
+  }
+
+  while (running) {
+    int n = epoll_wait(ep, evs, sizeof(evs) / sizeof(evs[0]), SOCKSERV_TICK_MS);
+    uint64_t now = now_tick();
+    for (i = 0; i < n; i++) {
+      conn *c = (conn *)evs[i].data.ptr;
+      listener *l = (listener *)evs[i].data.ptr;
+      if ((void *)c == &upstream_tag) {
+        upstream_dispatch();
+      } else if (l >= listeners && l < &listeners[listener_count]) {
+        conn_accept(l, now);
+      } else if (c->dead) {
+        continue;
+      } else if (evs[i].events & EPOLLOUT) {
+        conn_write(c, now);
+      } else {
+        conn_read(c, evs[i].events, now);
+      }
+    }
+    timer_wheel_advance(&wheel, now, conn_expired, NULL);
+    conn_reap();
+    upstream_reap();
+  }
+
+  close(ep);
+  for (i = 0; i < listener_count; i++) {
+    close(listeners[i].fd);
+    if (strncmp(listeners[i].addr, "unix:", 5) == 0) unlink(&listeners[i].addr[5]);
+  }
+  listener_count = 0;
 }
@@ -24,6 +24,52 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef _UWEB_SOCKSERV_H_
 #define _UWEB_SOCKSERV_H_
 
+#include <stdint.h>
+
+/* Serves on the listeners added, or if none on TCP port */
 void start_socket_server(int port);
+/* Parses -p <port>, -l <listener>, -P <prefix>=<backend> proxy routes and
+   -F <prefix>=<backend> FastCGI routes, takes any systemd listeners and
+   starts the server */
+void run_socket_server(int argc, char **args);
+/* Adds a listener, given as unix:<path> for a Unix domain stream socket,
+   fd:<n> for a descriptor already listening, e.g. inherited, or
+   [<host>:]<port> for TCP. All are served alike. Returns -1 if the
+   address is bad, it cannot be listened on or there are too many */
+int socket_server_listen(const char *addr);
+/* Adds the listeners passed by systemd socket activation, LISTEN_FDS
+   descriptors from 3 on when LISTEN_PID is this process. Returns how many
+   were added */
+int socket_server_listen_systemd(void);
+void socket_server_verbose(int on);
+/* Sets connection timeouts in milliseconds: whole request header, idle
+   while receiving body, idle between keep-alive requests, whole request */
+void socket_server_timeouts(uint32_t header_ms, uint32_t body_idle_ms,
+    uint32_t keepalive_ms, uint32_t request_ms);
+/* Sets admission limits: concurrent connections, requests in flight and
+   output bytes queued over all connections. Beyond them, connections and
+   new requests are answered with 503, and a response that would queue
+   more output is cut by closing its connection */
+void socket_server_limits(uint32_t conns, uint32_t requests, uint64_t queued_bytes);
+/* Sets how many output bytes a subscriber to GET /events/<channel> may
+   have queued. Beyond that, events are not queued to it, or if
+   drop_subscribers is set, it is disconnected */
+void socket_server_events(uint32_t max_queued_bytes, int drop_subscribers);
+/* Publishes a server-sent event to all subscribers of channel, formatted
+   once and shared by all of them. POST /publish/<channel> publishes the
+   request body. Returns the number of subscribers it was queued to, -1 if
+   the event name holds a line break or out of memory */
+int socket_server_publish(const char *channel, const char *event, const uint8_t *data, uint32_t len);
+
+/* Relays requests for resources starting with prefix to backend, given as
+   unix:<path> or <host>:<port>, over pooled keep-alive connections. Returns
+   -1 if the backend address is bad or there are too many routes */
+int socket_server_proxy(const char *prefix, const char *backend);
+/* Passes requests for resources starting with prefix to FastCGI workers at
+   backend, see socket_server_proxy */
+int socket_server_fastcgi(const char *prefix, const char *backend);
+/* Caches responses to GET and HEAD requests for resources starting with
+   prefix for ttl_ms, relayed ones too. Returns -1 if there are too many */
+int socket_server_cache(const char *prefix, uint32_t ttl_ms);
 
 #endif /* _UWEB_SOCKSERV_H_ */
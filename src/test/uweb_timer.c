@@ -0,0 +1,129 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "uweb_timer.h"
+
+static void _list_init(uweb_timer *head) {
+  head->next = head;
+  head->prev = head;
+}
+
+static void _list_add(uweb_timer *head, uweb_timer *t) {
+  t->next = head;
+  t->prev = head->prev;
+  head->prev->next = t;
+  head->prev = t;
+}
+
+void timer_wheel_init(uweb_timer_wheel *w, uint64_t now) {
+  int l, s;
+  w->now = now;
+  for (l = 0; l < TIMER_LEVELS; l++) {
+    for (s = 0; s < TIMER_SLOTS; s++) {
+      _list_init(&w->slot[l][s]);
+    }
+  }
+}
+
+void timer_init(uweb_timer *t) {
+  t->next = 0;
+  t->prev = 0;
+}
+
+int timer_armed(const uweb_timer *t) {
+  return t->next != 0;
+}
+
+void timer_cancel(uweb_timer *t) {
+  if (!timer_armed(t)) return;
+  t->prev->next = t->next;
+  t->next->prev = t->prev;
+  t->next = 0;
+  t->prev = 0;
+}
+
+// put timer in the slot of the lowest level covering its expiry
+static void _timer_place(uweb_timer_wheel *w, uweb_timer *t) {
+  uint64_t expires = t->expires;
+  uint64_t delta;
+  int l;
+  if (expires < w->now) expires = w->now;
+  delta = expires - w->now;
+  for (l = 0; l < TIMER_LEVELS - 1; l++) {
+    if (delta < (1ULL << (TIMER_LEVEL_BITS * (l + 1)))) break;
+  }
+  if (l == TIMER_LEVELS - 1 &&
+      delta >= (1ULL << (TIMER_LEVEL_BITS * TIMER_LEVELS))) {
+    // beyond wheel range, park at the far end and cascade again later
+    expires = w->now + (1ULL << (TIMER_LEVEL_BITS * TIMER_LEVELS)) - 1;
+  }
+  _list_add(&w->slot[l][(expires >> (TIMER_LEVEL_BITS * l)) & (TIMER_SLOTS - 1)], t);
+}
+
+void timer_arm(uweb_timer_wheel *w, uweb_timer *t, uint64_t expires) {
+  timer_cancel(t);
+  // current tick is already handled, earliest is next
+  t->expires = expires > w->now ? expires : w->now + 1;
+  _timer_place(w, t);
+}
+
+// move all timers of a higher level slot down to where they belong now
+static void _timer_cascade(uweb_timer_wheel *w, int l) {
+  uweb_timer *head = &w->slot[l][(w->now >> (TIMER_LEVEL_BITS * l)) & (TIMER_SLOTS - 1)];
+  uweb_timer list;
+  if (head->next == head) return;
+  // detach whole slot first, placing may put timers back into it
+  list.next = head->next;
+  list.prev = head->prev;
+  list.next->prev = &list;
+  list.prev->next = &list;
+  _list_init(head);
+  while (list.next != &list) {
+    uweb_timer *t = list.next;
+    timer_cancel(t);
+    _timer_place(w, t);
+  }
+}
+
+void timer_wheel_advance(uweb_timer_wheel *w, uint64_t now, uweb_timer_f fn, void *arg) {
+  while (w->now < now) {
+    int l;
+    w->now++;
+    // cascade higher levels when lower level wraps
+    for (l = 1; l < TIMER_LEVELS; l++) {
+      if (w->now & ((1ULL << (TIMER_LEVEL_BITS * l)) - 1)) break;
+      _timer_cascade(w, l);
+    }
+    uweb_timer *head = &w->slot[0][w->now & (TIMER_SLOTS - 1)];
+    while (head->next != head) {
+      uweb_timer *t = head->next;
+      timer_cancel(t);
+      if (t->expires > w->now) {
+        // parked beyond wheel range, not due yet
+        _timer_place(w, t);
+        continue;
+      }
+      fn(t, arg);
+    }
+  }
+}
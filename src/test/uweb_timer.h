@@ -0,0 +1,71 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Hierarchical timer wheel.
+ * Four levels of 64 slots each, level n slots spanning 64^n ticks. Timers
+ * are intrusive list nodes, so arming and cancelling is O(1) and needs no
+ * allocation. Timers far ahead are cascaded down a level when their slot
+ * comes up, expiring ones are never scanned for.
+ */
+
+#ifndef _UWEB_TIMER_H_
+#define _UWEB_TIMER_H_
+
+#include <stdint.h>
+
+#define TIMER_LEVEL_BITS   6
+#define TIMER_SLOTS        (1 << TIMER_LEVEL_BITS)
+#define TIMER_LEVELS       4
+
+typedef struct uweb_timer_s {
+  struct uweb_timer_s *next;
+  struct uweb_timer_s *prev;
+  // expiry tick
+  uint64_t expires;
+} uweb_timer;
+
+typedef void (*uweb_timer_f)(uweb_timer *t, void *arg);
+
+typedef struct {
+  // current tick, all timers expiring at or before now have fired
+  uint64_t now;
+  // slot list heads
+  uweb_timer slot[TIMER_LEVELS][TIMER_SLOTS];
+} uweb_timer_wheel;
+
+/* Initiates wheel starting at tick now */
+void timer_wheel_init(uweb_timer_wheel *w, uint64_t now);
+/* Initiates an unarmed timer */
+void timer_init(uweb_timer *t);
+/* Arms or rearms timer to expire at given tick */
+void timer_arm(uweb_timer_wheel *w, uweb_timer *t, uint64_t expires);
+/* Cancels timer, ok to call on unarmed timers */
+void timer_cancel(uweb_timer *t);
+/* Returns nonzero if timer is armed */
+int timer_armed(const uweb_timer *t);
+/* Advances wheel to tick now, calling fn for each expired timer.
+   Expired timers are unarmed before fn is called, fn may rearm them. */
+void timer_wheel_advance(uweb_timer_wheel *w, uint64_t now, uweb_timer_f fn, void *arg);
+
+#endif /* _UWEB_TIMER_H_ */
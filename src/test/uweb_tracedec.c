@@ -0,0 +1,88 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Decodes binary trace dumps from UWEB_trace_dump.
+ * usage: uweb_tracedec [dumpfile]
+ * Reads from stdin if no file is given.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "uweb.h"
+
+static void print_arg(const char *label, uint32_t v) {
+  if (label == 0) return;
+  if (strcmp(label, "method") == 0) {
+    printf(" %s=%s", label, v < _REQ_METHOD_COUNT ? UWEB_HTTP_REQ_METHODS[v] : "?");
+  } else if (strcmp(label, "char") == 0) {
+    printf(" %s=0x%02x", label, v);
+  } else {
+    printf(" %s=%u", label, v);
+  }
+}
+
+int main(int argc, char **args) {
+  static const char LEVELS[] = "-EID";
+  FILE *f = stdin;
+  uweb_trace_hdr hdr;
+  uweb_trace_rec rec;
+  uint32_t i, t0 = 0;
+
+  if (argc > 1 && (f = fopen(args[1], "rb")) == NULL) {
+    perror(args[1]);
+    return 1;
+  }
+
+  // a dump file may contain several consecutive dumps
+  while (fread(&hdr, sizeof(hdr), 1, f) == 1) {
+    if (memcmp(hdr.magic, UWEB_TRACE_MAGIC, 4) != 0 || hdr.version != UWEB_TRACE_VERSION ||
+        hdr.rec_size != sizeof(uweb_trace_rec)) {
+      fprintf(stderr, "bad trace dump header\n");
+      return 1;
+    }
+    printf("# %u records, %u lost\n", hdr.count, hdr.lost);
+    for (i = 0; i < hdr.count; i++) {
+      if (fread(&rec, sizeof(rec), 1, f) != 1) {
+        fprintf(stderr, "truncated trace dump\n");
+        return 1;
+      }
+      if (i == 0) t0 = rec.ts;
+      printf("%10.3f %c %-20s ", (double)(uint32_t)(rec.ts - t0) / 1000.0,
+          rec.level < sizeof(LEVELS) - 1 ? LEVELS[rec.level] : '?',
+          rec.state < UWEB_TRACE_STATE_COUNT ? UWEB_TRACE_STATES[rec.state] : "?");
+      if (rec.event < _TRC_EVENT_COUNT) {
+        const uweb_trace_desc *d = &UWEB_TRACE_EVENTS[rec.event];
+        printf("%s", d->name);
+        print_arg(d->arg_a, rec.a);
+        print_arg(d->arg_b, rec.b);
+      } else {
+        printf("event_%u a=%u b=%u", rec.event, rec.a, rec.b);
+      }
+      printf("\n");
+    }
+  }
+
+  if (f != stdin) fclose(f);
+  return 0;
+}
@@ -0,0 +1,254 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "uweb_upstream.h"
+
+typedef struct {
+  char addr[UPSTREAM_ADDR_LEN];
+  struct sockaddr_storage sa;
+  socklen_t sa_len;
+  // idle connections, most recently used first
+  upstream_conn *idle;
+  uint32_t idle_count;
+} backend;
+
+static backend backends[UPSTREAM_MAX_BACKENDS];
+static int backend_count;
+static int uep = -1;
+// closed connections, freed when no event of the batch can refer to them
+static upstream_conn *reap;
+
+static void _upstream_watch(upstream_conn *u, int op) {
+  struct epoll_event ev = { .events = 0, .data.ptr = u };
+  if (u->rx_on) ev.events |= EPOLLIN;
+  if (u->connecting || u->q.head) ev.events |= EPOLLOUT;
+  epoll_ctl(uep, op, u->fd, &ev);
+}
+
+// an idle connection turned readable, the backend closed it or misbehaves
+static void _upstream_idle_event(upstream_conn *u, uint32_t events) {
+  (void)events;
+  backend *b = &backends[u->backend];
+  upstream_conn **pp = &b->idle;
+  while (*pp && *pp != u) pp = &(*pp)->next;
+  if (*pp) {
+    *pp = u->next;
+    b->idle_count--;
+  }
+  upstream_close(u);
+}
+
+int upstream_backend(const char *addr) {
+  int i;
+  for (i = 0; i < backend_count; i++) {
+    if (strcmp(backends[i].addr, addr) == 0) return i;
+  }
+  if (backend_count >= UPSTREAM_MAX_BACKENDS || strlen(addr) >= UPSTREAM_ADDR_LEN) return -1;
+  backend *b = &backends[backend_count];
+  memset(b, 0, sizeof(backend));
+  if (strncmp(addr, "unix:", 5) == 0) {
+    struct sockaddr_un *sun = (struct sockaddr_un *)&b->sa;
+    if (addr[5] == 0 || strlen(&addr[5]) >= sizeof(sun->sun_path)) return -1;
+    sun->sun_family = AF_UNIX;
+    strcpy(sun->sun_path, &addr[5]);
+    b->sa_len = sizeof(struct sockaddr_un);
+  } else {
+    char host[UPSTREAM_ADDR_LEN];
+    struct addrinfo hints, *res;
+    const char *colon = strrchr(addr, ':');
+    if (colon == NULL || colon == addr || colon[1] == 0) return -1;
+    memcpy(host, addr, colon - addr);
+    host[colon - addr] = 0;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    // resolved once, when configured
+    if (getaddrinfo(host, colon + 1, &hints, &res) != 0) return -1;
+    memcpy(&b->sa, res->ai_addr, res->ai_addrlen);
+    b->sa_len = res->ai_addrlen;
+    freeaddrinfo(res);
+  }
+  strcpy(b->addr, addr);
+  return backend_count++;
+}
+
+const char *upstream_backend_addr(int backend) {
+  return backends[backend].addr;
+}
+
+upstream_conn *upstream_get(int backend_ix, upstream_event_f event, void *user) {
+  backend *b = &backends[backend_ix];
+  upstream_conn *u = b->idle;
+  if (uep < 0 && (uep = epoll_create1(EPOLL_CLOEXEC)) < 0) return NULL;
+  if (u) {
+    b->idle = u->next;
+    b->idle_count--;
+    u->next = NULL;
+    u->reused = 1;
+    u->event = event;
+    u->user = user;
+    if (!u->rx_on) {
+      u->rx_on = 1;
+      _upstream_watch(u, EPOLL_CTL_MOD);
+    }
+    return u;
+  }
+  int fd = socket(b->sa.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return NULL;
+  if (b->sa.ss_family != AF_UNIX) {
+    int istrue = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &istrue, sizeof(int));
+  }
+  u = calloc(1, sizeof(upstream_conn));
+  if (u == NULL) {
+    close(fd);
+    return NULL;
+  }
+  u->fd = fd;
+  u->backend = backend_ix;
+  u->rx_on = 1;
+  u->event = event;
+  u->user = user;
+  if (connect(fd, (struct sockaddr *)&b->sa, b->sa_len) < 0) {
+    // a unix socket with a full backlog says EAGAIN, taken as refused
+    if (errno != EINPROGRESS) {
+      close(fd);
+      free(u);
+      return NULL;
+    }
+    u->connecting = 1;
+  }
+  _upstream_watch(u, EPOLL_CTL_ADD);
+  return u;
+}
+
+void upstream_put(upstream_conn *u) {
+  backend *b = &backends[u->backend];
+  if (u->dead) return;
+  if (u->connecting || u->q.head || b->idle_count >= UPSTREAM_MAX_IDLE) {
+    upstream_close(u);
+    return;
+  }
+  u->event = _upstream_idle_event;
+  u->user = NULL;
+  if (!u->rx_on) {
+    u->rx_on = 1;
+    _upstream_watch(u, EPOLL_CTL_MOD);
+  }
+  u->next = b->idle;
+  b->idle = u;
+  b->idle_count++;
+}
+
+void upstream_close(upstream_conn *u) {
+  if (u->dead) return;
+  outq_clear(&u->q);
+  epoll_ctl(uep, EPOLL_CTL_DEL, u->fd, NULL);
+  close(u->fd);
+  u->dead = 1;
+  u->next = reap;
+  reap = u;
+}
+
+int upstream_write(upstream_conn *u, const uint8_t *data, uint32_t len) {
+  uint32_t sent = 0;
+  if (u->dead) return -1;
+  if (!u->connecting && u->q.head == NULL) {
+    ssize_t l = send(u->fd, data, len, MSG_NOSIGNAL);
+    if (l < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+    if (l > 0) sent = l;
+  }
+  if (sent < len) {
+    int watch = !u->connecting && u->q.head == NULL;
+    if (outq_push_copy(&u->q, data + sent, len - sent) < 0) return -1;
+    if (watch) _upstream_watch(u, EPOLL_CTL_MOD);
+  }
+  return 0;
+}
+
+void upstream_rx(upstream_conn *u, int on) {
+  if (u->dead || u->rx_on == !!on) return;
+  u->rx_on = !!on;
+  _upstream_watch(u, EPOLL_CTL_MOD);
+}
+
+int upstream_epoll_fd(void) {
+  if (uep < 0) uep = epoll_create1(EPOLL_CLOEXEC);
+  return uep;
+}
+
+void upstream_dispatch(void) {
+  struct epoll_event evs[64];
+  int i, n = epoll_wait(uep, evs, sizeof(evs) / sizeof(evs[0]), 0);
+  for (i = 0; i < n; i++) {
+    upstream_conn *u = (upstream_conn *)evs[i].data.ptr;
+    uint32_t e = evs[i].events;
+    uint32_t ev = 0;
+    if (u->dead) continue;
+    if (u->connecting) {
+      int err = 0;
+      socklen_t l = sizeof(err);
+      if (!(e & (EPOLLOUT | EPOLLERR | EPOLLHUP))) continue;
+      getsockopt(u->fd, SOL_SOCKET, SO_ERROR, &err, &l);
+      if (err) {
+        u->event(u, UPSTREAM_ERROR);
+        continue;
+      }
+      u->connecting = 0;
+    }
+    if ((e & EPOLLOUT) && u->q.head) {
+      int res = outq_flush(&u->q, u->fd);
+      if (res < 0) {
+        u->event(u, UPSTREAM_ERROR);
+        continue;
+      }
+      if (res == 0) ev |= UPSTREAM_DRAINED;
+    }
+    if ((e & EPOLLOUT) && u->q.head == NULL) {
+      // nothing more to write
+      _upstream_watch(u, EPOLL_CTL_MOD);
+    }
+    // hangups and errors are seen when reading
+    if (e & (EPOLLIN | EPOLLHUP | EPOLLERR)) ev |= UPSTREAM_READABLE;
+    if (ev) u->event(u, ev);
+  }
+}
+
+void upstream_reap(void) {
+  while (reap) {
+    upstream_conn *u = reap;
+    reap = u->next;
+    free(u);
+  }
+}
@@ -0,0 +1,100 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Upstream backend connections.
+ * Backends are addressed as unix:<path> or <host>:<port> and connected to
+ * nonblocking. Connections are watched in an epoll set of their own, which
+ * the server adds to its own set and dispatches when it is readable. A
+ * connection whose protocol allows it is put back in a pool per backend
+ * when done with, and taken from there by the next request, so backends
+ * see few, long lived connections.
+ */
+
+#ifndef _UWEB_UPSTREAM_H_
+#define _UWEB_UPSTREAM_H_
+
+#include <stdint.h>
+#include "uweb_outq.h"
+
+#define UPSTREAM_MAX_BACKENDS       8
+#define UPSTREAM_ADDR_LEN           108
+// idle connections kept per backend
+#define UPSTREAM_MAX_IDLE           8
+
+// upstream events
+#define UPSTREAM_READABLE           1
+// all queued output is written
+#define UPSTREAM_DRAINED            2
+// connect failed, or the connection broke
+#define UPSTREAM_ERROR              4
+
+struct upstream_conn_s;
+
+/* Called with UPSTREAM_* events on a connection in use */
+typedef void (*upstream_event_f)(struct upstream_conn_s *u, uint32_t events);
+
+typedef struct upstream_conn_s {
+  int fd;
+  int backend;
+  // connect not completed yet, output is queued meanwhile
+  uint8_t connecting;
+  // taken from the pool, the backend may have closed it since
+  uint8_t reused;
+  // readable events wanted
+  uint8_t rx_on;
+  uint8_t dead;
+  // output the socket could not take yet
+  outq q;
+  upstream_event_f event;
+  void *user;
+  // idle or reap list
+  struct upstream_conn_s *next;
+} upstream_conn;
+
+/* Adds a backend, unix:<path> or <host>:<port>, or finds one added before.
+   Returns its index, -1 if the address is bad or there are too many */
+int upstream_backend(const char *addr);
+/* Returns backend address */
+const char *upstream_backend_addr(int backend);
+/* Returns an idle connection to backend, or a new one still connecting,
+   which calls event with UPSTREAM_* events. Returns 0 on failure */
+upstream_conn *upstream_get(int backend, upstream_event_f event, void *user);
+/* Puts a connection with nothing in flight back in its pool, or closes it
+   if the pool is full */
+void upstream_put(upstream_conn *u);
+/* Closes a connection, freed when no pending event can refer to it */
+void upstream_close(upstream_conn *u);
+/* Writes to connection, queuing what it can not take. Returns -1 if the
+   connection is broken or out of memory */
+int upstream_write(upstream_conn *u, const uint8_t *data, uint32_t len);
+/* Turns readable events on or off, e.g. while the client is slow */
+void upstream_rx(upstream_conn *u, int on);
+/* Returns the epoll fd to watch for readable in the server loop */
+int upstream_epoll_fd(void);
+/* Handles ready connections, call when upstream_epoll_fd is readable */
+void upstream_dispatch(void);
+/* Frees closed connections, call when no event can refer to them */
+void upstream_reap(void);
+
+#endif /* _UWEB_UPSTREAM_H_ */
@@ -31,6 +31,23 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 static const char * const ERR_HTTP_TIMEOUT = UWEB_HTTP_MSG_TIMEOUT;
 static const char * const ERR_HTTP_BAD_REQUEST = UWEB_HTTP_MSG_BAD_REQUEST;
 static const char * const ERR_HTTP_NOT_IMPL = UWEB_HTTP_MSG_NOT_IMPL;
+static const char * const ERR_HTTP_URI_TOO_LONG = UWEB_HTTP_MSG_URI_TOO_LONG;
+static const char * const ERR_HTTP_HEADER_TOO_LARGE = UWEB_HTTP_MSG_HEADER_TOO_LARGE;
+static const char * const ERR_HTTP_BODY_TOO_LARGE = UWEB_HTTP_MSG_BODY_TOO_LARGE;
+static const char * const ERR_HTTP_REJECTED = UWEB_HTTP_MSG_REJECTED;
+static const char * const ERR_HTTP_EXPECTATION_FAILED = UWEB_HTTP_MSG_EXPECTATION_FAILED;
+
+#define _UWEB_STR(x) #x
+#define _UWEB_XSTR(x) _UWEB_STR(x)
+
+// precomputed overload response
+static char UWEB_SHED_RESPONSE[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Server: "UWEB_SERVER_NAME"\r\n"
+    "Retry-After: "_UWEB_XSTR(UWEB_RETRY_AFTER)"\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
 
 typedef enum {
   HEADER_METHOD = 0,
@@ -42,85 +59,281 @@ typedef enum {
   CHUNK_DATA,
   CHUNK_DATA_END,
   CHUNK_FOOTER,
+  CLOSING,
+  WEBSOCKET,
+  EVENT_STREAM,
+  HTTP2,
+  DEFERRED,
 } us_state;
 
-static struct {
-  uweb_response_f server_resp_f;
-  uweb_data_f server_data_f;
-
-  uint8_t tx_buf[UWEB_TX_MAX_LEN];
-
-  us_state state;
-
-  uweb_request_header req;
-
-  uint16_t header_line;
+// chunk size line: <hex size>[ws][;extensions]\r\n
+#define CHUNK_HDR_SIZE    0
+#define CHUNK_HDR_SPACE   1
+#define CHUNK_HDR_EXT     2
+#define CHUNK_HDR_CR      3
 
-  char *multipart_boundary;
-  uint8_t multipart_boundary_ix;
-  uint8_t multipart_boundary_len;
-  uint8_t multipart_delim;
-  uint32_t received_multipart_len;
+#if UWEB_CFG_CHUNKED_RESP
+// a generator is suspended, the response is not done
+#define _UWEB_GENERATING(ctx) ((ctx)->gen_f != 0)
+#else
+#define _UWEB_GENERATING(ctx) 0
+#endif
 
-  char req_buf[UWEB_REQ_BUF_MAX_LEN+1];
-  volatile uint16_t req_buf_len;
+static uweb_ctx _uweb_default_ctx;
 
-  uint32_t chunk_ix;
-  uint32_t chunk_len;
-  uint32_t received_content_len;
-} uweb;
+#define TRACE_E(ev, a, b) UWEB_TRACE_E(&ctx->trace, (ev), ctx->state, (a), (b))
+#define TRACE_I(ev, a, b) UWEB_TRACE_I(&ctx->trace, (ev), ctx->state, (a), (b))
+#define TRACE_D(ev, a, b) UWEB_TRACE_D(&ctx->trace, (ev), ctx->state, (a), (b))
 
 static char *_uweb_space_strip(char *);
+static int _uweb_nocase_eq(const char *a, const char *b, uint32_t n);
+static int _uweb_token(const char *list, const char *token);
+
+// empty request header
+static void _uweb_req_init(uweb_ctx *ctx) {
+  memset(ctx->req, 0, sizeof(uweb_request_header));
+  ctx->req->ctx = ctx;
+#if UWEB_CFG_ARENA
+  ctx->req->arena = &ctx->arena;
+#endif
+}
 
 // clear incoming request and reset server states
-static void _uweb_clear_req(uweb_request_header *req) {
-  memset(req, 0, sizeof(uweb_request_header));
-  uweb.state = HEADER_METHOD;
-  uweb.header_line = 0;
+static void _uweb_clear_req(uweb_ctx *ctx) {
+  // pooled header is given back between requests, and taken cleared
+  if (ctx->req) _uweb_req_init(ctx);
+  ctx->req_limits = ctx->limits;
+  ctx->header_bytes = 0;
+  ctx->header_count = 0;
+  ctx->req_buf_len = 0;
+  ctx->state = HEADER_METHOD;
+  ctx->deferred = 0;
+  ctx->header_line = 0;
+#if UWEB_CFG_CHUNKED_RESP
+  ctx->gen_f = 0;
+#endif
+#if UWEB_CFG_CACHE
+  ctx->cache.key_len = 0;
+#endif
+#if UWEB_CFG_ARENA
+  _uweb_arena_reset(&ctx->arena);
+#endif
+}
+
+#if UWEB_CFG_COALESCE
+// writes what is collected, the buffer is given back until next write
+static void _uweb_flush(uweb_ctx *ctx) {
+  UW_STREAM out = ctx->out_str;
+  if (ctx->out_len && out->write) {
+    int wlen = out->write(out, ctx->out_buf, ctx->out_len);
+    if (wlen > 0) out->wr_offs += wlen;
+  }
+  ctx->out_len = 0;
+#if UWEB_CFG_SLAB
+  if (ctx->out_buf) {
+    _uweb_slab_put(UWEB_SLAB_OUT, ctx->out_buf);
+    ctx->out_buf = 0;
+  }
+#endif
+}
+#else
+static void _uweb_flush(uweb_ctx *ctx) {
+  (void)ctx;
+}
+#endif
+
+// write to client, collected with other small writes if coalescing
+int32_t _uweb_write(uweb_ctx *ctx, UW_STREAM out, const uint8_t *data, uint32_t len) {
+#if UWEB_CFG_COALESCE
+  if (ctx->out_len && (out != ctx->out_str || ctx->out_len + len > UWEB_COALESCE_LEN)) {
+    _uweb_flush(ctx);
+  }
+  if (len < UWEB_COALESCE_LEN) {
+#if UWEB_CFG_SLAB
+    if (ctx->out_buf == 0) ctx->out_buf = (uint8_t *)_uweb_slab_get(UWEB_SLAB_OUT);
+    // out of buffers, written as it comes
+    if (ctx->out_buf)
+#endif
+    {
+      memcpy(&ctx->out_buf[ctx->out_len], data, len);
+      ctx->out_len += len;
+      ctx->out_str = out;
+      return len;
+    }
+  }
+#else
+  (void)ctx;
+#endif
+  if (out->write == 0) return len;
+  int wlen = out->write(out, (uint8_t *)(uintptr_t)data, len);
+  if (wlen > 0) out->wr_offs += wlen;
+  return wlen;
 }
 
-static void _uweb_sendf(UW_STREAM out, const char *str, ...) {
+static void _uweb_sendf(uweb_ctx *ctx, UW_STREAM out, const char *str, ...) {
   va_list arg_p;
   va_start(arg_p, str);
-  int len = vsprintf((char *)uweb.tx_buf, str, arg_p);
+  int len = vsprintf((char *)ctx->tx_buf, str, arg_p);
   va_end(arg_p);
 
-  if (out->write) {
-    int wlen = out->write(out, uweb.tx_buf, len);
-    out->wr_offs += wlen;
+  _uweb_write(ctx, out, ctx->tx_buf, len);
+  UWEB_METRIC_ADD(UWEB_CNT_BYTES_OUT, len);
+}
+
+// send up to len bytes of data to client; spliced by the out stream,
+// straight from the data's memory, else read through tx_buf. Returns bytes
+// sent, zero or negative when data has none
+static int32_t _uweb_send_part(uweb_ctx *ctx, UW_STREAM out, UW_STREAM data, int32_t len) {
+  int32_t rlen = 0;
+  if ((data->flags & UWEB_STREAM_FD) && out->splice) {
+    // what is collected goes first
+    _uweb_flush(ctx);
+    rlen = out->splice(out, data, len);
+    if (rlen < 0) return rlen;
+    out->wr_offs += rlen;
   }
+  if (rlen == 0 && (data->flags & UWEB_STREAM_MEM)) {
+    rlen = len;
+    data->avail_sz -= rlen;
+    _uweb_write(ctx, out, &data->mem[data->rd_offs], rlen);
+  } else if (rlen == 0) {
+    rlen = UWEB_TX_MAX_LEN < len ? UWEB_TX_MAX_LEN : len;
+    rlen = data->read ? data->read(data, ctx->tx_buf, rlen) : 0;
+    if (rlen <= 0) return rlen;
+    _uweb_write(ctx, out, ctx->tx_buf, rlen);
+  }
+  data->rd_offs += rlen;
+  UWEB_METRIC_ADD(UWEB_CNT_BYTES_OUT, rlen);
+  return rlen;
 }
 
 // send data to client
-static void _uweb_send_data(UW_STREAM out, UW_STREAM data) {
+static void _uweb_send_data(uweb_ctx *ctx, UW_STREAM out, UW_STREAM data) {
   while (data->avail_sz > 0) {
-    int32_t rlen = UWEB_TX_MAX_LEN < data->avail_sz ? UWEB_TX_MAX_LEN : data->avail_sz;
-    rlen = data->read ? data->read(data, uweb.tx_buf, rlen) : 0;
-    if (rlen > 0) data->rd_offs += rlen;
-    if (out->write) {
-     int wlen = out->write(out, uweb.tx_buf, rlen);
-     if (wlen > 0) out->wr_offs += rlen;
-    }
+    if (_uweb_send_part(ctx, out, data, data->avail_sz) <= 0) break;
   } // while tx
 }
 
-static void _uweb_send_data_fixed(UW_STREAM out, UW_STREAM data, int32_t len) {
-  while (len > 0) {
-    int32_t rlen = UWEB_TX_MAX_LEN < data->avail_sz ? UWEB_TX_MAX_LEN : data->avail_sz;
-    rlen = len < rlen ? len : rlen;
-    rlen = data->read ? data->read(data, uweb.tx_buf, rlen) : 0;
-    if (rlen > 0) data->rd_offs += rlen;
-    if (out->write) {
-      int wlen = out->write(out, uweb.tx_buf, rlen);
-      if (wlen > 0) out->wr_offs += rlen;
-    }
+#if UWEB_CFG_CHUNKED_RESP
+static void _uweb_send_data_fixed(uweb_ctx *ctx, UW_STREAM out, UW_STREAM data, int32_t len) {
+  while (len > 0 && data->avail_sz > 0) {
+    int32_t rlen = _uweb_send_part(ctx, out, data, len < data->avail_sz ? len : data->avail_sz);
+    if (rlen <= 0) break;
     len -= rlen;
   } // while tx
 }
+#endif
+
+#if UWEB_CFG_SLAB
+static void _uweb_abort(uweb_ctx *ctx, UW_STREAM out);
+
+// takes the pooled buffers for a call into uweb, nonzero when out of them
+static int _uweb_bufs_get(uweb_ctx *ctx) {
+  ctx->bufs_held++;
+  if (ctx->rx_buf == 0) ctx->rx_buf = (uint8_t *)_uweb_slab_get(UWEB_SLAB_RX);
+  if (ctx->req_buf == 0) ctx->req_buf = (char *)_uweb_slab_get(UWEB_SLAB_REQ);
+  if (ctx->tx_buf == 0) ctx->tx_buf = (uint8_t *)_uweb_slab_get(UWEB_SLAB_TX);
+  if (ctx->req == 0) {
+    ctx->req = (uweb_request_header *)_uweb_slab_get(UWEB_SLAB_HDR);
+    if (ctx->req) _uweb_req_init(ctx);
+  }
+  return ctx->rx_buf == 0 || ctx->req_buf == 0 || ctx->tx_buf == 0 || ctx->req == 0;
+}
+
+// call done, gives back the buffers holding nothing for the next one
+static void _uweb_bufs_put(uweb_ctx *ctx) {
+  if (--ctx->bufs_held) return;
+  // responses are written out within the call
+  if (ctx->tx_buf) {
+    _uweb_slab_put(UWEB_SLAB_TX, ctx->tx_buf);
+    ctx->tx_buf = 0;
+  }
+  // no lookahead left
+  if (ctx->rx_buf && ctx->rx_ix >= ctx->rx_len) {
+    _uweb_slab_put(UWEB_SLAB_RX, ctx->rx_buf);
+    ctx->rx_buf = 0;
+  }
+  // between requests or waiting for the server, nothing being collected
+  if (ctx->req_buf && (ctx->state == CLOSING || ctx->state == HTTP2 || ctx->state == DEFERRED ||
+      (ctx->state == HEADER_METHOD && ctx->req_buf_len == 0 && !ctx->deferred))) {
+    _uweb_slab_put(UWEB_SLAB_REQ, ctx->req_buf);
+    ctx->req_buf = 0;
+  }
+  // between requests; the streams of HTTP/2 have headers of their own
+  if (ctx->req && (ctx->state == CLOSING || ctx->state == HTTP2 ||
+      (ctx->state == HEADER_METHOD && ctx->req_buf_len == 0 && !ctx->deferred))) {
+    _uweb_slab_put(UWEB_SLAB_HDR, ctx->req);
+    ctx->req = 0;
+  }
+#if UWEB_CFG_HTTP2
+  if (ctx->h2 && ctx->state == CLOSING) {
+    _uweb_slab_put(UWEB_SLAB_H2, ctx->h2);
+    ctx->h2 = 0;
+  }
+#endif
+}
+
+// out of buffers, a new request is turned away, one under way dropped
+static void _uweb_bufs_lost(uweb_ctx *ctx, UW_STREAM out) {
+  if (ctx->state == CLOSING) return;
+  if (ctx->state == HEADER_METHOD && ctx->req_buf_len == 0 && !ctx->deferred) {
+    UWEB_shed(out, UWEB_SHED_MEMORY);
+    ctx->state = CLOSING;
+    ctx->rx_ix = ctx->rx_len;
+  } else {
+    UWEB_METRIC_INC(UWEB_CNT_SHED_MEMORY);
+    _uweb_abort(ctx, out);
+  }
+}
+#endif
+
+#if UWEB_CFG_CACHE
+static void _uweb_serve(uweb_ctx *ctx, UW_STREAM out, uweb_request_header *req);
+
+// serves requests that waited for a cached response, now there or given up
+static void _uweb_cache_resume(void) {
+  uweb_ctx *w;
+  while ((w = _uweb_cache_resumed()) != 0) {
+    w->deferred = 0;
+#if UWEB_CFG_SLAB
+    if (_uweb_bufs_get(w)) {
+      _uweb_bufs_lost(w, w->cache.out);
+      _uweb_bufs_put(w);
+      continue;
+    }
+#endif
+    _uweb_serve(w, w->cache.out, w->req);
+    _uweb_flush(w);
+    if (!w->deferred) w->cache.cached_f(w->req, 1);
+#if UWEB_CFG_SLAB
+    _uweb_bufs_put(w);
+#endif
+  }
+}
+#endif
+
+// close connection, dropping the request
+static void _uweb_abort(uweb_ctx *ctx, UW_STREAM out) {
+#if UWEB_CFG_CACHE
+  _uweb_cache_release(ctx);
+  _uweb_cache_resume();
+#endif
+  _uweb_flush(ctx);
+  if (out->close) out->close(out);
+  _uweb_clear_req(ctx);
+#if UWEB_CFG_CHUNKED_REQ
+  ctx->chunk_ix = 0;
+  ctx->chunk_len = 0;
+#endif
+  // drop whatever else the client sends
+  ctx->state = CLOSING;
+  ctx->rx_ix = ctx->rx_len;
+}
 
 // request error response
-static void _uweb_error(UW_STREAM out, uweb_http_status http_status, const char *error_page) {
-  _uweb_sendf(out,
+static void _uweb_error(uweb_ctx *ctx, UW_STREAM out, uweb_http_status http_status, const char *error_page) {
+  TRACE_E(TRC_ERROR_RESPONSE, UWEB_HTTP_STATUS_NUM[http_status], 0);
+  _uweb_sendf(ctx, out,
     "HTTP/1.1 %i %s\r\n"
     "Server: "UWEB_SERVER_NAME"\r\n"
     "Content-Type: text/html; charset=UTF-8\r\n"
@@ -129,30 +342,162 @@ static void _uweb_error(UW_STREAM out, uweb_http_status http_status, const char
     "\r\n",
     UWEB_HTTP_STATUS_NUM[http_status], UWEB_HTTP_STATUS_STRING[http_status],
     strlen(error_page));
-  _uweb_clear_req(&uweb.req);
-  uweb.chunk_ix = 0;
-  uweb.chunk_len = 0;
+  _uweb_sendf(ctx, out, "%s", error_page);
+  UWEB_METRIC_STATUS(http_status);
+  _uweb_abort(ctx, out);
 }
 
-// serve a request and send answer
-static void _uweb_request(UW_STREAM out, uweb_request_header *req) {
-  UWEB_DBG("req method %s\n", UWEB_HTTP_REQ_METHODS[req->method]);
-  UWEB_DBG("        res    %s\n", req->resource);
-  UWEB_DBG("        host   %s\n", req->host);
-  UWEB_DBG("        type   %s\n", req->content_type);
-  if (req->chunked) {
-    UWEB_DBG("        chunked\n");
+// request and its body are done. The connection is kept for the next one
+// unless the client asked to close it.
+static void _uweb_request_done(uweb_ctx *ctx, UW_STREAM out) {
+  if (ctx->deferred || _UWEB_GENERATING(ctx)) {
+    // server still answering, hold back further requests until it is done
+    ctx->state = DEFERRED;
+  } else if (_uweb_token(ctx->req->connection, "close")) {
+    _uweb_abort(ctx, out);
   } else {
-    UWEB_DBG("        length %i\n", req->content_length);
+    _uweb_clear_req(ctx);
   }
-  UWEB_DBG("        conn   %s\n", req->connection);
+}
 
-  if (req->method == _BAD_REQ) {
-    UWEB_DBG("BAD REQUEST\n");
-    _uweb_error(out, S400_BAD_REQ, ERR_HTTP_BAD_REQUEST);
+// request limit exceeded
+static void _uweb_limit(uweb_ctx *ctx, UW_STREAM out, uweb_http_status http_status, uint32_t value) {
+  (void)value;
+  TRACE_E(TRC_LIMIT, UWEB_HTTP_STATUS_NUM[http_status], value);
+  if (ctx->state >= CONTENT && ctx->state <= CHUNK_FOOTER) {
+    // reading the body, the response went out with the header
+    _uweb_abort(ctx, out);
     return;
   }
+  _uweb_error(ctx, out, http_status,
+      http_status == S414_REQ_URI_TOO_LONG ? ERR_HTTP_URI_TOO_LONG :
+      http_status == S413_REQ_ENTITY_TOO_LARGE ? ERR_HTTP_BODY_TOO_LARGE :
+      ERR_HTTP_HEADER_TOO_LARGE);
+}
+
+#if UWEB_CFG_METRICS && defined(UWEB_METRICS_PATH)
+typedef struct {
+  uweb_ctx *ctx;
+  UW_STREAM out;
+  uint32_t len;
+} _uweb_metrics_out;
+
+static void _uweb_metrics_flush(_uweb_metrics_out *mo) {
+  char chunk_hdr[12];
+  uint8_t crlf[2] = {'\r', '\n'};
+  int hlen = sprintf(chunk_hdr, "%x\r\n", (unsigned int)mo->len);
+  _uweb_write(mo->ctx, mo->out, (uint8_t *)chunk_hdr, hlen);
+  _uweb_write(mo->ctx, mo->out, mo->ctx->tx_buf, mo->len);
+  _uweb_write(mo->ctx, mo->out, crlf, 2);
+  UWEB_METRIC_ADD(UWEB_CNT_BYTES_OUT, hlen + mo->len + 2);
+  mo->len = 0;
+}
+
+static void _uweb_metrics_emit(void *arg, const char *str, uint32_t len) {
+  _uweb_metrics_out *mo = (_uweb_metrics_out *)arg;
+  if (mo->len + len > UWEB_TX_MAX_LEN) {
+    _uweb_metrics_flush(mo);
+  }
+  memcpy(&mo->ctx->tx_buf[mo->len], str, len);
+  mo->len += len;
+}
 
+// serve metrics in prometheus text format, chunked as size is not known
+static void _uweb_metrics_response(uweb_ctx *ctx, UW_STREAM out) {
+  _uweb_sendf(ctx, out,
+    "HTTP/1.1 %i %s\r\n"
+    "Server: "UWEB_SERVER_NAME"\r\n"
+    "Content-Type: text/plain; version=0.0.4\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n",
+    UWEB_HTTP_STATUS_NUM[S200_OK], UWEB_HTTP_STATUS_STRING[S200_OK]);
+  UWEB_METRIC_STATUS(S200_OK);
+  _uweb_metrics_out mo = { .ctx = ctx, .out = out, .len = 0 };
+  UWEB_metrics_format(_uweb_metrics_emit, &mo);
+  if (mo.len) _uweb_metrics_flush(&mo);
+  _uweb_sendf(ctx, out, "0\r\n\r\n");
+}
+#endif
+
+#if UWEB_CFG_WEBSOCKET
+// answer websocket handshake and switch to frame parsing
+static void _uweb_ws_upgrade(uweb_ctx *ctx, UW_STREAM out, uweb_request_header *req, const char *extra_headers) {
+  char accept[32];
+  if (!req->websocket || req->method != GET || strlen(req->ws_key) != 24 ||
+      !_uweb_token(req->connection, "upgrade")) {
+    _uweb_error(ctx, out, S400_BAD_REQ, ERR_HTTP_BAD_REQUEST);
+    return;
+  }
+  if (req->ws_version != 13) {
+    // tell the client which version we speak
+    TRACE_E(TRC_ERROR_RESPONSE, UWEB_HTTP_STATUS_NUM[S426_UPGRADE_REQUIRED], 0);
+    _uweb_sendf(ctx, out,
+      "HTTP/1.1 %i %s\r\n"
+      "Server: "UWEB_SERVER_NAME"\r\n"
+      "Sec-WebSocket-Version: 13\r\n"
+      "Content-Length: 0\r\n"
+      "Connection: close\r\n"
+      "\r\n",
+      UWEB_HTTP_STATUS_NUM[S426_UPGRADE_REQUIRED], UWEB_HTTP_STATUS_STRING[S426_UPGRADE_REQUIRED]);
+    UWEB_METRIC_STATUS(S426_UPGRADE_REQUIRED);
+    _uweb_abort(ctx, out);
+    return;
+  }
+  _uweb_ws_accept_key(req->ws_key, accept);
+  TRACE_I(TRC_WS_UPGRADE, 0, 0);
+  UWEB_METRIC_STATUS(S101_SWITCHING_PROTOCOLS);
+  _uweb_sendf(ctx, out,
+    "HTTP/1.1 %i %s\r\n"
+    "Server: "UWEB_SERVER_NAME"\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: %s\r\n"
+    "%s"
+    "\r\n",
+    UWEB_HTTP_STATUS_NUM[S101_SWITCHING_PROTOCOLS], UWEB_HTTP_STATUS_STRING[S101_SWITCHING_PROTOCOLS],
+    accept,
+    extra_headers ? extra_headers : "");
+  memset(&ctx->ws, 0, sizeof(uweb_ws));
+  ctx->ws.hdr_need = 2;
+  ctx->state = WEBSOCKET;
+}
+#endif
+
+#if UWEB_CFG_CHUNKED_RESP
+// sends what the generator yields as chunks until it is done, then the
+// last chunk, or until output is blocked
+static void _uweb_gen_run(uweb_ctx *ctx, UW_STREAM out) {
+  uweb_request_header *req = ctx->req;
+#if UWEB_CFG_METRICS
+  uint64_t t_handler;
+#endif
+  while (ctx->gen_f) {
+    if (ctx->blocked_f && ctx->blocked_f(req)) {
+      TRACE_D(TRC_GENERATOR, req->chunk_nbr, 0);
+      return;
+    }
+    UWEB_METRIC_TIME(t_handler);
+    int res = ctx->gen_f(&ctx->gen, req);
+    UWEB_METRIC_HIST_SINCE(UWEB_HIST_HANDLER, t_handler);
+    if (res == UWEB_GEN_DONE) {
+      ctx->gen_f = 0;
+      _uweb_sendf(ctx, out, "0\r\n\r\n");
+      _uweb_flush(ctx);
+    } else if (ctx->gen.len > 0) {
+      // an empty chunk would end the response
+      _uweb_sendf(ctx, out, "%x; chunk %i\r\n", ctx->gen.len, req->chunk_nbr);
+      _uweb_write(ctx, out, ctx->gen.buf, ctx->gen.len);
+      UWEB_METRIC_ADD(UWEB_CNT_BYTES_OUT, ctx->gen.len);
+      _uweb_sendf(ctx, out, "\r\n");
+      UWEB_METRIC_INC(UWEB_CNT_CHUNKS_OUT);
+      req->chunk_nbr++;
+    }
+  }
+}
+#endif
+
+// call the response function and send its answer
+static void _uweb_respond(uweb_ctx *ctx, UW_STREAM out, uweb_request_header *req) {
   char content_type[UWEB_MAX_CONTENT_TYPE_LEN];
   uweb_http_status http_status = S200_OK;
   char *extra_headers = 0;
@@ -160,34 +505,97 @@ static void _uweb_request(UW_STREAM out, uweb_request_header *req) {
   strncpy(content_type, "text/html; charset=utf-8", UWEB_MAX_CONTENT_TYPE_LEN);
 
   uweb_response res = UWEB_OK;
-  UW_STREAM response_stream;
-  if (uweb.server_resp_f){
-    res = uweb.server_resp_f(req, &response_stream, &http_status, content_type, &extra_headers);
+  UW_STREAM response_stream = 0;
+#if UWEB_CFG_METRICS
+  uint64_t t_handler;
+#endif
+  if (_UWEB_RESP_F(ctx, req)) {
+    UWEB_METRIC_TIME(t_handler);
+    res = _UWEB_RESP_F(ctx, req)(req, &response_stream, &http_status, content_type, &extra_headers);
+    UWEB_METRIC_HIST_SINCE(UWEB_HIST_HANDLER, t_handler);
   } else {
-    _uweb_error(out, S501_NOT_IMPLEMENTED, ERR_HTTP_NOT_IMPL);
+    _uweb_error(ctx, out, S501_NOT_IMPLEMENTED, ERR_HTTP_NOT_IMPL);
+    return;
+  }
+  if (res == UWEB_EVENT_STREAM) {
+    TRACE_I(TRC_EVENT_STREAM, 0, 0);
+    UWEB_METRIC_STATUS(S200_OK);
+    _uweb_sendf(ctx, out,
+      "HTTP/1.1 %i %s\r\n"
+      "Server: "UWEB_SERVER_NAME"\r\n"
+      "Content-Type: text/event-stream\r\n"
+      "Cache-Control: no-cache\r\n"
+      "%s"
+      "Connection: close\r\n"
+      "\r\n",
+      UWEB_HTTP_STATUS_NUM[S200_OK], UWEB_HTTP_STATUS_STRING[S200_OK],
+      extra_headers ? extra_headers : "");
+    ctx->state = EVENT_STREAM;
+    return;
+  }
+  if (res == UWEB_DEFERRED) {
+    TRACE_I(TRC_DEFERRED, 0, 0);
+    ctx->deferred = 1;
+    return;
+  }
+  if (res == UWEB_WEBSOCKET) {
+#if UWEB_CFG_WEBSOCKET
+    _uweb_ws_upgrade(ctx, out, req, extra_headers);
+#else
+    _uweb_error(ctx, out, S501_NOT_IMPLEMENTED, ERR_HTTP_NOT_IMPL);
+#endif
+    return;
+  }
+#if !UWEB_CFG_REDIRECT
+  if (res == UWEB_REDIRECT) {
+    _uweb_error(ctx, out, S501_NOT_IMPLEMENTED, ERR_HTTP_NOT_IMPL);
+    return;
+  }
+#endif
+#if !UWEB_CFG_CHUNKED_RESP
+  if (res == UWEB_CHUNKED || res == UWEB_GENERATOR) {
+    _uweb_error(ctx, out, S501_NOT_IMPLEMENTED, ERR_HTTP_NOT_IMPL);
     return;
   }
+#endif
+  UWEB_METRIC_STATUS(res == UWEB_REDIRECT ? S303_SEE_OTHER : http_status);
+  TRACE_I(TRC_RESPONSE, UWEB_HTTP_STATUS_NUM[res == UWEB_REDIRECT ? S303_SEE_OTHER : http_status], res);
 
   if (res == UWEB_OK) {
     // plain response
-    _uweb_sendf(out,
+    _uweb_sendf(ctx, out,
       "HTTP/1.1 %i %s\r\n"
       "Server: "UWEB_SERVER_NAME"\r\n"
       "Content-Type: %s\r\n"
       "Content-Length: %i\r\n"
       "%s"
-      "Connection: close\r\n"
+      "%s"
       "\r\n",
       UWEB_HTTP_STATUS_NUM[http_status], UWEB_HTTP_STATUS_STRING[http_status],
       content_type,
       response_stream->total_sz,
-      extra_headers ? extra_headers : "");
+      extra_headers ? extra_headers : "",
+      _uweb_token(req->connection, "close") ? "Connection: close\r\n" : "");
     if (req->method != HEAD) {
-      _uweb_send_data(out, response_stream);
+      _uweb_send_data(ctx, out, response_stream);
     }
+  } else if (res == UWEB_PREBUILT) {
+    // header made by the server, nothing to format
+    uint32_t hlen = strlen(req->prebuilt_hdr);
+    _uweb_write(ctx, out, (const uint8_t *)req->prebuilt_hdr, hlen);
+    if (_uweb_token(req->connection, "close")) {
+      _uweb_write(ctx, out, (const uint8_t *)"Connection: close\r\n", 19);
+      hlen += 19;
+    }
+    _uweb_write(ctx, out, (const uint8_t *)"\r\n", 2);
+    UWEB_METRIC_ADD(UWEB_CNT_BYTES_OUT, hlen + 2);
+    if (req->method != HEAD && response_stream) {
+      _uweb_send_data(ctx, out, response_stream);
+    }
+#if UWEB_CFG_REDIRECT
   } else if (res == UWEB_REDIRECT) {
     // redirect response
-    _uweb_sendf(out,
+    _uweb_sendf(ctx, out,
       "HTTP/1.1 %i %s\r\n"
       "Connection: close\r\n"
       "Location: %s\r\n"
@@ -196,87 +604,270 @@ static void _uweb_request(UW_STREAM out, uweb_request_header *req) {
       req->redirection_url ? req->redirection_url : "/"
     );
     if (out->close) out->close(out);
-  } else if (res == UWEB_CHUNKED) {
+#endif
+#if UWEB_CFG_CHUNKED_RESP
+  } else if (res == UWEB_CHUNKED || res == UWEB_GENERATOR) {
     // chunked response
-    _uweb_sendf(out,
+    _uweb_sendf(ctx, out,
       "HTTP/1.1 %i %s\r\n"
       "Server: "UWEB_SERVER_NAME"\r\n"
       "Content-Type: %s\r\n"
       "%s"
+      "%s"
       "Transfer-Encoding: chunked\r\n"
       "\r\n",
       UWEB_HTTP_STATUS_NUM[http_status], UWEB_HTTP_STATUS_STRING[http_status],
       content_type,
-      extra_headers ? extra_headers : "");
-    if (req->method != HEAD) {
+      extra_headers ? extra_headers : "",
+      _uweb_token(req->connection, "close") ? "Connection: close\r\n" : "");
+    if (res == UWEB_GENERATOR) {
+      if (req->method == HEAD) ctx->gen_f = 0;
+      else _uweb_gen_run(ctx, out);
+    } else if (req->method != HEAD) {
       uint32_t chunk_len;
       while (response_stream && (chunk_len = response_stream->avail_sz) > 0) {
-        _uweb_sendf(out, "%x; chunk %i\r\n", chunk_len, req->chunk_nbr);
-        _uweb_send_data_fixed(out, response_stream, chunk_len);
-        _uweb_sendf(out, "\r\n");
-        uweb.req.chunk_nbr++;
-        (void)uweb.server_resp_f(req, &response_stream, &http_status,
+        _uweb_sendf(ctx, out, "%x; chunk %i\r\n", chunk_len, req->chunk_nbr);
+        _uweb_send_data_fixed(ctx, out, response_stream, chunk_len);
+        _uweb_sendf(ctx, out, "\r\n");
+        UWEB_METRIC_INC(UWEB_CNT_CHUNKS_OUT);
+        ctx->req->chunk_nbr++;
+        UWEB_METRIC_TIME(t_handler);
+        (void)_UWEB_RESP_F(ctx, req)(req, &response_stream, &http_status,
             content_type, &extra_headers); // from now on, we ignore response
+        UWEB_METRIC_HIST_SINCE(UWEB_HIST_HANDLER, t_handler);
       }
-      _uweb_sendf(out, "0\r\n\r\n");
+      _uweb_sendf(ctx, out, "0\r\n\r\n");
     }
+#endif
+  }
+  // sent, the stream may let go of what it holds
+  if (response_stream && response_stream->close) response_stream->close(response_stream);
+}
+
+#if UWEB_CFG_CACHE
+// serve from the cache, or by the response function and cache the response
+static void _uweb_serve(uweb_ctx *ctx, UW_STREAM out, uweb_request_header *req) {
+  int res = _uweb_cache_request(ctx, out, req, _uweb_token(req->connection, "close"));
+  if (res == UWEB_CACHE_HIT) {
+    // a request that waited is told when resumed
+    if (ctx->cache.cached_f && ctx->state != DEFERRED) ctx->cache.cached_f(req, 0);
+    return;
+  }
+  if (res == UWEB_CACHE_WAIT) {
+    // answered when the response is cached, like a deferred one
+    ctx->deferred = 1;
+    return;
   }
+  if (ctx->cache.fill == 0) {
+    _uweb_respond(ctx, out, req);
+    return;
+  }
+  _uweb_respond(ctx, &ctx->cache.capture, req);
+  if (ctx->deferred || _UWEB_GENERATING(ctx)) {
+    // written by the server, or a suspended generator, done later
+    return;
+  }
+  // all of it through the capture before it is stored
+  _uweb_flush(ctx);
+  _uweb_cache_done(ctx, ctx->state != CLOSING && ctx->state != WEBSOCKET && ctx->state != EVENT_STREAM);
+  _uweb_cache_resume();
+}
+#endif
+
+// serve a request and send answer
+static void _uweb_request(uweb_ctx *ctx, UW_STREAM out, uweb_request_header *req) {
+  TRACE_I(TRC_REQUEST, req->method, req->content_length);
+
+  UWEB_METRIC_METHOD(req->method);
+  if (req->method == _BAD_REQ) {
+    _uweb_error(ctx, out, S400_BAD_REQ, ERR_HTTP_BAD_REQUEST);
+    return;
+  }
+
+#if UWEB_CFG_METRICS && defined(UWEB_METRICS_PATH)
+  if (req->method == GET && strcmp(req->resource, UWEB_METRICS_PATH) == 0) {
+    _uweb_metrics_response(ctx, out);
+    _uweb_flush(ctx);
+    return;
+  }
+#endif
+
+#if UWEB_CFG_CACHE
+  _uweb_serve(ctx, out, req);
+#else
+  _uweb_respond(ctx, out, req);
+#endif
+  // response done, or its start when the server or a generator goes on
+  _uweb_flush(ctx);
 }
 
 // handle HTTP header line
-static void _uweb_handle_http_header_line(UW_STREAM out, char *s, uint16_t len, UW_STREAM in) {
+static void _uweb_handle_http_header_line(uweb_ctx *ctx, UW_STREAM out, char *s, uint16_t len, UW_STREAM in) {
   (void)in;
   if (len > 0) {
     // http header element
-    switch (uweb.state) {
+    switch (ctx->state) {
     case HEADER_METHOD: {
       uint32_t i;
+#if UWEB_CFG_HTTP2
+      if (strcmp(s, "PRI * HTTP/2.0") == 0) {
+        // prior knowledge, the rest of the preface is parsed as HTTP/2
+        ctx->state = HTTP2;
+        if (_uweb_h2_start(ctx, out, 16)) {
+          UWEB_METRIC_INC(UWEB_CNT_SHED_MEMORY);
+          _uweb_abort(ctx, out);
+        }
+        return;
+      }
+#endif
       for (i = 0; i < _REQ_METHOD_COUNT; i++) {
         if (strstr(s, UWEB_HTTP_REQ_METHODS[i]) == s) {
-          uweb.req.method = i;
+          ctx->req->method = i;
           char *resource = _uweb_space_strip(&s[strlen(UWEB_HTTP_REQ_METHODS[i])]);
           char *space = (char *)strchr(resource, ' ');
           if (space) {
             *space = 0;
           }
-          strcpy(uweb.req.resource, resource);
+          uint32_t uri_len = strlen(resource);
+          if (uri_len >= UWEB_MAX_RESOURCE_LEN ||
+              (ctx->req_limits.uri_len && uri_len > ctx->req_limits.uri_len)) {
+            _uweb_limit(ctx, out, S414_REQ_URI_TOO_LONG, uri_len);
+            return;
+          }
+          memcpy(ctx->req->resource, resource, uri_len + 1);
           break;
         }
       } // per method
-      uweb.state = HEADER_FIELDS;
+      if (i == _REQ_METHOD_COUNT) {
+        TRACE_E(TRC_BAD_METHOD, ctx->header_line, len);
+      } else if (ctx->limits_f) {
+        // route limits
+        ctx->limits_f(ctx->req, &ctx->req_limits);
+        uint32_t uri_len = strlen(ctx->req->resource);
+        if (ctx->req_limits.uri_len && uri_len > ctx->req_limits.uri_len) {
+          _uweb_limit(ctx, out, S414_REQ_URI_TOO_LONG, uri_len);
+          return;
+        }
+      }
+#if UWEB_CFG_CACHE
+      _uweb_cache_key(ctx);
+#endif
+      ctx->state = HEADER_FIELDS;
       break;
     }
 
     case HEADER_FIELDS: {
       uint32_t i;
+      if (ctx->req_limits.header_count && ++ctx->header_count > ctx->req_limits.header_count) {
+        _uweb_limit(ctx, out, S431_REQ_HEADER_FIELDS_TOO_LARGE, ctx->header_count);
+        return;
+      }
+      if (ctx->field_f) {
+        ctx->field_f(ctx->req, s, len);
+      }
+#if UWEB_CFG_CACHE
+      _uweb_cache_field(ctx, s, len);
+#endif
       for (i = 0; i < _FIELD_COUNT; i++) {
         if (strstr(s, UWEB_HTTP_FIELDS[i]) == s) {
           switch (i) {
           case FCONNECTION: {
             char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
-            strncpy(uweb.req.connection, value, UWEB_MAX_CONNECTION_LEN);
+            strncpy(ctx->req->connection, value, UWEB_MAX_CONNECTION_LEN - 1);
             break;
           }
+#if UWEB_CFG_FIELD_HOST
           case FHOST: {
             char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
-            strncpy(uweb.req.host, value, UWEB_MAX_HOST_LEN);
+            strncpy(ctx->req->host, value, UWEB_MAX_HOST_LEN - 1);
             break;
           }
+#endif
+#if UWEB_CFG_FIELD_CONTENT_TYPE
           case FCONTENT_TYPE: {
             char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
-            strncpy(uweb.req.content_type, value, UWEB_MAX_CONTENT_DISP_LEN);
+            strncpy(ctx->req->content_type, value, UWEB_MAX_CONTENT_TYPE_LEN - 1);
             break;
           }
+#endif
           case FCONTENT_LENGTH: {
             char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
-            uweb.req.content_length = atoi(value);
+            unsigned long long content_length = strtoull(value, 0, 10);
+            if (content_length > 0xffffffffULL ||
+                (ctx->req_limits.body_size && content_length > ctx->req_limits.body_size)) {
+              _uweb_limit(ctx, out, S413_REQ_ENTITY_TOO_LARGE,
+                  content_length > 0xffffffffULL ? 0xffffffff : (uint32_t)content_length);
+              return;
+            }
+            ctx->req->content_length = content_length;
             break;
           }
           case FTRANSFER_ENCODING: {
             char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
-            uweb.req.chunked = strcmp("chunked", value) == 0;
+            ctx->req->chunked = strcmp("chunked", value) == 0;
             break;
           }
+          case FEXPECT: {
+            char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
+            if (!_uweb_nocase_eq("100-continue", value, 13)) {
+              _uweb_error(ctx, out, S417_EXPECTATION_FAILED, ERR_HTTP_EXPECTATION_FAILED);
+              return;
+            }
+            ctx->req->expect_continue = 1;
+            break;
+          }
+#if UWEB_CFG_WEBSOCKET || UWEB_CFG_HTTP2
+          case FUPGRADE: {
+            char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
+#if UWEB_CFG_WEBSOCKET
+            ctx->req->websocket = _uweb_nocase_eq("websocket", value, 10);
+#endif
+#if UWEB_CFG_HTTP2
+            ctx->req->h2c = _uweb_nocase_eq("h2c", value, 4);
+#endif
+            break;
+          }
+#endif
+#if UWEB_CFG_HTTP2
+          case FHTTP2_SETTINGS: {
+            char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
+            int dlen = ctx->req->h2_settings ? -1 :
+                uweb_base64url_decode(ctx->req->h2_settings_buf, UWEB_H2_UPGRADE_SETTINGS_LEN, value);
+            // exactly one, holding whole settings
+            if (dlen < 0 || dlen % 6) {
+              ctx->req->h2_settings = 2;
+            } else {
+              ctx->req->h2_settings = 1;
+              ctx->req->h2_settings_len = dlen;
+            }
+            break;
+          }
+#endif
+#if UWEB_CFG_WEBSOCKET
+          case FSEC_WEBSOCKET_KEY: {
+            char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
+            strncpy(ctx->req->ws_key, value, UWEB_MAX_WS_KEY_LEN - 1);
+            break;
+          }
+          case FSEC_WEBSOCKET_VERSION: {
+            char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
+            ctx->req->ws_version = strcmp("13", value) == 0 ? 13 : 0;
+            break;
+          }
+#endif
+#if UWEB_CFG_ASSETS
+          case FACCEPT_ENCODING: {
+            char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
+            ctx->req->accept_gzip = strstr(value, "gzip") != 0;
+            break;
+          }
+          case FIF_NONE_MATCH: {
+            char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
+            // too long to match any
+            if (strlen(value) < UWEB_MAX_ETAG_LEN) strcpy(ctx->req->if_none_match, value);
+            break;
+          }
+#endif
           } // switch field
           break;
         }
@@ -292,95 +883,152 @@ static void _uweb_handle_http_header_line(UW_STREAM out, char *s, uint16_t len,
   else // if (len == 0) meaning blank line
   {
     // end of HTTP header
+    UWEB_METRIC_HIST_SINCE(UWEB_HIST_HEADER_PARSE, ctx->t_header);
+
+#if UWEB_CFG_VHOST
+    if (ctx->vhosts) ctx->req->site = UWEB_vhost_find(ctx->vhosts, ctx->req->host);
+#endif
+    // accept or reject before any body is read
+    if (ctx->header_f && ctx->req->method != _BAD_REQ) {
+      uweb_http_status http_status = ctx->header_f(ctx->req);
+      if (http_status != S100_CONTINUE) {
+        TRACE_I(TRC_REJECT, UWEB_HTTP_STATUS_NUM[http_status], ctx->req->content_length);
+        _uweb_error(ctx, out, http_status, ERR_HTTP_REJECTED);
+        return;
+      }
+    }
+#if !UWEB_CFG_CHUNKED_REQ
+    if (ctx->req->chunked) {
+      _uweb_error(ctx, out, S501_NOT_IMPLEMENTED, ERR_HTTP_NOT_IMPL);
+      return;
+    }
+#endif
+#if UWEB_CFG_HTTP2
+    if (ctx->req->h2c && ctx->req->h2_settings == 1 && ctx->req->method != _BAD_REQ &&
+        ctx->req->content_length == 0 && !ctx->req->chunked &&
+        _uweb_token(ctx->req->connection, "upgrade") && _uweb_token(ctx->req->connection, "http2-settings")) {
+      // upgrade, the request is answered as stream 1
+      _uweb_sendf(ctx, out,
+        "HTTP/1.1 %i %s\r\n"
+        "Connection: Upgrade\r\n"
+        "Upgrade: h2c\r\n"
+        "\r\n",
+        UWEB_HTTP_STATUS_NUM[S101_SWITCHING_PROTOCOLS], UWEB_HTTP_STATUS_STRING[S101_SWITCHING_PROTOCOLS]);
+      UWEB_METRIC_STATUS(S101_SWITCHING_PROTOCOLS);
+      ctx->state = HTTP2;
+      if (_uweb_h2_upgrade(ctx, out)) {
+        _uweb_clear_req(ctx);
+        ctx->state = CLOSING;
+      }
+      return;
+    }
+#endif
+    if (ctx->req->expect_continue && (ctx->req->content_length > 0 || ctx->req->chunked)) {
+      TRACE_I(TRC_CONTINUE, ctx->req->content_length, ctx->req->chunked);
+      _uweb_sendf(ctx, out, "HTTP/1.1 %i %s\r\n\r\n",
+          UWEB_HTTP_STATUS_NUM[S100_CONTINUE], UWEB_HTTP_STATUS_STRING[S100_CONTINUE]);
+    }
 
     // serve request
-    _uweb_request(out, &uweb.req);
+    _uweb_request(ctx, out, ctx->req);
+    if (ctx->state == CLOSING || ctx->state == WEBSOCKET || ctx->state == EVENT_STREAM) {
+      return;
+    }
 
     // expecting data?
-    if (uweb.req.chunked) {
+#if UWEB_CFG_CHUNKED_REQ
+    if (ctx->req->chunked) {
       // --- chunked content
-      if (uweb.req.content_length > 0) {
-        UWEB_DBG("BAD CHUNK REQUEST, Content-Length > 0\n");
-        _uweb_error(out, S400_BAD_REQ, ERR_HTTP_BAD_REQUEST);
+      if (ctx->req->content_length > 0) {
+        TRACE_E(TRC_BAD_CHUNK_LENGTH, ctx->req->content_length, 0);
+        _uweb_error(ctx, out, S400_BAD_REQ, ERR_HTTP_BAD_REQUEST);
         return;
       }
-      uweb.state = CHUNK_DATA_HEADER;
-      uweb.chunk_ix = 0;
-      uweb.chunk_len = 0;
-      uweb.received_content_len = 0;
-    } else  if (uweb.req.content_length > 0) {
+      ctx->state = CHUNK_DATA_HEADER;
+      ctx->chunk_ix = 0;
+      ctx->chunk_len = 0;
+      ctx->chunk_digits = 0;
+      ctx->chunk_hdr = CHUNK_HDR_SIZE;
+      ctx->chunk_trailer_nbr = 0;
+      ctx->received_chunked_len = 0;
+      ctx->received_content_len = 0;
+    } else
+#endif
+    if (ctx->req->content_length > 0) {
       // --- plain content
-      uweb.received_content_len = 0;
-      uweb.state = CONTENT;
-      UWEB_DBG("getting content length %i, available now %i\n", uweb.req.content_length, in->avail_sz);
-
-      // --- multipart content
-      if (strstr(uweb.req.content_type, "multipart/form-data") == uweb.req.content_type) {
+      ctx->received_content_len = 0;
+      ctx->state = CONTENT;
+      TRACE_D(TRC_CONTENT, ctx->req->content_length, in->avail_sz);
+
+#if UWEB_CFG_MULTIPART
+      // --- multipart content, passed on raw when deferred
+      if (!ctx->deferred &&
+          strstr(ctx->req->content_type, "multipart/form-data") == ctx->req->content_type) {
         // get boundary string
-        char *boundary_start = strstr(uweb.req.content_type, "boundary");
+        char *boundary_start = strstr(ctx->req->content_type, "boundary");
         if (boundary_start == 0) {
-          UWEB_DBG("BAD MULTIPART REQUEST, boundary not found\n");
-          _uweb_error(out, S400_BAD_REQ, ERR_HTTP_BAD_REQUEST);
+          TRACE_E(TRC_BAD_MULTIPART, 0, 0);
+          _uweb_error(ctx, out, S400_BAD_REQ, ERR_HTTP_BAD_REQUEST);
           return;
         }
         boundary_start += 8; // "boundary"
         boundary_start = _uweb_space_strip(boundary_start);
         if (*boundary_start != '=') {
-          UWEB_DBG("BAD MULTIPART REQUEST, = not found\n");
-          _uweb_error(out, S400_BAD_REQ, ERR_HTTP_BAD_REQUEST);
+          TRACE_E(TRC_BAD_MULTIPART, 1, 0);
+          _uweb_error(ctx, out, S400_BAD_REQ, ERR_HTTP_BAD_REQUEST);
           return;
         }
         boundary_start++;
         boundary_start = _uweb_space_strip(boundary_start);
         if (strlen(boundary_start) == 0) {
-          UWEB_DBG("BAD MULTIPART REQUEST, boundary id not found\n");
-          _uweb_error(out, S400_BAD_REQ, ERR_HTTP_BAD_REQUEST);
+          TRACE_E(TRC_BAD_MULTIPART, 2, 0);
+          _uweb_error(ctx, out, S400_BAD_REQ, ERR_HTTP_BAD_REQUEST);
           return;
         }
-        uweb.multipart_boundary = boundary_start;
-        uweb.multipart_boundary_ix = 0;
-        uweb.multipart_delim = 0;
-        uweb.multipart_boundary_len = strlen(boundary_start);
-        uweb.req.cur_multipart.multipart_nbr = 0;
-        uweb.state = MULTI_CONTENT_HEADER;
-        uweb.header_line = 0;
-        UWEB_DBG("boundary start: %s\n", boundary_start);
+        ctx->multipart_boundary = boundary_start;
+        ctx->multipart_boundary_ix = 0;
+        ctx->multipart_delim = 0;
+        ctx->multipart_boundary_len = strlen(boundary_start);
+        ctx->req->cur_multipart.multipart_nbr = 0;
+        ctx->state = MULTI_CONTENT_HEADER;
+        ctx->header_line = 0;
+        TRACE_D(TRC_MULTIPART, ctx->multipart_boundary_len, 0);
       }
+#endif
 
     } else {
       // back to expecting a http header
-      _uweb_clear_req(&uweb.req);
+      _uweb_request_done(ctx, out);
     }
 
     return;
   }
 }
 
+#if UWEB_CFG_MULTIPART
 // handle multipart content header line
-static void _uweb_handle_multi_content_header_line(UW_STREAM out, char *s, uint16_t len, UW_STREAM in) {
-  (void)out;
+static void _uweb_handle_multi_content_header_line(uweb_ctx *ctx, UW_STREAM out, char *s, uint16_t len, UW_STREAM in) {
   (void)in;
   s[len] = 0;
   char *boundary_start;
-  if (strstr(s, "--") == s && (boundary_start = strstr(s+2, uweb.multipart_boundary))) {
+  if (strstr(s, "--") == s && (boundary_start = strstr(s+2, ctx->multipart_boundary))) {
     // boundary match
-    if (strstr(boundary_start + uweb.multipart_boundary_len, "--")) {
+    if (strstr(boundary_start + ctx->multipart_boundary_len, "--")) {
       // end of multipart message
       // back to expecting a http header
-      UWEB_DBG("multipart finished\n");
-      _uweb_clear_req(&uweb.req);
+      TRACE_D(TRC_MULTIPART_DONE, ctx->req->content_length, 0);
+      _uweb_request_done(ctx, out);
     } else {
       // multipart section
-      UWEB_DBG("multipart section %i header\n", uweb.req.cur_multipart.multipart_nbr);
+      TRACE_D(TRC_MULTIPART_SECTION, ctx->req->cur_multipart.multipart_nbr, 0);
+      UWEB_METRIC_INC(UWEB_CNT_MULTIPARTS);
     }
   } else if (len == 0) { // newline
     // end of multipart header, start of multipart data
-    UWEB_DBG("multipart data section %i [%s]\n", uweb.req.cur_multipart.multipart_nbr,
-        uweb.req.cur_multipart.content_disp);
-    uweb.state = MULTI_CONTENT_DATA;
-    uweb.multipart_boundary_ix = 0;
-    uweb.multipart_delim = 0;
-    uweb.received_multipart_len = 0;
+    ctx->state = MULTI_CONTENT_DATA;
+    ctx->multipart_boundary_ix = 0;
+    ctx->multipart_delim = 0;
+    ctx->received_multipart_len = 0;
   } else {
     // multipart header, get fields
     uint32_t i;
@@ -389,12 +1037,12 @@ static void _uweb_handle_multi_content_header_line(UW_STREAM out, char *s, uint1
         switch (i) {
         case FCONTENT_DISPOSITION: {
           char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
-          strncpy(uweb.req.cur_multipart.content_disp, value, UWEB_MAX_CONTENT_DISP_LEN);
+          strncpy(ctx->req->cur_multipart.content_disp, value, UWEB_MAX_CONTENT_DISP_LEN - 1);
           break;
         }
         case FCONTENT_TYPE: {
           char *value = _uweb_space_strip(&s[strlen(UWEB_HTTP_FIELDS[i])]);
-          strncpy(uweb.req.cur_multipart.content_type, value, UWEB_MAX_CONTENT_TYPE_LEN);
+          strncpy(ctx->req->cur_multipart.content_type, value, UWEB_MAX_CONTENT_TYPE_LEN - 1);
           break;
         }
         } // switch field
@@ -403,66 +1051,344 @@ static void _uweb_handle_multi_content_header_line(UW_STREAM out, char *s, uint1
     } // per field
   }
 }
+#endif
 
-// handle chunk header line
-static void _uweb_handle_chunk_header_line(UW_STREAM out, char *s, uint16_t len, UW_STREAM in) {
-  (void)out;
-  (void)in;
-  (void)len;
-  char *start = _uweb_space_strip(s);
-  char *end = (char *)strchr(start, ';');
-  if (end) *end = 0;
-  uweb.chunk_len = strtol(start, 0, 16);//atoin(start, 16, strlen(start));
-  if (uweb.chunk_len > 0) {
-    UWEB_DBG("chunk %i, length %i\n", uweb.chunk_ix, uweb.chunk_len);
-    uweb.state = CHUNK_DATA;
-  } else {
-    UWEB_DBG("chunks finished, footer\n");
-    uweb.state = CHUNK_FOOTER;
-    uweb.header_line = 0;
+// bytes available, either in lookahead buffer or in input stream
+static int32_t _uweb_avail(uweb_ctx *ctx, UW_STREAM in) {
+  if (ctx->rx_ix < ctx->rx_len) {
+    return ctx->rx_len - ctx->rx_ix;
   }
+  return in->avail_sz;
 }
 
-// handle chunk footer line
-static void _uweb_handle_chunk_footer_line(UW_STREAM out, char *s, uint16_t len, UW_STREAM in) {
-  (void)out;
-  (void)in;
-  (void)s;
-  if (len == 0) { // newline
-    _uweb_clear_req(&uweb.req);
+// read from lookahead buffer if there are bytes left, else from input stream
+static int32_t _uweb_read(uweb_ctx *ctx, UW_STREAM in, uint8_t *dst, uint32_t len) {
+  if (ctx->rx_ix < ctx->rx_len) {
+    uint32_t buffered = ctx->rx_len - ctx->rx_ix;
+    if (len > buffered) len = buffered;
+    memcpy(dst, &ctx->rx_buf[ctx->rx_ix], len);
+    ctx->rx_ix += len;
+    return len;
   }
+  int32_t rlen = in->read ? in->read(in, dst, len) : 0;
+  UWEB_METRIC_ADD(UWEB_CNT_BYTES_IN, rlen > 0 ? rlen : 0);
+  return rlen;
+}
+
+#if UWEB_CFG_CHUNKED_REQ
+static int8_t _uweb_hex(uint8_t c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
 }
 
+// report collected chunk data
+static void _uweb_chunk_report(uweb_ctx *ctx, uint8_t *data, uint32_t len) {
+  if (len == 0) return;
+  if (_UWEB_DATA_F(ctx, ctx->req)) {
+    _UWEB_DATA_F(ctx, ctx->req)(ctx->req, DATA_CHUNK, ctx->received_chunked_len, data, len);
+  }
+  ctx->received_chunked_len += len;
+}
+
+// parse chunked request data block-wise from lookahead buffer.
+// Chunk data is reported directly from the buffer. With UWEB_CHUNK_COALESCE
+// set, data from consecutive chunks within the same block is moved together
+// and reported in one call. Trailer lines are reported as DATA_CHUNK_TRAILER.
+// Returns -1 if no data could be read, else 0.
+static int _uweb_parse_chunked(uweb_ctx *ctx, UW_STREAM out, UW_STREAM in) {
+  if (ctx->rx_ix >= ctx->rx_len) {
+    int32_t len = in->avail_sz < UWEB_RX_BUF_LEN ? in->avail_sz : UWEB_RX_BUF_LEN;
+    len = in->read ? in->read(in, ctx->rx_buf, len) : 0;
+    if (len <= 0) return -1;
+    UWEB_METRIC_ADD(UWEB_CNT_BYTES_IN, len);
+    ctx->rx_ix = 0;
+    ctx->rx_len = len;
+  }
+
+  uint8_t *p = &ctx->rx_buf[ctx->rx_ix];
+  uint8_t *end = &ctx->rx_buf[ctx->rx_len];
+  uint8_t *data = 0;
+  uint32_t data_len = 0;
+
+  while (p < end) {
+    switch (ctx->state) {
+    case CHUNK_DATA_HEADER: {
+      // <hex size>[whitespace][;extensions]\r\n
+      uint8_t c = *p++;
+      if (c == '\n') {
+        if (ctx->chunk_digits == 0) {
+          TRACE_E(TRC_BAD_CHUNK_SIZE, ctx->chunk_ix, c);
+          goto bad_chunk;
+        }
+        ctx->received_content_len = 0;
+        if (ctx->req_limits.body_size &&
+            ctx->received_chunked_len + data_len + ctx->chunk_len > ctx->req_limits.body_size) {
+          _uweb_chunk_report(ctx, data, data_len);
+          _uweb_limit(ctx, out, S413_REQ_ENTITY_TOO_LARGE,
+              ctx->received_chunked_len + ctx->chunk_len);
+          return 0;
+        }
+        if (ctx->chunk_len > 0) {
+          TRACE_D(TRC_CHUNK, ctx->chunk_ix, ctx->chunk_len);
+          ctx->state = CHUNK_DATA;
+        } else {
+          ctx->state = CHUNK_FOOTER;
+          ctx->req_buf_len = 0;
+        }
+      } else if (c == '\r') {
+        ctx->chunk_hdr = CHUNK_HDR_CR;
+      } else if (ctx->chunk_hdr == CHUNK_HDR_EXT) {
+        // skip extensions
+      } else if (ctx->chunk_hdr == CHUNK_HDR_CR) {
+        TRACE_E(TRC_BAD_CHUNK_SIZE, ctx->chunk_ix, c);
+        goto bad_chunk;
+      } else if (c == ';') {
+        ctx->chunk_hdr = CHUNK_HDR_EXT;
+      } else if (c == ' ' || c == '\t') {
+        // whitespace only after the size
+        if (ctx->chunk_digits == 0) {
+          TRACE_E(TRC_BAD_CHUNK_SIZE, ctx->chunk_ix, c);
+          goto bad_chunk;
+        }
+        ctx->chunk_hdr = CHUNK_HDR_SPACE;
+      } else {
+        int8_t n = _uweb_hex(c);
+        if (n < 0 || ctx->chunk_digits >= 8 || ctx->chunk_hdr != CHUNK_HDR_SIZE) {
+          TRACE_E(TRC_BAD_CHUNK_SIZE, ctx->chunk_ix, c);
+          goto bad_chunk;
+        }
+        ctx->chunk_len = (ctx->chunk_len << 4) | n;
+        ctx->chunk_digits++;
+      }
+      break;
+    }
+
+    case CHUNK_DATA: {
+      uint32_t len = end - p;
+      if (len > ctx->chunk_len - ctx->received_content_len) {
+        len = ctx->chunk_len - ctx->received_content_len;
+      }
+      if (data == 0) {
+        data = p;
+      } else if (data + data_len != p) {
+        // coalesce with previous chunk's data, skipping framing in between
+        memmove(data + data_len, p, len);
+      }
+      data_len += len;
+      p += len;
+      ctx->received_content_len += len;
+      if (ctx->received_content_len == ctx->chunk_len) {
+        UWEB_METRIC_INC(UWEB_CNT_CHUNKS_IN);
+        ctx->chunk_ix++;
+        ctx->state = CHUNK_DATA_END;
+#if !UWEB_CHUNK_COALESCE
+        _uweb_chunk_report(ctx, data, data_len);
+        data = 0;
+        data_len = 0;
+#endif
+      }
+      break;
+    }
+
+    case CHUNK_DATA_END: {
+      uint8_t c = *p++;
+      if (c == '\n') {
+        ctx->state = CHUNK_DATA_HEADER;
+        ctx->chunk_len = 0;
+        ctx->chunk_digits = 0;
+        ctx->chunk_hdr = CHUNK_HDR_SIZE;
+      } else if (c != '\r') {
+        TRACE_E(TRC_BAD_CHUNK_END, ctx->chunk_ix, c);
+        goto bad_chunk;
+      }
+      break;
+    }
+
+    case CHUNK_FOOTER: {
+      uint8_t c = *p++;
+      // trailers count against the header limits
+      if (ctx->req_limits.header_bytes && ++ctx->header_bytes > ctx->req_limits.header_bytes) {
+        _uweb_chunk_report(ctx, data, data_len);
+        _uweb_limit(ctx, out, S431_REQ_HEADER_FIELDS_TOO_LARGE, ctx->header_bytes);
+        return 0;
+      }
+      if (c == '\r') break;
+      if (c != '\n') {
+        if (ctx->req_buf_len < UWEB_REQ_BUF_MAX_LEN) {
+          ctx->req_buf[ctx->req_buf_len++] = c;
+        }
+        break;
+      }
+      _uweb_chunk_report(ctx, data, data_len);
+      data = 0;
+      data_len = 0;
+      ctx->req_buf[ctx->req_buf_len] = 0;
+      if (ctx->req_buf_len > 0) {
+        if (ctx->req_limits.header_count && ++ctx->header_count > ctx->req_limits.header_count) {
+          _uweb_limit(ctx, out, S431_REQ_HEADER_FIELDS_TOO_LARGE, ctx->header_count);
+          return 0;
+        }
+        TRACE_D(TRC_CHUNK_TRAILER, ctx->chunk_trailer_nbr, ctx->req_buf_len);
+        if (_UWEB_DATA_F(ctx, ctx->req)) {
+          _UWEB_DATA_F(ctx, ctx->req)(ctx->req, DATA_CHUNK_TRAILER, ctx->chunk_trailer_nbr,
+              (uint8_t *)ctx->req_buf, ctx->req_buf_len);
+        }
+        ctx->chunk_trailer_nbr++;
+        ctx->req_buf_len = 0;
+      } else {
+        TRACE_D(TRC_CHUNKS_DONE, ctx->chunk_ix, ctx->received_chunked_len);
+        if (_UWEB_DATA_F(ctx, ctx->req)) {
+          // report data end
+          _UWEB_DATA_F(ctx, ctx->req)(ctx->req, DATA_CHUNK, ctx->received_chunked_len, 0, 0);
+        }
+        _uweb_request_done(ctx, out);
+        // leave rest of block to the header parser
+        if (ctx->state != CLOSING) ctx->rx_ix = p - ctx->rx_buf;
+        return 0;
+      }
+      break;
+    }
+
+    default:
+      UWEB_ASSERT(0);
+      break;
+    }
+  }
+
+  _uweb_chunk_report(ctx, data, data_len);
+  ctx->rx_ix = ctx->rx_len;
+  return 0;
+
+bad_chunk:
+  _uweb_chunk_report(ctx, data, data_len);
+  // the response is already sent, a 400 can not follow it
+  _uweb_abort(ctx, out);
+  return 0;
+}
+#endif
+
 // return redirect in response callback function
 uweb_response UWEB_return_redirect(uweb_request_header *req, const char *url) {
   req->redirection_url = url;
   return UWEB_REDIRECT;
 }
 
-// http data timeout
-void UWEB_timeout(UW_STREAM out) {
-  if (uweb.state != HEADER_METHOD) {
-    UWEB_DBG("request timeout\n");
-    _uweb_error(out, S408_REQUEST_TIMEOUT, ERR_HTTP_TIMEOUT);
+// return event stream in response callback function
+uweb_response UWEB_return_event_stream(uweb_request_header *req, const char *channel) {
+  req->event_channel = channel;
+  return UWEB_EVENT_STREAM;
+}
+
+// return prebuilt header in response callback function
+uweb_response UWEB_return_prebuilt(uweb_request_header *req, const char *hdr) {
+  req->prebuilt_hdr = hdr;
+  return UWEB_PREBUILT;
+}
+
+#if UWEB_CFG_CHUNKED_RESP
+// return generator in response callback function
+uweb_response UWEB_return_generator(uweb_request_header *req, uweb_gen_f gen_f, void *user) {
+  uweb_ctx *ctx = req->ctx;
+  memset(&ctx->gen, 0, sizeof(uweb_gen));
+  ctx->gen.user = user;
+  ctx->gen_f = gen_f;
+  return UWEB_GENERATOR;
+}
+#endif
+
+// http data timeout, also when stuck within the request line
+static void _uweb_timeout(uweb_ctx *ctx, UW_STREAM out) {
+  if (ctx->state == CLOSING) return;
+  if (ctx->state == EVENT_STREAM) {
+    // the stream simply ends
+    ctx->state = CLOSING;
+    return;
+  }
+  if (ctx->state == DEFERRED || ctx->deferred || _UWEB_GENERATING(ctx)) {
+    // the response is under way
+    TRACE_I(TRC_TIMEOUT, ctx->req_buf_len, 0);
+    UWEB_METRIC_INC(UWEB_CNT_TIMEOUTS);
+    _uweb_abort(ctx, out);
+    return;
+  }
+#if UWEB_CFG_WEBSOCKET
+  if (ctx->state == WEBSOCKET) {
+    UWEB_ws_close(ctx->req, out, UWEB_WS_CLOSE_GOING_AWAY);
+    ctx->state = CLOSING;
+    return;
+  }
+#endif
+#if UWEB_CFG_HTTP2
+  if (ctx->state == HTTP2) {
+    if (_uweb_h2_open_streams(ctx)) {
+      TRACE_I(TRC_TIMEOUT, 0, 0);
+      UWEB_METRIC_INC(UWEB_CNT_TIMEOUTS);
+    }
+    _uweb_h2_goaway(ctx, out, H2_NO_ERROR);
+    ctx->state = CLOSING;
+    return;
+  }
+#endif
+  if (ctx->state != HEADER_METHOD || ctx->req_buf_len > 0) {
+    TRACE_I(TRC_TIMEOUT, ctx->req_buf_len, 0);
+    UWEB_METRIC_INC(UWEB_CNT_TIMEOUTS);
+    _uweb_error(ctx, out, S408_REQUEST_TIMEOUT, ERR_HTTP_TIMEOUT);
   }
 }
 
+uweb_phase UWEB_ctx_phase(uweb_ctx *ctx) {
+  switch (ctx->state) {
+  case HEADER_METHOD:
+    return ctx->req_buf_len > 0 || ctx->rx_ix < ctx->rx_len ? UWEB_PHASE_HEADER : UWEB_PHASE_IDLE;
+  case HEADER_FIELDS:
+    return UWEB_PHASE_HEADER;
+  case CLOSING:
+    return UWEB_PHASE_CLOSING;
+  case WEBSOCKET:
+    return UWEB_PHASE_WEBSOCKET;
+  case EVENT_STREAM:
+    return UWEB_PHASE_EVENT_STREAM;
+  case DEFERRED:
+    return UWEB_PHASE_DEFERRED;
+#if UWEB_CFG_HTTP2
+  case HTTP2:
+    // between requests when no stream is open
+    return _uweb_h2_open_streams(ctx) ? UWEB_PHASE_BODY : UWEB_PHASE_IDLE;
+#endif
+  default:
+    return UWEB_PHASE_BODY;
+  }
+}
+
+void UWEB_shed(UW_STREAM out, uweb_shed_reason reason) {
+  if (out->write) {
+    int wlen = out->write(out, (uint8_t *)UWEB_SHED_RESPONSE, sizeof(UWEB_SHED_RESPONSE) - 1);
+    if (wlen > 0) out->wr_offs += wlen;
+  }
+  UWEB_METRIC_ADD(UWEB_CNT_BYTES_OUT, sizeof(UWEB_SHED_RESPONSE) - 1);
+  UWEB_METRIC_STATUS(S503_SERVICE_UNAVAILABLE);
+  UWEB_METRIC_INC(UWEB_CNT_SHED_CONNECTIONS + reason);
+  (void)reason;
+  if (out->close) out->close(out);
+}
+
 // parse http data characters
-void UWEB_parse(UW_STREAM in, UW_STREAM out) {
+static void _uweb_parse(uweb_ctx *ctx, UW_STREAM in, UW_STREAM out) {
   int32_t rx;
-  while ((rx = in->avail_sz) > 0) {
-    switch (uweb.state) {
+  while ((rx = _uweb_avail(ctx, in)) > 0) {
+    switch (ctx->state) {
 
     // --- HEADER PARSING
 
+#if UWEB_CFG_MULTIPART
     case MULTI_CONTENT_HEADER:
-    case CHUNK_DATA_HEADER:
-    case CHUNK_DATA_END:
+#endif
     case HEADER_METHOD:
-    case CHUNK_FOOTER:
     case HEADER_FIELDS: {
       uint8_t c;
-      int32_t res = in->read ? in->read(in, &c, 1) : 0;
+      int32_t res = _uweb_read(ctx, in, &c, 1);
 //      printf("HEADER     :%02x %c\n",
 //             c, c <= ' ' ? '.' : c);
 
@@ -470,199 +1396,487 @@ void UWEB_parse(UW_STREAM in, UW_STREAM out) {
         return;
       }
 
+#if UWEB_CFG_METRICS
+      if (ctx->state == HEADER_METHOD && ctx->req_buf_len == 0) {
+        UWEB_METRIC_TIME(ctx->t_header);
+      }
+#endif
+#if UWEB_CFG_MULTIPART
+      if (ctx->state != MULTI_CONTENT_HEADER)
+#endif
+      {
+        if (ctx->req_limits.header_bytes && ++ctx->header_bytes > ctx->req_limits.header_bytes) {
+          _uweb_limit(ctx, out, S431_REQ_HEADER_FIELDS_TOO_LARGE, ctx->header_bytes);
+          break;
+        }
+        if (ctx->req_buf_len >= UWEB_REQ_BUF_MAX_LEN && c != '\n' && c != '\r') {
+          // line does not fit, do not cut it
+          if (ctx->state == HEADER_METHOD) {
+            _uweb_limit(ctx, out, S414_REQ_URI_TOO_LONG, ctx->req_buf_len);
+          } else {
+            _uweb_limit(ctx, out, S431_REQ_HEADER_FIELDS_TOO_LARGE, ctx->req_buf_len);
+          }
+          break;
+        }
+      }
       if (c == '\r') continue;
-      if (uweb.req_buf_len >= UWEB_REQ_BUF_MAX_LEN || c == '\n') {
-        if (uweb.req_buf_len >= UWEB_REQ_BUF_MAX_LEN) {
-          uweb.req_buf[UWEB_REQ_BUF_MAX_LEN] = 0;
+      if (ctx->req_buf_len >= UWEB_REQ_BUF_MAX_LEN || c == '\n') {
+        if (ctx->req_buf_len >= UWEB_REQ_BUF_MAX_LEN) {
+          ctx->req_buf[UWEB_REQ_BUF_MAX_LEN] = 0;
         } else {
-          uweb.req_buf[uweb.req_buf_len] = 0;
+          ctx->req_buf[ctx->req_buf_len] = 0;
         }
-        if (uweb.state == CHUNK_DATA_HEADER) {
-          UWEB_DBG("CHUNK-HDR: %s\n", uweb.req_buf);
-          _uweb_handle_chunk_header_line(out, uweb.req_buf, uweb.req_buf_len, in);
-        } else if (uweb.state == CHUNK_DATA_END) {
-          // ignore
-          UWEB_DBG("CHUNK-DATA_END\n");
-          uweb.state = CHUNK_DATA_HEADER;
-          uweb.header_line = 0;
-          uweb.received_content_len = 0;
-        } else if (uweb.state == CHUNK_FOOTER) {
-          UWEB_DBG("CHUNK-FOOTER: %s\n", uweb.req_buf);
-          _uweb_handle_chunk_footer_line(out, uweb.req_buf, uweb.req_buf_len, in);
-        } else if (uweb.state == MULTI_CONTENT_HEADER) {
-          UWEB_DBG("MULTI-HDR:%s\n", uweb.req_buf);
-          _uweb_handle_multi_content_header_line(out, uweb.req_buf, uweb.req_buf_len, in);
-        } else {
-          UWEB_DBG("HTTP-HDR: %s\n", uweb.req_buf);
-          if (uweb.req_buf_len < 3 && uweb.header_line == 0) {
+#if UWEB_CFG_MULTIPART
+        if (ctx->state == MULTI_CONTENT_HEADER) {
+          TRACE_D(TRC_HEADER_LINE, ctx->header_line, ctx->req_buf_len);
+          _uweb_handle_multi_content_header_line(ctx, out, ctx->req_buf, ctx->req_buf_len, in);
+        } else
+#endif
+        {
+          TRACE_D(TRC_HEADER_LINE, ctx->header_line, ctx->req_buf_len);
+          if (ctx->req_buf_len < 3 && ctx->header_line == 0) {
             // ignore, probably just a stray newline
-            uweb.req_buf_len = 0;
+            ctx->req_buf_len = 0;
             break;
           }
-          _uweb_handle_http_header_line(out, uweb.req_buf, uweb.req_buf_len, in);
+          _uweb_handle_http_header_line(ctx, out, ctx->req_buf, ctx->req_buf_len, in);
         }
-        uweb.header_line++;
-        uweb.req_buf_len = 0;
+        ctx->header_line++;
+        ctx->req_buf_len = 0;
       }
 
       if (c != '\n') {
-        uweb.req_buf[uweb.req_buf_len++] = c;
+        ctx->req_buf[ctx->req_buf_len++] = c;
+      }
+      break;
+    }
+
+    // --- REJECTED OR STREAMING EVENTS, DROP DATA
+
+    // --- DEFERRED RESPONSE NOT DONE, LEAVE DATA
+
+    case DEFERRED:
+      return;
+
+    case EVENT_STREAM:
+    case CLOSING: {
+      int32_t len = rx < UWEB_REQ_BUF_MAX_LEN ? rx : UWEB_REQ_BUF_MAX_LEN;
+      if (_uweb_read(ctx, in, (uint8_t *)ctx->req_buf, len) <= 0) return;
+      break;
+    }
+
+#if UWEB_CFG_WEBSOCKET
+    // --- WEBSOCKET FRAMES
+
+    case WEBSOCKET: {
+      int res = _uweb_ws_parse(ctx, out, in);
+      if (res < 0) return;
+      if (res > 0) {
+        // closed, drop the rest
+        _uweb_clear_req(ctx);
+        ctx->state = CLOSING;
+      }
+      break;
+    }
+#endif
+
+#if UWEB_CFG_HTTP2
+    // --- HTTP/2 FRAMES
+
+    case HTTP2: {
+      int res = _uweb_h2_parse(ctx, out, in);
+      if (res < 0) return;
+      if (res > 0) {
+        // closed, drop the rest
+        _uweb_clear_req(ctx);
+        ctx->state = CLOSING;
       }
       break;
     }
+#endif
+
+#if UWEB_CFG_CHUNKED_REQ
+    // --- CHUNKED DATA PARSING
+
+    case CHUNK_DATA_HEADER:
+    case CHUNK_DATA:
+    case CHUNK_DATA_END:
+    case CHUNK_FOOTER:
+      if (_uweb_parse_chunked(ctx, out, in) < 0) {
+        return;
+      }
+      break;
+#endif
 
     // --- DATA PARSING
 
-    case CONTENT:
-    case CHUNK_DATA: {
+    case CONTENT: {
       // known content size
       int32_t len = rx < UWEB_REQ_BUF_MAX_LEN ? rx : UWEB_REQ_BUF_MAX_LEN;
-      if (uweb.state == CONTENT) {
-        len = len < (int32_t)(uweb.req.content_length - uweb.received_content_len) ?
-            len : (int32_t)(uweb.req.content_length - uweb.received_content_len);
-      } else if (uweb.state == CHUNK_DATA) {
-        len = len < (int32_t)(uweb.chunk_len - uweb.received_content_len) ?
-            len : (int32_t)(uweb.chunk_len - uweb.received_content_len);
-      }
-      len = in->read ? in->read(in, (uint8_t *)uweb.req_buf, len) : 0;
+      len = len < (int32_t)(ctx->req->content_length - ctx->received_content_len) ?
+          len : (int32_t)(ctx->req->content_length - ctx->received_content_len);
+      len = _uweb_read(ctx, in, (uint8_t *)ctx->req_buf, len);
       if (len <= 0) return;
 
-      if (uweb.server_data_f) {
+      if (_UWEB_DATA_F(ctx, ctx->req)) {
         // report data
-        uweb.server_data_f(&uweb.req, uweb.state == CONTENT ? DATA_CONTENT : DATA_CHUNK,
-            uweb.received_content_len, (uint8_t *)uweb.req_buf, len);
-      }
-
-      uweb.received_content_len += len;
-      if (uweb.req.chunked) {
-        // chunking data
-        if (uweb.received_content_len == uweb.chunk_len) {
-          UWEB_DBG("chunk %i received\n", uweb.chunk_ix);
-          uweb.chunk_ix++;
-          uweb.state = CHUNK_DATA_END;
-          uweb.header_line = 0;
-        }
-      } else {
-        // content data
-        if (uweb.received_content_len == uweb.req.content_length) {
-          UWEB_DBG("all content received\n");
-          if (uweb.server_data_f) {
-            // report data end
-            uweb.server_data_f(&uweb.req, uweb.state == CONTENT ? DATA_CONTENT : DATA_CHUNK,
-                uweb.received_content_len, 0, 0);
-          }
-          _uweb_clear_req(&uweb.req);
+        _UWEB_DATA_F(ctx, ctx->req)(ctx->req, DATA_CONTENT,
+            ctx->received_content_len, (uint8_t *)ctx->req_buf, len);
+      }
+
+      ctx->received_content_len += len;
+      if (ctx->received_content_len == ctx->req->content_length) {
+        TRACE_D(TRC_CONTENT_DONE, ctx->received_content_len, 0);
+        if (_UWEB_DATA_F(ctx, ctx->req)) {
+          // report data end
+          _UWEB_DATA_F(ctx, ctx->req)(ctx->req, DATA_CONTENT, ctx->received_content_len, 0, 0);
         }
+        _uweb_request_done(ctx, out);
       }
       break;
     }
+#if UWEB_CFG_MULTIPART
     case MULTI_CONTENT_DATA: {
       uint8_t flush_boundary_buf = 0;
       uint8_t c;
-      int32_t res = in->read ? in->read(in, &c, 1) : 0;
+      int32_t res = _uweb_read(ctx, in, &c, 1);
 
       if (res < 1) {
         return;
       }
 //      printf("MULCON_DATA:%02x %c  delim_ix:%i bound_ix:%i/%i\n",
 //             c, c <= ' ' ? '.' : c,
-//                 uweb.multipart_delim,
-//                 uweb.multipart_boundary_ix,  uweb.multipart_boundary_len);
+//                 ctx->multipart_delim,
+//                 ctx->multipart_boundary_ix,  ctx->multipart_boundary_len);
 
-      uweb.req_buf[uweb.req_buf_len++] = c;
+      ctx->req_buf[ctx->req_buf_len++] = c;
 
       // find boundary \r\n--<BOUNDARY>(--|\r\n)
-      if (c == "\r\n--"[uweb.multipart_delim] && uweb.multipart_delim < 4) {
-        uweb.multipart_delim++;
-      } else if (uweb.multipart_delim == 4 &&
-          c == uweb.multipart_boundary[uweb.multipart_boundary_ix]) {
-        uweb.multipart_boundary_ix++;
-      } else if (uweb.multipart_boundary_ix == uweb.multipart_boundary_len &&
-          uweb.multipart_delim < 6 && (c == '-' || c == '\r' || c == '\n')) {
-        uweb.multipart_delim++;
-        if (uweb.multipart_delim >= 6) {
-          UWEB_DBG("MULTI-PART-DATA: received full boundary\n");
-          uint16_t old_req_buf_len = uweb.req_buf_len;
+      if (c == "\r\n--"[ctx->multipart_delim] && ctx->multipart_delim < 4) {
+        ctx->multipart_delim++;
+      } else if (ctx->multipart_delim == 4 &&
+          c == ctx->multipart_boundary[ctx->multipart_boundary_ix]) {
+        ctx->multipart_boundary_ix++;
+      } else if (ctx->multipart_boundary_ix == ctx->multipart_boundary_len &&
+          ctx->multipart_delim < 6 && (c == '-' || c == '\r' || c == '\n')) {
+        ctx->multipart_delim++;
+        if (ctx->multipart_delim >= 6) {
+          TRACE_D(TRC_MULTIPART_BOUNDARY, ctx->req->cur_multipart.multipart_nbr,
+              ctx->received_multipart_len + ctx->req_buf_len - ctx->multipart_boundary_len - 6);
+          uint16_t old_req_buf_len = ctx->req_buf_len;
           // got a boundary, report previous collected data if any
-          if (uweb.req_buf_len - uweb.multipart_boundary_len - 6 > 0 && uweb.server_data_f) {
-            uweb.server_data_f(&uweb.req, DATA_MULTIPART, uweb.received_multipart_len,
-                (uint8_t*)uweb.req_buf, uweb.req_buf_len - uweb.multipart_boundary_len - 6);
+          if (ctx->req_buf_len - ctx->multipart_boundary_len - 6 > 0 && _UWEB_DATA_F(ctx, ctx->req)) {
+            _UWEB_DATA_F(ctx, ctx->req)(ctx->req, DATA_MULTIPART, ctx->received_multipart_len,
+                (uint8_t*)ctx->req_buf, ctx->req_buf_len - ctx->multipart_boundary_len - 6);
           }
-          uweb.received_multipart_len += uweb.req_buf_len - uweb.multipart_boundary_len - 6;
+          ctx->received_multipart_len += ctx->req_buf_len - ctx->multipart_boundary_len - 6;
 
-          if (uweb.server_data_f) {
+          if (_UWEB_DATA_F(ctx, ctx->req)) {
             // report data end
-            uweb.server_data_f(&uweb.req, DATA_MULTIPART, uweb.received_multipart_len, 0, 0);
+            _UWEB_DATA_F(ctx, ctx->req)(ctx->req, DATA_MULTIPART, ctx->received_multipart_len, 0, 0);
           }
 
-          uweb.req_buf_len = 0;
+          ctx->req_buf_len = 0;
 
           // reset and continue
-          uweb.multipart_boundary_ix = 0;
-          uweb.multipart_delim = 0;
-          uweb.req.cur_multipart.multipart_nbr++;
-          uweb.state = MULTI_CONTENT_HEADER;
-          _uweb_handle_multi_content_header_line(out,
-              &uweb.req_buf[old_req_buf_len - uweb.multipart_boundary_len - 4],
-              uweb.multipart_boundary_len + 4,
+          ctx->multipart_boundary_ix = 0;
+          ctx->multipart_delim = 0;
+          ctx->req->cur_multipart.multipart_nbr++;
+          ctx->state = MULTI_CONTENT_HEADER;
+          _uweb_handle_multi_content_header_line(ctx, out,
+              &ctx->req_buf[old_req_buf_len - ctx->multipart_boundary_len - 4],
+              ctx->multipart_boundary_len + 4,
               in);
           continue;
         }
       } else {
         // no boundary indication, pure data
-        if (uweb.multipart_delim > 0 || uweb.multipart_boundary_ix > 0) {
+        if (ctx->multipart_delim > 0 || ctx->multipart_boundary_ix > 0) {
           // report eaten data believed to be boundary
           flush_boundary_buf = 1;
         }
-        uweb.multipart_delim = c == '\r' ? 1 : 0;
-        uweb.multipart_boundary_ix = 0;
+        ctx->multipart_delim = c == '\r' ? 1 : 0;
+        ctx->multipart_boundary_ix = 0;
       }
 
       // calculate max buffer before flushing
       // in here, we keep room enough for \r\n--<BOUNDARY>(--|\r\n)
       // in order to avoid wrapping amidst a boundary definition
-      uint16_t max_buf = UWEB_REQ_BUF_MAX_LEN - (4 + uweb.multipart_boundary_len + 2) + uweb.multipart_delim + uweb.multipart_boundary_ix;
+      uint16_t max_buf = UWEB_REQ_BUF_MAX_LEN - (4 + ctx->multipart_boundary_len + 2) + ctx->multipart_delim + ctx->multipart_boundary_ix;
 
-      if (uweb.req_buf_len > 0 && (flush_boundary_buf || uweb.req_buf_len >= max_buf)) {
+      if (ctx->req_buf_len > 0 && (flush_boundary_buf || ctx->req_buf_len >= max_buf)) {
         // flush req or buffer overflow, report
-        if (uweb.server_data_f) {
-          uweb.server_data_f(&uweb.req, DATA_MULTIPART, uweb.received_multipart_len,
-              (uint8_t*)uweb.req_buf, uweb.req_buf_len);
+        if (_UWEB_DATA_F(ctx, ctx->req)) {
+          _UWEB_DATA_F(ctx, ctx->req)(ctx->req, DATA_MULTIPART, ctx->received_multipart_len,
+              (uint8_t*)ctx->req_buf, ctx->req_buf_len);
         }
-        uweb.received_multipart_len += uweb.req_buf_len;
-        uweb.req_buf_len = 0;
+        ctx->received_multipart_len += ctx->req_buf_len;
+        ctx->req_buf_len = 0;
       }
 
-      uweb.received_content_len++;
+      ctx->received_content_len++;
 
-      if (uweb.received_content_len == uweb.req.content_length) {
-        if (uweb.req_buf_len > 0 && uweb.server_data_f) {
+      if (ctx->received_content_len == ctx->req->content_length) {
+        if (ctx->req_buf_len > 0 && _UWEB_DATA_F(ctx, ctx->req)) {
           // report last bytes if we have not left this state already
-          uweb.server_data_f(&uweb.req, DATA_MULTIPART, uweb.received_multipart_len,
-              (uint8_t *)uweb.req_buf, uweb.req_buf_len);
+          _UWEB_DATA_F(ctx, ctx->req)(ctx->req, DATA_MULTIPART, ctx->received_multipart_len,
+              (uint8_t *)ctx->req_buf, ctx->req_buf_len);
           // report data end
-          uweb.server_data_f(&uweb.req, DATA_MULTIPART, uweb.received_multipart_len + uweb.req_buf_len, 0, 0);
+          _UWEB_DATA_F(ctx, ctx->req)(ctx->req, DATA_MULTIPART, ctx->received_multipart_len + ctx->req_buf_len, 0, 0);
         }
-        uweb.received_multipart_len += uweb.req_buf_len;
-        UWEB_DBG("all multi content received %i\n", uweb.req.content_length);
-        _uweb_clear_req(&uweb.req);
+        ctx->received_multipart_len += ctx->req_buf_len;
+        TRACE_D(TRC_MULTIPART_DONE, ctx->req->content_length, 0);
+        _uweb_request_done(ctx, out);
       }
 
       break;
     }
+#endif
     } // switch state
   } // while rx avail
 }
 
+void UWEB_ctx_timeout(uweb_ctx *ctx, UW_STREAM out) {
+#if UWEB_CFG_SLAB
+  if (_uweb_bufs_get(ctx)) {
+    if (UWEB_ctx_phase(ctx) != UWEB_PHASE_IDLE) _uweb_bufs_lost(ctx, out);
+  } else {
+    _uweb_timeout(ctx, out);
+  }
+  _uweb_flush(ctx);
+  _uweb_bufs_put(ctx);
+#else
+  _uweb_timeout(ctx, out);
+  _uweb_flush(ctx);
+#endif
+}
+
+void UWEB_ctx_parse(uweb_ctx *ctx, UW_STREAM in, UW_STREAM out) {
+#if UWEB_CFG_SLAB
+  if (_uweb_bufs_get(ctx)) {
+    _uweb_bufs_lost(ctx, out);
+  } else {
+    _uweb_parse(ctx, in, out);
+  }
+  _uweb_flush(ctx);
+  _uweb_bufs_put(ctx);
+#else
+  _uweb_parse(ctx, in, out);
+  _uweb_flush(ctx);
+#endif
+}
+
+void UWEB_ctx_init(uweb_ctx *ctx, uweb_response_f server_resp_f, uweb_data_f server_data_f) {
+  memset(ctx, 0, sizeof(uweb_ctx));
+#if !UWEB_CFG_SLAB
+  ctx->req = &ctx->req_mem;
+#endif
+  ctx->server_resp_f = server_resp_f;
+  ctx->server_data_f = server_data_f;
+  ctx->limits.uri_len = UWEB_LIMIT_URI_LEN;
+  ctx->limits.header_bytes = UWEB_LIMIT_HEADER_BYTES;
+  ctx->limits.header_count = UWEB_LIMIT_HEADER_COUNT;
+  ctx->limits.body_size = UWEB_LIMIT_BODY_SIZE;
+  _uweb_clear_req(ctx);
+}
+
+void UWEB_ctx_set_limits(uweb_ctx *ctx, const uweb_limits *limits, uweb_limits_f limits_f) {
+  if (limits) ctx->limits = *limits;
+  ctx->limits_f = limits_f;
+  if (ctx->state == HEADER_METHOD && ctx->req_buf_len == 0) {
+    ctx->req_limits = ctx->limits;
+  }
+}
+
+void UWEB_set_limits(const uweb_limits *limits, uweb_limits_f limits_f) {
+  UWEB_ctx_set_limits(&_uweb_default_ctx, limits, limits_f);
+}
+
+void UWEB_ctx_set_header_f(uweb_ctx *ctx, uweb_header_f header_f) {
+  ctx->header_f = header_f;
+}
+
+void UWEB_set_header_f(uweb_header_f header_f) {
+  UWEB_ctx_set_header_f(&_uweb_default_ctx, header_f);
+}
+
+void UWEB_ctx_set_field_f(uweb_ctx *ctx, uweb_field_f field_f) {
+  ctx->field_f = field_f;
+}
+
+#if UWEB_CFG_VHOST
+void UWEB_ctx_set_vhosts(uweb_ctx *ctx, const uweb_vhosts *vhosts) {
+  ctx->vhosts = vhosts;
+}
+
+void UWEB_set_vhosts(const uweb_vhosts *vhosts) {
+  UWEB_ctx_set_vhosts(&_uweb_default_ctx, vhosts);
+}
+#endif
+
+// response written, parse on unless the body is still coming
+static void _uweb_response_done(uweb_ctx *ctx, UW_STREAM in, UW_STREAM out) {
+#if UWEB_CFG_CACHE
+  _uweb_cache_done(ctx, 1);
+  _uweb_cache_resume();
+#endif
+  if (ctx->state != DEFERRED) {
+    // body still coming, the request ends when it is received
+    return;
+  }
+  _uweb_request_done(ctx, out);
+  if (ctx->state != CLOSING) {
+    UWEB_ctx_parse(ctx, in, out);
+  }
+}
+
+static void _uweb_deferred_done(uweb_ctx *ctx, UW_STREAM in, UW_STREAM out) {
+  TRACE_I(TRC_DEFERRED, 1, 0);
+  ctx->deferred = 0;
+  _uweb_response_done(ctx, in, out);
+}
+
+void UWEB_ctx_deferred_done(uweb_ctx *ctx, UW_STREAM in, UW_STREAM out) {
+  if (!ctx->deferred && ctx->state != DEFERRED) return;
+#if UWEB_CFG_SLAB
+  if (_uweb_bufs_get(ctx)) {
+    _uweb_bufs_lost(ctx, out);
+  } else {
+    _uweb_deferred_done(ctx, in, out);
+  }
+  _uweb_flush(ctx);
+  _uweb_bufs_put(ctx);
+#else
+  _uweb_deferred_done(ctx, in, out);
+  _uweb_flush(ctx);
+#endif
+}
+
+#if UWEB_CFG_CHUNKED_RESP
+void UWEB_ctx_set_blocked_f(uweb_ctx *ctx, uweb_blocked_f blocked_f) {
+  ctx->blocked_f = blocked_f;
+}
+
+static void _uweb_resume(uweb_ctx *ctx, UW_STREAM in, UW_STREAM out) {
+  TRACE_D(TRC_GENERATOR, ctx->req->chunk_nbr, 1);
+  _uweb_gen_run(ctx, UWEB_ctx_out(ctx, out));
+  if (ctx->gen_f == 0) _uweb_response_done(ctx, in, out);
+}
+
+void UWEB_ctx_resume(uweb_ctx *ctx, UW_STREAM in, UW_STREAM out) {
+  if (ctx->gen_f == 0 || ctx->state == CLOSING) return;
+#if UWEB_CFG_SLAB
+  if (_uweb_bufs_get(ctx)) {
+    _uweb_bufs_lost(ctx, out);
+  } else {
+    _uweb_resume(ctx, in, out);
+  }
+  _uweb_flush(ctx);
+  _uweb_bufs_put(ctx);
+#else
+  _uweb_resume(ctx, in, out);
+  _uweb_flush(ctx);
+#endif
+}
+#endif
+
+void UWEB_flush(uweb_request_header *req) {
+  _uweb_flush(req->ctx);
+}
+
+UW_STREAM UWEB_ctx_out(uweb_ctx *ctx, UW_STREAM out) {
+#if UWEB_CFG_CACHE
+  if (ctx->cache.fill) return &ctx->cache.capture;
+#else
+  (void)ctx;
+#endif
+  return out;
+}
+
+void UWEB_ctx_close(uweb_ctx *ctx) {
+#if UWEB_CFG_HTTP2
+  // streams not done, e.g. waiting for window
+  _uweb_h2_close(ctx);
+#endif
+#if UWEB_CFG_CACHE
+  _uweb_cache_release(ctx);
+  _uweb_cache_resume();
+#endif
+#if UWEB_CFG_COALESCE
+  // nowhere to write it
+  ctx->out_len = 0;
+  _uweb_flush(ctx);
+#endif
+#if UWEB_CFG_ARENA
+  // fallback blocks of a request left open
+  _uweb_arena_reset(&ctx->arena);
+#endif
+#if UWEB_CFG_SLAB
+  // given back now, or when the call it is closed from returns
+  ctx->state = CLOSING;
+  ctx->rx_ix = ctx->rx_len;
+  if (ctx->bufs_held == 0) {
+    ctx->bufs_held = 1;
+    _uweb_bufs_put(ctx);
+  }
+#endif
+  (void)ctx;
+}
+
+void UWEB_timeout(UW_STREAM out) {
+  UWEB_ctx_timeout(&_uweb_default_ctx, out);
+}
+
+void UWEB_parse(UW_STREAM in, UW_STREAM out) {
+  if (_uweb_default_ctx.state == CLOSING) {
+    // a new connection
+    _uweb_clear_req(&_uweb_default_ctx);
+  }
+  UWEB_ctx_parse(&_uweb_default_ctx, in, out);
+}
+
 void UWEB_init(uweb_response_f server_resp_f, uweb_data_f server_data_f) {
-  memset(&uweb, 0, sizeof(uweb));
-  uweb.server_resp_f = server_resp_f;
-  uweb.server_data_f = server_data_f;
+  UWEB_ctx_init(&_uweb_default_ctx, server_resp_f, server_data_f);
 }
 
+#if UWEB_TRACE_LEVEL > UWEB_TRACE_OFF
+void UWEB_ctx_trace_dump(uweb_ctx *ctx, uweb_trace_emit_f emit, void *arg) {
+  _uweb_trace_dump(&ctx->trace, emit, arg);
+}
+
+void UWEB_trace_dump(uweb_trace_emit_f emit, void *arg) {
+  UWEB_ctx_trace_dump(&_uweb_default_ctx, emit, arg);
+}
+#endif
+
 static char *_uweb_space_strip(char *s) {
   while (*s == ' ' || *s == '\t') {
     s++;
   }
   return s;
 }
+
+// compares n chars ignoring ascii case
+static int _uweb_nocase_eq(const char *a, const char *b, uint32_t n) {
+  while (n--) {
+    char ca = *a++, cb = *b++;
+    if (ca >= 'A' && ca <= 'Z') ca += 'a' - 'A';
+    if (cb >= 'A' && cb <= 'Z') cb += 'a' - 'A';
+    if (ca != cb) return 0;
+    if (ca == 0) return 1;
+  }
+  return 1;
+}
+
+// finds token in a comma separated header value, ignoring case
+static int _uweb_token(const char *list, const char *token) {
+  uint32_t tlen = strlen(token);
+  while (*list) {
+    uint32_t len;
+    while (*list == ' ' || *list == '\t' || *list == ',') list++;
+    for (len = 0; list[len] && list[len] != ',' && list[len] != ' ' && list[len] != '\t'; len++);
+    if (len == tlen && _uweb_nocase_eq(list, token, len)) return 1;
+    list += len;
+  }
+  return 0;
+}
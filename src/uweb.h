@@ -26,6 +26,17 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "uweb_cfg.h"
 #include "uweb_http.h"
+#include "uweb_metrics.h"
+#include "uweb_trace.h"
+#include "uweb_ws.h"
+#include "uweb_h2.h"
+#include "uweb_cache.h"
+#include "uweb_arena.h"
+#include "uweb_slab.h"
+#include "uweb_gen.h"
+#include "uweb_streams.h"
+#include "uweb_assets.h"
+#include "uweb_vhost.h"
 
 #ifndef UWEB_SERVER_NAME
 #define UWEB_SERVER_NAME "uWeb"
@@ -59,8 +70,75 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define UWEB_REQ_BUF_MAX_LEN           512
 #endif
 
-#ifndef UWEB_DBG
-#define UWEB_DBG(...)
+#ifndef UWEB_RX_BUF_LEN
+#define UWEB_RX_BUF_LEN                512
+#endif
+
+/* HTTP/1.1 features, set to 0 to compile out what a product does not use.
+   Requests needing a missing feature, and responses using one, are
+   answered 501 Not Implemented. */
+
+/* multipart/form-data bodies reported part by part as DATA_MULTIPART,
+   else as plain DATA_CONTENT */
+#ifndef UWEB_CFG_MULTIPART
+#define UWEB_CFG_MULTIPART             1
+#endif
+
+/* Transfer-Encoding: chunked request bodies */
+#ifndef UWEB_CFG_CHUNKED_REQ
+#define UWEB_CFG_CHUNKED_REQ           1
+#endif
+
+/* UWEB_CHUNKED responses */
+#ifndef UWEB_CFG_CHUNKED_RESP
+#define UWEB_CFG_CHUNKED_RESP          1
+#endif
+
+/* UWEB_REDIRECT responses */
+#ifndef UWEB_CFG_REDIRECT
+#define UWEB_CFG_REDIRECT              1
+#endif
+
+/* Host and Content-Type fields kept in the request */
+#ifndef UWEB_CFG_FIELD_HOST
+#define UWEB_CFG_FIELD_HOST            1
+#endif
+
+#ifndef UWEB_CFG_FIELD_CONTENT_TYPE
+#define UWEB_CFG_FIELD_CONTENT_TYPE    1
+#endif
+
+#if UWEB_CFG_MULTIPART && !UWEB_CFG_FIELD_CONTENT_TYPE
+#error "UWEB_CFG_MULTIPART needs UWEB_CFG_FIELD_CONTENT_TYPE"
+#endif
+
+#if UWEB_CFG_VHOST && !UWEB_CFG_FIELD_HOST
+#error "UWEB_CFG_VHOST needs UWEB_CFG_FIELD_HOST"
+#endif
+
+/* If set, data from consecutive chunks in a chunked request are reported
+   in one DATA_CHUNK call when the chunks arrive in the same block. */
+#ifndef UWEB_CHUNK_COALESCE
+#define UWEB_CHUNK_COALESCE            1
+#endif
+
+/* If set, small writes to the client, headers, chunk framing and small
+   payloads, are collected in a buffer of UWEB_COALESCE_LEN bytes and
+   written together: when it is full, when a response is done, when the
+   server calls UWEB_flush, and before a call into uweb returns. Unset,
+   every piece is written on its own as it is made. Without UWEB_CFG_SLAB
+   the buffer is in every context; keep UWEB_COALESCE_LEN small then. */
+#ifndef UWEB_CFG_COALESCE
+#define UWEB_CFG_COALESCE              0
+#endif
+
+#ifndef UWEB_COALESCE_LEN
+#define UWEB_COALESCE_LEN              16384
+#endif
+
+/* Seconds in Retry-After of 503 responses when shedding load */
+#ifndef UWEB_RETRY_AFTER
+#define UWEB_RETRY_AFTER               1
 #endif
 
 #ifndef UWEB_ASSERT
@@ -79,11 +157,64 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define UWEB_HTTP_MSG_NOT_IMPL          "Not implemented\n"
 #endif
 
+#ifndef UWEB_HTTP_MSG_URI_TOO_LONG
+#define UWEB_HTTP_MSG_URI_TOO_LONG      "Request URI too long\n"
+#endif
+
+#ifndef UWEB_HTTP_MSG_HEADER_TOO_LARGE
+#define UWEB_HTTP_MSG_HEADER_TOO_LARGE  "Request header too large\n"
+#endif
+
+#ifndef UWEB_HTTP_MSG_BODY_TOO_LARGE
+#define UWEB_HTTP_MSG_BODY_TOO_LARGE    "Request body too large\n"
+#endif
+
+#ifndef UWEB_HTTP_MSG_EXPECTATION_FAILED
+#define UWEB_HTTP_MSG_EXPECTATION_FAILED "Expectation not supported\n"
+#endif
+
+#ifndef UWEB_HTTP_MSG_REJECTED
+#define UWEB_HTTP_MSG_REJECTED          "Request rejected\n"
+#endif
+
+/* Default request limits, zero for no limit. Violations are answered with
+   414, 431 or 413 as soon as they are seen. The URI can never be longer
+   than UWEB_MAX_RESOURCE_LEN - 1. */
+#ifndef UWEB_LIMIT_URI_LEN
+#define UWEB_LIMIT_URI_LEN              (UWEB_MAX_RESOURCE_LEN - 1)
+#endif
+
+#ifndef UWEB_LIMIT_HEADER_BYTES
+#define UWEB_LIMIT_HEADER_BYTES         8192
+#endif
+
+#ifndef UWEB_LIMIT_HEADER_COUNT
+#define UWEB_LIMIT_HEADER_COUNT         64
+#endif
+
+#ifndef UWEB_LIMIT_BODY_SIZE
+#define UWEB_LIMIT_BODY_SIZE            0
+#endif
+
+// Reasons for shedding load
+typedef enum {
+  UWEB_SHED_CONNECTIONS = 0,
+  UWEB_SHED_REQUESTS,
+  UWEB_SHED_OUTPUT,
+  // out of buffers, see UWEB_CFG_SLAB
+  UWEB_SHED_MEMORY,
+} uweb_shed_reason;
+
 // Request return codes
 typedef enum {
   UWEB_OK = 0,
   UWEB_CHUNKED,
-  UWEB_REDIRECT
+  UWEB_REDIRECT,
+  UWEB_WEBSOCKET,
+  UWEB_EVENT_STREAM,
+  UWEB_DEFERRED,
+  UWEB_GENERATOR,
+  UWEB_PREBUILT
 } uweb_response;
 
 // Multipart content metadata
@@ -93,19 +224,63 @@ typedef struct {
   char content_disp[UWEB_MAX_CONTENT_DISP_LEN];
 } uweb_request_multipart;
 
+struct uweb_ctx_s;
+struct uweb_site_s;
+
 // Request metadata
 typedef struct {
+  // the context this request belongs to
+  struct uweb_ctx_s *ctx;
   uweb_http_req_method method;
   char resource[UWEB_MAX_RESOURCE_LEN];
+#if UWEB_CFG_FIELD_HOST
   char host[UWEB_MAX_HOST_LEN];
+#endif
+#if UWEB_CFG_VHOST
+  // site of host, known when the header is complete
+  const struct uweb_site_s *site;
+#endif
   uint32_t content_length;
+#if UWEB_CFG_FIELD_CONTENT_TYPE
   char content_type[UWEB_MAX_CONTENT_TYPE_LEN];
+#endif
   char connection[UWEB_MAX_CONNECTION_LEN];
   uint8_t chunked;
+  // client sent Expect: 100-continue and waits before sending the body
+  uint8_t expect_continue;
+#if UWEB_CFG_WEBSOCKET
+  // client asks to upgrade to websocket
+  uint8_t websocket;
+  char ws_key[UWEB_MAX_WS_KEY_LEN];
+  uint8_t ws_version;
+#endif
+#if UWEB_CFG_HTTP2
+  // client asks to upgrade to h2c
+  uint8_t h2c;
+  // HTTP2-Settings fields seen, 2 also if one was bad
+  uint8_t h2_settings;
+  uint8_t h2_settings_len;
+  uint8_t h2_settings_buf[UWEB_H2_UPGRADE_SETTINGS_LEN];
+  // HTTP/2 stream identifier, zero for HTTP/1.1
+  uint32_t stream_id;
+#endif
   uint32_t chunk_nbr;
+#if UWEB_CFG_MULTIPART
   uweb_request_multipart cur_multipart;
+#endif
+#if UWEB_CFG_ARENA
+  // scratch memory until the request is done, see UWEB_req_alloc
+  uweb_arena *arena;
+#endif
+#if UWEB_CFG_ASSETS
+  // client takes gzip content encoding
+  uint8_t accept_gzip;
+  char if_none_match[UWEB_MAX_ETAG_LEN];
+#endif
   union {
     const char *redirection_url;
+    const char *event_channel;
+    const char *prebuilt_hdr;
   };
 } uweb_request_header;
 
@@ -113,12 +288,25 @@ typedef struct {
 typedef enum {
   DATA_CONTENT = 0,
   DATA_CHUNK,
-  DATA_MULTIPART
+  DATA_MULTIPART,
+  DATA_CHUNK_TRAILER,
+  DATA_WS_TEXT,
+  DATA_WS_BINARY,
+  DATA_WS_PONG,
+  DATA_WS_CLOSE
 } uweb_data_type;
 
 
 #define UWEB_UNKNONW_SZ          -1
 
+// Stream flags
+// bytes are in memory at mem, uweb writes them from there
+#define UWEB_STREAM_MEM          (1<<0)
+// user is a file descriptor an output stream may splice from
+#define UWEB_STREAM_FD           (1<<1)
+// rd_offs may be set anywhere within total_sz, see UWEB_stream_seek
+#define UWEB_STREAM_SEEKABLE     (1<<2)
+
 typedef struct uweb_data_stream_s {
   /**
    * Stream user data, e.g. a pointer or a file descriptor.
@@ -159,9 +347,26 @@ typedef struct uweb_data_stream_s {
    */
   int32_t (* write)(struct uweb_data_stream_s *stream, uint8_t *src, uint32_t len);
   /**
-   * Flushes and closes. May be null.
+   * Flushes and closes. May be null. Called by uweb on a response stream
+   * when the response is sent.
    */
   void (* close)(struct uweb_data_stream_s *stream);
+  /**
+   * UWEB_STREAM_* flags, what the stream offers besides read and write.
+   */
+  uint32_t flags;
+  /**
+   * With UWEB_STREAM_MEM, the bytes of the stream, those from rd_offs on
+   * are available. Read is then only called by servers that need a copy.
+   */
+  const uint8_t *mem;
+  /**
+   * Output streams: moves up to len bytes from src, a UWEB_STREAM_FD
+   * stream, without them passing uweb, e.g. by splice. Returns bytes
+   * moved, zero to have uweb read and write them instead, or negative for
+   * error. Updates avail_sz of src like read. May be null.
+   */
+  int32_t (* splice)(struct uweb_data_stream_s *stream, struct uweb_data_stream_s *src, uint32_t len);
 } uweb_data_stream;
 
 typedef uweb_data_stream *UW_STREAM;
@@ -171,7 +376,9 @@ typedef uweb_data_stream *UW_STREAM;
  * Can respond with a full data, or with chunked transfer.
  *
  * @param req - contains the client request data
- * @param res - stream where to put data to be sent to client
+ * @param res - stream where to put data to be sent to client. May already
+ *              point to storage for this request, e.g. per HTTP/2 stream,
+ *              which should then be used
  * @param http_status - defaults to S200_OK, but can be altered if necessary
  * @param content_type - defaults to text/plain, but can be altered if necessary
  * @param extra_headers - defaults to 0, user may put extra header strings here,
@@ -179,6 +386,17 @@ typedef uweb_data_stream *UW_STREAM;
  * @return SERVER_OK if all data to send to client is filled in stream res;
  *         SERVER_CHUNK if server wants to send partial data to client via stream res.
  *         If so, this function will be called repeatedly until user sends zero data.
+ *         UWEB_WEBSOCKET to accept a request with req->websocket set, res is
+ *         then not used and extra_headers are added to the 101 response.
+ *         UWEB_EVENT_STREAM to answer with a text/event-stream left open,
+ *         see UWEB_return_event_stream.
+ *         UWEB_DEFERRED when the server writes the whole response itself,
+ *         later, e.g. relayed from a backend. uweb sends nothing, reports
+ *         the body as received, multipart bodies too as DATA_CONTENT, and
+ *         parses no further request until UWEB_ctx_deferred_done is
+ *         called. HTTP/1.1 only.
+ *         UWEB_GENERATOR to answer with chunks yielded by a generator, see
+ *         UWEB_return_generator. HTTP/1.1 only.
  */
 typedef uweb_response (*uweb_response_f)(
     uweb_request_header *req,
@@ -192,6 +410,15 @@ typedef uweb_response (*uweb_response_f)(
  * When the data is ended, this is called with params length and buf begin zero.
  * This can be useful in e.g. multipart transfers when saving data to file to close
  * resources.
+ * For chunked requests, offset is counted over all chunks. Any trailer
+ * header lines after the last chunk are reported one by one as type
+ * DATA_CHUNK_TRAILER with offset being the trailer line index, before
+ * the data end is reported.
+ * On a websocket, messages are reported as DATA_WS_TEXT or DATA_WS_BINARY
+ * pieces, offset counted over all fragments, ended by a zero length call.
+ * Pongs are reported as DATA_WS_PONG. A close is reported as DATA_WS_CLOSE
+ * with offset being the close status and data the reason, after which the
+ * connection is closed.
  * @param req - pointer to the client request
  * @param type - the data type
  * @param offset - offset in received data
@@ -205,22 +432,595 @@ typedef void (*uweb_data_f)(
     uint8_t *data,
     uint32_t length);
 
+#if UWEB_CFG_VHOST
+// A site served by virtual hosting
+typedef struct uweb_site_s {
+  // host name in lower case, without port
+  const char *host;
+  // response and data functions of the site, zero for the context's
+  uweb_response_f resp_f;
+  uweb_data_f data_f;
+  // document root, not used by uweb
+  const char *root;
+#if UWEB_CFG_ASSETS
+  // embedded files, not used by uweb
+  const uweb_assets *assets;
+#endif
+  // user data, not used by uweb
+  void *user;
+} uweb_site;
+
+// Sites hashed on host name, see UWEB_vhosts_init
+typedef struct {
+  const uweb_site **slots;
+  uint32_t mask;
+  uint32_t seed;
+  // site of unknown hosts, may be zero
+  const uweb_site *dflt;
+} uweb_vhosts;
+#endif
+
+// Context phases
+typedef enum {
+  // waiting for a request
+  UWEB_PHASE_IDLE = 0,
+  // receiving request header
+  UWEB_PHASE_HEADER,
+  // receiving request body
+  UWEB_PHASE_BODY,
+  // request rejected, connection should be closed
+  UWEB_PHASE_CLOSING,
+  // upgraded to websocket, waiting for frames
+  UWEB_PHASE_WEBSOCKET,
+  // streaming server-sent events, nothing more is read
+  UWEB_PHASE_EVENT_STREAM,
+  // request received, its deferred response is not done, further requests
+  // are left unread
+  UWEB_PHASE_DEFERRED,
+} uweb_phase;
+
+// Request limits, zero for no limit
+typedef struct {
+  // request URI length
+  uint32_t uri_len;
+  // total request header bytes, including request line
+  uint32_t header_bytes;
+  // number of header fields
+  uint32_t header_count;
+  // body size, Content-Length or sum of chunks
+  uint32_t body_size;
+} uweb_limits;
+
+/**
+ * Called when the request line is parsed, before any header fields, to
+ * set limits per route. Limits are preset with the context limits.
+ * @param req - the request, method and resource are known
+ * @param limits - limits for this request, may be lowered or raised
+ */
+typedef void (*uweb_limits_f)(uweb_request_header *req, uweb_limits *limits);
+
+/**
+ * Called when the request header is complete, before the response function
+ * and before any body is read. Lets a server turn down e.g. unauthorized or
+ * unwanted uploads without receiving them. If the client sent
+ * Expect: 100-continue, 100 Continue is sent only when the request is
+ * accepted.
+ * @param req - the request, all header fields are known
+ * @return S100_CONTINUE to accept, or a final status to reject the request
+ *         with, the connection is then closed
+ */
+typedef uweb_http_status (*uweb_header_f)(uweb_request_header *req);
+
+/**
+ * Called with each request header field line as received, before uweb
+ * parses it, e.g. to pass all fields on to a backend.
+ * @param req - the request, method and resource are known
+ * @param line - the field line, without line ending
+ * @param len - length of line
+ */
+typedef void (*uweb_field_f)(uweb_request_header *req, const char *line, uint32_t len);
+
+#if UWEB_CFG_CHUNKED_RESP
+/**
+ * Generates a chunked response, see uweb_gen.h.
+ * @param gen - generator state, yield with UWEB_GEN_YIELD
+ * @param req - the request
+ * @return UWEB_GEN_MORE with a yielded buffer, UWEB_GEN_DONE when done
+ */
+typedef int (*uweb_gen_f)(uweb_gen *gen, uweb_request_header *req);
+
+/**
+ * Asked before each generator call whether output is blocked, e.g. the
+ * socket did not take all written so far.
+ * @param req - the request being answered
+ * @return nonzero to suspend the generator until UWEB_ctx_resume
+ */
+typedef int (*uweb_blocked_f)(uweb_request_header *req);
+#endif
+
+#if UWEB_CFG_CACHE
+/**
+ * Picks the requests whose responses are cached. Called for GET and HEAD
+ * requests without body when the header is complete.
+ * @param req - the request, all header fields are known
+ * @return milliseconds to keep the response, zero to not cache it
+ */
+typedef uint32_t (*uweb_cache_f)(uweb_request_header *req);
+
+/**
+ * Called when uweb answered a request without the response function, from
+ * the cache, and when a request that waited for a response being cached is
+ * answered, from the cache or by the response function.
+ * @param req - the request
+ * @param waited - the request waited, UWEB_ctx_phase is UWEB_PHASE_DEFERRED,
+ *                 and the server calls UWEB_ctx_deferred_done as for its own
+ *                 deferred responses
+ */
+typedef void (*uweb_cached_f)(uweb_request_header *req, int waited);
+
+// Cache state of a context
+typedef struct {
+  // key of current request, UWEB_CACHE_KEY_LEN if too long for one
+  uint16_t key_len;
+  char key[UWEB_CACHE_KEY_LEN];
+  // entry filled by current response, plus one, zero when none
+  uint8_t fill;
+  // entry waited for, plus one, zero when not waiting
+  uint8_t wait;
+  // the response waited for was not kept, answer by the response function
+  uint8_t pass;
+  // waiting requests of the same entry
+  struct uweb_ctx_s *wait_prev;
+  struct uweb_ctx_s *wait_next;
+  // client output, and the stream capturing the response on its way there
+  UW_STREAM out;
+  uweb_data_stream capture;
+  uweb_cached_f cached_f;
+} uweb_cache_req;
+#endif
+
+#if UWEB_CFG_HTTP2
+// HTTP/2 stream, one request and its response
+typedef struct {
+  // stream identifier, zero when free
+  uint32_t id;
+  // client has sent END_STREAM
+  uint8_t end_remote;
+  // response not started, sending or sent
+  uint8_t resp_state;
+  // response return code
+  uint8_t resp;
+  // reset the stream when the response is sent, the body is not wanted
+  uint8_t reset_when_sent;
+  // error to answer with instead of calling the response function,
+  // S100_CONTINUE when none
+  uweb_http_status error_status;
+  const char *error_page;
+  // flow control window for sending
+  int32_t send_window;
+  // body bytes received, and not yet acknowledged by WINDOW_UPDATE
+  uint32_t received_len;
+  uint32_t recv_unacked;
+  uint32_t body_limit;
+  // bytes left of current response chunk
+  uint32_t chunk_left;
+  UW_STREAM res;
+  // response stream storage, offered to the response function in *res
+  uweb_data_stream res_store;
+  uweb_request_header req;
+} uweb_h2_stream;
+
+// HTTP/2 connection state
+typedef struct {
+  // preface bytes received
+  uint8_t preface_ix;
+  uint8_t hdr[UWEB_H2_FRAME_HDR_LEN];
+  uint8_t hdr_len;
+  // current frame
+  uint8_t frame_type;
+  uint8_t frame_flags;
+  uint8_t pad_len;
+  uint32_t frame_len;
+  uint32_t frame_stream;
+  uint32_t frame_offs;
+  // header block being collected, zero stream when none
+  uint32_t block_stream;
+  uint8_t block_flags;
+  // bytes in buf, frame payload or header block
+  uint32_t buf_len;
+  uint32_t last_stream_id;
+  int32_t send_window;
+  uint32_t recv_unacked;
+  uint32_t peer_initial_window;
+  uint32_t peer_max_frame;
+  uweb_hpack hpack;
+  uint8_t buf[UWEB_H2_FRAME_BUF_LEN];
+  uweb_h2_stream streams[UWEB_H2_MAX_STREAMS];
+} uweb_h2;
+#endif
+
+/**
+ * Server context, holding the parser state of one client connection.
+ * A server handling several connections at once keeps one context per
+ * connection. Contents are private to uweb.
+ */
+typedef struct uweb_ctx_s {
+  uweb_response_f server_resp_f;
+  uweb_data_f server_data_f;
+  uweb_limits_f limits_f;
+  uweb_header_f header_f;
+  uweb_field_f field_f;
+#if UWEB_CFG_VHOST
+  const uweb_vhosts *vhosts;
+#endif
+  // user data, not used by uweb
+  void *user;
+
+  uweb_limits limits;
+  // limits of current request
+  uweb_limits req_limits;
+  uint32_t header_bytes;
+  uint32_t header_count;
+
+#if UWEB_CFG_SLAB
+  // pooled, held only while needed
+  uint8_t *tx_buf;
+  char *req_buf;
+  uint8_t *rx_buf;
+  // nested calls into uweb holding the buffers
+  uint8_t bufs_held;
+#else
+  uint8_t tx_buf[UWEB_TX_MAX_LEN];
+#endif
+
+#if UWEB_CFG_COALESCE
+  // writes collected for out_str, pooled with UWEB_CFG_SLAB
+#if UWEB_CFG_SLAB
+  uint8_t *out_buf;
+#else
+  uint8_t out_buf[UWEB_COALESCE_LEN];
+#endif
+  uint32_t out_len;
+  UW_STREAM out_str;
+#endif
+
+  uint8_t state;
+  // the server answers current request itself, see UWEB_DEFERRED
+  uint8_t deferred;
+
+  // current request, pooled with UWEB_CFG_SLAB and held while one is
+  // under way
+  uweb_request_header *req;
+#if !UWEB_CFG_SLAB
+  uweb_request_header req_mem;
+#endif
+
+  uint16_t header_line;
+
+#if UWEB_CFG_MULTIPART
+  char *multipart_boundary;
+  uint8_t multipart_boundary_ix;
+  uint8_t multipart_boundary_len;
+  uint8_t multipart_delim;
+  uint32_t received_multipart_len;
+#endif
+
+#if !UWEB_CFG_SLAB
+  char req_buf[UWEB_REQ_BUF_MAX_LEN+1];
+#endif
+  volatile uint16_t req_buf_len;
+
+#if !UWEB_CFG_SLAB
+  uint8_t rx_buf[UWEB_RX_BUF_LEN];
+#endif
+  uint16_t rx_ix;
+  uint16_t rx_len;
+
+#if UWEB_CFG_CHUNKED_REQ
+  uint32_t chunk_ix;
+  uint32_t chunk_len;
+  uint8_t chunk_digits;
+  // where in the chunk size line we are, after digits, in extensions
+  uint8_t chunk_hdr;
+  uint32_t chunk_trailer_nbr;
+  uint32_t received_chunked_len;
+#endif
+  uint32_t received_content_len;
+
+#if UWEB_CFG_CHUNKED_RESP
+  // generator of current response, zero when none is running
+  uweb_gen_f gen_f;
+  uweb_gen gen;
+  uweb_blocked_f blocked_f;
+#endif
+
+#if UWEB_CFG_METRICS
+  uint64_t t_header;
+#endif
+#if UWEB_CFG_WEBSOCKET
+  uweb_ws ws;
+#endif
+#if UWEB_CFG_HTTP2
+  // pooled with UWEB_CFG_SLAB and held until the connection closes, zero
+  // until it speaks HTTP/2
+  uweb_h2 *h2;
+#if !UWEB_CFG_SLAB
+  uweb_h2 h2_mem;
+#endif
+#endif
+#if UWEB_CFG_CACHE
+  uweb_cache_req cache;
+#endif
+#if UWEB_CFG_ARENA
+  uweb_arena arena;
+#endif
+#if UWEB_TRACE_LEVEL > UWEB_TRACE_OFF
+  uweb_trace_ring trace;
+#endif
+} uweb_ctx;
+
 /* Initiates uweb with given response and data functions */
 void UWEB_init(uweb_response_f server_resp_f, uweb_data_f server_data_f);
 /*  Call this when client has sent no data in a while */
 void UWEB_timeout(UW_STREAM out);
 /* Call this when there is client request data in stream in.
- * Response will be sent to out stream. */
+ * Response will be sent to out stream. After an error response the rest
+ * of the data is dropped, and next call starts over with a new request. */
 void UWEB_parse(UW_STREAM in, UW_STREAM out);
+
+/* Context variants of above, for serving several connections at once.
+ * UWEB_init, UWEB_timeout and UWEB_parse use a default context. */
+void UWEB_ctx_init(uweb_ctx *ctx, uweb_response_f server_resp_f, uweb_data_f server_data_f);
+/* Sends 408 if a request is partially received */
+void UWEB_ctx_timeout(uweb_ctx *ctx, UW_STREAM out);
+void UWEB_ctx_parse(uweb_ctx *ctx, UW_STREAM in, UW_STREAM out);
+/* Returns what the context is waiting for, e.g. to pick a timeout */
+uweb_phase UWEB_ctx_phase(uweb_ctx *ctx);
+/* Sets request limits and an optional per route limits function. Zero
+ * limits pointer keeps the defaults from UWEB_LIMIT_*. */
+void UWEB_ctx_set_limits(uweb_ctx *ctx, const uweb_limits *limits, uweb_limits_f limits_f);
+/* Sets request limits of the default context */
+void UWEB_set_limits(const uweb_limits *limits, uweb_limits_f limits_f);
+/* Sets the header complete function, zero accepts all requests */
+void UWEB_ctx_set_header_f(uweb_ctx *ctx, uweb_header_f header_f);
+/* Sets the header complete function of the default context */
+void UWEB_set_header_f(uweb_header_f header_f);
+/* Sets the header field function, zero for none */
+void UWEB_ctx_set_field_f(uweb_ctx *ctx, uweb_field_f field_f);
+#if UWEB_CFG_VHOST
+/* Sets the sites requests are served by, zero for none. A request for a
+ * site with its own functions goes to those, others to the context's. */
+void UWEB_ctx_set_vhosts(uweb_ctx *ctx, const uweb_vhosts *vhosts);
+/* Sets the sites of the default context */
+void UWEB_set_vhosts(const uweb_vhosts *vhosts);
+#endif
+/* Call when the response to a request answered with UWEB_DEFERRED is
+ * written. The connection is closed if the client asked so, else further
+ * requests already received are parsed from the lookahead buffer and in. */
+void UWEB_ctx_deferred_done(uweb_ctx *ctx, UW_STREAM in, UW_STREAM out);
+/* Returns the stream to write a deferred response to; out, or a stream
+ * capturing the response on its way to out when it is being cached. Out is
+ * the stream the request was parsed with. */
+UW_STREAM UWEB_ctx_out(uweb_ctx *ctx, UW_STREAM out);
+/* Call when the connection of a context is closed, before the context is
+ * dropped or initiated again. Lets go of a cached response the context
+ * fills or waits for, and of the buffers it holds. */
+void UWEB_ctx_close(uweb_ctx *ctx);
+
+/* Writes what is collected for the client of the request now, e.g. from a
+ * response function before writing to the connection itself, or to get a
+ * part of a slow response on its way. Does nothing unless
+ * UWEB_CFG_COALESCE is set. */
+void UWEB_flush(uweb_request_header *req);
+
+/* Sends a precomputed 503 with Retry-After and closes out. Needs no
+ * context, so a server over its limits can reject a connection or request
+ * before parsing it. The reason is counted in metrics. */
+void UWEB_shed(UW_STREAM out, uweb_shed_reason reason);
 /* Call in your server_resp_f to redirect to another url via 303.
  * When returning in response function, simply call
  * <code>return UWEB_return_redirect(req, "http://anotherurl.com");</code> */
 uweb_response UWEB_return_redirect(uweb_request_header *req, const char *url);
+/* Call in your server_resp_f to answer with a server-sent event stream on
+ * given channel. Only the response header is sent, the connection is then
+ * left open for events written by the server, e.g. formatted once with
+ * uweb_sse_format and queued on all subscribers of the channel. Channel
+ * must outlive the request, e.g. point into req->resource. Read it back
+ * from req->event_channel when UWEB_ctx_phase is UWEB_PHASE_EVENT_STREAM.
+ * <code>return UWEB_return_event_stream(req, "telemetry");</code> */
+uweb_response UWEB_return_event_stream(uweb_request_header *req, const char *channel);
+
+/* Call in your server_resp_f to answer with a response header made by the
+ * server, hdr: status line and header fields without the empty line
+ * ending them. The body is res, of hdr's Content-Length. uweb only adds
+ * Connection: close when closing. HTTP/2 responses are made as for
+ * UWEB_OK, hdr is not used. Hdr must outlive the request.
+ * <code>return UWEB_return_prebuilt(req, "HTTP/1.1 204 No Content\r\n");</code> */
+uweb_response UWEB_return_prebuilt(uweb_request_header *req, const char *hdr);
+
+#if UWEB_CFG_ASSETS
+/* Finds the asset of path in bundle, path up to any query; a path ending
+ * in / finds its index.html. Zero if there is none. */
+const uweb_asset *UWEB_asset_find(const uweb_assets *bundle, const char *path);
+/* Call in your server_resp_f to answer with asset a, read through stream
+ * str. The other arguments are those of server_resp_f.
+ * <code>if ((a = UWEB_asset_find(&web, req->resource)) != 0)
+ *   return UWEB_asset_serve(req, a, &str, res, http_status, content_type, extra_headers);</code> */
+uweb_response UWEB_asset_serve(uweb_request_header *req, const uweb_asset *a, UW_STREAM str,
+    UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers);
+#endif
+
+#if UWEB_CFG_VHOST
+/* Hashes count sites into slots, nslots of them, a power of two, so that
+ * no two hosts share a slot. Takes the fewest slots that will do; give at
+ * least twice count. Dflt serves unknown hosts, may be zero. Sites and
+ * slots must outlive vhosts. Returns zero, or -1 if the sites did not fit
+ * or two have the same host. */
+int UWEB_vhosts_init(uweb_vhosts *vhosts, const uweb_site *sites, uint32_t count,
+    const uweb_site **slots, uint32_t nslots, const uweb_site *dflt);
+/* Returns the site of host, any port and case ignored, else the default
+ * site. */
+const uweb_site *UWEB_vhost_find(const uweb_vhosts *vhosts, const char *host);
+#endif
+
+#if UWEB_CFG_CHUNKED_RESP
+/* Call in your server_resp_f to answer with a chunked response yielded by
+ * generator gen_f, see uweb_gen.h, instead of being called per chunk. User
+ * is found in gen->user. The response header is sent at once, the chunks
+ * as long as output is not blocked.
+ * <code>return UWEB_return_generator(req, count_gen, 0);</code> */
+uweb_response UWEB_return_generator(uweb_request_header *req, uweb_gen_f gen_f, void *user);
+/* Sets the output blocked function, zero runs generators to their end at
+ * once */
+void UWEB_ctx_set_blocked_f(uweb_ctx *ctx, uweb_blocked_f blocked_f);
+/* Call when output is no longer blocked while ctx->gen_f is set. Goes on
+ * with the suspended generator; when it is done, as for
+ * UWEB_ctx_deferred_done. */
+void UWEB_ctx_resume(uweb_ctx *ctx, UW_STREAM in, UW_STREAM out);
+#endif
+
+/* Makes str a stream over len constant bytes at data, seekable. Data must
+ * outlive the stream. */
+UW_STREAM UWEB_stream_mem(UW_STREAM str, const void *data, uint32_t len);
+/* Moves the read offset of a seekable stream, returns nonzero if the
+ * stream is not seekable or offs is beyond its end */
+int UWEB_stream_seek(UW_STREAM str, uint32_t offs);
+#if defined(UWEB_STREAM_REALLOC) && defined(UWEB_STREAM_FREE)
+/* Makes str an empty growable buffer stream. Writes append, growing the
+ * buffer to twice its size when full, reads take from the front. The
+ * written bytes are at str->mem, str->total_sz of them; close frees them.
+ * Returns zero if no buffer of len bytes could be had. */
+UW_STREAM UWEB_stream_buf(UW_STREAM str, uint32_t len);
+#endif
+#if UWEB_CFG_STREAMS_POSIX
+/* Makes str a seekable stream over the file at path. Files up to
+ * UWEB_STREAM_MAP_MAX_LEN are mapped into memory, larger ones are
+ * UWEB_STREAM_FD streams read by offset. With UWEB_FILE_CACHE_ENTRIES the
+ * file is taken from the cache when unchanged; close releases it. Returns
+ * zero if the file cannot be opened, with errno set. */
+UW_STREAM UWEB_stream_file(UW_STREAM str, const char *path);
+#if UWEB_FILE_CACHE_ENTRIES
+/* Forgets all cached files, e.g. after one was written. Streams still
+ * open keep their file until closed. */
+void UWEB_file_cache_clear(void);
+#endif
+/* Makes str a stream reading the pipe fd, avail_sz is what the pipe
+ * holds, updated on each read. The pipe is not closed by the stream. */
+UW_STREAM UWEB_stream_pipe(UW_STREAM str, int fd);
+/* Moves up to len bytes from pipe stream str to fd by splice, or from an
+ * unmapped file stream by sendfile, without copying them through user
+ * space. Returns bytes moved, zero if fd takes no more now, negative for
+ * error. */
+int32_t UWEB_stream_splice(UW_STREAM str, int fd, uint32_t len);
+#endif
+
+#if UWEB_CFG_WEBSOCKET
+/* Writes a final, unmasked frame header for a payload of len bytes into dst,
+ * which must hold UWEB_WS_HDR_MAX_LEN bytes. Returns the header length.
+ * Lets a server frame a message once and send it to many sockets. */
+uint32_t UWEB_ws_header(uint8_t *dst, uweb_ws_opcode opcode, uint32_t len);
+/* Sends a message on a websocket */
+void UWEB_ws_send(UW_STREAM out, uweb_ws_opcode opcode, const uint8_t *data, uint32_t len);
+/* Starts closing a websocket, the connection is closed when the client
+ * answers */
+void UWEB_ws_close(uweb_request_header *req, UW_STREAM out, uint16_t code);
+
+// internal
+int _uweb_ws_parse(uweb_ctx *ctx, UW_STREAM out, UW_STREAM in);
+void _uweb_ws_accept_key(const char *key, char *accept);
+#endif
+
+// internal
+int32_t _uweb_write(uweb_ctx *ctx, UW_STREAM out, const uint8_t *data, uint32_t len);
+// response and data functions of a request, its site's when it has them
+#if UWEB_CFG_VHOST
+#define _UWEB_RESP_F(ctx, req) \
+  ((req)->site && (req)->site->resp_f ? (req)->site->resp_f : (ctx)->server_resp_f)
+#define _UWEB_DATA_F(ctx, req) \
+  ((req)->site && (req)->site->data_f ? (req)->site->data_f : (ctx)->server_data_f)
+#else
+#define _UWEB_RESP_F(ctx, req) ((ctx)->server_resp_f)
+#define _UWEB_DATA_F(ctx, req) ((ctx)->server_data_f)
+#endif
+
+#if UWEB_CFG_HTTP2
+// internal
+int _uweb_h2_start(uweb_ctx *ctx, UW_STREAM out, uint8_t preface_ix);
+int _uweb_h2_upgrade(uweb_ctx *ctx, UW_STREAM out);
+int _uweb_h2_parse(uweb_ctx *ctx, UW_STREAM out, UW_STREAM in);
+void _uweb_h2_goaway(uweb_ctx *ctx, UW_STREAM out, uint32_t err);
+void _uweb_h2_close(uweb_ctx *ctx);
+uint32_t _uweb_h2_open_streams(uweb_ctx *ctx);
+#endif
+
+#if UWEB_CFG_CACHE
+/* Caches the responses picked by cache_f, zero for none. Keyed on method,
+ * resource and the values of the header fields named in vary, a zero
+ * terminated list, or zero. */
+void UWEB_set_cache_f(uweb_cache_f cache_f, const char * const *vary);
+/* Sets the function called when uweb answered a request from the cache.
+ * Requests wait for a response being cached only when it is set, else
+ * they are answered by the response function. */
+void UWEB_ctx_set_cached_f(uweb_ctx *ctx, uweb_cached_f cached_f);
+/* Drops all cached responses of the calling thread */
+void UWEB_cache_clear(void);
+
+// internal
+void _uweb_cache_key(uweb_ctx *ctx);
+void _uweb_cache_field(uweb_ctx *ctx, const char *line, uint32_t len);
+int _uweb_cache_request(uweb_ctx *ctx, UW_STREAM out, uweb_request_header *req, int close);
+void _uweb_cache_done(uweb_ctx *ctx, int complete);
+void _uweb_cache_release(uweb_ctx *ctx);
+uweb_ctx *_uweb_cache_resumed(void);
+#endif
+
+#if UWEB_CFG_ARENA
+/* Allocates len bytes for the request, aligned to UWEB_ARENA_ALIGN. They
+ * stay valid until the request is done, also while the response is sent,
+ * and are never freed one by one. Returns zero when out of memory. */
+void *UWEB_req_alloc(uweb_request_header *req, uint32_t len);
+/* Formats a string into the request arena, zero when out of memory */
+char *UWEB_req_printf(uweb_request_header *req, const char *fmt, ...);
+
+// internal
+void _uweb_arena_reset(uweb_arena *a);
+#endif
+
+#if UWEB_CFG_SLAB
+/* Fills in the usage of each pool, _UWEB_SLAB_COUNT entries, for the
+ * calling thread */
+void UWEB_slab_stats(uweb_slab_stats *stats);
+
+// internal
+void *_uweb_slab_get(uweb_slab_class c);
+void _uweb_slab_put(uweb_slab_class c, void *b);
+const char *_uweb_slab_name(uweb_slab_class c, uint32_t *size);
+#endif
+
+#if UWEB_TRACE_LEVEL > UWEB_TRACE_OFF
+/* Dumps the request trace ring in binary, to be decoded by uweb_tracedec */
+void UWEB_trace_dump(uweb_trace_emit_f emit, void *arg);
+void UWEB_ctx_trace_dump(uweb_ctx *ctx, uweb_trace_emit_f emit, void *arg);
+#endif
 
 /* Returns a url-decoded version of str */
 char *urlndecode(char *dst, char *str, int num);
 /* Returns a url-encoded version of str */
 char *urlnencode(char *dst, char *str, int num);
+/* Calculates the 20 byte SHA-1 digest of data */
+void uweb_sha1(uint8_t *digest, const uint8_t *data, uint32_t len);
+/* Base64 encodes src into dst, which must hold 4 * ((len + 2) / 3) + 1
+ * bytes. Returns the encoded length. */
+int uweb_base64_encode(char *dst, const uint8_t *src, uint32_t len);
+/* Decodes base64url src, padding optional, into dst of size bytes. Returns
+ * the decoded length, -1 on a bad character or if it does not fit. */
+int uweb_base64url_decode(uint8_t *dst, uint32_t size, const char *src);
+/* Formats a server-sent event into dst of size bytes. Event name may be 0,
+ * id 0 sends no id. Each data line, ended by CR, LF or CRLF, gets its own
+ * data field. Returns the formatted length, also when it does not fit, like
+ * snprintf, or 0 if the event name holds a line break. */
+uint32_t uweb_sse_format(char *dst, uint32_t size, const char *event, uint32_t id,
+    const uint8_t *data, uint32_t len);
 
 
 
@@ -0,0 +1,106 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "uweb.h"
+
+#if UWEB_CFG_ARENA
+
+#define ARENA_ROUND(n)                 (((n) + UWEB_ARENA_ALIGN - 1) & ~(uint32_t)(UWEB_ARENA_ALIGN - 1))
+// keeps rounding and block header from wrapping around
+#define ARENA_MAX_ALLOC                0x7fffffffUL
+#define ARENA_BLOCK_HDR                ARENA_ROUND(sizeof(uweb_arena_block))
+
+void *UWEB_req_alloc(uweb_request_header *req, uint32_t len) {
+  uweb_arena *a = req->arena;
+  if (a == 0) return 0;
+  if (len > ARENA_MAX_ALLOC) {
+    UWEB_METRIC_INC(UWEB_CNT_ARENA_FAILURES);
+    return 0;
+  }
+  len = ARENA_ROUND(len);
+#if UWEB_CFG_SLAB
+  if (a->buf == 0) a->buf = (uint8_t *)_uweb_slab_get(UWEB_SLAB_ARENA);
+  if (a->buf && len <= UWEB_ARENA_LEN - a->used) {
+#else
+  if (len <= UWEB_ARENA_LEN - a->used) {
+#endif
+    void *p = &a->buf[a->used];
+    a->used += len;
+    return p;
+  }
+  // the most recent block, or a new one
+  uweb_arena_block *b = a->blocks;
+  if (b && len <= b->len - b->used) {
+    void *p = (uint8_t *)b + ARENA_BLOCK_HDR + b->used;
+    b->used += len;
+    return p;
+  }
+#ifdef UWEB_ARENA_BLOCK_ALLOC
+  uint32_t blen = len > UWEB_ARENA_BLOCK_LEN ? len : UWEB_ARENA_BLOCK_LEN;
+  b = (uweb_arena_block *)UWEB_ARENA_BLOCK_ALLOC(ARENA_BLOCK_HDR + blen);
+  if (b) {
+    UWEB_METRIC_INC(UWEB_CNT_ARENA_BLOCKS);
+    b->next = a->blocks;
+    b->len = blen;
+    b->used = len;
+    a->blocks = b;
+    return (uint8_t *)b + ARENA_BLOCK_HDR;
+  }
+#endif
+  UWEB_METRIC_INC(UWEB_CNT_ARENA_FAILURES);
+  return 0;
+}
+
+char *UWEB_req_printf(uweb_request_header *req, const char *fmt, ...) {
+  va_list arg_p;
+  va_start(arg_p, fmt);
+  int len = vsnprintf(0, 0, fmt, arg_p);
+  va_end(arg_p);
+  if (len < 0) return 0;
+  char *s = (char *)UWEB_req_alloc(req, len + 1);
+  if (s == 0) return 0;
+  va_start(arg_p, fmt);
+  vsnprintf(s, len + 1, fmt, arg_p);
+  va_end(arg_p);
+  return s;
+}
+
+// request done, everything handed out is given back
+void _uweb_arena_reset(uweb_arena *a) {
+  a->used = 0;
+#if UWEB_CFG_SLAB
+  if (a->buf) {
+    _uweb_slab_put(UWEB_SLAB_ARENA, a->buf);
+    a->buf = 0;
+  }
+#endif
+  while (a->blocks) {
+    uweb_arena_block *b = a->blocks;
+    a->blocks = b->next;
+#ifdef UWEB_ARENA_BLOCK_FREE
+    UWEB_ARENA_BLOCK_FREE(b);
+#endif
+  }
+}
+
+#endif /* UWEB_CFG_ARENA */
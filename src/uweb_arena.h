@@ -0,0 +1,87 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Request arena.
+ * Scratch memory for handlers building a response, e.g. JSON or a
+ * directory listing, handed out by bumping a pointer through a buffer in
+ * each context. Nothing is freed piecemeal; the arena is reset when the
+ * request is done, on HTTP/2 when no stream is left open. Requests that
+ * outgrow it get fallback blocks chained from UWEB_ARENA_BLOCK_ALLOC,
+ * freed again on reset, or nothing if it is not defined.
+ */
+
+#ifndef UWEB_ARENA_H_
+#define UWEB_ARENA_H_
+
+#include "uweb_cfg.h"
+#include "uweb_slab.h"
+
+#ifndef UWEB_CFG_ARENA
+#define UWEB_CFG_ARENA                 0
+#endif
+
+/* Arena bytes in each context */
+#ifndef UWEB_ARENA_LEN
+#define UWEB_ARENA_LEN                 1024
+#endif
+
+/* Alignment of allocations, a power of two */
+#ifndef UWEB_ARENA_ALIGN
+#define UWEB_ARENA_ALIGN               8
+#endif
+
+/* Min size of a fallback block, larger allocations get a block of their own */
+#ifndef UWEB_ARENA_BLOCK_LEN
+#define UWEB_ARENA_BLOCK_LEN           4096
+#endif
+
+/* Define UWEB_ARENA_BLOCK_ALLOC(len) and UWEB_ARENA_BLOCK_FREE(p), e.g. as
+   malloc and free, to chain fallback blocks when the arena is full */
+
+// Fallback block, its memory follows
+typedef struct uweb_arena_block_s {
+  struct uweb_arena_block_s *next;
+  uint32_t len;
+  uint32_t used;
+} uweb_arena_block;
+
+// Arena of a context
+typedef struct {
+  uint32_t used;
+  // most recent block first
+  uweb_arena_block *blocks;
+#if UWEB_CFG_SLAB
+  // pooled, taken with the first allocation
+  uint8_t *buf;
+#else
+  union {
+    uint8_t buf[UWEB_ARENA_LEN];
+    uint64_t align_u64;
+    void *align_ptr;
+    double align_dbl;
+  };
+#endif
+} uweb_arena;
+
+#endif /* UWEB_ARENA_H_ */
@@ -0,0 +1,97 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "uweb.h"
+
+#if UWEB_CFG_ASSETS
+
+// orders path, up to any query and with index.html after a trailing /,
+// against an asset path
+static int _uweb_asset_cmp(const char *path, const char *asset_path) {
+  static const char INDEX[] = "index.html";
+  const char *idx = 0;
+  while (1) {
+    char c = *path;
+    if (idx) {
+      c = *idx;
+    } else if (c == '?' || c == '#') {
+      c = 0;
+    }
+    if (c == 0 && idx == 0 && path[-1] == '/') {
+      // a directory, its index
+      idx = INDEX;
+      c = *idx;
+    }
+    if (c != *asset_path) return (uint8_t)c - (uint8_t)*asset_path;
+    if (c == 0) return 0;
+    if (idx) idx++;
+    else path++;
+    asset_path++;
+  }
+}
+
+const uweb_asset *UWEB_asset_find(const uweb_assets *bundle, const char *path) {
+  uint32_t lo = 0, hi = bundle->count;
+  if (path[0] != '/') return 0;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    int cmp = _uweb_asset_cmp(path, bundle->assets[mid].path);
+    if (cmp == 0) return &bundle->assets[mid];
+    if (cmp < 0) hi = mid;
+    else lo = mid + 1;
+  }
+  return 0;
+}
+
+uweb_response UWEB_asset_serve(uweb_request_header *req, const uweb_asset *a, UW_STREAM str,
+    UW_STREAM *res, uweb_http_status *http_status, char *content_type, char **extra_headers) {
+  const char *hdr = a->hdr;
+  // what HTTP/2 takes as extra headers
+  const char *fields = &a->hdr[a->extra];
+  if (req->if_none_match[0] && strstr(req->if_none_match, a->etag)) {
+    // client has it
+    *http_status = S304_NOT_MODIFIED;
+    hdr = a->hdr_304;
+    UWEB_stream_mem(str, 0, 0);
+  } else if (req->accept_gzip && a->gz_len) {
+    hdr = a->gz_hdr;
+    fields = &a->gz_hdr[a->gz_extra];
+    UWEB_stream_mem(str, a->gz_data, a->gz_len);
+  } else {
+    UWEB_stream_mem(str, a->data, a->len);
+  }
+  *res = str;
+#if UWEB_CFG_HTTP2
+  if (req->stream_id) {
+    strncpy(content_type, a->mime, UWEB_MAX_CONTENT_TYPE_LEN - 1);
+    *extra_headers = (char *)(uintptr_t)fields;
+  }
+#else
+  (void)content_type;
+  (void)extra_headers;
+  (void)fields;
+#endif
+  return UWEB_return_prebuilt(req, hdr);
+}
+
+#endif
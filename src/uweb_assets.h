@@ -0,0 +1,78 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Embedded assets.
+ * A directory of static files compiled into the binary by uweb_assetgen,
+ * see the assets target of the makefile. Each file becomes an entry with
+ * its bytes, a gzip variant when that is smaller, an ETag, a MIME type and
+ * prebuilt response headers, sorted on path. UWEB_asset_serve answers a
+ * request for one from memory: no file system, nothing formatted, a 304
+ * when the client has it already and the gzip variant when the client
+ * takes it.
+ */
+
+#ifndef UWEB_ASSETS_H_
+#define UWEB_ASSETS_H_
+
+#include "uweb_cfg.h"
+
+#ifndef UWEB_CFG_ASSETS
+#define UWEB_CFG_ASSETS                0
+#endif
+
+/* Longest If-None-Match value kept, longer ones never match */
+#ifndef UWEB_MAX_ETAG_LEN
+#define UWEB_MAX_ETAG_LEN              64
+#endif
+
+// One embedded file
+typedef struct {
+  // absolute, e.g. "/index.html"
+  const char *path;
+  const char *mime;
+  // quoted, as sent
+  const char *etag;
+  // status line and header fields of the 200 response, without the empty
+  // line ending them. The fields from extra on, ETag and those after it,
+  // also go into HTTP/2 responses.
+  const char *hdr;
+  uint16_t extra;
+  const uint8_t *data;
+  uint32_t len;
+  // gzip variant, zero gz_len when it would not be smaller
+  const char *gz_hdr;
+  uint16_t gz_extra;
+  const uint8_t *gz_data;
+  uint32_t gz_len;
+  // status line and header fields of the 304 response
+  const char *hdr_304;
+} uweb_asset;
+
+// A bundle of embedded files, sorted on path
+typedef struct {
+  const uweb_asset *assets;
+  uint32_t count;
+} uweb_assets;
+
+#endif /* UWEB_ASSETS_H_ */
@@ -0,0 +1,348 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "uweb.h"
+
+#if UWEB_CFG_CACHE
+
+#define TRACE_I(ev, a, b) UWEB_TRACE_I(&ctx->trace, (ev), ctx->state, (a), (b))
+
+// entry states
+#define CACHE_FREE                     0
+#define CACHE_FILLING                  1
+#define CACHE_READY                    2
+
+typedef struct {
+  uint8_t state;
+  // response did not fit, or was cut
+  uint8_t overflow;
+  uint16_t key_len;
+  // bytes stored, and of them the header up to the blank line
+  uint32_t len;
+  uint32_t hdr_len;
+  uint32_t ttl_ms;
+  uint64_t stored;
+  uint64_t expires;
+  // last use, the least recently used entry is replaced first
+  uint32_t used;
+  // requests waiting for the entry to be filled
+  uweb_ctx *waiters;
+  char key[UWEB_CACHE_KEY_LEN];
+  uint8_t data[UWEB_CACHE_ENTRY_LEN];
+} uweb_cache_entry;
+
+static uweb_cache_f _uweb_cache_f;
+static const char * const *_uweb_cache_vary;
+
+static UWEB_THREAD_LOCAL uweb_cache_entry _uweb_cache[UWEB_CACHE_ENTRIES];
+static UWEB_THREAD_LOCAL uint32_t _uweb_cache_clock;
+// waiting requests whose entry was filled or given up
+static UWEB_THREAD_LOCAL uweb_ctx *_uweb_cache_resume;
+
+static int _uweb_cache_nocase_eq(const char *a, const char *b, uint32_t n) {
+  while (n--) {
+    char ca = *a++;
+    char cb = *b++;
+    if (ca >= 'A' && ca <= 'Z') ca += 'a' - 'A';
+    if (cb >= 'A' && cb <= 'Z') cb += 'a' - 'A';
+    if (ca != cb) return 0;
+  }
+  return 1;
+}
+
+static void _uweb_cache_key_add(uweb_cache_req *c, const char *s, uint32_t len) {
+  if (c->key_len + len >= UWEB_CACHE_KEY_LEN) {
+    // too long, not cached
+    c->key_len = UWEB_CACHE_KEY_LEN;
+    return;
+  }
+  memcpy(&c->key[c->key_len], s, len);
+  c->key_len += len;
+}
+
+// request line parsed, key starts with method and resource
+void _uweb_cache_key(uweb_ctx *ctx) {
+  uweb_cache_req *c = &ctx->cache;
+  c->key_len = 0;
+  if (_uweb_cache_f == 0 || (ctx->req->method != GET && ctx->req->method != HEAD)) return;
+  const char *method = UWEB_HTTP_REQ_METHODS[ctx->req->method];
+  _uweb_cache_key_add(c, method, strlen(method));
+  _uweb_cache_key_add(c, " ", 1);
+  _uweb_cache_key_add(c, ctx->req->resource, strlen(ctx->req->resource));
+}
+
+// header field line, the values of selected fields are added to the key
+void _uweb_cache_field(uweb_ctx *ctx, const char *line, uint32_t len) {
+  uweb_cache_req *c = &ctx->cache;
+  uint32_t i;
+  if (c->key_len == 0 || c->key_len >= UWEB_CACHE_KEY_LEN || _uweb_cache_vary == 0) return;
+  for (i = 0; _uweb_cache_vary[i]; i++) {
+    uint32_t nlen = strlen(_uweb_cache_vary[i]);
+    if (len <= nlen || line[nlen] != ':' || !_uweb_cache_nocase_eq(line, _uweb_cache_vary[i], nlen)) {
+      continue;
+    }
+    const char *value = &line[nlen + 1];
+    while (value < &line[len] && (*value == ' ' || *value == '\t')) value++;
+    char sep[2] = { '\n', (char)(i + 1) };
+    _uweb_cache_key_add(c, sep, 2);
+    _uweb_cache_key_add(c, value, &line[len] - value);
+  }
+}
+
+static uweb_cache_entry *_uweb_cache_find(const uweb_cache_req *c) {
+  uint32_t i;
+  for (i = 0; i < UWEB_CACHE_ENTRIES; i++) {
+    uweb_cache_entry *e = &_uweb_cache[i];
+    if (e->state != CACHE_FREE && e->key_len == c->key_len && memcmp(e->key, c->key, c->key_len) == 0) {
+      return e;
+    }
+  }
+  return 0;
+}
+
+// a free entry, else an expired one, else the least recently used one
+static uweb_cache_entry *_uweb_cache_claim(uint64_t now) {
+  uweb_cache_entry *lru = 0;
+  uint32_t i;
+  for (i = 0; i < UWEB_CACHE_ENTRIES; i++) {
+    uweb_cache_entry *e = &_uweb_cache[i];
+    if (e->state == CACHE_FREE) return e;
+    if (e->state != CACHE_READY) continue;
+    if (now >= e->expires) return e;
+    if (lru == 0 || (int32_t)(e->used - lru->used) < 0) lru = e;
+  }
+  return lru;
+}
+
+// a header field of the stored response is name and holds token
+static int _uweb_cache_hdr_has(const uweb_cache_entry *e, const char *name, const char *token) {
+  const char *h = (const char *)e->data;
+  uint32_t nlen = strlen(name);
+  uint32_t tlen = strlen(token);
+  uint32_t i = 0;
+  while (i < e->hdr_len) {
+    uint32_t end = i;
+    while (end + 1 < e->hdr_len && (h[end] != '\r' || h[end + 1] != '\n')) end++;
+    if (end - i > nlen && h[i + nlen] == ':' && _uweb_cache_nocase_eq(&h[i], name, nlen)) {
+      uint32_t j;
+      for (j = i + nlen + 1; j + tlen <= end; j++) {
+        if (_uweb_cache_nocase_eq(&h[j], token, tlen)) return 1;
+      }
+    }
+    i = end + 2;
+  }
+  return 0;
+}
+
+// a complete response is kept if it is a 200 that may be shared
+static int _uweb_cache_storable(uweb_cache_entry *e) {
+  uint32_t i;
+  if (e->overflow || e->len < 13 || memcmp(e->data, "HTTP/1.1 200 ", 13) != 0) return 0;
+  for (i = 0; i + 3 < e->len; i++) {
+    if (memcmp(&e->data[i], "\r\n\r\n", 4) == 0) break;
+  }
+  if (i + 3 >= e->len) return 0;
+  e->hdr_len = i + 2;
+  return !_uweb_cache_hdr_has(e, "Connection", "close") &&
+         !_uweb_cache_hdr_has(e, "Cache-Control", "no-store") &&
+         !_uweb_cache_hdr_has(e, "Cache-Control", "private");
+}
+
+static void _uweb_cache_write(UW_STREAM out, const uint8_t *data, uint32_t len) {
+  if (out->write && len) {
+    int32_t wlen = out->write(out, (uint8_t *)(uintptr_t)data, len);
+    if (wlen > 0) out->wr_offs += wlen;
+  }
+  UWEB_METRIC_ADD(UWEB_CNT_BYTES_OUT, len);
+}
+
+// sends a stored response, its age and the client's connection close added
+static void _uweb_cache_send(uweb_ctx *ctx, UW_STREAM out, uweb_cache_entry *e, uint64_t now, int close) {
+  uint32_t age = (uint32_t)((now - e->stored) / 1000000000ULL);
+  TRACE_I(TRC_CACHE_HIT, e - _uweb_cache, age);
+  UWEB_METRIC_INC(UWEB_CNT_CACHE_HITS);
+  UWEB_METRIC_STATUS(S200_OK);
+  e->used = ++_uweb_cache_clock;
+  int len = sprintf((char *)ctx->tx_buf, "Age: %u\r\n%s", age, close ? "Connection: close\r\n" : "");
+  _uweb_cache_write(out, e->data, e->hdr_len);
+  _uweb_cache_write(out, ctx->tx_buf, len);
+  _uweb_cache_write(out, &e->data[e->hdr_len], e->len - e->hdr_len);
+}
+
+// stores what is written on its way to the client
+static int32_t _uweb_cache_capture_write(UW_STREAM str, uint8_t *src, uint32_t len) {
+  uweb_ctx *ctx = (uweb_ctx *)str->user;
+  uweb_cache_req *c = &ctx->cache;
+  if (c->fill) {
+    uweb_cache_entry *e = &_uweb_cache[c->fill - 1];
+    if (e->len + len > UWEB_CACHE_ENTRY_LEN) {
+      e->overflow = 1;
+    } else if (!e->overflow) {
+      memcpy(&e->data[e->len], src, len);
+      e->len += len;
+    }
+  }
+  if (c->out->write == 0) return len;
+  int32_t wlen = c->out->write(c->out, src, len);
+  if (wlen > 0) c->out->wr_offs += wlen;
+  return wlen;
+}
+
+static void _uweb_cache_capture_close(UW_STREAM str) {
+  uweb_ctx *ctx = (uweb_ctx *)str->user;
+  uweb_cache_req *c = &ctx->cache;
+  if (c->fill) _uweb_cache[c->fill - 1].overflow = 1;
+  if (c->out->close) c->out->close(c->out);
+}
+
+int _uweb_cache_request(uweb_ctx *ctx, UW_STREAM out, uweb_request_header *req, int close) {
+  uweb_cache_req *c = &ctx->cache;
+  uint32_t ttl_ms;
+  if (c->pass) {
+    c->pass = 0;
+    return UWEB_CACHE_PASS;
+  }
+  if (c->key_len == 0 || c->key_len >= UWEB_CACHE_KEY_LEN || req->content_length || req->chunked) {
+    return UWEB_CACHE_PASS;
+  }
+#if UWEB_CFG_WEBSOCKET
+  if (req->websocket) return UWEB_CACHE_PASS;
+#endif
+  if (_uweb_cache_f == 0 || (ttl_ms = _uweb_cache_f(req)) == 0) return UWEB_CACHE_PASS;
+
+  uint64_t now = UWEB_TIME_NS();
+  uweb_cache_entry *e = _uweb_cache_find(c);
+  if (e && e->state == CACHE_READY && now < e->expires) {
+    _uweb_cache_send(ctx, out, e, now, close);
+    return UWEB_CACHE_HIT;
+  }
+  if (e && e->state == CACHE_FILLING) {
+    // without a way to resume, answered by the response function
+    if (c->cached_f == 0) return UWEB_CACHE_PASS;
+    TRACE_I(TRC_CACHE_WAIT, e - _uweb_cache, 0);
+    UWEB_METRIC_INC(UWEB_CNT_CACHE_WAITS);
+    c->wait = e - _uweb_cache + 1;
+    c->out = out;
+    c->wait_prev = 0;
+    c->wait_next = e->waiters;
+    if (e->waiters) e->waiters->cache.wait_prev = ctx;
+    e->waiters = ctx;
+    return UWEB_CACHE_WAIT;
+  }
+  UWEB_METRIC_INC(UWEB_CNT_CACHE_MISSES);
+  // the response closes the connection, it is not kept
+  if (close) return UWEB_CACHE_PASS;
+  if (e == 0) e = _uweb_cache_claim(now);
+  if (e == 0) return UWEB_CACHE_PASS;
+
+  TRACE_I(TRC_CACHE_MISS, e - _uweb_cache, ttl_ms);
+  e->state = CACHE_FILLING;
+  e->overflow = 0;
+  e->key_len = c->key_len;
+  memcpy(e->key, c->key, c->key_len);
+  e->len = 0;
+  e->hdr_len = 0;
+  e->ttl_ms = ttl_ms;
+  e->waiters = 0;
+  c->fill = e - _uweb_cache + 1;
+  c->out = out;
+  memset(&c->capture, 0, sizeof(uweb_data_stream));
+  c->capture.user = ctx;
+  c->capture.total_sz = UWEB_UNKNONW_SZ;
+  c->capture.write = _uweb_cache_capture_write;
+  c->capture.close = _uweb_cache_capture_close;
+  return UWEB_CACHE_PASS;
+}
+
+// response written; kept if complete, and its waiting requests resumed
+void _uweb_cache_done(uweb_ctx *ctx, int complete) {
+  uweb_cache_req *c = &ctx->cache;
+  if (c->fill == 0) return;
+  uweb_cache_entry *e = &_uweb_cache[c->fill - 1];
+  c->fill = 0;
+  e->state = CACHE_FREE;
+  if (complete && _uweb_cache_storable(e)) {
+    TRACE_I(TRC_CACHE_STORE, e - _uweb_cache, e->len);
+    e->state = CACHE_READY;
+    e->stored = UWEB_TIME_NS();
+    e->expires = e->stored + (uint64_t)e->ttl_ms * 1000000ULL;
+    e->used = ++_uweb_cache_clock;
+  }
+  // waiting requests are answered from the entry, or by the response
+  // function when a complete response was not kept; a given up one is
+  // tried again
+  while (e->waiters) {
+    uweb_ctx *w = e->waiters;
+    e->waiters = w->cache.wait_next;
+    if (e->waiters) e->waiters->cache.wait_prev = 0;
+    w->cache.pass = complete && e->state != CACHE_READY;
+    w->cache.wait = UWEB_CACHE_RESUMING;
+    w->cache.wait_prev = 0;
+    w->cache.wait_next = _uweb_cache_resume;
+    if (_uweb_cache_resume) _uweb_cache_resume->cache.wait_prev = w;
+    _uweb_cache_resume = w;
+  }
+}
+
+// gives up filling, and stops waiting
+void _uweb_cache_release(uweb_ctx *ctx) {
+  uweb_cache_req *c = &ctx->cache;
+  _uweb_cache_done(ctx, 0);
+  if (c->wait) {
+    uweb_ctx **head = c->wait == UWEB_CACHE_RESUMING ? &_uweb_cache_resume : &_uweb_cache[c->wait - 1].waiters;
+    if (c->wait_prev) c->wait_prev->cache.wait_next = c->wait_next;
+    else *head = c->wait_next;
+    if (c->wait_next) c->wait_next->cache.wait_prev = c->wait_prev;
+    c->wait = 0;
+  }
+  c->pass = 0;
+}
+
+// next waiting request to serve again, 0 when none
+uweb_ctx *_uweb_cache_resumed(void) {
+  uweb_ctx *w = _uweb_cache_resume;
+  if (w) {
+    _uweb_cache_resume = w->cache.wait_next;
+    if (_uweb_cache_resume) _uweb_cache_resume->cache.wait_prev = 0;
+    w->cache.wait = 0;
+  }
+  return w;
+}
+
+void UWEB_set_cache_f(uweb_cache_f cache_f, const char * const *vary) {
+  _uweb_cache_f = cache_f;
+  _uweb_cache_vary = vary;
+}
+
+void UWEB_ctx_set_cached_f(uweb_ctx *ctx, uweb_cached_f cached_f) {
+  ctx->cache.cached_f = cached_f;
+}
+
+void UWEB_cache_clear(void) {
+  uint32_t i;
+  for (i = 0; i < UWEB_CACHE_ENTRIES; i++) {
+    if (_uweb_cache[i].state == CACHE_READY) _uweb_cache[i].state = CACHE_FREE;
+  }
+}
+
+#endif /* UWEB_CFG_CACHE */
@@ -0,0 +1,78 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Response cache.
+ * A cache function picks GET and HEAD requests whose responses are kept,
+ * and for how long. Responses are keyed on method, resource and the values
+ * of selected request header fields, and stored serialized, header and
+ * body, as they are written; a chunked response chunk by chunk. A hit is
+ * answered with the stored bytes, an Age field added, without calling the
+ * response function. Only complete 200 responses fitting an entry are
+ * kept, not those with Connection: close or Cache-Control: no-store or
+ * private.
+ * While a response is being produced, further requests for the same key
+ * wait for it rather than call the response function again. The response
+ * function runs to completion within the request, so this happens for
+ * deferred responses, e.g. relayed from a backend, which the server writes
+ * through UWEB_ctx_out. HTTP/1.1 only.
+ * Entries live in a fixed table per thread.
+ */
+
+#ifndef UWEB_CACHE_H_
+#define UWEB_CACHE_H_
+
+#include "uweb_cfg.h"
+
+#ifndef UWEB_CFG_CACHE
+#define UWEB_CFG_CACHE                 0
+#endif
+
+/* Number of cached responses per thread */
+#ifndef UWEB_CACHE_ENTRIES
+#define UWEB_CACHE_ENTRIES             8
+#endif
+
+/* Max serialized length of a cached response, header and body */
+#ifndef UWEB_CACHE_ENTRY_LEN
+#define UWEB_CACHE_ENTRY_LEN           4096
+#endif
+
+/* Max key length; method, resource and selected field values */
+#ifndef UWEB_CACHE_KEY_LEN
+#define UWEB_CACHE_KEY_LEN             320
+#endif
+
+#if UWEB_CACHE_ENTRIES > 254
+#error "UWEB_CACHE_ENTRIES must be below 255"
+#endif
+
+// Cache lookup results
+#define UWEB_CACHE_PASS                0
+#define UWEB_CACHE_HIT                 1
+#define UWEB_CACHE_WAIT                2
+
+// Waiting request is in the resume list rather than an entry's waiters
+#define UWEB_CACHE_RESUMING            0xff
+
+#endif /* UWEB_CACHE_H_ */
@@ -84,3 +84,142 @@ char *urlndecode(char *dst, char *str, int num) {
   *pdst = '\0';
   return dst;
 }
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1_block(uint32_t *h, const uint8_t *blk) {
+  uint32_t w[80];
+  uint32_t a, b, c, d, e, f, k, t;
+  int i;
+  for (i = 0; i < 16; i++) {
+    w[i] = (blk[i*4] << 24) | (blk[i*4+1] << 16) | (blk[i*4+2] << 8) | blk[i*4+3];
+  }
+  for (i = 16; i < 80; i++) {
+    w[i] = ROL32(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+  }
+  a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+  for (i = 0; i < 80; i++) {
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5a827999;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ed9eba1;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8f1bbcdc;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xca62c1d6;
+    }
+    t = ROL32(a, 5) + f + e + k + w[i];
+    e = d; d = c; c = ROL32(b, 30); b = a; a = t;
+  }
+  h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+void uweb_sha1(uint8_t *digest, const uint8_t *data, uint32_t len) {
+  uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+  uint8_t blk[64];
+  uint64_t bits = (uint64_t)len * 8;
+  uint32_t i;
+  while (len >= 64) {
+    sha1_block(h, data);
+    data += 64;
+    len -= 64;
+  }
+  // pad last block(s) with 0x80, zeroes and bit length
+  memset(blk, 0, sizeof(blk));
+  memcpy(blk, data, len);
+  blk[len] = 0x80;
+  if (len >= 56) {
+    sha1_block(h, blk);
+    memset(blk, 0, sizeof(blk));
+  }
+  for (i = 0; i < 8; i++) blk[63 - i] = bits >> (i * 8);
+  sha1_block(h, blk);
+  for (i = 0; i < 20; i++) digest[i] = h[i / 4] >> (24 - (i % 4) * 8);
+}
+
+int uweb_base64_encode(char *dst, const uint8_t *src, uint32_t len) {
+  static const char __b64[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  char *pdst = dst;
+  uint32_t i;
+  for (i = 0; i + 2 < len; i += 3) {
+    uint32_t v = (src[i] << 16) | (src[i+1] << 8) | src[i+2];
+    *pdst++ = __b64[(v >> 18) & 63];
+    *pdst++ = __b64[(v >> 12) & 63];
+    *pdst++ = __b64[(v >> 6) & 63];
+    *pdst++ = __b64[v & 63];
+  }
+  if (i < len) {
+    uint32_t v = src[i] << 16;
+    if (i + 1 < len) v |= src[i+1] << 8;
+    *pdst++ = __b64[(v >> 18) & 63];
+    *pdst++ = __b64[(v >> 12) & 63];
+    *pdst++ = i + 1 < len ? __b64[(v >> 6) & 63] : '=';
+    *pdst++ = '=';
+  }
+  *pdst = '\0';
+  return pdst - dst;
+}
+
+int uweb_base64url_decode(uint8_t *dst, uint32_t size, const char *src) {
+  uint32_t v = 0, bits = 0, len = 0;
+  for (; *src && *src != '='; src++) {
+    char c = *src;
+    uint32_t d;
+    if (c >= 'A' && c <= 'Z') d = c - 'A';
+    else if (c >= 'a' && c <= 'z') d = c - 'a' + 26;
+    else if (c >= '0' && c <= '9') d = c - '0' + 52;
+    else if (c == '-') d = 62;
+    else if (c == '_') d = 63;
+    else return -1;
+    v = (v << 6) | d;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      if (len >= size) return -1;
+      dst[len++] = v >> bits;
+    }
+  }
+  // a single trailing character holds no full byte
+  if (bits >= 6) return -1;
+  return len;
+}
+
+// appends to dst while it fits, always counting
+static void sse_put(char *dst, uint32_t size, uint32_t *len, const char *src, uint32_t n) {
+  if (*len < size) memcpy(&dst[*len], src, *len + n <= size ? n : size - *len);
+  *len += n;
+}
+
+uint32_t uweb_sse_format(char *dst, uint32_t size, const char *event, uint32_t id,
+    const uint8_t *data, uint32_t len) {
+  uint32_t flen = 0;
+  uint32_t i, line;
+  // a line break in the name would inject fields
+  if (event && strpbrk(event, "\r\n")) return 0;
+  if (id) {
+    char id_line[16];
+    sse_put(dst, size, &flen, id_line, sprintf(id_line, "id: %u\n", (unsigned int)id));
+  }
+  if (event) {
+    sse_put(dst, size, &flen, "event: ", 7);
+    sse_put(dst, size, &flen, event, strlen(event));
+    sse_put(dst, size, &flen, "\n", 1);
+  }
+  // lines end in CR, LF or CRLF, like the client splits them
+  for (line = 0, i = 0; i <= len; i++) {
+    if (i == len || data[i] == '\n' || data[i] == '\r') {
+      sse_put(dst, size, &flen, "data: ", 6);
+      sse_put(dst, size, &flen, (const char *)&data[line], i - line);
+      sse_put(dst, size, &flen, "\n", 1);
+      if (i + 1 < len && data[i] == '\r' && data[i + 1] == '\n') i++;
+      line = i + 1;
+    }
+  }
+  sse_put(dst, size, &flen, "\n", 1);
+  return flen;
+}
@@ -0,0 +1,85 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Response generators.
+ * A chunked response written as a stackless coroutine, protothread style:
+ * the generator yields buffers, uweb sends each as a chunk and calls the
+ * generator again, which then goes on after the yield. When the output
+ * blocked function of the context says output is blocked, uweb leaves the
+ * generator suspended until UWEB_ctx_resume. Locals do not survive a
+ * yield, keep state in ix and user, e.g. from UWEB_req_alloc. The resume
+ * point is a line number, so a generator must not yield from within a
+ * switch of its own, nor twice on one line.
+ *
+ *   static int count_gen(uweb_gen *gen, uweb_request_header *req) {
+ *     UWEB_GEN_BEGIN(gen);
+ *     for (gen->ix = 0; gen->ix < 10; gen->ix++) {
+ *       UWEB_GEN_YIELD(gen, "tick\n", 5);
+ *     }
+ *     UWEB_GEN_END(gen);
+ *   }
+ */
+
+#ifndef UWEB_GEN_H_
+#define UWEB_GEN_H_
+
+#include "uweb_cfg.h"
+
+// Generator results
+typedef enum {
+  UWEB_GEN_DONE = 0,
+  // yielded buf, len
+  UWEB_GEN_MORE
+} uweb_gen_result;
+
+// Generator state, per context
+typedef struct {
+  // where to go on, zero to start
+  uint16_t pt;
+  // yielded buffer, must stay valid until the generator is called again
+  const uint8_t *buf;
+  uint32_t len;
+  // free for the generator, e.g. a loop counter
+  uint32_t ix;
+  void *user;
+} uweb_gen;
+
+#define UWEB_GEN_BEGIN(gen) \
+  switch ((gen)->pt) { case 0:
+
+#define UWEB_GEN_YIELD(gen, data, n) \
+  do { \
+    (gen)->pt = __LINE__; \
+    (gen)->buf = (const uint8_t *)(data); \
+    (gen)->len = (n); \
+    return UWEB_GEN_MORE; \
+    case __LINE__:; \
+  } while (0)
+
+#define UWEB_GEN_END(gen) \
+  } \
+  (gen)->pt = 0; \
+  return UWEB_GEN_DONE
+
+#endif /* UWEB_GEN_H_ */
@@ -0,0 +1,1268 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "uweb.h"
+
+#if UWEB_CFG_HTTP2
+
+#define TRACE_E(ev, a, b) UWEB_TRACE_E(&ctx->trace, (ev), ctx->state, (a), (b))
+#define TRACE_I(ev, a, b) UWEB_TRACE_I(&ctx->trace, (ev), ctx->state, (a), (b))
+#define TRACE_D(ev, a, b) UWEB_TRACE_D(&ctx->trace, (ev), ctx->state, (a), (b))
+
+// frame flags
+#define H2_FLAG_END_STREAM    0x01
+#define H2_FLAG_ACK           0x01
+#define H2_FLAG_END_HEADERS   0x04
+#define H2_FLAG_PADDED        0x08
+#define H2_FLAG_PRIORITY      0x20
+
+// settings
+#define H2_SETTINGS_HEADER_TABLE_SIZE       0x1
+#define H2_SETTINGS_MAX_CONCURRENT_STREAMS  0x3
+#define H2_SETTINGS_INITIAL_WINDOW_SIZE     0x4
+#define H2_SETTINGS_MAX_FRAME_SIZE          0x5
+#define H2_SETTINGS_MAX_HEADER_LIST_SIZE    0x6
+
+// response states
+#define H2_RESP_NONE          0
+#define H2_RESP_SENDING       1
+#define H2_RESP_SENT          2
+
+// received data is acknowledged in batches of this
+#define H2_WINDOW_UPDATE_LEN  16384
+
+// HPACK static table, RFC 7541 appendix A
+static const char * const UWEB_HPACK_STATIC[][2] = {
+  {":authority", ""},
+  {":method", "GET"},
+  {":method", "POST"},
+  {":path", "/"},
+  {":path", "/index.html"},
+  {":scheme", "http"},
+  {":scheme", "https"},
+  {":status", "200"},
+  {":status", "204"},
+  {":status", "206"},
+  {":status", "304"},
+  {":status", "400"},
+  {":status", "404"},
+  {":status", "500"},
+  {"accept-charset", ""},
+  {"accept-encoding", "gzip, deflate"},
+  {"accept-language", ""},
+  {"accept-ranges", ""},
+  {"accept", ""},
+  {"access-control-allow-origin", ""},
+  {"age", ""},
+  {"allow", ""},
+  {"authorization", ""},
+  {"cache-control", ""},
+  {"content-disposition", ""},
+  {"content-encoding", ""},
+  {"content-language", ""},
+  {"content-length", ""},
+  {"content-location", ""},
+  {"content-range", ""},
+  {"content-type", ""},
+  {"cookie", ""},
+  {"date", ""},
+  {"etag", ""},
+  {"expect", ""},
+  {"expires", ""},
+  {"from", ""},
+  {"host", ""},
+  {"if-match", ""},
+  {"if-modified-since", ""},
+  {"if-none-match", ""},
+  {"if-range", ""},
+  {"if-unmodified-since", ""},
+  {"last-modified", ""},
+  {"link", ""},
+  {"location", ""},
+  {"max-forwards", ""},
+  {"proxy-authenticate", ""},
+  {"proxy-authorization", ""},
+  {"range", ""},
+  {"referer", ""},
+  {"refresh", ""},
+  {"retry-after", ""},
+  {"server", ""},
+  {"set-cookie", ""},
+  {"strict-transport-security", ""},
+  {"transfer-encoding", ""},
+  {"user-agent", ""},
+  {"vary", ""},
+  {"via", ""},
+  {"www-authenticate", ""},
+};
+
+#define UWEB_HPACK_STATIC_LEN  (sizeof(UWEB_HPACK_STATIC) / sizeof(UWEB_HPACK_STATIC[0]))
+
+// HPACK huffman code, RFC 7541 appendix B. The code is canonical, so
+// the number of codes per length and the symbols in code order suffice.
+static const uint8_t UWEB_HPACK_HUFF_COUNT[31] = {
+  0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3, 0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4
+};
+
+static const uint8_t UWEB_HPACK_HUFF_SYMS[256] = {
+  0x30, 0x31, 0x32, 0x61, 0x63, 0x65, 0x69, 0x6f, 0x73, 0x74, 0x20, 0x25, 0x2d, 0x2e, 0x2f, 0x33,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3d, 0x41, 0x5f, 0x62, 0x64, 0x66, 0x67, 0x68, 0x6c, 0x6d,
+  0x6e, 0x70, 0x72, 0x75, 0x3a, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x4b, 0x4c,
+  0x4d, 0x4e, 0x4f, 0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x59, 0x6a, 0x6b, 0x71, 0x76,
+  0x77, 0x78, 0x79, 0x7a, 0x26, 0x2a, 0x2c, 0x3b, 0x58, 0x5a, 0x21, 0x22, 0x28, 0x29, 0x3f, 0x27,
+  0x2b, 0x7c, 0x23, 0x3e, 0x00, 0x24, 0x40, 0x5b, 0x5d, 0x7e, 0x5e, 0x7d, 0x3c, 0x60, 0x7b, 0x5c,
+  0xc3, 0xd0, 0x80, 0x82, 0x83, 0xa2, 0xb8, 0xc2, 0xe0, 0xe2, 0x99, 0xa1, 0xa7, 0xac, 0xb0, 0xb1,
+  0xb3, 0xd1, 0xd8, 0xd9, 0xe3, 0xe5, 0xe6, 0x81, 0x84, 0x85, 0x86, 0x88, 0x92, 0x9a, 0x9c, 0xa0,
+  0xa3, 0xa4, 0xa9, 0xaa, 0xad, 0xb2, 0xb5, 0xb9, 0xba, 0xbb, 0xbd, 0xbe, 0xc4, 0xc6, 0xe4, 0xe8,
+  0xe9, 0x01, 0x87, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8f, 0x93, 0x95, 0x96, 0x97, 0x98, 0x9b, 0x9d,
+  0x9e, 0xa5, 0xa6, 0xa8, 0xae, 0xaf, 0xb4, 0xb6, 0xb7, 0xbc, 0xbf, 0xc5, 0xe7, 0xef, 0x09, 0x8e,
+  0x90, 0x91, 0x94, 0x9f, 0xab, 0xce, 0xd7, 0xe1, 0xec, 0xed, 0xc7, 0xcf, 0xea, 0xeb, 0xc0, 0xc1,
+  0xc8, 0xc9, 0xca, 0xcd, 0xd2, 0xd5, 0xda, 0xdb, 0xee, 0xf0, 0xf2, 0xf3, 0xff, 0xcb, 0xcc, 0xd3,
+  0xd4, 0xd6, 0xdd, 0xde, 0xdf, 0xf1, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe,
+  0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x0b, 0x0c, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14,
+  0x15, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x7f, 0xdc, 0xf9, 0x0a, 0x0d, 0x16,
+};
+
+static uint32_t _h2_get32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void _h2_put32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void _h2_write(uweb_ctx *ctx, UW_STREAM out, const uint8_t *data, uint32_t len) {
+  _uweb_write(ctx, out, data, len);
+  UWEB_METRIC_ADD(UWEB_CNT_BYTES_OUT, len);
+}
+
+static void _h2_frame_hdr(uint8_t *dst, uint32_t len, uint8_t type, uint8_t flags, uint32_t stream) {
+  dst[0] = len >> 16;
+  dst[1] = len >> 8;
+  dst[2] = len;
+  dst[3] = type;
+  dst[4] = flags;
+  _h2_put32(&dst[5], stream & 0x7fffffff);
+}
+
+// sends a frame, payload len must fit in tx buffer
+static void _h2_send_frame(uweb_ctx *ctx, UW_STREAM out, uint8_t type, uint8_t flags, uint32_t stream,
+    const uint8_t *payload, uint32_t len) {
+  _h2_frame_hdr(ctx->tx_buf, len, type, flags, stream);
+  if (len) memcpy(&ctx->tx_buf[UWEB_H2_FRAME_HDR_LEN], payload, len);
+  _h2_write(ctx, out, ctx->tx_buf, UWEB_H2_FRAME_HDR_LEN + len);
+}
+
+static void _h2_send_rst(uweb_ctx *ctx, UW_STREAM out, uint32_t stream, uweb_h2_error err) {
+  uint8_t payload[4];
+  TRACE_I(TRC_H2_RST, stream, err);
+  _h2_put32(payload, err);
+  _h2_send_frame(ctx, out, H2_RST_STREAM, 0, stream, payload, 4);
+}
+
+static void _h2_send_window_update(uweb_ctx *ctx, UW_STREAM out, uint32_t stream, uint32_t inc) {
+  uint8_t payload[4];
+  _h2_put32(payload, inc);
+  _h2_send_frame(ctx, out, H2_WINDOW_UPDATE, 0, stream, payload, 4);
+}
+
+void _uweb_h2_goaway(uweb_ctx *ctx, UW_STREAM out, uint32_t err) {
+  uint8_t payload[8];
+  if (err == H2_NO_ERROR) {
+    TRACE_I(TRC_H2_GOAWAY, err, ctx->h2->last_stream_id);
+  } else {
+    TRACE_E(TRC_H2_GOAWAY, err, ctx->h2->last_stream_id);
+  }
+  _h2_put32(payload, ctx->h2->last_stream_id);
+  _h2_put32(&payload[4], err);
+  _h2_send_frame(ctx, out, H2_GOAWAY, 0, 0, payload, 8);
+  _uweb_h2_close(ctx);
+  if (out->close) out->close(out);
+}
+
+// --- HPACK
+
+// decodes an integer with prefix bits
+static int _hpack_int(const uint8_t **p, const uint8_t *end, uint8_t prefix, uint32_t *v) {
+  uint32_t max = (1 << prefix) - 1;
+  uint32_t val, m = 0;
+  if (*p >= end) return -1;
+  val = *(*p)++ & max;
+  if (val < max) {
+    *v = val;
+    return 0;
+  }
+  while (*p < end) {
+    uint8_t b = *(*p)++;
+    uint32_t add;
+    // at most 32 bits
+    if (m > 28 || (m == 28 && (b & 0x70))) return -1;
+    add = (uint32_t)(b & 0x7f) << m;
+    if (val + add < val) return -1;
+    val += add;
+    m += 7;
+    if ((b & 0x80) == 0) {
+      *v = val;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// decodes huffman coded src bit by bit, using that the code is canonical.
+// Returns decoded length, -1 on bad coding. Only max bytes are stored, a
+// longer result is just counted.
+static int32_t _hpack_huff(const uint8_t *src, uint32_t len, char *dst, uint32_t max) {
+  uint32_t code = 0, first = 0, index = 0, bits = 0, acc = 0;
+  uint32_t out = 0;
+  uint32_t i;
+  int b;
+  for (i = 0; i < len; i++) {
+    for (b = 7; b >= 0; b--) {
+      uint32_t bit = (src[i] >> b) & 1;
+      code |= bit;
+      acc = (acc << 1) | bit;
+      bits++;
+      uint32_t count = UWEB_HPACK_HUFF_COUNT[bits];
+      if (code - first < count) {
+        index += code - first;
+        // eos must not be coded
+        if (index >= 256) return -1;
+        if (out < max) dst[out] = UWEB_HPACK_HUFF_SYMS[index];
+        out++;
+        code = first = index = bits = acc = 0;
+        continue;
+      }
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+      if (bits >= 30) return -1;
+    }
+  }
+  // padding is up to seven bits of the eos prefix, all ones
+  if (bits > 7 || acc != (1U << bits) - 1) return -1;
+  return out;
+}
+
+// decodes a string literal into dst. Returns length, -1 on error. A string
+// longer than max is skipped, only its length is returned.
+static int32_t _hpack_str(const uint8_t **p, const uint8_t *end, char *dst, uint32_t max) {
+  uint32_t len;
+  uint8_t huff;
+  int32_t res;
+  if (*p >= end) return -1;
+  huff = **p & 0x80;
+  if (_hpack_int(p, end, 7, &len) < 0 || len > (uint32_t)(end - *p)) return -1;
+  if (huff) {
+    res = _hpack_huff(*p, len, dst, max);
+  } else if (len > max) {
+    res = len;
+  } else {
+    memcpy(dst, *p, len);
+    res = len;
+  }
+  *p += len;
+  return res;
+}
+
+// bytes stored for table entry e, setting name and value length
+static uint32_t _hpack_entry(const uint8_t *e, uint32_t *n, uint32_t *v) {
+  if (e[0] == 0xff && e[1] == 0xff) {
+    // field too long to keep, only its lengths are
+    *n = (e[2] << 8) | e[3];
+    *v = (e[4] << 8) | e[5];
+    return 6;
+  }
+  *n = (e[0] << 8) | e[1];
+  *v = (e[2] << 8) | e[3];
+  return 4 + *n + *v;
+}
+
+// returns entry at dynamic table index ix, 0 being the newest
+static const uint8_t *_hpack_dyn(const uweb_hpack *hp, uint32_t ix) {
+  const uint8_t *e = hp->tab;
+  uint32_t n, v;
+  while (ix--) {
+    e += _hpack_entry(e, &n, &v);
+  }
+  return e;
+}
+
+// copies name and value of table index idx. Returns -1 if no such entry,
+// -2 if it was too long to keep; only the lengths are set then.
+static int _hpack_get(const uweb_hpack *hp, uint32_t idx, char *name, uint32_t *nlen,
+    char *value, uint32_t *vlen) {
+  if (idx == 0) return -1;
+  if (idx <= UWEB_HPACK_STATIC_LEN) {
+    *nlen = strlen(UWEB_HPACK_STATIC[idx - 1][0]);
+    memcpy(name, UWEB_HPACK_STATIC[idx - 1][0], *nlen);
+    if (value) {
+      *vlen = strlen(UWEB_HPACK_STATIC[idx - 1][1]);
+      memcpy(value, UWEB_HPACK_STATIC[idx - 1][1], *vlen);
+    }
+    return 0;
+  }
+  idx -= UWEB_HPACK_STATIC_LEN + 1;
+  if (idx >= hp->count) return -1;
+  const uint8_t *e = _hpack_dyn(hp, idx);
+  uint32_t n, v;
+  uint32_t elen = _hpack_entry(e, &n, &v);
+  *nlen = n;
+  if (value) *vlen = v;
+  if (elen != 4 + n + v) return -2;
+  // fits, as entries longer than UWEB_H2_FIELD_LEN are kept size only
+  memcpy(name, &e[4], n);
+  if (value) memcpy(value, &e[4 + n], v);
+  return 0;
+}
+
+static void _hpack_evict(uweb_hpack *hp, uint32_t need) {
+  while (hp->count && hp->size + need > hp->max_size) {
+    const uint8_t *e = _hpack_dyn(hp, hp->count - 1);
+    uint32_t n, v;
+    hp->count--;
+    hp->len -= _hpack_entry(e, &n, &v);
+    hp->size -= 32 + n + v;
+  }
+}
+
+// adds an entry, size only when name is 0; the decoder must count it to
+// stay in sync with the peer even if the field was too long to keep
+static void _hpack_add(uweb_hpack *hp, const char *name, uint32_t nlen, const char *value, uint32_t vlen) {
+  uint32_t esize = 32 + nlen + vlen;
+  uint32_t elen = name ? 4 + nlen + vlen : 6;
+  if (esize > hp->max_size) {
+    // larger than table, empties it
+    hp->count = 0;
+    hp->len = 0;
+    hp->size = 0;
+    return;
+  }
+  _hpack_evict(hp, esize);
+  memmove(&hp->tab[elen], hp->tab, hp->len);
+  if (name) {
+    hp->tab[0] = nlen >> 8;
+    hp->tab[1] = nlen;
+    hp->tab[2] = vlen >> 8;
+    hp->tab[3] = vlen;
+    memcpy(&hp->tab[4], name, nlen);
+    memcpy(&hp->tab[4 + nlen], value, vlen);
+  } else {
+    hp->tab[0] = 0xff;
+    hp->tab[1] = 0xff;
+    hp->tab[2] = nlen >> 8;
+    hp->tab[3] = nlen;
+    hp->tab[4] = vlen >> 8;
+    hp->tab[5] = vlen;
+  }
+  hp->len += elen;
+  hp->size += esize;
+  hp->count++;
+}
+
+// --- streams
+
+static uweb_h2_stream *_h2_stream_find(uweb_h2 *h2, uint32_t id) {
+  uint32_t i;
+  if (id == 0) return 0;
+  for (i = 0; i < UWEB_H2_MAX_STREAMS; i++) {
+    if (h2->streams[i].id == id) return &h2->streams[i];
+  }
+  return 0;
+}
+
+static uweb_h2_stream *_h2_stream_new(uweb_ctx *ctx, uint32_t id) {
+  uweb_h2 *h2 = ctx->h2;
+  uint32_t i;
+  for (i = 0; i < UWEB_H2_MAX_STREAMS; i++) {
+    uweb_h2_stream *s = &h2->streams[i];
+    if (s->id == 0) {
+      memset(s, 0, sizeof(uweb_h2_stream));
+      s->id = id;
+      s->send_window = h2->peer_initial_window;
+      s->req.ctx = ctx;
+      s->req.stream_id = id;
+#if UWEB_CFG_ARENA
+      s->req.arena = &ctx->arena;
+#endif
+      return s;
+    }
+  }
+  return 0;
+}
+
+// frees a stream, closing its response stream, sent or not
+static void _h2_stream_free(uweb_h2_stream *s) {
+  if (s->res && s->res->close) {
+    s->res->close(s->res);
+  }
+  s->id = 0;
+#if UWEB_CFG_ARENA
+  // streams share the arena of the connection
+  if (_uweb_h2_open_streams(s->req.ctx) == 0) _uweb_arena_reset(&s->req.ctx->arena);
+#endif
+}
+
+void _uweb_h2_close(uweb_ctx *ctx) {
+  uint32_t i;
+  if (ctx->h2 == 0) return;
+  for (i = 0; i < UWEB_H2_MAX_STREAMS; i++) {
+    if (ctx->h2->streams[i].id) _h2_stream_free(&ctx->h2->streams[i]);
+  }
+}
+
+uint32_t _uweb_h2_open_streams(uweb_ctx *ctx) {
+  uint32_t i, n = 0;
+  if (ctx->h2 == 0) return 0;
+  for (i = 0; i < UWEB_H2_MAX_STREAMS; i++) {
+    if (ctx->h2->streams[i].id) n++;
+  }
+  return n;
+}
+
+// --- response
+
+// encodes an integer with prefix bits, first holding the bits above
+static uint32_t _hpack_put_int(uint8_t *dst, uint8_t first, uint8_t prefix, uint32_t v) {
+  uint32_t max = (1 << prefix) - 1;
+  uint32_t n = 0;
+  if (v < max) {
+    dst[n++] = first | v;
+    return n;
+  }
+  dst[n++] = first | max;
+  v -= max;
+  while (v >= 0x80) {
+    dst[n++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  dst[n++] = v;
+  return n;
+}
+
+// encodes a literal field without indexing, not huffman coded. Name is
+// given by static table index, or if zero as string which is lowercased.
+// Returns encoded length, zero if it does not fit in size.
+static uint32_t _hpack_put_field(uint8_t *dst, uint32_t size, uint32_t idx,
+    const char *name, uint32_t nlen, const char *value, uint32_t vlen) {
+  uint32_t n, i;
+  if (size < 15 + nlen + vlen) return 0;
+  n = _hpack_put_int(dst, 0x00, 4, idx);
+  if (idx == 0) {
+    n += _hpack_put_int(&dst[n], 0x00, 7, nlen);
+    for (i = 0; i < nlen; i++) {
+      char c = name[i];
+      dst[n++] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+  }
+  n += _hpack_put_int(&dst[n], 0x00, 7, vlen);
+  memcpy(&dst[n], value, vlen);
+  return n + vlen;
+}
+
+// header fields not allowed in HTTP/2
+static int _h2_conn_specific(const char *name, uint32_t nlen) {
+  static const char * const fields[] = {
+    "connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade"
+  };
+  uint32_t i, j;
+  for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    if (strlen(fields[i]) != nlen) continue;
+    for (j = 0; j < nlen; j++) {
+      char c = name[j];
+      if ((c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c) != fields[i][j]) break;
+    }
+    if (j == nlen) return 1;
+  }
+  return 0;
+}
+
+static void _h2_send_headers(uweb_ctx *ctx, UW_STREAM out, uweb_h2_stream *s, uweb_http_status http_status,
+    const char *content_type, int32_t content_length, const char *extra_headers, uint8_t end_stream) {
+  // status codes in the static table
+  static const uint16_t status_idx[][2] = {
+    {200, 8}, {204, 9}, {206, 10}, {304, 11}, {400, 12}, {404, 13}, {500, 14}
+  };
+  uint8_t *dst = &ctx->tx_buf[UWEB_H2_FRAME_HDR_LEN];
+  uint32_t size = UWEB_TX_MAX_LEN - UWEB_H2_FRAME_HDR_LEN;
+  uint32_t len = 0, i;
+  char num[12];
+  uint16_t status = UWEB_HTTP_STATUS_NUM[http_status];
+
+  for (i = 0; i < sizeof(status_idx) / sizeof(status_idx[0]); i++) {
+    if (status_idx[i][0] == status) break;
+  }
+  if (i < sizeof(status_idx) / sizeof(status_idx[0])) {
+    dst[len++] = 0x80 | status_idx[i][1];
+  } else {
+    len += _hpack_put_field(&dst[len], size - len, 8, 0, 0, num, sprintf(num, "%i", status));
+  }
+  len += _hpack_put_field(&dst[len], size - len, 54, 0, 0, UWEB_SERVER_NAME, strlen(UWEB_SERVER_NAME));
+  if (http_status == S303_SEE_OTHER && s->resp == UWEB_REDIRECT) {
+    const char *url = s->req.redirection_url ? s->req.redirection_url : "/";
+    len += _hpack_put_field(&dst[len], size - len, 46, 0, 0, url, strlen(url));
+  }
+  if (content_type) {
+    len += _hpack_put_field(&dst[len], size - len, 31, 0, 0, content_type, strlen(content_type));
+  }
+  if (content_length >= 0) {
+    len += _hpack_put_field(&dst[len], size - len, 28, 0, 0, num, sprintf(num, "%i", content_length));
+  }
+  while (extra_headers && *extra_headers) {
+    // Name: value lines
+    const char *colon = strchr(extra_headers, ':');
+    const char *eol = strchr(extra_headers, '\n');
+    if (eol == 0) eol = extra_headers + strlen(extra_headers);
+    if (colon && colon < eol) {
+      const char *value = colon + 1;
+      const char *vend = eol;
+      while (value < vend && *value == ' ') value++;
+      while (vend > value && (vend[-1] == '\r' || vend[-1] == ' ')) vend--;
+      uint32_t nlen = colon - extra_headers;
+      if (!_h2_conn_specific(extra_headers, nlen)) {
+        len += _hpack_put_field(&dst[len], size - len, 0, extra_headers, nlen, value, vend - value);
+      }
+    }
+    extra_headers = *eol ? eol + 1 : eol;
+  }
+
+  _h2_frame_hdr(ctx->tx_buf, len, H2_HEADERS, H2_FLAG_END_HEADERS | (end_stream ? H2_FLAG_END_STREAM : 0), s->id);
+  _h2_write(ctx, out, ctx->tx_buf, UWEB_H2_FRAME_HDR_LEN + len);
+  s->resp_state = end_stream ? H2_RESP_SENT : H2_RESP_SENDING;
+}
+
+// sends response body as far as flow control windows allow
+static void _h2_send_body(uweb_ctx *ctx, UW_STREAM out, uweb_h2_stream *s) {
+  uweb_h2 *h2 = ctx->h2;
+  while (s->resp_state == H2_RESP_SENDING) {
+    if (s->chunk_left == 0) {
+      if (s->resp == UWEB_CHUNKED) {
+        // next chunk, from now on we ignore response
+        char content_type[UWEB_MAX_CONTENT_TYPE_LEN];
+        uweb_http_status http_status = S200_OK;
+        char *extra_headers = 0;
+#if UWEB_CFG_METRICS
+        uint64_t t_handler;
+#endif
+        UWEB_METRIC_INC(UWEB_CNT_CHUNKS_OUT);
+        s->req.chunk_nbr++;
+        UWEB_METRIC_TIME(t_handler);
+        (void)_UWEB_RESP_F(ctx, &s->req)(&s->req, &s->res, &http_status, content_type, &extra_headers);
+        UWEB_METRIC_HIST_SINCE(UWEB_HIST_HANDLER, t_handler);
+        s->chunk_left = s->res && s->res->avail_sz > 0 ? s->res->avail_sz : 0;
+      }
+      if (s->chunk_left == 0) {
+        _h2_send_frame(ctx, out, H2_DATA, H2_FLAG_END_STREAM, s->id, 0, 0);
+        s->resp_state = H2_RESP_SENT;
+        return;
+      }
+    }
+    int32_t len = s->chunk_left;
+    if (len > h2->send_window) len = h2->send_window;
+    if (len > s->send_window) len = s->send_window;
+    if (len > (int32_t)h2->peer_max_frame) len = h2->peer_max_frame;
+    const uint8_t *payload = 0;
+    if (s->res->flags & UWEB_STREAM_MEM) {
+      // sent straight from the stream's memory, not limited by tx buffer
+      if (len > s->res->avail_sz) len = s->res->avail_sz;
+      if (len <= 0) return; // window closed, wait for WINDOW_UPDATE
+      payload = &s->res->mem[s->res->rd_offs];
+      s->res->avail_sz -= len;
+    } else {
+      if (len > UWEB_TX_MAX_LEN - UWEB_H2_FRAME_HDR_LEN) len = UWEB_TX_MAX_LEN - UWEB_H2_FRAME_HDR_LEN;
+      if (len <= 0) return; // window closed, wait for WINDOW_UPDATE
+      len = s->res->read ? s->res->read(s->res, &ctx->tx_buf[UWEB_H2_FRAME_HDR_LEN], len) : 0;
+    }
+    if (len <= 0) {
+      // stream ended early
+      _h2_send_frame(ctx, out, H2_DATA, H2_FLAG_END_STREAM, s->id, 0, 0);
+      s->resp_state = H2_RESP_SENT;
+      return;
+    }
+    s->res->rd_offs += len;
+    s->chunk_left -= len;
+    h2->send_window -= len;
+    s->send_window -= len;
+    uint8_t end = s->resp != UWEB_CHUNKED && s->chunk_left == 0;
+    _h2_frame_hdr(ctx->tx_buf, len, H2_DATA, end ? H2_FLAG_END_STREAM : 0, s->id);
+    if (payload) {
+      _h2_write(ctx, out, ctx->tx_buf, UWEB_H2_FRAME_HDR_LEN);
+      _h2_write(ctx, out, payload, len);
+    } else {
+      _h2_write(ctx, out, ctx->tx_buf, UWEB_H2_FRAME_HDR_LEN + len);
+    }
+    if (end) s->resp_state = H2_RESP_SENT;
+  }
+}
+
+// frees the stream when both sides are done
+static void _h2_stream_done(uweb_ctx *ctx, UW_STREAM out, uweb_h2_stream *s) {
+  if (s->resp_state != H2_RESP_SENT) return;
+  if (!s->end_remote && s->reset_when_sent) {
+    // tell client to stop sending the body
+    _h2_send_rst(ctx, out, s->id, H2_NO_ERROR);
+  } else if (!s->end_remote) {
+    return;
+  }
+  _h2_stream_free(s);
+}
+
+// sends what flow control now allows on all streams
+static void _h2_pump(uweb_ctx *ctx, UW_STREAM out) {
+  uint32_t i;
+  for (i = 0; i < UWEB_H2_MAX_STREAMS && ctx->h2->send_window > 0; i++) {
+    uweb_h2_stream *s = &ctx->h2->streams[i];
+    if (s->id && s->resp_state == H2_RESP_SENDING) {
+      _h2_send_body(ctx, out, s);
+      _h2_stream_done(ctx, out, s);
+    }
+  }
+}
+
+// serve a stream request and start sending answer
+static void _h2_request(uweb_ctx *ctx, UW_STREAM out, uweb_h2_stream *s) {
+  uweb_request_header *req = &s->req;
+  TRACE_I(TRC_REQUEST, req->method, req->content_length);
+  UWEB_METRIC_METHOD(req->method);
+
+  char content_type[UWEB_MAX_CONTENT_TYPE_LEN];
+  uweb_http_status http_status = S200_OK;
+  char *extra_headers = 0;
+  uweb_response res = UWEB_OK;
+
+  if (s->error_status == S100_CONTINUE) {
+    if (req->method == _BAD_REQ || req->resource[0] == 0) {
+      s->error_status = S400_BAD_REQ;
+      s->error_page = UWEB_HTTP_MSG_BAD_REQUEST;
+    } else if (_UWEB_RESP_F(ctx, req) == 0) {
+      s->error_status = S501_NOT_IMPLEMENTED;
+      s->error_page = UWEB_HTTP_MSG_NOT_IMPL;
+    }
+  }
+  if (s->error_status == S100_CONTINUE) {
+#if UWEB_CFG_METRICS
+    uint64_t t_handler;
+#endif
+    strncpy(content_type, "text/html; charset=utf-8", UWEB_MAX_CONTENT_TYPE_LEN);
+    memset(&s->res_store, 0, sizeof(uweb_data_stream));
+    s->res = &s->res_store;
+    UWEB_METRIC_TIME(t_handler);
+    res = _UWEB_RESP_F(ctx, req)(req, &s->res, &http_status, content_type, &extra_headers);
+    UWEB_METRIC_HIST_SINCE(UWEB_HIST_HANDLER, t_handler);
+    if (res == UWEB_WEBSOCKET || res == UWEB_EVENT_STREAM || res == UWEB_DEFERRED ||
+        res == UWEB_GENERATOR) {
+      // connection wide protocols, or answers, not over a stream
+#if UWEB_CFG_CHUNKED_RESP
+      ctx->gen_f = 0;
+#endif
+      s->error_status = S501_NOT_IMPLEMENTED;
+      s->error_page = UWEB_HTTP_MSG_NOT_IMPL;
+    }
+    // headers are made from status, content type and extra headers
+    if (res == UWEB_PREBUILT) res = UWEB_OK;
+  }
+  if (s->error_status != S100_CONTINUE) {
+    TRACE_E(TRC_ERROR_RESPONSE, UWEB_HTTP_STATUS_NUM[s->error_status], s->id);
+    http_status = s->error_status;
+    strcpy(content_type, "text/html; charset=UTF-8");
+    extra_headers = 0;
+    s->res = UWEB_stream_mem(&s->res_store, s->error_page, strlen(s->error_page));
+    s->reset_when_sent = 1;
+    res = UWEB_OK;
+  } else {
+    if (res == UWEB_REDIRECT) http_status = S303_SEE_OTHER;
+    TRACE_I(TRC_RESPONSE, UWEB_HTTP_STATUS_NUM[http_status], res);
+  }
+  UWEB_METRIC_STATUS(http_status);
+  s->resp = res;
+
+  if (res == UWEB_REDIRECT) {
+    _h2_send_headers(ctx, out, s, http_status, 0, -1, 0, 1);
+  } else {
+    int32_t avail = s->res && s->res->avail_sz > 0 ? s->res->avail_sz : 0;
+    s->chunk_left = avail;
+    _h2_send_headers(ctx, out, s, http_status, content_type,
+        res == UWEB_OK && http_status != S304_NOT_MODIFIED ? (s->res ? s->res->total_sz : 0) : -1,
+        extra_headers, req->method == HEAD || avail == 0);
+    _h2_send_body(ctx, out, s);
+  }
+  _h2_stream_done(ctx, out, s);
+}
+
+// --- request header
+
+static void _h2_reject(uweb_h2_stream *s, uweb_http_status http_status, const char *page) {
+  if (s->error_status != S100_CONTINUE) return;
+  s->error_status = http_status;
+  s->error_page = page;
+}
+
+// copies a field value, truncated to dst size
+static void _h2_copy(char *dst, uint32_t size, const char *value, uint32_t vlen) {
+  if (vlen > size - 1) vlen = size - 1;
+  memcpy(dst, value, vlen);
+  dst[vlen] = 0;
+}
+
+// a decoded header field of stream s
+static void _h2_field(uweb_h2_stream *s, const char *name, uint32_t nlen, char *value, uint32_t vlen) {
+  uweb_request_header *req = &s->req;
+  uint32_t i;
+  value[vlen] = 0;
+  if (nlen == 7 && memcmp(name, ":method", 7) == 0) {
+    for (i = 1; i < _REQ_METHOD_COUNT; i++) {
+      if (strcmp(value, UWEB_HTTP_REQ_METHODS[i]) == 0) {
+        req->method = i;
+        break;
+      }
+    }
+  } else if (nlen == 5 && memcmp(name, ":path", 5) == 0) {
+    if (vlen >= UWEB_MAX_RESOURCE_LEN) {
+      _h2_reject(s, S414_REQ_URI_TOO_LONG, UWEB_HTTP_MSG_URI_TOO_LONG);
+    } else {
+      memcpy(req->resource, value, vlen + 1);
+    }
+#if UWEB_CFG_FIELD_HOST
+  } else if ((nlen == 10 && memcmp(name, ":authority", 10) == 0) ||
+      (nlen == 4 && memcmp(name, "host", 4) == 0)) {
+    _h2_copy(req->host, UWEB_MAX_HOST_LEN, value, vlen);
+#endif
+#if UWEB_CFG_FIELD_CONTENT_TYPE
+  } else if (nlen == 12 && memcmp(name, "content-type", 12) == 0) {
+    _h2_copy(req->content_type, UWEB_MAX_CONTENT_TYPE_LEN, value, vlen);
+#endif
+  } else if (nlen == 14 && memcmp(name, "content-length", 14) == 0) {
+    unsigned long long content_length = strtoull(value, 0, 10);
+    req->content_length = content_length > 0xffffffffULL ? 0xffffffff : (uint32_t)content_length;
+#if UWEB_CFG_ASSETS
+  } else if (nlen == 15 && memcmp(name, "accept-encoding", 15) == 0) {
+    req->accept_gzip = strstr(value, "gzip") != 0;
+  } else if (nlen == 13 && memcmp(name, "if-none-match", 13) == 0) {
+    // too long to match any
+    if (vlen < UWEB_MAX_ETAG_LEN) memcpy(req->if_none_match, value, vlen + 1);
+#endif
+  }
+}
+
+// decodes a header block. Fields go to stream s, or are only decoded to
+// keep the dynamic table in sync if s is zero. Returns -1 on a
+// compression error.
+static int _h2_decode(uweb_ctx *ctx, uweb_h2_stream *s, const uint8_t *p, uint32_t len,
+    uint32_t *header_bytes, uint32_t *header_count) {
+  uweb_hpack *hp = &ctx->h2->hpack;
+  const uint8_t *end = p + len;
+  char name[UWEB_H2_FIELD_LEN + 1];
+  char value[UWEB_H2_FIELD_LEN + 1];
+  uint32_t nlen, vlen, idx;
+  int32_t res;
+  while (p < end) {
+    uint8_t b = *p;
+    if (b & 0x80) {
+      // indexed field
+      if (_hpack_int(&p, end, 7, &idx) < 0) return -1;
+      res = _hpack_get(hp, idx, name, &nlen, value, &vlen);
+      if (res == -1) return -1;
+      if (res < 0) {
+        if (s) _h2_reject(s, S431_REQ_HEADER_FIELDS_TOO_LARGE, UWEB_HTTP_MSG_HEADER_TOO_LARGE);
+        continue;
+      }
+    } else if ((b & 0xe0) == 0x20) {
+      // dynamic table size update
+      if (_hpack_int(&p, end, 5, &idx) < 0 || idx > UWEB_H2_HPACK_TABLE_LEN) return -1;
+      hp->max_size = idx;
+      _hpack_evict(hp, 0);
+      continue;
+    } else {
+      // literal, with incremental indexing or not
+      uint8_t indexing = b & 0x40;
+      uint8_t long_name;
+      if (_hpack_int(&p, end, indexing ? 6 : 4, &idx) < 0) return -1;
+      if (idx) {
+        res = _hpack_get(hp, idx, name, &nlen, 0, 0);
+        if (res == -1) return -1;
+        long_name = res < 0;
+      } else {
+        res = _hpack_str(&p, end, name, UWEB_H2_FIELD_LEN);
+        if (res < 0) return -1;
+        nlen = res;
+        long_name = nlen > UWEB_H2_FIELD_LEN;
+      }
+      res = _hpack_str(&p, end, value, UWEB_H2_FIELD_LEN);
+      if (res < 0) return -1;
+      vlen = res;
+      if (long_name || vlen > UWEB_H2_FIELD_LEN) {
+        // too long to look at, the table keeps its size
+        if (indexing) _hpack_add(hp, 0, nlen, 0, vlen);
+        if (s && !long_name && nlen == 5 && memcmp(name, ":path", 5) == 0) {
+          _h2_reject(s, S414_REQ_URI_TOO_LONG, UWEB_HTTP_MSG_URI_TOO_LONG);
+        } else if (s) {
+          _h2_reject(s, S431_REQ_HEADER_FIELDS_TOO_LARGE, UWEB_HTTP_MSG_HEADER_TOO_LARGE);
+        }
+        continue;
+      }
+      if (indexing) _hpack_add(hp, name, nlen, value, vlen);
+    }
+    if (s) {
+      *header_bytes += nlen + vlen + 32;
+      (*header_count)++;
+      TRACE_D(TRC_HEADER_LINE, nlen, vlen);
+      _h2_field(s, name, nlen, value, vlen);
+    }
+  }
+  return 0;
+}
+
+// header block of a new stream is decoded, check limits and serve it
+static void _h2_headers_done(uweb_ctx *ctx, UW_STREAM out, uweb_h2_stream *s,
+    uint32_t header_bytes, uint32_t header_count) {
+  uweb_request_header *req = &s->req;
+  uweb_limits limits = ctx->limits;
+  TRACE_I(TRC_H2_STREAM, s->id, s->end_remote);
+  if (req->method == _BAD_REQ) {
+    TRACE_E(TRC_BAD_METHOD, s->id, 0);
+  } else if (ctx->limits_f) {
+    // route limits
+    ctx->limits_f(req, &limits);
+  }
+  uint32_t uri_len = strlen(req->resource);
+  if (limits.uri_len && uri_len > limits.uri_len) {
+    TRACE_E(TRC_LIMIT, UWEB_HTTP_STATUS_NUM[S414_REQ_URI_TOO_LONG], uri_len);
+    _h2_reject(s, S414_REQ_URI_TOO_LONG, UWEB_HTTP_MSG_URI_TOO_LONG);
+  } else if (limits.header_bytes && header_bytes > limits.header_bytes) {
+    TRACE_E(TRC_LIMIT, UWEB_HTTP_STATUS_NUM[S431_REQ_HEADER_FIELDS_TOO_LARGE], header_bytes);
+    _h2_reject(s, S431_REQ_HEADER_FIELDS_TOO_LARGE, UWEB_HTTP_MSG_HEADER_TOO_LARGE);
+  } else if (limits.header_count && header_count > limits.header_count) {
+    TRACE_E(TRC_LIMIT, UWEB_HTTP_STATUS_NUM[S431_REQ_HEADER_FIELDS_TOO_LARGE], header_count);
+    _h2_reject(s, S431_REQ_HEADER_FIELDS_TOO_LARGE, UWEB_HTTP_MSG_HEADER_TOO_LARGE);
+  } else if (limits.body_size && req->content_length > limits.body_size) {
+    TRACE_E(TRC_LIMIT, UWEB_HTTP_STATUS_NUM[S413_REQ_ENTITY_TOO_LARGE], req->content_length);
+    _h2_reject(s, S413_REQ_ENTITY_TOO_LARGE, UWEB_HTTP_MSG_BODY_TOO_LARGE);
+  }
+  s->body_limit = limits.body_size;
+
+#if UWEB_CFG_VHOST
+  if (ctx->vhosts) req->site = UWEB_vhost_find(ctx->vhosts, req->host);
+#endif
+  // accept or reject before any body is read
+  if (s->error_status == S100_CONTINUE && ctx->header_f && req->method != _BAD_REQ) {
+    uweb_http_status http_status = ctx->header_f(req);
+    if (http_status != S100_CONTINUE) {
+      TRACE_I(TRC_REJECT, UWEB_HTTP_STATUS_NUM[http_status], req->content_length);
+      _h2_reject(s, http_status, UWEB_HTTP_MSG_REJECTED);
+    }
+  }
+  _h2_request(ctx, out, s);
+}
+
+// a complete header block is in buf
+static int _h2_block_end(uweb_ctx *ctx, UW_STREAM out) {
+  uweb_h2 *h2 = ctx->h2;
+  uint32_t id = h2->block_stream;
+  uint8_t end_stream = h2->block_flags & H2_FLAG_END_STREAM;
+  uint32_t header_bytes = 0, header_count = 0;
+  uweb_h2_stream *s = _h2_stream_find(h2, id);
+  h2->block_stream = 0;
+  if (s) {
+    // trailer fields, not reported
+    if (_h2_decode(ctx, 0, h2->buf, h2->buf_len, 0, 0) < 0) return H2_COMPRESSION_ERROR;
+    if (!end_stream || s->end_remote) return H2_PROTOCOL_ERROR;
+    s->end_remote = 1;
+    if (_UWEB_DATA_F(ctx, &s->req) && s->error_status == S100_CONTINUE) {
+      // report data end
+      _UWEB_DATA_F(ctx, &s->req)(&s->req, DATA_CONTENT, s->received_len, 0, 0);
+    }
+    _h2_stream_done(ctx, out, s);
+    return 0;
+  }
+  if ((id & 1) == 0 || id <= h2->last_stream_id) return H2_PROTOCOL_ERROR;
+  h2->last_stream_id = id;
+  s = _h2_stream_new(ctx, id);
+  if (_h2_decode(ctx, s, h2->buf, h2->buf_len, &header_bytes, &header_count) < 0) {
+    if (s) s->id = 0;
+    return H2_COMPRESSION_ERROR;
+  }
+  if (s == 0) {
+    // client ignored our max concurrent streams
+    _h2_send_rst(ctx, out, id, H2_REFUSED_STREAM);
+    return 0;
+  }
+  s->end_remote = end_stream;
+  _h2_headers_done(ctx, out, s, header_bytes, header_count);
+  return 0;
+}
+
+// frame header is complete, check it
+static int _h2_frame_start(uweb_ctx *ctx, UW_STREAM out) {
+  uweb_h2 *h2 = ctx->h2;
+  h2->frame_len = (h2->hdr[0] << 16) | (h2->hdr[1] << 8) | h2->hdr[2];
+  h2->frame_type = h2->hdr[3];
+  h2->frame_flags = h2->hdr[4];
+  h2->frame_stream = _h2_get32(&h2->hdr[5]) & 0x7fffffff;
+  h2->frame_offs = 0;
+  h2->pad_len = 0;
+  TRACE_D(TRC_H2_FRAME, h2->frame_type | (h2->frame_flags << 8), h2->frame_len);
+
+  if (h2->frame_len > UWEB_H2_MAX_FRAME_LEN) return H2_FRAME_SIZE_ERROR;
+  if (h2->block_stream &&
+      (h2->frame_type != H2_CONTINUATION || h2->frame_stream != h2->block_stream)) {
+    // header blocks must not be interleaved
+    return H2_PROTOCOL_ERROR;
+  }
+  switch (h2->frame_type) {
+  case H2_DATA: {
+    if (h2->frame_stream == 0 || h2->frame_stream > h2->last_stream_id) return H2_PROTOCOL_ERROR;
+    if (h2->frame_len > UWEB_H2_DEFAULT_WINDOW - h2->recv_unacked) return H2_FLOW_CONTROL_ERROR;
+    h2->recv_unacked += h2->frame_len;
+    uweb_h2_stream *s = _h2_stream_find(h2, h2->frame_stream);
+    if (s && (s->end_remote || h2->frame_len > UWEB_H2_DEFAULT_WINDOW - s->recv_unacked)) {
+      _h2_send_rst(ctx, out, s->id, s->end_remote ? H2_STREAM_CLOSED : H2_FLOW_CONTROL_ERROR);
+      _h2_stream_free(s);
+      s = 0;
+    }
+    if (s) s->recv_unacked += h2->frame_len;
+    if ((h2->frame_flags & H2_FLAG_PADDED) && h2->frame_len == 0) return H2_PROTOCOL_ERROR;
+    break;
+  }
+  case H2_HEADERS:
+    if (h2->frame_stream == 0) return H2_PROTOCOL_ERROR;
+    h2->buf_len = 0;
+    // fall through
+  case H2_CONTINUATION:
+    if (h2->frame_type == H2_CONTINUATION && h2->block_stream == 0) return H2_PROTOCOL_ERROR;
+    if (h2->buf_len + h2->frame_len > UWEB_H2_FRAME_BUF_LEN) {
+      // header block does not fit, and must be decoded as a whole
+      TRACE_E(TRC_LIMIT, UWEB_HTTP_STATUS_NUM[S431_REQ_HEADER_FIELDS_TOO_LARGE], h2->buf_len + h2->frame_len);
+      return H2_ENHANCE_YOUR_CALM;
+    }
+    break;
+  case H2_PUSH_PROMISE:
+    return H2_PROTOCOL_ERROR;
+  default:
+    h2->buf_len = 0;
+    if (h2->frame_len > UWEB_H2_FRAME_BUF_LEN) return H2_FRAME_SIZE_ERROR;
+    break;
+  }
+  return 0;
+}
+
+// piece of DATA frame payload
+static int _h2_data(uweb_ctx *ctx, UW_STREAM out, uint8_t *p, uint32_t len) {
+  uweb_h2 *h2 = ctx->h2;
+  uint32_t offs = h2->frame_offs;
+  if ((h2->frame_flags & H2_FLAG_PADDED) && offs == 0) {
+    h2->pad_len = *p++;
+    len--;
+    offs++;
+    if (h2->pad_len >= h2->frame_len) return H2_PROTOCOL_ERROR;
+  }
+  uint32_t data_end = h2->frame_len - h2->pad_len;
+  if (offs >= data_end) return 0;
+  if (len > data_end - offs) len = data_end - offs;
+  uweb_h2_stream *s = _h2_stream_find(h2, h2->frame_stream);
+  if (s == 0 || len == 0 || s->error_status != S100_CONTINUE) return 0;
+  if (s->body_limit && s->received_len + len > s->body_limit) {
+    TRACE_E(TRC_LIMIT, UWEB_HTTP_STATUS_NUM[S413_REQ_ENTITY_TOO_LARGE], s->received_len + len);
+    _h2_send_rst(ctx, out, s->id, H2_CANCEL);
+    _h2_stream_free(s);
+    return 0;
+  }
+  if (_UWEB_DATA_F(ctx, &s->req)) {
+    // report data
+    _UWEB_DATA_F(ctx, &s->req)(&s->req, DATA_CONTENT, s->received_len, p, len);
+  }
+  s->received_len += len;
+  return 0;
+}
+
+// DATA frame is received
+static void _h2_data_end(uweb_ctx *ctx, UW_STREAM out) {
+  uweb_h2 *h2 = ctx->h2;
+  uweb_h2_stream *s = _h2_stream_find(h2, h2->frame_stream);
+  if (h2->recv_unacked >= H2_WINDOW_UPDATE_LEN) {
+    _h2_send_window_update(ctx, out, 0, h2->recv_unacked);
+    h2->recv_unacked = 0;
+  }
+  if (s == 0) return;
+  if (h2->frame_flags & H2_FLAG_END_STREAM) {
+    s->end_remote = 1;
+    TRACE_D(TRC_CONTENT_DONE, s->received_len, s->id);
+    if (_UWEB_DATA_F(ctx, &s->req) && s->error_status == S100_CONTINUE) {
+      // report data end
+      _UWEB_DATA_F(ctx, &s->req)(&s->req, DATA_CONTENT, s->received_len, 0, 0);
+    }
+    _h2_stream_done(ctx, out, s);
+  } else if (s->recv_unacked >= H2_WINDOW_UPDATE_LEN) {
+    _h2_send_window_update(ctx, out, s->id, s->recv_unacked);
+    s->recv_unacked = 0;
+  }
+}
+
+// applies a SETTINGS payload of the client
+static int _h2_settings(uweb_h2 *h2, const uint8_t *p, uint32_t len) {
+  uint32_t i;
+  for (i = 0; i < len; i += 6) {
+    uint16_t id = (p[i] << 8) | p[i + 1];
+    uint32_t val = _h2_get32(&p[i + 2]);
+    if (id == H2_SETTINGS_INITIAL_WINDOW_SIZE) {
+      uint32_t j;
+      int64_t delta = (int64_t)val - h2->peer_initial_window;
+      if (val > 0x7fffffff) return H2_FLOW_CONTROL_ERROR;
+      // no open stream window may grow beyond 2^31-1
+      for (j = 0; j < UWEB_H2_MAX_STREAMS; j++) {
+        if (h2->streams[j].id && h2->streams[j].send_window + delta > 0x7fffffff) {
+          return H2_FLOW_CONTROL_ERROR;
+        }
+      }
+      for (j = 0; j < UWEB_H2_MAX_STREAMS; j++) {
+        h2->streams[j].send_window += (int32_t)delta;
+      }
+      h2->peer_initial_window = val;
+    } else if (id == H2_SETTINGS_MAX_FRAME_SIZE) {
+      if (val < UWEB_H2_MAX_FRAME_LEN || val > 0xffffff) return H2_PROTOCOL_ERROR;
+      h2->peer_max_frame = val;
+    }
+  }
+  return H2_NO_ERROR;
+}
+
+// frame is received. Returns an error code, or -1 if the client goes away.
+static int _h2_frame_end(uweb_ctx *ctx, UW_STREAM out) {
+  uweb_h2 *h2 = ctx->h2;
+  uint8_t *p = h2->buf;
+  uint32_t len = h2->frame_len;
+  switch (h2->frame_type) {
+  case H2_DATA:
+    _h2_data_end(ctx, out);
+    break;
+  case H2_HEADERS: {
+    // strip padding and priority
+    uint32_t offs = 0, pad = 0;
+    if (h2->frame_flags & H2_FLAG_PADDED) {
+      if (len < 1) return H2_PROTOCOL_ERROR;
+      pad = p[0];
+      offs = 1;
+    }
+    if (h2->frame_flags & H2_FLAG_PRIORITY) offs += 5;
+    if (offs + pad > len) return H2_PROTOCOL_ERROR;
+    h2->buf_len = len - offs - pad;
+    memmove(h2->buf, &p[offs], h2->buf_len);
+    h2->block_stream = h2->frame_stream;
+    h2->block_flags = h2->frame_flags;
+    if (h2->frame_flags & H2_FLAG_END_HEADERS) return _h2_block_end(ctx, out);
+    break;
+  }
+  case H2_CONTINUATION:
+    if (h2->frame_flags & H2_FLAG_END_HEADERS) return _h2_block_end(ctx, out);
+    break;
+  case H2_PRIORITY:
+    if (h2->frame_stream == 0) return H2_PROTOCOL_ERROR;
+    if (len != 5) return H2_FRAME_SIZE_ERROR;
+    break;
+  case H2_RST_STREAM: {
+    if (h2->frame_stream == 0 || h2->frame_stream > h2->last_stream_id) return H2_PROTOCOL_ERROR;
+    if (len != 4) return H2_FRAME_SIZE_ERROR;
+    uweb_h2_stream *s = _h2_stream_find(h2, h2->frame_stream);
+    TRACE_I(TRC_H2_RST, h2->frame_stream, _h2_get32(p));
+    if (s) _h2_stream_free(s);
+    break;
+  }
+  case H2_SETTINGS: {
+    int err;
+    if (h2->frame_stream) return H2_PROTOCOL_ERROR;
+    if (h2->frame_flags & H2_FLAG_ACK) {
+      if (len) return H2_FRAME_SIZE_ERROR;
+      break;
+    }
+    if (len % 6) return H2_FRAME_SIZE_ERROR;
+    err = _h2_settings(h2, p, len);
+    if (err) return err;
+    _h2_send_frame(ctx, out, H2_SETTINGS, H2_FLAG_ACK, 0, 0, 0);
+    _h2_pump(ctx, out);
+    break;
+  }
+  case H2_PING:
+    if (h2->frame_stream) return H2_PROTOCOL_ERROR;
+    if (len != 8) return H2_FRAME_SIZE_ERROR;
+    if ((h2->frame_flags & H2_FLAG_ACK) == 0) {
+      _h2_send_frame(ctx, out, H2_PING, H2_FLAG_ACK, 0, p, 8);
+    }
+    break;
+  case H2_GOAWAY:
+    TRACE_I(TRC_H2_GOAWAY, len >= 8 ? _h2_get32(&p[4]) : 0, 0);
+    return -1;
+  case H2_WINDOW_UPDATE: {
+    if (len != 4) return H2_FRAME_SIZE_ERROR;
+    uint32_t inc = _h2_get32(p) & 0x7fffffff;
+    if (h2->frame_stream == 0) {
+      if (inc == 0) return H2_PROTOCOL_ERROR;
+      if ((int64_t)h2->send_window + inc > 0x7fffffff) return H2_FLOW_CONTROL_ERROR;
+      h2->send_window += inc;
+    } else {
+      uweb_h2_stream *s = _h2_stream_find(h2, h2->frame_stream);
+      if (s && (inc == 0 || (int64_t)s->send_window + inc > 0x7fffffff)) {
+        _h2_send_rst(ctx, out, s->id, inc == 0 ? H2_PROTOCOL_ERROR : H2_FLOW_CONTROL_ERROR);
+        _h2_stream_free(s);
+      } else if (s) {
+        s->send_window += inc;
+      }
+    }
+    _h2_pump(ctx, out);
+    break;
+  }
+  default:
+    // unknown frame types are ignored
+    break;
+  }
+  return 0;
+}
+
+int _uweb_h2_parse(uweb_ctx *ctx, UW_STREAM out, UW_STREAM in) {
+  uweb_h2 *h2 = ctx->h2;
+  int err;
+  if (ctx->rx_ix >= ctx->rx_len) {
+    int32_t len = in->avail_sz < UWEB_RX_BUF_LEN ? in->avail_sz : UWEB_RX_BUF_LEN;
+    len = in->read ? in->read(in, ctx->rx_buf, len) : 0;
+    if (len <= 0) return -1;
+    UWEB_METRIC_ADD(UWEB_CNT_BYTES_IN, len);
+    ctx->rx_ix = 0;
+    ctx->rx_len = len;
+  }
+
+  uint8_t *p = &ctx->rx_buf[ctx->rx_ix];
+  uint8_t *end = &ctx->rx_buf[ctx->rx_len];
+
+  while (p < end) {
+    if (h2->preface_ix < UWEB_H2_PREFACE_LEN) {
+      // rest of client preface
+      if (*p++ != UWEB_H2_PREFACE[h2->preface_ix++]) {
+        err = H2_PROTOCOL_ERROR;
+        goto conn_error;
+      }
+      continue;
+    }
+    if (h2->hdr_len < UWEB_H2_FRAME_HDR_LEN) {
+      // frame header
+      h2->hdr[h2->hdr_len++] = *p++;
+      if (h2->hdr_len < UWEB_H2_FRAME_HDR_LEN) continue;
+      err = _h2_frame_start(ctx, out);
+      if (err) goto conn_error;
+    } else {
+      // frame payload, DATA is reported from the block, others are buffered
+      uint32_t len = (uint32_t)(end - p) < h2->frame_len - h2->frame_offs ?
+          (uint32_t)(end - p) : h2->frame_len - h2->frame_offs;
+      if (h2->frame_type == H2_DATA) {
+        err = _h2_data(ctx, out, p, len);
+        if (err) goto conn_error;
+      } else {
+        memcpy(&h2->buf[h2->buf_len], p, len);
+        h2->buf_len += len;
+      }
+      p += len;
+      h2->frame_offs += len;
+    }
+    if (h2->frame_offs == h2->frame_len) {
+      h2->hdr_len = 0;
+      err = _h2_frame_end(ctx, out);
+      if (err < 0) {
+        // client went away
+        ctx->rx_ix = ctx->rx_len;
+        _uweb_h2_close(ctx);
+        if (out->close) out->close(out);
+        return 1;
+      }
+      if (err) goto conn_error;
+    }
+  }
+
+  ctx->rx_ix = ctx->rx_len;
+  return 0;
+
+conn_error:
+  ctx->rx_ix = ctx->rx_len;
+  _uweb_h2_goaway(ctx, out, err);
+  return 1;
+}
+
+int _uweb_h2_start(uweb_ctx *ctx, UW_STREAM out, uint8_t preface_ix) {
+  uweb_h2 *h2;
+  uint8_t settings[18];
+  TRACE_I(TRC_H2_START, preface_ix, 0);
+#if UWEB_CFG_SLAB
+  // held until the connection closes
+  if (ctx->h2 == 0) ctx->h2 = (uweb_h2 *)_uweb_slab_get(UWEB_SLAB_H2);
+  if (ctx->h2 == 0) return -1;
+#else
+  ctx->h2 = &ctx->h2_mem;
+#endif
+  h2 = ctx->h2;
+  memset(h2, 0, sizeof(uweb_h2));
+  h2->preface_ix = preface_ix;
+  h2->send_window = UWEB_H2_DEFAULT_WINDOW;
+  h2->peer_initial_window = UWEB_H2_DEFAULT_WINDOW;
+  h2->peer_max_frame = UWEB_H2_MAX_FRAME_LEN;
+  h2->hpack.max_size = UWEB_H2_HPACK_TABLE_LEN;
+
+  // server preface
+  settings[0] = 0;
+  settings[1] = H2_SETTINGS_MAX_CONCURRENT_STREAMS;
+  _h2_put32(&settings[2], UWEB_H2_MAX_STREAMS);
+  settings[6] = 0;
+  settings[7] = H2_SETTINGS_HEADER_TABLE_SIZE;
+  _h2_put32(&settings[8], UWEB_H2_HPACK_TABLE_LEN);
+  settings[12] = 0;
+  settings[13] = H2_SETTINGS_MAX_HEADER_LIST_SIZE;
+  _h2_put32(&settings[14], UWEB_H2_FRAME_BUF_LEN);
+  _h2_send_frame(ctx, out, H2_SETTINGS, 0, 0, settings, sizeof(settings));
+  return 0;
+}
+
+int _uweb_h2_upgrade(uweb_ctx *ctx, UW_STREAM out) {
+  uweb_h2_stream *s;
+  int err;
+  if (_uweb_h2_start(ctx, out, 0)) {
+    UWEB_METRIC_INC(UWEB_CNT_SHED_MEMORY);
+    if (out->close) out->close(out);
+    return 1;
+  }
+  // HTTP2-Settings of the upgrade request count as the first SETTINGS
+  err = _h2_settings(ctx->h2, ctx->req->h2_settings_buf, ctx->req->h2_settings_len);
+  if (err) {
+    _uweb_h2_goaway(ctx, out, err);
+    return 1;
+  }
+  // the upgrading request is stream 1, half closed as it has no body
+  ctx->h2->last_stream_id = 1;
+  s = _h2_stream_new(ctx, 1);
+  if (s == 0) return 0;
+  memcpy(&s->req, ctx->req, sizeof(uweb_request_header));
+  s->req.stream_id = 1;
+  s->end_remote = 1;
+  TRACE_I(TRC_H2_STREAM, s->id, s->end_remote);
+  _h2_request(ctx, out, s);
+  return 0;
+}
+
+#endif /* UWEB_CFG_HTTP2 */
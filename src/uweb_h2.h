@@ -0,0 +1,116 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * HTTP/2 cleartext (h2c), RFC 7540 and HPACK RFC 7541.
+ * A connection starting with the HTTP/2 preface, or a request upgrading
+ * with Upgrade: h2c, is parsed as frames. Each stream is a request served
+ * with the same response and data functions as HTTP/1.1; req->stream_id
+ * tells them apart. Request limits and the header function apply per
+ * stream once its header block is decoded. Streams, the HPACK dynamic table
+ * and the frame buffer are sized below, so a constrained build can trade
+ * concurrency for RAM.
+ */
+
+#ifndef UWEB_H2_H_
+#define UWEB_H2_H_
+
+#include "uweb_cfg.h"
+
+#ifndef UWEB_CFG_HTTP2
+#define UWEB_CFG_HTTP2                 0
+#endif
+
+/* Max concurrent streams per connection */
+#ifndef UWEB_H2_MAX_STREAMS
+#define UWEB_H2_MAX_STREAMS            4
+#endif
+
+/* HPACK dynamic table size in bytes, advertised to the client */
+#ifndef UWEB_H2_HPACK_TABLE_LEN
+#define UWEB_H2_HPACK_TABLE_LEN        4096
+#endif
+
+/* Buffer for frames other than DATA, and for a whole header block */
+#ifndef UWEB_H2_FRAME_BUF_LEN
+#define UWEB_H2_FRAME_BUF_LEN          4096
+#endif
+
+/* Max decoded length of a header field name and value */
+#ifndef UWEB_H2_FIELD_LEN
+#define UWEB_H2_FIELD_LEN              512
+#endif
+
+/* Max decoded HTTP2-Settings of an h2c upgrade, six settings */
+#ifndef UWEB_H2_UPGRADE_SETTINGS_LEN
+#define UWEB_H2_UPGRADE_SETTINGS_LEN   36
+#endif
+
+#define UWEB_H2_PREFACE                "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define UWEB_H2_PREFACE_LEN            24
+#define UWEB_H2_FRAME_HDR_LEN          9
+/* Max frame payload accepted, the protocol minimum */
+#define UWEB_H2_MAX_FRAME_LEN          16384
+#define UWEB_H2_DEFAULT_WINDOW         65535
+
+// Frame types
+typedef enum {
+  H2_DATA = 0x0,
+  H2_HEADERS = 0x1,
+  H2_PRIORITY = 0x2,
+  H2_RST_STREAM = 0x3,
+  H2_SETTINGS = 0x4,
+  H2_PUSH_PROMISE = 0x5,
+  H2_PING = 0x6,
+  H2_GOAWAY = 0x7,
+  H2_WINDOW_UPDATE = 0x8,
+  H2_CONTINUATION = 0x9,
+} uweb_h2_frame_type;
+
+// Error codes
+typedef enum {
+  H2_NO_ERROR = 0x0,
+  H2_PROTOCOL_ERROR = 0x1,
+  H2_INTERNAL_ERROR = 0x2,
+  H2_FLOW_CONTROL_ERROR = 0x3,
+  H2_STREAM_CLOSED = 0x5,
+  H2_FRAME_SIZE_ERROR = 0x6,
+  H2_REFUSED_STREAM = 0x7,
+  H2_CANCEL = 0x8,
+  H2_COMPRESSION_ERROR = 0x9,
+  H2_ENHANCE_YOUR_CALM = 0xb,
+} uweb_h2_error;
+
+// HPACK dynamic table, newest entry first. Entries are stored as two
+// 16 bit lengths followed by name and value.
+typedef struct {
+  uint8_t tab[UWEB_H2_HPACK_TABLE_LEN];
+  // bytes used in tab
+  uint16_t len;
+  uint16_t count;
+  // size as counted by HPACK, 32 bytes overhead per entry
+  uint32_t size;
+  uint32_t max_size;
+} uweb_hpack;
+
+#endif /* UWEB_H2_H_ */
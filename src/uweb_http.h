@@ -69,6 +69,13 @@ typedef enum {
   FCONTENT_TYPE,
   FTRANSFER_ENCODING,
   FCONTENT_DISPOSITION,
+  FEXPECT,
+  FUPGRADE,
+  FSEC_WEBSOCKET_KEY,
+  FHTTP2_SETTINGS,
+  FSEC_WEBSOCKET_VERSION,
+  FACCEPT_ENCODING,
+  FIF_NONE_MATCH,
   _FIELD_COUNT
 } uweb_http_fields;
 
@@ -79,6 +86,13 @@ static const char* const UWEB_HTTP_FIELDS[] = {
   "Content-Type:",
   "Transfer-Encoding:",
   "Content-Disposition:",
+  "Expect:",
+  "Upgrade:",
+  "Sec-WebSocket-Key:",
+  "HTTP2-Settings:",
+  "Sec-WebSocket-Version:",
+  "Accept-Encoding:",
+  "If-None-Match:",
 };
 
 
@@ -117,12 +131,15 @@ typedef enum {
   S415_UNSUPPORTED_MEDIA_TYPE,
   S416_REQ_RANGE_NOT_SATISFIABLE,
   S417_EXPECTATION_FAILED,
+  S426_UPGRADE_REQUIRED,
+  S431_REQ_HEADER_FIELDS_TOO_LARGE,
   S500_INTERNAL_SERVER_ERROR,
   S501_NOT_IMPLEMENTED,
   S502_BAD_GATEWAY,
   S503_SERVICE_UNAVAILABLE,
   S504_GATEWAY_TIMEOUT,
   S505_HTTP_VERSION_NOT_SUPPORTED,
+  _HTTP_STATUS_COUNT
 } uweb_http_status;
 
 static const uint16_t const UWEB_HTTP_STATUS_NUM[] = {
@@ -131,6 +148,7 @@ static const uint16_t const UWEB_HTTP_STATUS_NUM[] = {
   300, 301, 302, 303, 304, 305, 307,
   400, 401, 402, 403, 404, 405, 406, 407, 408, 409,
   410, 411, 412, 413, 414, 415, 416, 417,
+  426, 431,
   500, 501, 502, 503, 504, 505,
 };
 
@@ -169,6 +187,8 @@ static const char * const UWEB_HTTP_STATUS_STRING[] = {
   "Unsupported Media Type",
   "Requested range not satisfiable",
   "Expectation Failed",
+  "Upgrade Required",
+  "Request Header Fields Too Large",
   "Internal Server Error",
   "Not Implemented",
   "Bad Gateway",
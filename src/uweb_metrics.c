@@ -0,0 +1,179 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stddef.h>
+#include "uweb.h"
+
+#if UWEB_CFG_METRICS
+
+static const char * const UWEB_METRICS_COUNTER_NAMES[] = {
+  "uweb_bytes_received_total",
+  "uweb_bytes_sent_total",
+  "uweb_request_chunks_total",
+  "uweb_response_chunks_total",
+  "uweb_multipart_parts_total",
+  "uweb_timeouts_total",
+  "uweb_shed_connections_total",
+  "uweb_shed_requests_total",
+  "uweb_shed_output_total",
+  "uweb_shed_memory_total",
+  "uweb_cache_hits_total",
+  "uweb_cache_misses_total",
+  "uweb_cache_waits_total",
+  "uweb_arena_blocks_total",
+  "uweb_arena_failures_total",
+};
+
+static const char * const UWEB_METRICS_HIST_NAMES[] = {
+  "uweb_header_parse_seconds",
+  "uweb_handler_seconds",
+};
+
+UWEB_THREAD_LOCAL uweb_metrics_block *_uweb_metrics_local;
+UWEB_THREAD_LOCAL uint8_t _uweb_metrics_shared;
+
+// one block per thread, and the last one shared by any further threads
+static uweb_metrics_block _uweb_metrics_blocks[UWEB_METRICS_MAX_THREADS + 1];
+static volatile uint32_t _uweb_metrics_blocks_used;
+
+// first call from a thread, claim a block
+uweb_metrics_block *_uweb_metrics_register(void) {
+  uint32_t ix = __atomic_fetch_add(&_uweb_metrics_blocks_used, 1, __ATOMIC_RELAXED);
+  if (ix >= UWEB_METRICS_MAX_THREADS) {
+    ix = UWEB_METRICS_MAX_THREADS;
+    _uweb_metrics_shared = 1;
+  }
+  _uweb_metrics_local = &_uweb_metrics_blocks[ix];
+  return _uweb_metrics_local;
+}
+
+void UWEB_metrics_get(uweb_metrics_block *dst) {
+  uint32_t b, i, j;
+  uint32_t used = __atomic_load_n(&_uweb_metrics_blocks_used, __ATOMIC_RELAXED);
+  if (used > UWEB_METRICS_MAX_THREADS) used = UWEB_METRICS_MAX_THREADS + 1;
+  memset(dst, 0, sizeof(uweb_metrics_block));
+  for (b = 0; b < used; b++) {
+    const uweb_metrics_block *m = &_uweb_metrics_blocks[b];
+    for (i = 0; i < _REQ_METHOD_COUNT; i++) dst->req_method[i] += m->req_method[i];
+    for (i = 0; i < _HTTP_STATUS_COUNT; i++) dst->resp_status[i] += m->resp_status[i];
+    for (i = 0; i < _UWEB_CNT_COUNT; i++) dst->counter[i] += m->counter[i];
+    for (i = 0; i < _UWEB_HIST_COUNT; i++) {
+      for (j = 0; j <= UWEB_METRICS_BUCKETS; j++) dst->hist[i][j] += m->hist[i][j];
+      dst->hist_sum[i] += m->hist_sum[i];
+    }
+#if UWEB_CFG_SLAB
+    for (i = 0; i < _UWEB_SLAB_COUNT; i++) {
+      dst->slab_in_use[i] += m->slab_in_use[i];
+      dst->slab_high[i] += m->slab_high[i];
+    }
+#endif
+  }
+}
+
+void UWEB_metrics_reset(void) {
+#if UWEB_CFG_SLAB
+  // gauges stay
+  uint32_t b;
+  for (b = 0; b <= UWEB_METRICS_MAX_THREADS; b++) {
+    uweb_metrics_block *m = &_uweb_metrics_blocks[b];
+    memset(m, 0, offsetof(uweb_metrics_block, slab_in_use));
+  }
+#else
+  memset(_uweb_metrics_blocks, 0, sizeof(_uweb_metrics_blocks));
+#endif
+}
+
+static void _uweb_metrics_emitf(uweb_metrics_emit_f emit, void *arg, const char *fmt, ...) {
+  char line[160];
+  va_list arg_p;
+  va_start(arg_p, fmt);
+  int len = vsnprintf(line, sizeof(line), fmt, arg_p);
+  va_end(arg_p);
+  if (len >= (int)sizeof(line)) len = sizeof(line) - 1;
+  if (len > 0) emit(arg, line, len);
+}
+
+void UWEB_metrics_format(uweb_metrics_emit_f emit, void *arg) {
+  // per thread, several may format at once
+  static UWEB_THREAD_LOCAL uweb_metrics_block m;
+  uint32_t i, j;
+  uint64_t err_4xx = 0, err_5xx = 0;
+
+  UWEB_metrics_get(&m);
+
+  _uweb_metrics_emitf(emit, arg, "# TYPE uweb_requests_total counter\n");
+  for (i = 0; i < _REQ_METHOD_COUNT; i++) {
+    if (m.req_method[i] == 0) continue;
+    _uweb_metrics_emitf(emit, arg, "uweb_requests_total{method=\"%s\"} %llu\n",
+        i == _BAD_REQ ? "BAD" : UWEB_HTTP_REQ_METHODS[i], (unsigned long long)m.req_method[i]);
+  }
+
+  _uweb_metrics_emitf(emit, arg, "# TYPE uweb_responses_total counter\n");
+  for (i = 0; i < _HTTP_STATUS_COUNT; i++) {
+    if (m.resp_status[i] == 0) continue;
+    _uweb_metrics_emitf(emit, arg, "uweb_responses_total{code=\"%i\"} %llu\n",
+        UWEB_HTTP_STATUS_NUM[i], (unsigned long long)m.resp_status[i]);
+    if (UWEB_HTTP_STATUS_NUM[i] >= 500) err_5xx += m.resp_status[i];
+    else if (UWEB_HTTP_STATUS_NUM[i] >= 400) err_4xx += m.resp_status[i];
+  }
+
+  _uweb_metrics_emitf(emit, arg, "# TYPE uweb_errors_total counter\n");
+  _uweb_metrics_emitf(emit, arg, "uweb_errors_total{class=\"4xx\"} %llu\n", (unsigned long long)err_4xx);
+  _uweb_metrics_emitf(emit, arg, "uweb_errors_total{class=\"5xx\"} %llu\n", (unsigned long long)err_5xx);
+
+  for (i = 0; i < _UWEB_CNT_COUNT; i++) {
+    _uweb_metrics_emitf(emit, arg, "# TYPE %s counter\n", UWEB_METRICS_COUNTER_NAMES[i]);
+    _uweb_metrics_emitf(emit, arg, "%s %llu\n", UWEB_METRICS_COUNTER_NAMES[i],
+        (unsigned long long)m.counter[i]);
+  }
+
+#if UWEB_CFG_SLAB
+  for (j = 0; j < 2; j++) {
+    const char *name = j ? "uweb_slab_buffers_high" : "uweb_slab_buffers";
+    _uweb_metrics_emitf(emit, arg, "# TYPE %s gauge\n", name);
+    for (i = 0; i < _UWEB_SLAB_COUNT; i++) {
+      uint32_t size;
+      const char *pool = _uweb_slab_name(i, &size);
+      _uweb_metrics_emitf(emit, arg, "%s{pool=\"%s\",size=\"%u\"} %llu\n", name, pool, size,
+          (unsigned long long)(j ? m.slab_high[i] : m.slab_in_use[i]));
+    }
+  }
+#endif
+
+  for (i = 0; i < _UWEB_HIST_COUNT; i++) {
+    const char *name = UWEB_METRICS_HIST_NAMES[i];
+    uint64_t cum = 0;
+    _uweb_metrics_emitf(emit, arg, "# TYPE %s histogram\n", name);
+    for (j = 0; j < UWEB_METRICS_BUCKETS; j++) {
+      cum += m.hist[i][j];
+      _uweb_metrics_emitf(emit, arg, "%s_bucket{le=\"%.9g\"} %llu\n", name,
+          (double)(1ULL << (10 + j)) / 1e9, (unsigned long long)cum);
+    }
+    cum += m.hist[i][UWEB_METRICS_BUCKETS];
+    _uweb_metrics_emitf(emit, arg, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)cum);
+    _uweb_metrics_emitf(emit, arg, "%s_sum %.9f\n", name, (double)m.hist_sum[i] / 1e9);
+    _uweb_metrics_emitf(emit, arg, "%s_count %llu\n", name, (unsigned long long)cum);
+  }
+}
+
+#endif /* UWEB_CFG_METRICS */
@@ -0,0 +1,165 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Request metrics.
+ * Each thread counts into its own block, so the hot path is a plain
+ * increment without locks or atomics. Blocks are summed up when the
+ * metrics are read, e.g. via UWEB_METRICS_PATH in Prometheus text format.
+ */
+
+#ifndef UWEB_METRICS_H_
+#define UWEB_METRICS_H_
+
+#include "uweb_cfg.h"
+#include "uweb_http.h"
+#include "uweb_slab.h"
+
+#ifndef UWEB_CFG_METRICS
+#define UWEB_CFG_METRICS               0
+#endif
+
+/* Resource path where metrics are served, undefine to not serve them */
+#ifndef UWEB_METRICS_PATH
+#define UWEB_METRICS_PATH              "/metrics"
+#endif
+
+/* Max number of threads counting in blocks of their own, further threads
+   share one more block and count in it atomically */
+#ifndef UWEB_METRICS_MAX_THREADS
+#define UWEB_METRICS_MAX_THREADS       1
+#endif
+
+/* Thread local storage specifier, e.g. __thread */
+#ifndef UWEB_THREAD_LOCAL
+#define UWEB_THREAD_LOCAL
+#endif
+
+/* Monotonic time in nanoseconds, used for latency histograms */
+#ifndef UWEB_TIME_NS
+#define UWEB_TIME_NS()                 0
+#endif
+
+/* Number of histogram buckets, bucket n counting values up to 2^(10+n) ns */
+#define UWEB_METRICS_BUCKETS           20
+
+typedef enum {
+  UWEB_CNT_BYTES_IN = 0,
+  UWEB_CNT_BYTES_OUT,
+  UWEB_CNT_CHUNKS_IN,
+  UWEB_CNT_CHUNKS_OUT,
+  UWEB_CNT_MULTIPARTS,
+  UWEB_CNT_TIMEOUTS,
+  // in uweb_shed_reason order
+  UWEB_CNT_SHED_CONNECTIONS,
+  UWEB_CNT_SHED_REQUESTS,
+  UWEB_CNT_SHED_OUTPUT,
+  UWEB_CNT_SHED_MEMORY,
+  // cached responses sent, requests that found none, requests that waited
+  UWEB_CNT_CACHE_HITS,
+  UWEB_CNT_CACHE_MISSES,
+  UWEB_CNT_CACHE_WAITS,
+  // arena fallback blocks allocated, arena allocations that failed
+  UWEB_CNT_ARENA_BLOCKS,
+  UWEB_CNT_ARENA_FAILURES,
+  _UWEB_CNT_COUNT
+} uweb_metrics_counter;
+
+typedef enum {
+  UWEB_HIST_HEADER_PARSE = 0,
+  UWEB_HIST_HANDLER,
+  _UWEB_HIST_COUNT
+} uweb_metrics_histogram;
+
+typedef struct {
+  uint64_t req_method[_REQ_METHOD_COUNT];
+  uint64_t resp_status[_HTTP_STATUS_COUNT];
+  uint64_t counter[_UWEB_CNT_COUNT];
+  uint64_t hist[_UWEB_HIST_COUNT][UWEB_METRICS_BUCKETS + 1];
+  uint64_t hist_sum[_UWEB_HIST_COUNT];
+#if UWEB_CFG_SLAB
+  // pool buffers in use and high-water marks, not cleared on reset
+  uint64_t slab_in_use[_UWEB_SLAB_COUNT];
+  uint64_t slab_high[_UWEB_SLAB_COUNT];
+#endif
+} uweb_metrics_block;
+
+/* Called with pieces of metrics text */
+typedef void (*uweb_metrics_emit_f)(void *arg, const char *str, uint32_t len);
+
+#if UWEB_CFG_METRICS
+
+extern UWEB_THREAD_LOCAL uweb_metrics_block *_uweb_metrics_local;
+extern UWEB_THREAD_LOCAL uint8_t _uweb_metrics_shared;
+uweb_metrics_block *_uweb_metrics_register(void);
+
+static inline uweb_metrics_block *_uweb_metrics(void) {
+  uweb_metrics_block *m = _uweb_metrics_local;
+  return m ? m : _uweb_metrics_register();
+}
+
+static inline void _uweb_metrics_add(uint64_t *c, uint64_t n) {
+  if (_uweb_metrics_shared) {
+    __atomic_fetch_add(c, n, __ATOMIC_RELAXED);
+  } else {
+    *c += n;
+  }
+}
+
+static inline void _uweb_metrics_hist(uweb_metrics_histogram h, uint64_t ns) {
+  uweb_metrics_block *m = _uweb_metrics();
+  // smallest bucket whose bound is not below ns
+  uint32_t ix = ns <= 1024 ? 0 : 64 - __builtin_clzll(ns - 1) - 10;
+  if (ix > UWEB_METRICS_BUCKETS) ix = UWEB_METRICS_BUCKETS;
+  _uweb_metrics_add(&m->hist[h][ix], 1);
+  _uweb_metrics_add(&m->hist_sum[h], ns);
+}
+
+#define UWEB_METRIC_ADD(cnt, n)        _uweb_metrics_add(&_uweb_metrics()->counter[(cnt)], (n))
+#define UWEB_METRIC_INC(cnt)           UWEB_METRIC_ADD(cnt, 1)
+#define UWEB_METRIC_METHOD(m)          _uweb_metrics_add(&_uweb_metrics()->req_method[(m)], 1)
+#define UWEB_METRIC_STATUS(s)          _uweb_metrics_add(&_uweb_metrics()->resp_status[(s)], 1)
+#define UWEB_METRIC_TIME(t)            ((t) = UWEB_TIME_NS())
+#define UWEB_METRIC_HIST_SINCE(h, t)   _uweb_metrics_hist((h), UWEB_TIME_NS() - (t))
+#define UWEB_METRIC_SLAB(c, g, n)      _uweb_metrics_add(&_uweb_metrics()->slab_##g[(c)], (uint64_t)(int64_t)(n))
+
+/* Sums up all thread blocks into dst */
+void UWEB_metrics_get(uweb_metrics_block *dst);
+/* Clears all counters */
+void UWEB_metrics_reset(void);
+/* Formats all metrics in Prometheus text format, calling emit per line */
+void UWEB_metrics_format(uweb_metrics_emit_f emit, void *arg);
+
+#else
+
+#define UWEB_METRIC_ADD(cnt, n)
+#define UWEB_METRIC_INC(cnt)
+#define UWEB_METRIC_METHOD(m)
+#define UWEB_METRIC_STATUS(s)
+#define UWEB_METRIC_TIME(t)
+#define UWEB_METRIC_HIST_SINCE(h, t)
+#define UWEB_METRIC_SLAB(c, g, n)
+
+#endif
+
+#endif /* UWEB_METRICS_H_ */
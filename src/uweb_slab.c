@@ -0,0 +1,143 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "uweb.h"
+
+#if UWEB_CFG_SLAB
+
+#define SLAB_ROUND(n)                  (((n) + 7) & ~7u)
+
+static const uint32_t SLAB_SIZE[_UWEB_SLAB_COUNT] = {
+  SLAB_ROUND(UWEB_RX_BUF_LEN),
+  SLAB_ROUND(UWEB_REQ_BUF_MAX_LEN + 1),
+  SLAB_ROUND(UWEB_TX_MAX_LEN),
+  SLAB_ROUND(UWEB_ARENA_LEN),
+  SLAB_ROUND(UWEB_COALESCE_LEN),
+  SLAB_ROUND(sizeof(uweb_request_header)),
+#if UWEB_CFG_HTTP2
+  SLAB_ROUND(sizeof(uweb_h2)),
+#endif
+};
+
+#if UWEB_CFG_METRICS
+static const char * const SLAB_NAME[_UWEB_SLAB_COUNT] = {
+  "rx", "req", "tx", "arena", "out", "hdr",
+#if UWEB_CFG_HTTP2
+  "h2",
+#endif
+};
+#endif
+
+typedef struct {
+  // free buffers, linked through their first word
+  void *free;
+  uint32_t in_use;
+  uint32_t high;
+  uint32_t total;
+} slab_pool;
+
+static UWEB_THREAD_LOCAL slab_pool _uweb_slab[_UWEB_SLAB_COUNT];
+
+#ifndef UWEB_SLAB_ALLOC
+#if UWEB_CFG_COALESCE && UWEB_COALESCE_LEN > UWEB_SLAB_POOL_LEN
+#error "UWEB_SLAB_POOL_LEN must hold a UWEB_COALESCE_LEN buffer"
+#endif
+#if UWEB_CFG_ARENA && UWEB_ARENA_LEN > UWEB_SLAB_POOL_LEN
+#error "UWEB_SLAB_POOL_LEN must hold a UWEB_ARENA_LEN buffer"
+#endif
+
+static uint64_t _uweb_slab_mem[UWEB_SLAB_POOL_LEN / 8];
+static uint32_t _uweb_slab_mem_used;
+
+static void *_uweb_slab_mem_get(uint32_t len) {
+  uint32_t offs = __atomic_fetch_add(&_uweb_slab_mem_used, len, __ATOMIC_RELAXED);
+  if (offs + len > sizeof(_uweb_slab_mem) || offs + len < offs) {
+    // leave it exhausted for everyone
+    __atomic_store_n(&_uweb_slab_mem_used, sizeof(_uweb_slab_mem), __ATOMIC_RELAXED);
+    return 0;
+  }
+  return (uint8_t *)_uweb_slab_mem + offs;
+}
+#endif
+
+// another UWEB_SLAB_GROW buffers, or one if they are large
+static int _uweb_slab_grow(uweb_slab_class c) {
+  slab_pool *p = &_uweb_slab[c];
+  uint32_t size = SLAB_SIZE[c];
+  uint32_t n = size * UWEB_SLAB_GROW > UWEB_SLAB_GROW_MAX_LEN ? 1 : UWEB_SLAB_GROW;
+  uint32_t i;
+#ifdef UWEB_SLAB_ALLOC
+  uint8_t *mem = (uint8_t *)UWEB_SLAB_ALLOC(size * n);
+#else
+  uint8_t *mem = (uint8_t *)_uweb_slab_mem_get(size * n);
+#endif
+  if (mem == 0) return -1;
+  for (i = 0; i < n; i++) {
+    void *b = &mem[i * size];
+    *(void **)b = p->free;
+    p->free = b;
+  }
+  p->total += n;
+  return 0;
+}
+
+void *_uweb_slab_get(uweb_slab_class c) {
+  slab_pool *p = &_uweb_slab[c];
+  if (p->free == 0 && _uweb_slab_grow(c) < 0) return 0;
+  void *b = p->free;
+  p->free = *(void **)b;
+  p->in_use++;
+  UWEB_METRIC_SLAB(c, in_use, 1);
+  if (p->in_use > p->high) {
+    p->high = p->in_use;
+    UWEB_METRIC_SLAB(c, high, 1);
+  }
+  return b;
+}
+
+void _uweb_slab_put(uweb_slab_class c, void *b) {
+  slab_pool *p = &_uweb_slab[c];
+  *(void **)b = p->free;
+  p->free = b;
+  p->in_use--;
+  UWEB_METRIC_SLAB(c, in_use, -1);
+}
+
+void UWEB_slab_stats(uweb_slab_stats *stats) {
+  uint32_t c;
+  for (c = 0; c < _UWEB_SLAB_COUNT; c++) {
+    stats[c].size = SLAB_SIZE[c];
+    stats[c].in_use = _uweb_slab[c].in_use;
+    stats[c].high = _uweb_slab[c].high;
+    stats[c].total = _uweb_slab[c].total;
+  }
+}
+
+#if UWEB_CFG_METRICS
+const char *_uweb_slab_name(uweb_slab_class c, uint32_t *size) {
+  *size = SLAB_SIZE[c];
+  return SLAB_NAME[c];
+}
+#endif
+
+#endif /* UWEB_CFG_SLAB */
@@ -0,0 +1,91 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Buffer pools.
+ * The parser buffers of a context, receive, request line and transmit,
+ * the request header, the request arena and the output coalescing buffer
+ * are taken from per thread pools, one per buffer kind, when a call into
+ * uweb needs them and given back when the connection no longer does, e.g.
+ * between keep-alive requests. An idle connection then holds no buffers,
+ * so memory follows the connections being served rather than those open.
+ * The HTTP/2 state is taken when a connection starts HTTP/2 and held until
+ * it closes.
+ * Pools grow UWEB_SLAB_GROW buffers at a time, one at a time for buffers
+ * too large for that, from UWEB_SLAB_ALLOC if defined, else from a static
+ * pool of UWEB_SLAB_POOL_LEN bytes, and never shrink; steady state
+ * allocates nothing.
+ */
+
+#ifndef UWEB_SLAB_H_
+#define UWEB_SLAB_H_
+
+#include "uweb_cfg.h"
+#include "uweb_h2.h"
+
+#ifndef UWEB_CFG_SLAB
+#define UWEB_CFG_SLAB                  0
+#endif
+
+/* Buffers a pool grows by at a time */
+#ifndef UWEB_SLAB_GROW
+#define UWEB_SLAB_GROW                 8
+#endif
+
+/* Most bytes a pool grows by UWEB_SLAB_GROW buffers at a time, pools of
+   larger buffers grow by one */
+#ifndef UWEB_SLAB_GROW_MAX_LEN
+#define UWEB_SLAB_GROW_MAX_LEN         16384
+#endif
+
+/* Bytes of the static pool, shared by all threads, when there is no
+   UWEB_SLAB_ALLOC(len) */
+#ifndef UWEB_SLAB_POOL_LEN
+#define UWEB_SLAB_POOL_LEN             32768
+#endif
+
+// Buffer kinds, each with a pool of its own
+typedef enum {
+  UWEB_SLAB_RX = 0,
+  UWEB_SLAB_REQ,
+  UWEB_SLAB_TX,
+  UWEB_SLAB_ARENA,
+  UWEB_SLAB_OUT,
+  UWEB_SLAB_HDR,
+#if UWEB_CFG_HTTP2
+  UWEB_SLAB_H2,
+#endif
+  _UWEB_SLAB_COUNT
+} uweb_slab_class;
+
+// Pool usage of the calling thread
+typedef struct {
+  // buffer size
+  uint32_t size;
+  // buffers taken now, at most so far, and in the pool
+  uint32_t in_use;
+  uint32_t high;
+  uint32_t total;
+} uweb_slab_stats;
+
+#endif /* UWEB_SLAB_H_ */
@@ -0,0 +1,370 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+// splice
+#define _GNU_SOURCE
+#include "uweb.h"
+
+#if UWEB_CFG_STREAMS_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#endif
+
+// --- constant memory
+
+static int32_t _stream_mem_read(UW_STREAM str, uint8_t *dst, uint32_t len) {
+  if (str->avail_sz <= 0) return 0;
+  if (len > (uint32_t)str->avail_sz) len = str->avail_sz;
+  memcpy(dst, &str->mem[str->rd_offs], len);
+  str->avail_sz -= len;
+  return len;
+}
+
+UW_STREAM UWEB_stream_mem(UW_STREAM str, const void *data, uint32_t len) {
+  memset(str, 0, sizeof(uweb_data_stream));
+  str->mem = (const uint8_t *)data;
+  str->total_sz = len;
+  str->avail_sz = len;
+  str->read = _stream_mem_read;
+  str->flags = UWEB_STREAM_MEM | UWEB_STREAM_SEEKABLE;
+  return str;
+}
+
+int UWEB_stream_seek(UW_STREAM str, uint32_t offs) {
+  if ((str->flags & UWEB_STREAM_SEEKABLE) == 0 || str->total_sz < 0 || offs > (uint32_t)str->total_sz) {
+    return -1;
+  }
+  str->rd_offs = offs;
+  str->avail_sz = str->total_sz - offs;
+  return 0;
+}
+
+// --- growable buffer, its size kept in user
+
+#if defined(UWEB_STREAM_REALLOC) && defined(UWEB_STREAM_FREE)
+
+static int32_t _stream_buf_write(UW_STREAM str, uint8_t *src, uint32_t len) {
+  uint32_t size = (uint32_t)(uintptr_t)str->user;
+  uint32_t need = (uint32_t)str->total_sz + len;
+  if (need < len) return -1;
+  if (need > size) {
+    uint8_t *buf;
+    if (size < UWEB_STREAM_BUF_MIN_LEN) size = UWEB_STREAM_BUF_MIN_LEN;
+    while (size < need && size <= 0x7fffffffUL / 2) size *= 2;
+    if (size < need) return -1;
+    buf = (uint8_t *)UWEB_STREAM_REALLOC((void *)(uintptr_t)str->mem, size);
+    if (buf == 0) return -1;
+    str->mem = buf;
+    str->user = (void *)(uintptr_t)size;
+  }
+  memcpy((uint8_t *)(uintptr_t)&str->mem[str->total_sz], src, len);
+  str->total_sz += len;
+  str->avail_sz += len;
+  return len;
+}
+
+static void _stream_buf_close(UW_STREAM str) {
+  UWEB_STREAM_FREE((void *)(uintptr_t)str->mem);
+  str->mem = 0;
+  str->user = 0;
+  str->total_sz = 0;
+  str->avail_sz = 0;
+  str->rd_offs = 0;
+}
+
+UW_STREAM UWEB_stream_buf(UW_STREAM str, uint32_t len) {
+  UWEB_stream_mem(str, 0, 0);
+  str->write = _stream_buf_write;
+  str->close = _stream_buf_close;
+  if (len) {
+    str->mem = (const uint8_t *)UWEB_STREAM_REALLOC(0, len);
+    if (str->mem == 0) return 0;
+    str->user = (void *)(uintptr_t)len;
+  }
+  return str;
+}
+
+#endif
+
+#if UWEB_CFG_STREAMS_POSIX
+
+// --- file, mapped when small, else read by offset
+
+static int32_t _stream_fd_read(UW_STREAM str, uint8_t *dst, uint32_t len) {
+  ssize_t n;
+  if (str->avail_sz <= 0) return 0;
+  if (len > (uint32_t)str->avail_sz) len = str->avail_sz;
+  // by offset, others may read the same descriptor
+  n = pread((int)(intptr_t)str->user, dst, len, str->rd_offs);
+  if (n > 0) str->avail_sz -= n;
+  return n;
+}
+
+static int _file_open(const char *path, struct stat *st, int *fd, void **map) {
+  *map = 0;
+  *fd = open(path, O_RDONLY);
+  if (*fd < 0) return -1;
+  if (fstat(*fd, st) < 0) {
+    close(*fd);
+    return -1;
+  }
+  if (!S_ISREG(st->st_mode) || st->st_size > 0x7fffffffL) {
+    close(*fd);
+    errno = EINVAL;
+    return -1;
+  }
+  if (st->st_size > 0 && st->st_size <= UWEB_STREAM_MAP_MAX_LEN) {
+    *map = mmap(0, st->st_size, PROT_READ, MAP_PRIVATE, *fd, 0);
+    if (*map == MAP_FAILED) {
+      close(*fd);
+      return -1;
+    }
+    // read through, once
+    madvise(*map, st->st_size, MADV_SEQUENTIAL);
+  }
+  return 0;
+}
+
+static void _file_close(int fd, void *map, uint32_t size) {
+  if (map) munmap(map, size);
+  close(fd);
+}
+
+static void _stream_file_set(UW_STREAM str, int fd, void *map, uint32_t size) {
+  if (map) {
+    UWEB_stream_mem(str, map, size);
+  } else {
+    memset(str, 0, sizeof(uweb_data_stream));
+    str->total_sz = size;
+    str->avail_sz = size;
+    str->read = _stream_fd_read;
+    str->flags = UWEB_STREAM_FD | UWEB_STREAM_SEEKABLE;
+  }
+  str->user = (void *)(intptr_t)fd;
+}
+
+static void _stream_file_close(UW_STREAM str) {
+  _file_close((int)(intptr_t)str->user, (void *)(uintptr_t)str->mem, str->total_sz);
+  str->mem = 0;
+  str->total_sz = 0;
+  str->avail_sz = 0;
+}
+
+#if UWEB_FILE_CACHE_ENTRIES
+
+typedef enum {
+  FILE_FREE = 0,
+  FILE_OPEN,
+  // changed or cleared, closed when the last transfer is done
+  FILE_STALE,
+} _file_state;
+
+typedef struct {
+  char path[UWEB_FILE_CACHE_PATH_LEN];
+  int fd;
+  void *map;
+  uint32_t size;
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+  uint64_t checked_ms;
+  uint32_t used;
+  uint16_t refs;
+  uint8_t state;
+} _file_entry;
+
+static UWEB_THREAD_LOCAL _file_entry _file_cache[UWEB_FILE_CACHE_ENTRIES];
+static UWEB_THREAD_LOCAL uint32_t _file_clock;
+
+static uint64_t _file_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int _file_same(const _file_entry *e, const struct stat *st) {
+  return st->st_dev == e->dev && st->st_ino == e->ino && st->st_size == e->size &&
+      st->st_mtim.tv_sec == e->mtime.tv_sec && st->st_mtim.tv_nsec == e->mtime.tv_nsec;
+}
+
+static void _file_drop(_file_entry *e) {
+  if (e->refs) {
+    e->state = FILE_STALE;
+  } else {
+    _file_close(e->fd, e->map, e->size);
+    e->state = FILE_FREE;
+  }
+}
+
+// the open file of path, opened now if not cached or changed. Zero if it
+// cannot be cached, with *fail set if it cannot be opened either
+static _file_entry *_file_cache_get(const char *path, int *fail) {
+  uint64_t now = _file_now_ms();
+  struct stat st;
+  _file_entry *e = 0, *claim = 0;
+  uint32_t i;
+  int fd;
+  void *map;
+  *fail = 0;
+  if (strlen(path) >= UWEB_FILE_CACHE_PATH_LEN) return 0;
+  for (i = 0; i < UWEB_FILE_CACHE_ENTRIES; i++) {
+    if (_file_cache[i].state == FILE_OPEN && strcmp(_file_cache[i].path, path) == 0) {
+      e = &_file_cache[i];
+      break;
+    }
+  }
+  if (e && now - e->checked_ms >= UWEB_FILE_CACHE_CHECK_MS) {
+    if (stat(path, &st) == 0 && _file_same(e, &st)) {
+      e->checked_ms = now;
+    } else {
+      // transfers under way keep the old file
+      _file_drop(e);
+      e = 0;
+    }
+  }
+  if (e == 0) {
+    // a free entry, else the least recently used one not being sent
+    for (i = 0; i < UWEB_FILE_CACHE_ENTRIES; i++) {
+      _file_entry *c = &_file_cache[i];
+      if (c->state == FILE_FREE) {
+        claim = c;
+        break;
+      }
+      if (c->state == FILE_OPEN && c->refs == 0 && (claim == 0 || c->used < claim->used)) claim = c;
+    }
+    if (claim == 0) return 0;
+    if (_file_open(path, &st, &fd, &map) < 0) {
+      *fail = 1;
+      return 0;
+    }
+    if (claim->state == FILE_OPEN) _file_drop(claim);
+    e = claim;
+    strcpy(e->path, path);
+    e->fd = fd;
+    e->map = map;
+    e->size = st.st_size;
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->mtime = st.st_mtim;
+    e->checked_ms = now;
+    e->refs = 0;
+    e->state = FILE_OPEN;
+  }
+  e->used = ++_file_clock;
+  e->refs++;
+  return e;
+}
+
+static void _stream_file_release(UW_STREAM str) {
+  int fd = (int)(intptr_t)str->user;
+  uint32_t i;
+  for (i = 0; i < UWEB_FILE_CACHE_ENTRIES; i++) {
+    _file_entry *e = &_file_cache[i];
+    if (e->state != FILE_FREE && e->fd == fd && e->refs) {
+      if (--e->refs == 0 && e->state == FILE_STALE) _file_drop(e);
+      break;
+    }
+  }
+  str->mem = 0;
+  str->total_sz = 0;
+  str->avail_sz = 0;
+}
+
+void UWEB_file_cache_clear(void) {
+  uint32_t i;
+  for (i = 0; i < UWEB_FILE_CACHE_ENTRIES; i++) {
+    if (_file_cache[i].state == FILE_OPEN) _file_drop(&_file_cache[i]);
+  }
+}
+
+#endif
+
+UW_STREAM UWEB_stream_file(UW_STREAM str, const char *path) {
+  struct stat st;
+  int fd;
+  void *map;
+#if UWEB_FILE_CACHE_ENTRIES
+  int fail;
+  _file_entry *e = _file_cache_get(path, &fail);
+  if (e) {
+    _stream_file_set(str, e->fd, e->map, e->size);
+    str->close = _stream_file_release;
+    return str;
+  }
+  if (fail) return 0;
+#endif
+  if (_file_open(path, &st, &fd, &map) < 0) return 0;
+  _stream_file_set(str, fd, map, st.st_size);
+  str->close = _stream_file_close;
+  return str;
+}
+
+// --- pipe
+
+// what the pipe holds now
+static void _stream_pipe_avail(UW_STREAM str) {
+  int n = 0;
+  if (ioctl((int)(intptr_t)str->user, FIONREAD, &n) < 0) n = 0;
+  str->avail_sz = n;
+}
+
+static int32_t _stream_pipe_read(UW_STREAM str, uint8_t *dst, uint32_t len) {
+  ssize_t n = read((int)(intptr_t)str->user, dst, len);
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) n = 0;
+  _stream_pipe_avail(str);
+  return n;
+}
+
+UW_STREAM UWEB_stream_pipe(UW_STREAM str, int fd) {
+  memset(str, 0, sizeof(uweb_data_stream));
+  str->user = (void *)(intptr_t)fd;
+  str->total_sz = UWEB_UNKNONW_SZ;
+  str->read = _stream_pipe_read;
+  str->flags = UWEB_STREAM_FD;
+  _stream_pipe_avail(str);
+  return str;
+}
+
+int32_t UWEB_stream_splice(UW_STREAM str, int fd, uint32_t len) {
+  ssize_t n;
+  if ((str->flags & UWEB_STREAM_MEM) == 0 && (str->flags & UWEB_STREAM_SEEKABLE)) {
+    // a file, by offset as others may send the same descriptor
+    off_t offs = str->rd_offs;
+    if (len > (uint32_t)str->avail_sz) len = str->avail_sz;
+    n = sendfile(fd, (int)(intptr_t)str->user, &offs, len);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) n = 0;
+    if (n > 0) str->avail_sz -= n;
+    return n;
+  }
+  n = splice((int)(intptr_t)str->user, NULL, fd, NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) n = 0;
+  _stream_pipe_avail(str);
+  return n;
+}
+
+#endif
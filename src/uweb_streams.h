@@ -0,0 +1,75 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Stream implementations.
+ * Ready made uweb_data_streams keeping avail_sz and total_sz right: over
+ * constant memory, a growable buffer, and on POSIX systems a file and a
+ * pipe. Memory backed streams are written by uweb straight from their bytes
+ * rather than copied through the transmit buffer, and a pipe or a large
+ * file may be spliced to a socket by an output stream that can. Open files
+ * may be kept in a small per thread cache, shared by concurrent transfers.
+ * See the UWEB_stream_* functions in uweb.h.
+ */
+
+#ifndef UWEB_STREAMS_H_
+#define UWEB_STREAMS_H_
+
+#include "uweb_cfg.h"
+
+/* File and pipe streams, needs mmap, pread, sendfile and splice */
+#ifndef UWEB_CFG_STREAMS_POSIX
+#define UWEB_CFG_STREAMS_POSIX         0
+#endif
+
+/* Define UWEB_STREAM_REALLOC(p, len) and UWEB_STREAM_FREE(p), e.g. as
+   realloc and free, for growable buffer streams */
+
+/* Least buffer of a growable buffer stream, doubled while it is too small */
+#ifndef UWEB_STREAM_BUF_MIN_LEN
+#define UWEB_STREAM_BUF_MIN_LEN        256
+#endif
+
+/* Files up to this size are memory mapped, larger ones are read by
+   offset from their descriptor */
+#ifndef UWEB_STREAM_MAP_MAX_LEN
+#define UWEB_STREAM_MAP_MAX_LEN        (1024*1024)
+#endif
+
+/* Open files kept per thread, with their stat metadata. Zero opens each
+   file anew */
+#ifndef UWEB_FILE_CACHE_ENTRIES
+#define UWEB_FILE_CACHE_ENTRIES        0
+#endif
+
+/* Milliseconds a cached file is trusted before it is stat:ed again */
+#ifndef UWEB_FILE_CACHE_CHECK_MS
+#define UWEB_FILE_CACHE_CHECK_MS       1000
+#endif
+
+/* Longest path cached, longer ones are opened anew */
+#ifndef UWEB_FILE_CACHE_PATH_LEN
+#define UWEB_FILE_CACHE_PATH_LEN       128
+#endif
+
+#endif /* UWEB_STREAMS_H_ */
@@ -0,0 +1,104 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "uweb.h"
+
+const uweb_trace_desc UWEB_TRACE_EVENTS[_TRC_EVENT_COUNT] = {
+  {"header_line",       "line",     "len"},
+  {"request",           "method",   "content_length"},
+  {"response",          "status",   "type"},
+  {"error_response",    "status",   0},
+  {"bad_method",        "line",     "len"},
+  {"bad_chunk_length",  "content_length", 0},
+  {"bad_chunk_size",    "chunk",    "char"},
+  {"bad_chunk_end",     "chunk",    "char"},
+  {"bad_multipart",     "reason",   0},
+  {"content",           "content_length", "avail"},
+  {"content_done",      "len",      0},
+  {"chunk",             "chunk",    "len"},
+  {"chunk_trailer",     "trailer",  "len"},
+  {"chunks_done",       "chunks",   "len"},
+  {"multipart",         "boundary_len", 0},
+  {"multipart_section", "part",     0},
+  {"multipart_boundary","part",     "len"},
+  {"multipart_done",    "content_length", 0},
+  {"timeout",           "req_buf_len", 0},
+  {"limit",             "status",   "value"},
+  {"continue",          "length",   "chunked"},
+  {"reject",            "status",   "length"},
+  {"ws_upgrade",        0,          0},
+  {"ws_frame",          "hdr",      "length"},
+  {"ws_close",          "code",     "by_server"},
+  {"ws_error",          "code",     "hdr"},
+  {"event_stream",      0,          0},
+  {"h2_start",          "preface",  0},
+  {"h2_frame",          "type_flags", "length"},
+  {"h2_stream",         "stream",   "end_stream"},
+  {"h2_goaway",         "error",    "last_stream"},
+  {"h2_rst",            "stream",   "error"},
+  {"deferred",          "done",     0},
+  {"cache_hit",         "entry",    "age"},
+  {"cache_miss",        "entry",    "ttl_ms"},
+  {"cache_wait",        "entry",    0},
+  {"cache_store",       "entry",    "len"},
+  {"generator",         "chunks",   "resumed"},
+};
+
+// must follow us_state in uweb.c
+const char * const UWEB_TRACE_STATES[] = {
+  "HEADER_METHOD",
+  "HEADER_FIELDS",
+  "CONTENT",
+  "MULTI_CONTENT_HEADER",
+  "MULTI_CONTENT_DATA",
+  "CHUNK_DATA_HEADER",
+  "CHUNK_DATA",
+  "CHUNK_DATA_END",
+  "CHUNK_FOOTER",
+  "CLOSING",
+  "WEBSOCKET",
+  "EVENT_STREAM",
+  "HTTP2",
+  "DEFERRED",
+};
+
+const uint32_t UWEB_TRACE_STATE_COUNT = sizeof(UWEB_TRACE_STATES) / sizeof(UWEB_TRACE_STATES[0]);
+
+void _uweb_trace_dump(const uweb_trace_ring *ring, uweb_trace_emit_f emit, void *arg) {
+  uweb_trace_hdr hdr;
+  uint32_t head = ring->head;
+  uint32_t count = head < UWEB_TRACE_LEN ? head : UWEB_TRACE_LEN;
+  uint32_t first = head - count;
+  memcpy(hdr.magic, UWEB_TRACE_MAGIC, 4);
+  hdr.version = UWEB_TRACE_VERSION;
+  hdr.rec_size = sizeof(uweb_trace_rec);
+  hdr.count = count;
+  hdr.lost = first;
+  emit(arg, (const uint8_t *)&hdr, sizeof(hdr));
+
+  // emit in at most two pieces, from first to ring end and from ring start
+  uint32_t ix = first & (UWEB_TRACE_LEN - 1);
+  uint32_t len = UWEB_TRACE_LEN - ix < count ? UWEB_TRACE_LEN - ix : count;
+  if (len) emit(arg, (const uint8_t *)&ring->rec[ix], len * sizeof(uweb_trace_rec));
+  if (count - len) emit(arg, (const uint8_t *)&ring->rec[0], (count - len) * sizeof(uweb_trace_rec));
+}
@@ -0,0 +1,178 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Binary request tracing.
+ * Trace points write fixed size records - event, timestamp, parser state and
+ * two integer arguments - into a ring buffer. No formatting is done in the
+ * server, the ring is dumped as is and decoded offline by uweb_tracedec.
+ * Trace points above UWEB_TRACE_LEVEL compile to nothing, arguments are not
+ * even evaluated.
+ */
+
+#ifndef UWEB_TRACE_H_
+#define UWEB_TRACE_H_
+
+#include "uweb_cfg.h"
+
+#define UWEB_TRACE_OFF                 0
+#define UWEB_TRACE_ERR                 1
+#define UWEB_TRACE_INFO                2
+#define UWEB_TRACE_DBG                 3
+
+#ifndef UWEB_TRACE_LEVEL
+#define UWEB_TRACE_LEVEL               UWEB_TRACE_OFF
+#endif
+
+/* Number of records in trace ring, must be a power of two */
+#ifndef UWEB_TRACE_LEN
+#define UWEB_TRACE_LEN                 64
+#endif
+
+/* Monotonic time in nanoseconds */
+#ifndef UWEB_TIME_NS
+#define UWEB_TIME_NS()                 0
+#endif
+
+/* Trace record timestamp, in microseconds */
+#ifndef UWEB_TRACE_TS
+#define UWEB_TRACE_TS()                ((uint32_t)(UWEB_TIME_NS() / 1000))
+#endif
+
+#define UWEB_TRACE_MAGIC               "UWTR"
+#define UWEB_TRACE_VERSION             1
+
+// Trace events. When adding an event, add its description in uweb_trace.c
+typedef enum {
+  TRC_HEADER_LINE = 0,
+  TRC_REQUEST,
+  TRC_RESPONSE,
+  TRC_ERROR_RESPONSE,
+  TRC_BAD_METHOD,
+  TRC_BAD_CHUNK_LENGTH,
+  TRC_BAD_CHUNK_SIZE,
+  TRC_BAD_CHUNK_END,
+  TRC_BAD_MULTIPART,
+  TRC_CONTENT,
+  TRC_CONTENT_DONE,
+  TRC_CHUNK,
+  TRC_CHUNK_TRAILER,
+  TRC_CHUNKS_DONE,
+  TRC_MULTIPART,
+  TRC_MULTIPART_SECTION,
+  TRC_MULTIPART_BOUNDARY,
+  TRC_MULTIPART_DONE,
+  TRC_TIMEOUT,
+  TRC_LIMIT,
+  TRC_CONTINUE,
+  TRC_REJECT,
+  TRC_WS_UPGRADE,
+  TRC_WS_FRAME,
+  TRC_WS_CLOSE,
+  TRC_WS_ERROR,
+  TRC_EVENT_STREAM,
+  TRC_H2_START,
+  TRC_H2_FRAME,
+  TRC_H2_STREAM,
+  TRC_H2_GOAWAY,
+  TRC_H2_RST,
+  TRC_DEFERRED,
+  TRC_CACHE_HIT,
+  TRC_CACHE_MISS,
+  TRC_CACHE_WAIT,
+  TRC_CACHE_STORE,
+  TRC_GENERATOR,
+  _TRC_EVENT_COUNT
+} uweb_trace_event;
+
+// Trace record, 16 bytes
+typedef struct {
+  uint32_t ts;
+  uint16_t event;
+  uint8_t level;
+  uint8_t state;
+  uint32_t a;
+  uint32_t b;
+} uweb_trace_rec;
+
+// Trace dump header, followed by count records, oldest first
+typedef struct {
+  char magic[4];
+  uint16_t version;
+  uint16_t rec_size;
+  uint32_t count;
+  uint32_t lost;
+} uweb_trace_hdr;
+
+typedef struct {
+  uint32_t head;
+  uweb_trace_rec rec[UWEB_TRACE_LEN];
+} uweb_trace_ring;
+
+// Trace event description, used when decoding
+typedef struct {
+  const char *name;
+  const char *arg_a;
+  const char *arg_b;
+} uweb_trace_desc;
+
+/* Called with pieces of binary trace dump */
+typedef void (*uweb_trace_emit_f)(void *arg, const uint8_t *data, uint32_t len);
+
+extern const uweb_trace_desc UWEB_TRACE_EVENTS[_TRC_EVENT_COUNT];
+extern const char * const UWEB_TRACE_STATES[];
+extern const uint32_t UWEB_TRACE_STATE_COUNT;
+
+static inline void _uweb_trace(uweb_trace_ring *ring, uweb_trace_event ev, uint8_t level,
+    uint8_t state, uint32_t a, uint32_t b) {
+  uweb_trace_rec *r = &ring->rec[ring->head++ & (UWEB_TRACE_LEN - 1)];
+  r->ts = UWEB_TRACE_TS();
+  r->event = ev;
+  r->level = level;
+  r->state = state;
+  r->a = a;
+  r->b = b;
+}
+
+/* Dumps ring, header first, records oldest first */
+void _uweb_trace_dump(const uweb_trace_ring *ring, uweb_trace_emit_f emit, void *arg);
+
+#if UWEB_TRACE_LEVEL >= UWEB_TRACE_ERR
+#define UWEB_TRACE_E(ring, ev, st, a, b) _uweb_trace((ring), (ev), UWEB_TRACE_ERR, (st), (a), (b))
+#else
+#define UWEB_TRACE_E(ring, ev, st, a, b) do {} while (0)
+#endif
+
+#if UWEB_TRACE_LEVEL >= UWEB_TRACE_INFO
+#define UWEB_TRACE_I(ring, ev, st, a, b) _uweb_trace((ring), (ev), UWEB_TRACE_INFO, (st), (a), (b))
+#else
+#define UWEB_TRACE_I(ring, ev, st, a, b) do {} while (0)
+#endif
+
+#if UWEB_TRACE_LEVEL >= UWEB_TRACE_DBG
+#define UWEB_TRACE_D(ring, ev, st, a, b) _uweb_trace((ring), (ev), UWEB_TRACE_DBG, (st), (a), (b))
+#else
+#define UWEB_TRACE_D(ring, ev, st, a, b) do {} while (0)
+#endif
+
+#endif /* UWEB_TRACE_H_ */
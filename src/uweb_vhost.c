@@ -0,0 +1,104 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "uweb.h"
+
+#if UWEB_CFG_VHOST
+
+// length of the name in host, without port or trailing dot
+static uint32_t _uweb_vhost_name_len(const char *host) {
+  uint32_t len = 0;
+  if (host[0] == '[') {
+    // IPv6 literal, up to its bracket
+    while (host[len] && host[len] != ']') len++;
+    if (host[len]) len++;
+    return len;
+  }
+  while (host[len] && host[len] != ':') len++;
+  if (len > 1 && host[len - 1] == '.') len--;
+  return len;
+}
+
+// FNV-1a over the lower cased name, varied by seed
+static uint32_t _uweb_vhost_hash(const char *name, uint32_t len, uint32_t seed) {
+  uint32_t h = 2166136261UL ^ (seed * 0x9e3779b9UL);
+  uint32_t i;
+  for (i = 0; i < len; i++) {
+    char c = name[i];
+    if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    h ^= (uint8_t)c;
+    h *= 16777619UL;
+  }
+  return h ^ (h >> 16);
+}
+
+// name of len chars is host, ignoring ascii case
+static int _uweb_vhost_eq(const char *host, const char *name, uint32_t len) {
+  while (len--) {
+    char ca = *host++;
+    char cb = *name++;
+    if (ca >= 'A' && ca <= 'Z') ca += 'a' - 'A';
+    if (cb >= 'A' && cb <= 'Z') cb += 'a' - 'A';
+    if (ca != cb) return 0;
+  }
+  return *host == 0;
+}
+
+int UWEB_vhosts_init(uweb_vhosts *vhosts, const uweb_site *sites, uint32_t count,
+    const uweb_site **slots, uint32_t nslots, const uweb_site *dflt) {
+  uint32_t size, seed, i;
+  memset(vhosts, 0, sizeof(uweb_vhosts));
+  vhosts->dflt = dflt;
+  for (size = 1; size < count; size <<= 1);
+  // the fewest slots, and a seed, that give each host its own
+  for (; size <= nslots; size <<= 1) {
+    for (seed = 0; seed < UWEB_VHOST_SEEDS; seed++) {
+      memset(slots, 0, size * sizeof(*slots));
+      for (i = 0; i < count; i++) {
+        const char *host = sites[i].host;
+        uint32_t ix = _uweb_vhost_hash(host, strlen(host), seed) & (size - 1);
+        if (slots[ix]) break;
+        slots[ix] = &sites[i];
+      }
+      if (i == count) {
+        vhosts->slots = slots;
+        vhosts->mask = size - 1;
+        vhosts->seed = seed;
+        return 0;
+      }
+    }
+  }
+  return -1;
+}
+
+const uweb_site *UWEB_vhost_find(const uweb_vhosts *vhosts, const char *host) {
+  uint32_t len = _uweb_vhost_name_len(host);
+  const uweb_site *site;
+  if (vhosts->slots == 0 || len == 0) return vhosts->dflt;
+  // laid out without collisions, one probe tells
+  site = vhosts->slots[_uweb_vhost_hash(host, len, vhosts->seed) & vhosts->mask];
+  if (site && _uweb_vhost_eq(site->host, host, len)) return site;
+  return vhosts->dflt;
+}
+
+#endif
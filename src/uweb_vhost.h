@@ -0,0 +1,49 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * Virtual hosts.
+ * Several sites served by one uweb, told apart by the Host header or the
+ * HTTP/2 :authority. Each site has its own response and data functions,
+ * document root and asset bundle. The host names are hashed into a table
+ * laid out so that no two collide, so finding the site of a request is one
+ * hash and one compare; unknown hosts go to the default site. The site is
+ * found when the request header is complete, before the header function,
+ * and is at req->site.
+ */
+
+#ifndef UWEB_VHOST_H_
+#define UWEB_VHOST_H_
+
+#include "uweb_cfg.h"
+
+#ifndef UWEB_CFG_VHOST
+#define UWEB_CFG_VHOST                 0
+#endif
+
+/* Seeds tried per table size when laying out the sites */
+#ifndef UWEB_VHOST_SEEDS
+#define UWEB_VHOST_SEEDS               64
+#endif
+
+#endif /* UWEB_VHOST_H_ */
@@ -0,0 +1,289 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "uweb.h"
+
+#if UWEB_CFG_WEBSOCKET
+
+#if UWEB_REQ_BUF_MAX_LEN < UWEB_WS_CTRL_MAX_LEN
+#error "UWEB_REQ_BUF_MAX_LEN must hold a control frame payload"
+#endif
+
+#define TRACE_E(ev, a, b) UWEB_TRACE_E(&ctx->trace, (ev), ctx->state, (a), (b))
+#define TRACE_I(ev, a, b) UWEB_TRACE_I(&ctx->trace, (ev), ctx->state, (a), (b))
+#define TRACE_D(ev, a, b) UWEB_TRACE_D(&ctx->trace, (ev), ctx->state, (a), (b))
+
+static void _uweb_ws_write(UW_STREAM out, const uint8_t *data, uint32_t len) {
+  if (out->write) {
+    int wlen = out->write(out, (uint8_t *)(uintptr_t)data, len);
+    if (wlen > 0) out->wr_offs += wlen;
+  }
+  UWEB_METRIC_ADD(UWEB_CNT_BYTES_OUT, len);
+}
+
+uint32_t UWEB_ws_header(uint8_t *dst, uweb_ws_opcode opcode, uint32_t len) {
+  dst[0] = 0x80 | opcode;
+  if (len < 126) {
+    dst[1] = len;
+    return 2;
+  } else if (len <= 0xffff) {
+    dst[1] = 126;
+    dst[2] = len >> 8;
+    dst[3] = len;
+    return 4;
+  } else {
+    dst[1] = 127;
+    dst[2] = dst[3] = dst[4] = dst[5] = 0;
+    dst[6] = len >> 24;
+    dst[7] = len >> 16;
+    dst[8] = len >> 8;
+    dst[9] = len;
+    return 10;
+  }
+}
+
+void UWEB_ws_send(UW_STREAM out, uweb_ws_opcode opcode, const uint8_t *data, uint32_t len) {
+  uint8_t frame[UWEB_WS_HDR_MAX_LEN + UWEB_WS_CTRL_MAX_LEN];
+  uint32_t hlen = UWEB_ws_header(frame, opcode, len);
+  if (len <= UWEB_WS_CTRL_MAX_LEN) {
+    // small frames in one write
+    if (len) memcpy(&frame[hlen], data, len);
+    _uweb_ws_write(out, frame, hlen + len);
+  } else {
+    _uweb_ws_write(out, frame, hlen);
+    _uweb_ws_write(out, data, len);
+  }
+}
+
+static void _uweb_ws_send_close(UW_STREAM out, uint16_t code, const uint8_t *reason, uint32_t len) {
+  uint8_t payload[UWEB_WS_CTRL_MAX_LEN];
+  if (code == UWEB_WS_CLOSE_NO_STATUS) {
+    // must not be sent
+    UWEB_ws_send(out, WS_CLOSE, 0, 0);
+    return;
+  }
+  if (len > UWEB_WS_CTRL_MAX_LEN - 2) len = UWEB_WS_CTRL_MAX_LEN - 2;
+  payload[0] = code >> 8;
+  payload[1] = code;
+  if (len) memcpy(&payload[2], reason, len);
+  UWEB_ws_send(out, WS_CLOSE, payload, len + 2);
+}
+
+void UWEB_ws_close(uweb_request_header *req, UW_STREAM out, uint16_t code) {
+  uweb_ctx *ctx = req->ctx;
+  if (ctx->ws.close_sent) return;
+  TRACE_I(TRC_WS_CLOSE, code, 1);
+  _uweb_ws_send_close(out, code, 0, 0);
+  ctx->ws.close_sent = 1;
+}
+
+// xor payload with mask, starting at mask byte ix. Works on eight bytes at
+// a time, the compiler may widen further.
+static void _uweb_ws_unmask(uint8_t *p, uint32_t len, const uint8_t *mask, uint32_t ix) {
+  uint8_t m[8];
+  uint64_t m64;
+  uint32_t i;
+  for (i = 0; i < 8; i++) m[i] = mask[(ix + i) & 3];
+  memcpy(&m64, m, 8);
+  while (len >= 8) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    w ^= m64;
+    memcpy(p, &w, 8);
+    p += 8;
+    len -= 8;
+  }
+  for (i = 0; i < len; i++) p[i] ^= m[i];
+}
+
+// frame header is complete, check it
+static uint16_t _uweb_ws_frame_start(uweb_ctx *ctx) {
+  uweb_ws *ws = &ctx->ws;
+  uint8_t fin = ws->hdr[0] & 0x80;
+  uint8_t len7 = ws->hdr[1] & 0x7f;
+  ws->opcode = ws->hdr[0] & 0x0f;
+  ws->frame_offs = 0;
+  if (len7 == 126) {
+    ws->frame_left = (ws->hdr[2] << 8) | ws->hdr[3];
+  } else if (len7 == 127) {
+    uint32_t i;
+    ws->frame_left = 0;
+    for (i = 2; i < 10; i++) ws->frame_left = (ws->frame_left << 8) | ws->hdr[i];
+  } else {
+    ws->frame_left = len7;
+  }
+  memcpy(ws->mask, &ws->hdr[ws->hdr_len - 4], 4);
+  TRACE_D(TRC_WS_FRAME, ws->hdr[0], (uint32_t)ws->frame_left);
+
+  if (ws->opcode & 0x8) {
+    // control frame, may come in between fragments
+    if (!fin || ws->frame_left > UWEB_WS_CTRL_MAX_LEN ||
+        (ws->opcode != WS_CLOSE && ws->opcode != WS_PING && ws->opcode != WS_PONG)) {
+      return UWEB_WS_CLOSE_PROTOCOL_ERROR;
+    }
+    return 0;
+  }
+  if (ws->opcode == WS_CONTINUATION) {
+    if (ws->msg_opcode == 0) return UWEB_WS_CLOSE_PROTOCOL_ERROR;
+  } else if (ws->opcode == WS_TEXT || ws->opcode == WS_BINARY) {
+    if (ws->msg_opcode != 0) return UWEB_WS_CLOSE_PROTOCOL_ERROR;
+    ws->msg_opcode = ws->opcode;
+    ws->msg_offs = 0;
+  } else {
+    return UWEB_WS_CLOSE_PROTOCOL_ERROR;
+  }
+  if (ws->msg_offs + ws->frame_left > 0xffffffffULL ||
+      (ctx->req_limits.body_size && ws->msg_offs + ws->frame_left > ctx->req_limits.body_size)) {
+    TRACE_E(TRC_LIMIT, UWEB_WS_CLOSE_TOO_BIG, (uint32_t)ws->frame_left);
+    return UWEB_WS_CLOSE_TOO_BIG;
+  }
+  return 0;
+}
+
+// frame payload is complete. Returns 1 if the connection is to be closed.
+static int _uweb_ws_frame_end(uweb_ctx *ctx, UW_STREAM out) {
+  uweb_ws *ws = &ctx->ws;
+  uint8_t *payload = (uint8_t *)ctx->req_buf;
+  uint32_t len = ws->frame_offs;
+  switch (ws->opcode) {
+  case WS_CONTINUATION:
+  case WS_TEXT:
+  case WS_BINARY:
+    if (ws->hdr[0] & 0x80) {
+      if (_UWEB_DATA_F(ctx, ctx->req)) {
+        // report message end
+        _UWEB_DATA_F(ctx, ctx->req)(ctx->req, ws->msg_opcode == WS_TEXT ? DATA_WS_TEXT : DATA_WS_BINARY,
+            ws->msg_offs, 0, 0);
+      }
+      ws->msg_opcode = 0;
+    }
+    break;
+  case WS_PING:
+    if (!ws->close_sent) UWEB_ws_send(out, WS_PONG, payload, len);
+    break;
+  case WS_PONG:
+    if (_UWEB_DATA_F(ctx, ctx->req)) {
+      _UWEB_DATA_F(ctx, ctx->req)(ctx->req, DATA_WS_PONG, 0, payload, len);
+    }
+    break;
+  case WS_CLOSE: {
+    uint16_t code = len >= 2 ? (payload[0] << 8) | payload[1] : UWEB_WS_CLOSE_NO_STATUS;
+    if (len == 1) {
+      // a status code is two bytes
+      code = UWEB_WS_CLOSE_PROTOCOL_ERROR;
+      TRACE_E(TRC_WS_ERROR, code, len);
+    }
+    TRACE_I(TRC_WS_CLOSE, code, 0);
+    if (_UWEB_DATA_F(ctx, ctx->req)) {
+      _UWEB_DATA_F(ctx, ctx->req)(ctx->req, DATA_WS_CLOSE, code,
+          len >= 2 ? &payload[2] : 0, len >= 2 ? len - 2 : 0);
+    }
+    if (!ws->close_sent) _uweb_ws_send_close(out, code, 0, 0);
+    if (out->close) out->close(out);
+    return 1;
+  }
+  }
+  return 0;
+}
+
+int _uweb_ws_parse(uweb_ctx *ctx, UW_STREAM out, UW_STREAM in) {
+  uweb_ws *ws = &ctx->ws;
+  uint16_t err;
+  if (ctx->rx_ix >= ctx->rx_len) {
+    int32_t len = in->avail_sz < UWEB_RX_BUF_LEN ? in->avail_sz : UWEB_RX_BUF_LEN;
+    len = in->read ? in->read(in, ctx->rx_buf, len) : 0;
+    if (len <= 0) return -1;
+    UWEB_METRIC_ADD(UWEB_CNT_BYTES_IN, len);
+    ctx->rx_ix = 0;
+    ctx->rx_len = len;
+  }
+
+  uint8_t *p = &ctx->rx_buf[ctx->rx_ix];
+  uint8_t *end = &ctx->rx_buf[ctx->rx_len];
+
+  while (p < end) {
+    if (ws->hdr_len < ws->hdr_need) {
+      // frame header
+      ws->hdr[ws->hdr_len++] = *p++;
+      if (ws->hdr_len == 2) {
+        if ((ws->hdr[0] & 0x70) || (ws->hdr[1] & 0x80) == 0) {
+          // reserved bits set or client frame not masked
+          err = UWEB_WS_CLOSE_PROTOCOL_ERROR;
+          goto bad_frame;
+        }
+        uint8_t len7 = ws->hdr[1] & 0x7f;
+        ws->hdr_need = 2 + (len7 == 126 ? 2 : len7 == 127 ? 8 : 0) + 4;
+      }
+      if (ws->hdr_len == ws->hdr_need) {
+        err = _uweb_ws_frame_start(ctx);
+        if (err) goto bad_frame;
+      } else {
+        continue;
+      }
+    } else {
+      // frame payload
+      uint32_t len = (uint64_t)(end - p) < ws->frame_left ? (uint32_t)(end - p) : (uint32_t)ws->frame_left;
+      _uweb_ws_unmask(p, len, ws->mask, ws->frame_offs);
+      if (ws->opcode & 0x8) {
+        memcpy(&ctx->req_buf[ws->frame_offs], p, len);
+      } else if (_UWEB_DATA_F(ctx, ctx->req)) {
+        _UWEB_DATA_F(ctx, ctx->req)(ctx->req, ws->msg_opcode == WS_TEXT ? DATA_WS_TEXT : DATA_WS_BINARY,
+            ws->msg_offs, p, len);
+      }
+      p += len;
+      ws->frame_left -= len;
+      ws->frame_offs += len;
+      if ((ws->opcode & 0x8) == 0) ws->msg_offs += len;
+    }
+    if (ws->frame_left == 0) {
+      ws->hdr_len = 0;
+      ws->hdr_need = 2;
+      if (_uweb_ws_frame_end(ctx, out)) {
+        ctx->rx_ix = ctx->rx_len;
+        return 1;
+      }
+    }
+  }
+
+  ctx->rx_ix = ctx->rx_len;
+  return 0;
+
+bad_frame:
+  TRACE_E(TRC_WS_ERROR, err, ws->hdr[0]);
+  ctx->rx_ix = ctx->rx_len;
+  if (!ws->close_sent) _uweb_ws_send_close(out, err, 0, 0);
+  if (out->close) out->close(out);
+  return 1;
+}
+
+void _uweb_ws_accept_key(const char *key, char *accept) {
+  uint8_t digest[20];
+  char buf[UWEB_MAX_WS_KEY_LEN + sizeof(UWEB_WS_GUID)];
+  uint32_t len = strlen(key);
+  memcpy(buf, key, len);
+  memcpy(&buf[len], UWEB_WS_GUID, sizeof(UWEB_WS_GUID) - 1);
+  uweb_sha1(digest, (const uint8_t *)buf, len + sizeof(UWEB_WS_GUID) - 1);
+  uweb_base64_encode(accept, digest, sizeof(digest));
+}
+
+#endif /* UWEB_CFG_WEBSOCKET */
@@ -0,0 +1,93 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Peter Andersson (pelleplutt1976<at>gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+ * WebSocket (RFC 6455).
+ * A request with Upgrade: websocket is handed to the response function
+ * with req->websocket set. Returning UWEB_WEBSOCKET answers the handshake
+ * with 101 Switching Protocols, and from then on the connection is parsed
+ * as frames. Message payloads are unmasked in place a word at a time and
+ * passed to the data function piece by piece, like request bodies. Pings
+ * are answered by uweb.
+ */
+
+#ifndef UWEB_WS_H_
+#define UWEB_WS_H_
+
+#include "uweb_cfg.h"
+
+#ifndef UWEB_CFG_WEBSOCKET
+#define UWEB_CFG_WEBSOCKET             0
+#endif
+
+/* Max length of Sec-WebSocket-Key, 24 for a valid key */
+#ifndef UWEB_MAX_WS_KEY_LEN
+#define UWEB_MAX_WS_KEY_LEN            32
+#endif
+
+#define UWEB_WS_GUID                   "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/* Max frame header length; two bytes, 64 bit length and mask */
+#define UWEB_WS_HDR_MAX_LEN            14
+
+/* Max payload length of control frames */
+#define UWEB_WS_CTRL_MAX_LEN           125
+
+// Frame opcodes
+typedef enum {
+  WS_CONTINUATION = 0x0,
+  WS_TEXT = 0x1,
+  WS_BINARY = 0x2,
+  WS_CLOSE = 0x8,
+  WS_PING = 0x9,
+  WS_PONG = 0xa,
+} uweb_ws_opcode;
+
+// Close status codes
+#define UWEB_WS_CLOSE_NORMAL           1000
+#define UWEB_WS_CLOSE_GOING_AWAY       1001
+#define UWEB_WS_CLOSE_PROTOCOL_ERROR   1002
+#define UWEB_WS_CLOSE_NO_STATUS        1005
+#define UWEB_WS_CLOSE_TOO_BIG          1009
+
+// Frame parser state
+typedef struct {
+  uint8_t hdr[UWEB_WS_HDR_MAX_LEN];
+  uint8_t hdr_len;
+  uint8_t hdr_need;
+  // opcode of current frame
+  uint8_t opcode;
+  // opcode of current, possibly fragmented, message; zero when none
+  uint8_t msg_opcode;
+  // we sent close, waiting for the client to answer
+  uint8_t close_sent;
+  uint8_t mask[4];
+  // payload left of current frame
+  uint64_t frame_left;
+  // payload received of current frame
+  uint32_t frame_offs;
+  // payload received of current message
+  uint32_t msg_offs;
+} uweb_ws;
+
+#endif /* UWEB_WS_H_ */